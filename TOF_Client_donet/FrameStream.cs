@@ -0,0 +1,101 @@
+﻿using System.Threading.Channels;
+
+namespace TOF_Client_donet
+{
+    // Frames pushed by the DLL acquisition thread (setFrameCallback), no polling needed. They are
+    // delivered through the FrameReceived event and, once ReadAllAsync() was called, to an
+    // IAsyncEnumerable. Subscribe first, then Start(), so no frame is missed. The native callback delegate lives in a field until Dispose() removed it
+    // from the DLL, so the GC never collects it while the DLL can still call it.
+    public sealed class FrameStream : IDisposable
+    {
+        // The frame lives in DLL memory, it is only valid during the call.
+        public delegate void FrameHandler(in VL53L5CX_Frame frame);
+
+        private readonly IntPtr sensor;
+        private readonly WrapperClass.FrameCallback callback;
+        private readonly int bufferedFrames;
+        private readonly uint everyNFrames;
+        private readonly bool ownsStreaming;
+        private bool started;
+        private Channel<VL53L5CX_Frame>? channel;
+        private long handlerErrors;
+        private bool disposed;
+
+        // Raised on the DLL acquisition thread. The next frame is not read before the handlers
+        // return, their time is published in the driver metrics (frameCallbackUs).
+        public event FrameHandler? FrameReceived;
+
+        // Exceptions thrown by FrameReceived handlers, they cannot be passed on to the DLL.
+        public long HandlerErrors => Interlocked.Read(ref handlerErrors);
+
+        // everyNFrames > 1 only delivers every n-th frame, ReadAllAsync() keeps the newest
+        // bufferedFrames frames for a slow reader. Nothing is delivered before Start().
+        // ownsStreaming: Start() starts streaming without queue and Dispose() stops it, pass
+        // false to receive the frames of a stream started with startStreaming() instead.
+        public FrameStream(IntPtr sensor, uint everyNFrames = 1, int bufferedFrames = 64, bool ownsStreaming = true)
+        {
+            this.sensor = sensor;
+            this.everyNFrames = everyNFrames;
+            this.bufferedFrames = bufferedFrames;
+            this.ownsStreaming = ownsStreaming;
+            unsafe { callback = onFrame; }
+        }
+
+        // Installs the callback and starts streaming if the stream owns it. Ranging must be started.
+        public void Start()
+        {
+            if (started || disposed)
+                return;
+            if (!WrapperClass.setFrameCallback(sensor, callback, IntPtr.Zero, everyNFrames))
+                throw new InvalidOperationException("setFrameCallback failed");
+            started = true;
+            if (ownsStreaming && !WrapperClass.startStreaming(sensor, 0))
+                throw new InvalidOperationException("startStreaming failed");
+        }
+
+        private unsafe void onFrame(VL53L5CX_Frame* frame, IntPtr user_data)
+        {
+            try
+            {
+                FrameReceived?.Invoke(in *frame);
+            }
+            catch (Exception)
+            {
+                Interlocked.Increment(ref handlerErrors);
+            }
+
+            Volatile.Read(ref channel)?.Writer.TryWrite(*frame);
+        }
+
+        // Frames received from now on, copied. Ends when the stream is disposed.
+        public IAsyncEnumerable<VL53L5CX_Frame> ReadAllAsync(CancellationToken cancellationToken = default)
+        {
+            if (Volatile.Read(ref channel) == null)
+            {
+                Interlocked.CompareExchange(ref channel, Channel.CreateBounded<VL53L5CX_Frame>(new BoundedChannelOptions(bufferedFrames)
+                {
+                    FullMode = BoundedChannelFullMode.DropOldest,
+                    SingleWriter = true,
+                }), null);
+            }
+            return channel!.Reader.ReadAllAsync(cancellationToken);
+        }
+
+        public void Dispose()
+        {
+            if (disposed)
+                return;
+            disposed = true;
+
+            // Once this returns the DLL is done with the delegate. Not from a FrameReceived handler.
+            if (started)
+            {
+                WrapperClass.setFrameCallback(sensor, null, IntPtr.Zero, 1);
+                if (ownsStreaming)
+                    WrapperClass.stopStreaming(sensor);
+            }
+            channel?.Writer.TryComplete();
+            GC.KeepAlive(callback);
+        }
+    }
+}
@@ -1,4 +1,5 @@
-﻿using System.Reflection.Metadata.Ecma335;
+﻿using System.Diagnostics;
+using System.Reflection.Metadata.Ecma335;
 using System.Runtime.InteropServices;
 
 namespace TOF_Client_donet
@@ -16,6 +17,8 @@ namespace TOF_Client_donet
             try
             {
                 IntPtr sensor = WrapperClass.Instantiate(I2C_Address);
+                if (sensor == IntPtr.Zero)
+                    throw new InvalidOperationException("Cannot open the sensor");
 
                 WrapperClass.startRanging(sensor);
                 distance = WrapperClass.getRange(sensor);   // throw away the first entry after turn on 
@@ -50,8 +53,244 @@ namespace TOF_Client_donet
         }
 
 
+        static long sumDistances(in VL53L5CX_Frame frame)
+        {
+            long sum = 0;
+            foreach (short distance in frame.Distances)
+                sum += distance;
+            return sum;
+        }
+
+        // Per frame cost of getFrame(), getRange(), readFrames() and of the frame callback on a recording
+        // replayed as fast as possible:
+        //   TOF_Client_donet benchmark <recording>
+        static void runBenchmark(string recording)
+        {
+            IntPtr sensor = WrapperClass.InstantiateReplay(recording, 1);
+            if (sensor == IntPtr.Zero)
+            {
+                Console.WriteLine("Cannot open " + recording);
+                return;
+            }
+            WrapperClass.startRanging(sensor);
+
+            VL53L5CX_Frame frame = VL53L5CX_Frame.Create();
+            long allocated = GC.GetAllocatedBytesForCurrentThread();
+            Stopwatch watch = Stopwatch.StartNew();
+            int frames = 0;
+            long sum = 0;
+            while (WrapperClass.getFrame(sensor, ref frame) == VL53L5CX_Frame.Ready)
+            {
+                sum += sumDistances(frame);
+                frames++;
+            }
+            watch.Stop();
+            long frameBytes = GC.GetAllocatedBytesForCurrentThread() - allocated;
+            double frameUs = watch.Elapsed.TotalMilliseconds * 1000.0 / Math.Max(frames, 1);
+            WrapperClass.Conclude(sensor);
+
+            sensor = WrapperClass.InstantiateReplay(recording, 1);
+            WrapperClass.startRanging(sensor);
+
+            allocated = GC.GetAllocatedBytesForCurrentThread();
+            watch.Restart();
+            double total = 0;
+            for (int i = 0; i < frames; i++)
+                total += WrapperClass.getRange(sensor);
+            watch.Stop();
+            long rangeBytes = GC.GetAllocatedBytesForCurrentThread() - allocated;
+            double rangeUs = watch.Elapsed.TotalMilliseconds * 1000.0 / Math.Max(frames, 1);
+            WrapperClass.Conclude(sensor);
+
+            // Same with the median filter in front of the ROI, and someone in front of the center zones
+            sensor = WrapperClass.InstantiateReplay(recording, 1);
+            WrapperClass.setZoneFilter(sensor, VL53L5CX_Filter.Create(VL53L5CX_Filter.Median));
+            Span<VL53L5CX_PresenceZone> presenceZones = stackalloc VL53L5CX_PresenceZone[1];
+            presenceZones[0] = VL53L5CX_PresenceZone.Create(VL53L5CX_Roi.Create(), 1000, 1150, 2, 3, 15);
+            WrapperClass.setPresenceZones(sensor, presenceZones);
+            WrapperClass.setTracker(sensor, VL53L5CX_TrackerConfig.Create());
+            WrapperClass.setBackground(sensor, VL53L5CX_BackgroundConfig.Create());
+            WrapperClass.setCounter(sensor, VL53L5CX_CounterConfig.Create());
+            bool motionSet = WrapperClass.setMotionIndicator(sensor, VL53L5CX_MotionConfig.Create());
+            WrapperClass.startRanging(sensor);
+            allocated = GC.GetAllocatedBytesForCurrentThread();
+            watch.Restart();
+            double filteredTotal = 0;
+            for (int i = 0; i < frames; i++)
+                filteredTotal += WrapperClass.getRange(sensor);
+            watch.Stop();
+            long filteredBytes = GC.GetAllocatedBytesForCurrentThread() - allocated;
+            double filteredUs = watch.Elapsed.TotalMilliseconds * 1000.0 / Math.Max(frames, 1);
+            Span<VL53L5CX_PresenceEvent> presenceEvents = stackalloc VL53L5CX_PresenceEvent[8];
+            int presenceCount = WrapperClass.readPresenceEvents(sensor, presenceEvents);
+            uint presenceState = WrapperClass.getPresenceState(sensor);
+            WrapperClass.getZoneMotion(sensor, 0, out VL53L5CX_ZoneMotion presenceMotion);
+            int presenceEntered = 0;
+            foreach (VL53L5CX_PresenceEvent presenceEvent in presenceEvents.Slice(0, presenceCount))
+                presenceEntered += (presenceEvent.type == VL53L5CX_PresenceEvent.Entered) ? 1 : 0;
+            Span<VL53L5CX_Track> tracks = stackalloc VL53L5CX_Track[VL53L5CX_TrackerConfig.MaxTracks];
+            int trackCount = WrapperClass.getTracks(sensor, tracks);
+            int targetsPerZone = WrapperClass.getTargetsPerZone(sensor);
+            Span<VL53L5CX_Blob> blobs = stackalloc VL53L5CX_Blob[VL53L5CX_CounterConfig.MaxBlobs];
+            int blobCount = WrapperClass.getBlobs(sensor, blobs);
+            WrapperClass.getCrossingCounts(sensor, out ulong crossedForward, out ulong crossedBackward);
+            Span<VL53L5CX_MotionFrame> motionFrames = stackalloc VL53L5CX_MotionFrame[64];
+            int motionFrameCount = WrapperClass.readMotionFrames(sensor, motionFrames);
+            Span<VL53L5CX_MotionEvent> motionEvents = stackalloc VL53L5CX_MotionEvent[8];
+            int motionEventCount = WrapperClass.readMotionEvents(sensor, motionEvents);
+            bool motionRead = WrapperClass.getMotion(sensor, out VL53L5CX_MotionFrame motion);
+            bool learned = WrapperClass.getForeground(sensor, out ulong foreground);
+            string backgroundPath = Path.Combine(Path.GetTempPath(), "tof_client_background.vl5b");
+            bool backgroundSaved = WrapperClass.saveBackground(sensor, backgroundPath);
+            WrapperClass.Conclude(sensor);
+            sensor = WrapperClass.InstantiateReplay(recording, 1);
+            WrapperClass.setBackground(sensor, VL53L5CX_BackgroundConfig.Create());
+            bool backgroundLoaded = WrapperClass.loadBackground(sensor, backgroundPath);
+            bool idleOnReplay = WrapperClass.setIdleMode(sensor, VL53L5CX_IdleConfig.Create());
+            bool governorOnReplay = WrapperClass.setGovernor(sensor, VL53L5CX_GovernorConfig.Create());
+            WrapperClass.Conclude(sensor);
+            File.Delete(backgroundPath);
+
+            // Four lanes side by side, one column of the 4x4 grid each
+            sensor = WrapperClass.InstantiateReplay(recording, 1);
+            WrapperClass.startRanging(sensor);
+            Span<VL53L5CX_Roi> lanes = stackalloc VL53L5CX_Roi[4];
+            for (int lane = 0; lane < 4; lane++)
+                lanes[lane] = VL53L5CX_Roi.Create(0x1111UL << lane);
+            Span<double> laneDistances = stackalloc double[4];
+            allocated = GC.GetAllocatedBytesForCurrentThread();
+            long roiTicks = 0;
+            double laneTotal = 0;
+            while (WrapperClass.getFrame(sensor, ref frame) == VL53L5CX_Frame.Ready)
+            {
+                long start = Stopwatch.GetTimestamp();
+                WrapperClass.evaluateRois(frame, lanes, laneDistances);
+                roiTicks += Stopwatch.GetTimestamp() - start;
+                laneTotal += laneDistances[0] + laneDistances[1] + laneDistances[2] + laneDistances[3];
+            }
+            long roiBytes = GC.GetAllocatedBytesForCurrentThread() - allocated;
+            double roiUs = roiTicks * 1000000.0 / Stopwatch.Frequency / Math.Max(frames, 1);
+            WrapperClass.Conclude(sensor);
+
+            // Like an analytics thread: wake up every 250 ms and drain whatever was queued
+            sensor = WrapperClass.InstantiateReplay(recording, 1);
+            WrapperClass.startRanging(sensor);
+            WrapperClass.startStreaming(sensor, (uint)frames);
+            VL53L5CX_Frame[] batch = new VL53L5CX_Frame[256];
+            allocated = GC.GetAllocatedBytesForCurrentThread();
+            watch.Reset();
+            int batchFrames = 0;
+            int calls = 0;
+            long batchSum = 0;
+            while (true)
+            {
+                Thread.Sleep(250);
+                int drained = 0;
+                int count;
+                watch.Start();
+                while (WrapperClass.readFrames(sensor, batch, out count, 0) == VL53L5CX_Frame.Ready)
+                {
+                    for (int i = 0; i < count; i++)
+                        batchSum += sumDistances(batch[i]);
+                    drained += count;
+                    calls++;
+                }
+                watch.Stop();
+                if (drained == 0)
+                    break;
+                batchFrames += drained;
+            }
+            long batchBytes = GC.GetAllocatedBytesForCurrentThread() - allocated;
+            double batchUs = watch.Elapsed.TotalMilliseconds * 1000.0 / Math.Max(batchFrames, 1);
+            WrapperClass.Conclude(sensor);
+
+            // Pushed frames, no polling on this side
+            sensor = WrapperClass.InstantiateReplay(recording, 1);
+            WrapperClass.startRanging(sensor);
+            int pushedFrames = 0;
+            long pushedSum = 0;
+            using (FrameStream stream = new FrameStream(sensor))
+            {
+                stream.FrameReceived += (in VL53L5CX_Frame pushed) =>
+                {
+                    pushedSum += sumDistances(pushed);
+                    pushedFrames++;
+                };
+                watch.Restart();
+                stream.Start();
+                while ((Volatile.Read(ref pushedFrames) < frames) && (watch.ElapsedMilliseconds < 10000))
+                    Thread.Sleep(1);
+                watch.Stop();
+            }
+            double pushedUs = watch.Elapsed.TotalMilliseconds * 1000.0 / Math.Max(pushedFrames, 1);
+            WrapperClass.Conclude(sensor);
+
+            sensor = WrapperClass.InstantiateReplay(recording, 1);
+            WrapperClass.startRanging(sensor);
+            int asyncFrames = 0;
+            long asyncSum = 0;
+            using (FrameStream stream = new FrameStream(sensor, 1, frames))
+            using (CancellationTokenSource timeout = new CancellationTokenSource(10000))
+            {
+                IAsyncEnumerable<VL53L5CX_Frame> pending = stream.ReadAllAsync(timeout.Token);
+                watch.Restart();
+                stream.Start();
+                Task consumer = Task.Run(async () =>
+                {
+                    await foreach (VL53L5CX_Frame pushed in pending)
+                    {
+                        asyncSum += sumDistances(pushed);
+                        if (++asyncFrames == frames)
+                            break;
+                    }
+                });
+                try
+                {
+                    consumer.Wait();
+                }
+                catch (AggregateException)
+                {
+                    // timed out, the count tells
+                }
+                watch.Stop();
+            }
+            double asyncUs = watch.Elapsed.TotalMilliseconds * 1000.0 / Math.Max(asyncFrames, 1);
+            WrapperClass.Conclude(sensor);
+
+            Console.WriteLine("Frames replayed    : " + frames + " (distance sum " + sum + ", range sum " + total + ")");
+            Console.WriteLine("getFrame per frame : " + frameUs.ToString("F2") + " us, " + frameBytes + " bytes allocated in total");
+            Console.WriteLine("getRange per frame : " + rangeUs.ToString("F2") + " us, " + rangeBytes + " bytes allocated in total");
+            Console.WriteLine("getRange median    : " + filteredUs.ToString("F2") + " us per frame (range sum " + filteredTotal + "), "
+                + filteredBytes + " bytes allocated in total");
+            Console.WriteLine("Presence           : " + presenceCount + " event(s), " + presenceEntered + " entered, state " + presenceState
+                + ", motion " + presenceMotion.motion + " at " + presenceMotion.velocity_mm_s.ToString("F0") + " mm/s");
+            Console.WriteLine("Tracker            : " + trackCount + " track(s), " + targetsPerZone + " target(s) per zone"
+                + ((trackCount > 0) ? (", #" + tracks[0].id + " at " + tracks[0].distance_mm.ToString("F0") + " mm over " + tracks[0].zones + " zones") : ""));
+            Console.WriteLine("Background         : " + (learned ? System.Numerics.BitOperations.PopCount(foreground) + " foreground zone(s)" : "learning")
+                + ", saved " + backgroundSaved + ", loaded " + backgroundLoaded);
+            Console.WriteLine("Idle mode          : " + (idleOnReplay ? "set" : "refused") + " on a replay, a recording has no INT line");
+            Console.WriteLine("Governor           : " + (governorOnReplay ? "set" : "refused") + " on a replay, a recording cannot change tiers");
+            Console.WriteLine("Motion indicator   : " + (motionSet ? "set" : "refused") + ", " + motionFrameCount + " frame(s) queued, "
+                + (motionRead ? motion.aggregates : 0) + " aggregate(s) scored in the recording, " + motionEventCount + " event(s)");
+            Console.WriteLine("People counter     : " + blobCount + " blob(s), " + crossedForward + " forward, " + crossedBackward + " backward");
+            Console.WriteLine("evaluateRois       : " + roiUs.ToString("F2") + " us per frame for 4 lanes (lane sum " + laneTotal
+                + "), " + roiBytes + " bytes allocated in total");
+            Console.WriteLine("readFrames         : " + batchFrames + " frames in " + calls + " calls (distance sum " + batchSum + "), "
+                + batchUs.ToString("F2") + " us per frame, " + batchBytes + " bytes allocated in total");
+            Console.WriteLine("FrameReceived      : " + pushedFrames + " frames (distance sum " + pushedSum + "), "
+                + pushedUs.ToString("F2") + " us per frame");
+            Console.WriteLine("ReadAllAsync       : " + asyncFrames + " frames (distance sum " + asyncSum + "), "
+                + asyncUs.ToString("F2") + " us per frame");
+        }
+
         static void Main(string[] args)
         {
+            if ((args.Length == 2) && (args[0] == "benchmark"))
+            {
+                runBenchmark(args[1]);
+                return;
+            }
+
             Console.WriteLine("TOF Sensor start");
             Program program = new Program();
 
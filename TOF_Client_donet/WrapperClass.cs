@@ -1,4 +1,5 @@
 ﻿using System;
+using System.Diagnostics.CodeAnalysis;
 using System.Runtime.InteropServices;
 using System.Collections.Generic;
 using System.Linq;
@@ -21,6 +22,11 @@ namespace TOF_Client_donet
         public static extern IntPtr Instantiate(byte i2c_address);
 
 
+        //extern "C" SENSOR_API void* InstantiateReplay(const char* recording_path, uint8_t replay_mode);
+        // replay_mode: 0 = real time, 1 = as fast as possible, 2 = stepped (see replayStep)
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        public static extern IntPtr InstantiateReplay([MarshalAs(UnmanagedType.LPStr)] string recording_path, byte replay_mode);
+
         //extern "C" SENSOR_API void Conclude(VL53L5CXSensor* t);
         [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
         public static extern void Conclude(IntPtr t);
@@ -41,7 +47,788 @@ namespace TOF_Client_donet
         [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
         public static extern double getRange(IntPtr t);
 
+        //extern "C" SENSOR_API int32_t getFrame(VL53L5CXSensor* t, VL53L5CX_Frame* frame);
+        // Returns VL53L5CX_Frame.Ready, NotReady, BadVersion or Error. The frame is passed by
+        // reference (pinned for the call, never copied), create it with VL53L5CX_Frame.Create().
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int getFrame(IntPtr t, ref VL53L5CX_Frame frame);
+
+        // Same for frames already pinned or in native memory.
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        public static extern unsafe int getFrame(IntPtr t, VL53L5CX_Frame* frame);
+
+        //extern "C" SENSOR_API bool setRangeRoi(VL53L5CXSensor* t, const VL53L5CX_Roi* roi);
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        public static extern bool setRangeRoi(IntPtr t, in VL53L5CX_Roi roi);
+
+        // Restores the default ROI of getRange().
+        [DllImport(_dllImportPath, EntryPoint = "setRangeRoi", CallingConvention = CallingConvention.Cdecl)]
+        public static extern bool resetRangeRoi(IntPtr t, IntPtr roi);
+
+        //extern "C" SENSOR_API bool setZoneFilter(VL53L5CXSensor* t, const VL53L5CX_Filter* filter);
+        // Filters the zone distances of every frame over time. Not while streaming.
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        public static extern bool setZoneFilter(IntPtr t, in VL53L5CX_Filter filter);
+
+        // Back to the raw distances.
+        [DllImport(_dllImportPath, EntryPoint = "setZoneFilter", CallingConvention = CallingConvention.Cdecl)]
+        public static extern bool clearZoneFilter(IntPtr t, IntPtr filter);
+
+        //extern "C" SENSOR_API bool setPresenceZones(VL53L5CXSensor* t, const VL53L5CX_PresenceZone* zones, int32_t count);
+        // Up to 8 zones, an empty span removes them. Not while streaming.
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        private static extern unsafe bool setPresenceZones(IntPtr t, VL53L5CX_PresenceZone* zones, int count);
+
+        public static unsafe bool setPresenceZones(IntPtr t, ReadOnlySpan<VL53L5CX_PresenceZone> zones)
+        {
+            fixed (VL53L5CX_PresenceZone* z = zones)
+                return setPresenceZones(t, z, zones.Length);
+        }
+
+        //typedef void (*VL53L5CX_PresenceCallback)(const VL53L5CX_PresenceEvent* event, void* user_data);
+        // Called by the thread that read the frame, the acquisition thread while streaming. Must not throw.
+        // Keep the delegate referenced while it is installed.
+        [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+        public unsafe delegate void PresenceCallback(VL53L5CX_PresenceEvent* presence_event, IntPtr user_data);
+
+        //extern "C" SENSOR_API bool setPresenceCallback(VL53L5CXSensor* t, VL53L5CX_PresenceCallback callback, void* user_data);
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        public static extern bool setPresenceCallback(IntPtr t, PresenceCallback? callback, IntPtr user_data);
+
+        //extern "C" SENSOR_API int32_t readPresenceEvents(VL53L5CXSensor* t, VL53L5CX_PresenceEvent* events, int32_t capacity);
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        private static extern unsafe int readPresenceEvents(IntPtr t, VL53L5CX_PresenceEvent* events, int capacity);
+
+        // Queued events, oldest first, without waiting. Returns how many were written.
+        public static unsafe int readPresenceEvents(IntPtr t, Span<VL53L5CX_PresenceEvent> events)
+        {
+            fixed (VL53L5CX_PresenceEvent* e = events)
+                return readPresenceEvents(t, e, events.Length);
+        }
+
+        //extern "C" SENSOR_API uint32_t getPresenceState(VL53L5CXSensor* t);
+        // Bit i set: presence zone i is occupied.
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        public static extern uint getPresenceState(IntPtr t);
+
+        //extern "C" SENSOR_API bool getZoneMotion(VL53L5CXSensor* t, int32_t zone, VL53L5CX_ZoneMotion* motion);
+        // Range rate and predicted arrival of presence zone zone as of the last frame.
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        public static extern bool getZoneMotion(IntPtr t, int zone, out VL53L5CX_ZoneMotion motion);
+
+        //extern "C" SENSOR_API bool setTracker(VL53L5CXSensor* t, const VL53L5CX_TrackerConfig* config);
+        // Tracks every target of every zone across frames. Not while streaming.
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        public static extern bool setTracker(IntPtr t, in VL53L5CX_TrackerConfig config);
+
+        // Removes the tracker.
+        [DllImport(_dllImportPath, EntryPoint = "setTracker", CallingConvention = CallingConvention.Cdecl)]
+        public static extern bool clearTracker(IntPtr t, IntPtr config);
+
+        //extern "C" SENSOR_API int32_t getTracks(VL53L5CXSensor* t, VL53L5CX_Track* tracks, int32_t capacity);
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        private static extern unsafe int getTracks(IntPtr t, VL53L5CX_Track* tracks, int capacity);
+
+        // Confirmed tracks as of the last frame, also while streaming. Returns how many were written.
+        public static unsafe int getTracks(IntPtr t, Span<VL53L5CX_Track> tracks)
+        {
+            fixed (VL53L5CX_Track* k = tracks)
+                return getTracks(t, k, tracks.Length);
+        }
+
+        //extern "C" SENSOR_API int32_t getTargetsPerZone(VL53L5CXSensor* t);
+        // Targets per zone of the native build, 1 to 4.
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int getTargetsPerZone(IntPtr t);
+
+        //extern "C" SENSOR_API bool setBackground(VL53L5CXSensor* t, const VL53L5CX_BackgroundConfig* config);
+        // Learns the depth of the empty lane per zone, the foreground of the people counter. Not while streaming.
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        public static extern bool setBackground(IntPtr t, in VL53L5CX_BackgroundConfig config);
+
+        // Removes the background model, a people counter makes its own.
+        [DllImport(_dllImportPath, EntryPoint = "setBackground", CallingConvention = CallingConvention.Cdecl)]
+        public static extern bool clearBackground(IntPtr t, IntPtr config);
+
+        //extern "C" SENSOR_API bool getForeground(VL53L5CXSensor* t, uint64_t* foreground);
+        // Foreground zones of the last frame, false while learning.
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        public static extern bool getForeground(IntPtr t, out ulong foreground);
+
+        //extern "C" SENSOR_API bool saveBackground(VL53L5CXSensor* t, const char* path);
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        public static extern bool saveBackground(IntPtr t, [MarshalAs(UnmanagedType.LPStr)] string path);
+
+        //extern "C" SENSOR_API bool loadBackground(VL53L5CXSensor* t, const char* path);
+        // Only a model saved with the calibration data of this sensor. Not while streaming.
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        public static extern bool loadBackground(IntPtr t, [MarshalAs(UnmanagedType.LPStr)] string path);
+
+        //extern "C" SENSOR_API bool setIdleMode(VL53L5CXSensor* t, const VL53L5CX_IdleConfig* config);
+        // Reads no frames while the lane is empty, the sensor INT wakes the host up. Not while streaming or replaying.
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        public static extern bool setIdleMode(IntPtr t, in VL53L5CX_IdleConfig config);
+
+        // Disables idle mode, every frame is read again.
+        [DllImport(_dllImportPath, EntryPoint = "setIdleMode", CallingConvention = CallingConvention.Cdecl)]
+        public static extern bool clearIdleMode(IntPtr t, IntPtr config);
+
+        //extern "C" SENSOR_API bool getIdleStats(VL53L5CXSensor* t, VL53L5CX_IdleStats* stats);
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        public static extern bool getIdleStats(IntPtr t, out VL53L5CX_IdleStats stats);
+
+        //extern "C" SENSOR_API bool setMotionIndicator(VL53L5CXSensor* t, const VL53L5CX_MotionConfig* config);
+        // Programs the motion indicator of the sensor firmware and streams its scores with every frame. Not while streaming.
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        public static extern bool setMotionIndicator(IntPtr t, in VL53L5CX_MotionConfig config);
+
+        // Stops taking the motion results.
+        [DllImport(_dllImportPath, EntryPoint = "setMotionIndicator", CallingConvention = CallingConvention.Cdecl)]
+        public static extern bool clearMotionIndicator(IntPtr t, IntPtr config);
+
+        //extern "C" SENSOR_API bool getMotion(VL53L5CXSensor* t, VL53L5CX_MotionFrame* motion);
+        // Motion results of the last frame, false before the first one.
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        public static extern bool getMotion(IntPtr t, out VL53L5CX_MotionFrame motion);
+
+        //extern "C" SENSOR_API int32_t readMotionFrames(VL53L5CXSensor* t, VL53L5CX_MotionFrame* frames, int32_t capacity);
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        private static extern unsafe int readMotionFrames(IntPtr t, VL53L5CX_MotionFrame* frames, int capacity);
+
+        // Queued motion results of the newest 64 frames, oldest first, without waiting. Returns how many were written.
+        public static unsafe int readMotionFrames(IntPtr t, Span<VL53L5CX_MotionFrame> frames)
+        {
+            fixed (VL53L5CX_MotionFrame* f = frames)
+                return readMotionFrames(t, f, frames.Length);
+        }
+
+        //extern "C" SENSOR_API int32_t readMotionEvents(VL53L5CXSensor* t, VL53L5CX_MotionEvent* events, int32_t capacity);
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        private static extern unsafe int readMotionEvents(IntPtr t, VL53L5CX_MotionEvent* events, int capacity);
+
+        // Queued motion events, oldest first, without waiting. Returns how many were written.
+        public static unsafe int readMotionEvents(IntPtr t, Span<VL53L5CX_MotionEvent> events)
+        {
+            fixed (VL53L5CX_MotionEvent* e = events)
+                return readMotionEvents(t, e, events.Length);
+        }
+
+        //extern "C" SENSOR_API bool setGovernor(VL53L5CXSensor* t, const VL53L5CX_GovernorConfig* config);
+        // Moves the sensor between power and frame rate tiers with the occupancy of the lane and the time of day.
+        // Not while streaming, replaying or in idle mode.
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        public static extern bool setGovernor(IntPtr t, in VL53L5CX_GovernorConfig config);
+
+        // Removes the governor, the sensor is woken up and stays in its current tier.
+        [DllImport(_dllImportPath, EntryPoint = "setGovernor", CallingConvention = CallingConvention.Cdecl)]
+        public static extern bool clearGovernor(IntPtr t, IntPtr config);
+
+        //extern "C" SENSOR_API bool getGovernorStats(VL53L5CXSensor* t, VL53L5CX_GovernorStats* stats);
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        public static extern bool getGovernorStats(IntPtr t, out VL53L5CX_GovernorStats stats);
+
+        //extern "C" SENSOR_API bool setCounter(VL53L5CXSensor* t, const VL53L5CX_CounterConfig* config);
+        // Counts people crossing a line on the foreground of the background model. Not while streaming.
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        public static extern bool setCounter(IntPtr t, in VL53L5CX_CounterConfig config);
+
+        // Removes the people counter.
+        [DllImport(_dllImportPath, EntryPoint = "setCounter", CallingConvention = CallingConvention.Cdecl)]
+        public static extern bool clearCounter(IntPtr t, IntPtr config);
+
+        //extern "C" SENSOR_API bool getCrossingCounts(VL53L5CXSensor* t, uint64_t* forward, uint64_t* backward);
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        public static extern bool getCrossingCounts(IntPtr t, out ulong forward, out ulong backward);
+
+        //extern "C" SENSOR_API int32_t readCrossingEvents(VL53L5CXSensor* t, VL53L5CX_CrossingEvent* events, int32_t capacity);
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        private static extern unsafe int readCrossingEvents(IntPtr t, VL53L5CX_CrossingEvent* events, int capacity);
+
+        // Queued crossings, oldest first, without waiting. Returns how many were written.
+        public static unsafe int readCrossingEvents(IntPtr t, Span<VL53L5CX_CrossingEvent> events)
+        {
+            fixed (VL53L5CX_CrossingEvent* e = events)
+                return readCrossingEvents(t, e, events.Length);
+        }
+
+        //extern "C" SENSOR_API int32_t getBlobs(VL53L5CXSensor* t, VL53L5CX_Blob* blobs, int32_t capacity);
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        private static extern unsafe int getBlobs(IntPtr t, VL53L5CX_Blob* blobs, int capacity);
+
+        // Blobs tracked as of the last frame, also while streaming. Returns how many were written.
+        public static unsafe int getBlobs(IntPtr t, Span<VL53L5CX_Blob> blobs)
+        {
+            fixed (VL53L5CX_Blob* b = blobs)
+                return getBlobs(t, b, blobs.Length);
+        }
+
+        //extern "C" SENSOR_API int32_t evaluateRois(const VL53L5CX_Frame* frame, const VL53L5CX_Roi* rois, int32_t count, double* distances_mm, uint8_t* valid_zones);
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        private static extern unsafe int evaluateRois(VL53L5CX_Frame* frame, VL53L5CX_Roi* rois, int count, double* distances_mm, byte* valid_zones);
+
+        // One distance per ROI, 0 where no zone is valid. validZones may be empty, otherwise as long as rois.
+        public static unsafe int evaluateRois(in VL53L5CX_Frame frame, ReadOnlySpan<VL53L5CX_Roi> rois, Span<double> distances, Span<byte> validZones = default)
+        {
+            if ((distances.Length < rois.Length) || (!validZones.IsEmpty && (validZones.Length < rois.Length)))
+                return VL53L5CX_Frame.Error;
+            fixed (VL53L5CX_Frame* f = &frame)
+            fixed (VL53L5CX_Roi* r = rois)
+            fixed (double* d = distances)
+            fixed (byte* v = validZones)
+                return evaluateRois(f, r, rois.Length, d, v);
+        }
+
+        //extern "C" SENSOR_API bool startStreaming(VL53L5CXSensor* t, uint32_t queue_frames);
+        // Starts the DLL acquisition thread, at most queue_frames frames are kept for readFrames().
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        public static extern bool startStreaming(IntPtr t, uint queue_frames);
+
+        //extern "C" SENSOR_API void stopStreaming(VL53L5CXSensor* t);
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void stopStreaming(IntPtr t);
+
+        //extern "C" SENSOR_API int32_t readFrames(VL53L5CXSensor* t, VL53L5CX_Frame* frames, int32_t capacity, int32_t* count, uint32_t timeout_ms);
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        public static extern unsafe int readFrames(IntPtr t, VL53L5CX_Frame* frames, int capacity, out int count, uint timeout_ms);
+
+        // Moves every frame queued since the last call (as many as fit in frames) in a single
+        // call, waiting at most timeout_ms for the first one. Returns VL53L5CX_Frame.Ready with
+        // count > 0, NotReady on timeout, BadVersion or Error.
+        public static unsafe int readFrames(IntPtr t, Span<VL53L5CX_Frame> frames, out int count, uint timeout_ms)
+        {
+            count = 0;
+            if (frames.IsEmpty)
+                return VL53L5CX_Frame.Error;
+            frames[0].version = VL53L5CX_Frame.Version;
+            frames[0].size = (uint)sizeof(VL53L5CX_Frame);
+            fixed (VL53L5CX_Frame* p = frames)
+                return readFrames(t, p, frames.Length, out count, timeout_ms);
+        }
+
+        //typedef void (*VL53L5CX_FrameCallback)(const VL53L5CX_Frame* frame, void* user_data);
+        // Called from the DLL acquisition thread, the frame is only valid during the call. Keep the
+        // delegate referenced while it is installed, FrameStream does that.
+        [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+        public unsafe delegate void FrameCallback(VL53L5CX_Frame* frame, IntPtr user_data);
+
+        //extern "C" SENSOR_API bool setFrameCallback(VL53L5CXSensor* t, VL53L5CX_FrameCallback callback, void* user_data, uint32_t every_n_frames);
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        public static extern bool setFrameCallback(IntPtr t, FrameCallback? callback, IntPtr user_data, uint every_n_frames);
+
+        //extern "C" SENSOR_API bool startRecording(VL53L5CXSensor* t, const char* path, bool raw);
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        public static extern bool startRecording(IntPtr t, [MarshalAs(UnmanagedType.LPStr)] string path, bool raw);
+
+        //extern "C" SENSOR_API void stopRecording(VL53L5CXSensor* t);
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void stopRecording(IntPtr t);
+
+        //extern "C" SENSOR_API bool replayStep(VL53L5CXSensor* t, uint32_t frames);
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        public static extern bool replayStep(IntPtr t, uint frames);
+
+        //extern "C" SENSOR_API bool setTimeouts(VL53L5CXSensor* t, uint32_t operation_ms, uint32_t frame_percent);
+        // Call budgets in ms (0 = ULD budgets) and frame read budgets in percent of the frame period
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        public static extern bool setTimeouts(IntPtr t, uint operation_ms, uint frame_percent);
+
+        //typedef void (*VL53L5CX_ErrorCallback)(uint8_t error_code, uint32_t error_value, void* user_data);
+        // Called by the thread whose call failed, the acquisition thread while streaming. Must not throw,
+        // the exception cannot unwind through the DLL. Keep the delegate referenced while it is installed.
+        [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+        public delegate void ErrorCallback(byte error_code, uint error_value, IntPtr user_data);
+
+        //extern "C" SENSOR_API bool setErrorCallback(VL53L5CXSensor* t, VL53L5CX_ErrorCallback callback, void* user_data);
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        public static extern bool setErrorCallback(IntPtr t, ErrorCallback? callback, IntPtr user_data);
+
+        //extern "C" SENSOR_API bool getLastError(VL53L5CXSensor* t, uint8_t* error_code, uint32_t* error_value);
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        public static extern bool getLastError(IntPtr t, out byte error_code, out uint error_value);
+
+        //extern "C" SENSOR_API uint64_t getErrorCount(VL53L5CXSensor* t, uint8_t error_code);
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        public static extern ulong getErrorCount(IntPtr t, byte error_code);
+
+        //extern "C" SENSOR_API bool getMetricsName(VL53L5CXSensor* t, char* buffer, uint32_t size);
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        public static extern bool getMetricsName(IntPtr t, [MarshalAs(UnmanagedType.LPStr)] StringBuilder buffer, uint size);
+
+        //extern "C" SENSOR_API void setLogLevel(uint8_t level);
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void setLogLevel(byte level);
+
+        //typedef void (*VL53L5CX_LogCallback)(uint8_t level, const char* message);
+        // Called from the DLL logging thread. Keep the delegate referenced while it is installed.
+        [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+        public delegate void LogCallback(byte level, [MarshalAs(UnmanagedType.LPStr)] string message);
+
+        //extern "C" SENSOR_API void setLogSink(VL53L5CX_LogCallback sink);
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void setLogSink(LogCallback sink);
+
+        //extern "C" SENSOR_API void startTrace();
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void startTrace();
+
+        //extern "C" SENSOR_API void stopTrace();
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void stopTrace();
+
+        //extern "C" SENSOR_API bool saveTrace(const char* path);
+        [DllImport(_dllImportPath, CallingConvention = CallingConvention.Cdecl)]
+        public static extern bool saveTrace([MarshalAs(UnmanagedType.LPStr)] string path);
+
         #endregion
 
     }
+
+    // Mirrors VL53L5CX_Roi in VL53L5CXSensor.h.
+    [StructLayout(LayoutKind.Sequential)]
+    public struct VL53L5CX_Roi
+    {
+        public const byte Mean = 0;
+        public const byte Min = 1;
+        public const byte Median = 2;
+        public const byte SignalWeighted = 3;
+
+        public ulong zone_mask;         // bit i = zone i, 0 = the center zones
+        public uint status_mask;        // bit s accepts target_status s
+        public uint min_signal;
+        public short min_distance_mm;   // distances strictly between min and max count
+        public short max_distance_mm;
+        public ushort max_sigma_mm;
+        public byte reduction;
+        public byte outlier_cm;         // drop zones this far from their 3x3 neighbour median, 0 = off
+
+        // The getRange() default rules on the given zones
+        public static VL53L5CX_Roi Create(ulong zoneMask = 0, byte reduction = Mean)
+        {
+            return new VL53L5CX_Roi
+            {
+                zone_mask = zoneMask, status_mask = 1u << 5, min_signal = 0, min_distance_mm = 10,
+                max_distance_mm = 1200, max_sigma_mm = ushort.MaxValue, reduction = reduction
+            };
+        }
+    }
+
+    // Mirrors VL53L5CX_PresenceZone in VL53L5CXSensor.h.
+    [StructLayout(LayoutKind.Sequential)]
+    public struct VL53L5CX_PresenceZone
+    {
+        public VL53L5CX_Roi roi;
+        public short enter_mm;          // occupied when closer, for enter_frames frames in a row
+        public short exit_mm;           // free when farther (or empty), for exit_frames frames in a row
+        public ushort enter_frames;
+        public ushort exit_frames;
+        public ushort min_dwell_frames;
+        public short trigger_mm;        // arrival is predicted for this distance, 0 = enter_mm
+        public byte rate_frames;        // range rate window, 0 = 8
+        public byte reserved;
+        public ushort arrival_ms;       // ARRIVING once the predicted arrival is this close, 0 = none
+
+        public static VL53L5CX_PresenceZone Create(VL53L5CX_Roi roi, short enterMm, short exitMm, ushort enterFrames = 1,
+            ushort exitFrames = 1, ushort minDwellFrames = 0, ushort arrivalMs = 0)
+        {
+            return new VL53L5CX_PresenceZone
+            {
+                roi = roi, enter_mm = enterMm, exit_mm = exitMm, enter_frames = enterFrames, exit_frames = exitFrames,
+                min_dwell_frames = minDwellFrames, arrival_ms = arrivalMs
+            };
+        }
+    }
+
+    // Mirrors VL53L5CX_ZoneMotion in VL53L5CXSensor.h.
+    [StructLayout(LayoutKind.Sequential)]
+    public struct VL53L5CX_ZoneMotion
+    {
+        public const byte Unknown = 0;
+        public const byte Stationary = 1;
+        public const byte Approaching = 2;
+        public const byte Leaving = 3;
+
+        public ulong timestamp_ns;      // newest frame of the fit
+        public float distance_mm;
+        public float velocity_mm_s;     // negative while approaching
+        public float arrival_s;         // until trigger_mm, 0 if closer, -1 if not approaching
+        public byte motion;
+        public byte samples;
+        public ushort reserved;
+    }
+
+    // Mirrors VL53L5CX_TrackerConfig in VL53L5CXSensor.h.
+    [StructLayout(LayoutKind.Sequential)]
+    public struct VL53L5CX_TrackerConfig
+    {
+        public const int MaxTracks = 16;
+
+        public VL53L5CX_Roi roi;        // zones (0 = all of them) and rules of the targets
+        public ushort gate_mm;          // 0 = 300
+        public byte min_zones;          // 0 = 1
+        public byte confirm_frames;     // 0 = 2
+        public byte max_misses;         // 0 = 5
+        public byte reserved0;
+        public byte reserved1;
+        public byte reserved2;
+
+        // Status 5 and 9 out to 4000 mm on all zones
+        public static VL53L5CX_TrackerConfig Create(ushort gateMm = 300, byte confirmFrames = 2, byte maxMisses = 5)
+        {
+            VL53L5CX_Roi roi = VL53L5CX_Roi.Create();
+            roi.status_mask = (1u << 5) | (1u << 9);
+            roi.max_distance_mm = 4000;
+            return new VL53L5CX_TrackerConfig
+            {
+                roi = roi, gate_mm = gateMm, min_zones = 1, confirm_frames = confirmFrames, max_misses = maxMisses
+            };
+        }
+    }
+
+    // Mirrors VL53L5CX_Track in VL53L5CXSensor.h.
+    [StructLayout(LayoutKind.Sequential)]
+    public unsafe struct VL53L5CX_Track
+    {
+        public ulong zone_mask;
+        public uint id;
+        public uint age_frames;
+        public float distance_mm;
+        public float velocity_mm_s;     // negative while approaching
+        public float column;            // centroid in zones
+        public float row;
+        public byte zones;
+        public byte misses;             // frames in a row predicted only
+        public fixed byte reserved[6];
+    }
+
+    // Mirrors VL53L5CX_BackgroundConfig in VL53L5CXSensor.h.
+    [StructLayout(LayoutKind.Sequential)]
+    public unsafe struct VL53L5CX_BackgroundConfig
+    {
+        public VL53L5CX_Roi roi;        // zones (0 = all of them) and rules of the targets
+        public short margin_mm;         // 0 = 300
+        public ushort learn_frames;     // 0 = 15, the lane must be empty meanwhile
+        public ushort adapt_frames;     // window of the statistics, 0 = 900
+        public byte sigma_tenths;       // 0 = 30
+        public fixed byte reserved[9];
+
+        // Status 5 and 9 out to 4000 mm on all zones
+        public static VL53L5CX_BackgroundConfig Create(short marginMm = 300, ushort adaptFrames = 900, byte sigmaTenths = 30)
+        {
+            VL53L5CX_Roi roi = VL53L5CX_Roi.Create();
+            roi.status_mask = (1u << 5) | (1u << 9);
+            roi.max_distance_mm = 4000;
+            return new VL53L5CX_BackgroundConfig
+            {
+                roi = roi, margin_mm = marginMm, learn_frames = 15, adapt_frames = adaptFrames, sigma_tenths = sigmaTenths
+            };
+        }
+    }
+
+    // Mirrors VL53L5CX_IdleConfig in VL53L5CXSensor.h.
+    [StructLayout(LayoutKind.Sequential)]
+    public unsafe struct VL53L5CX_IdleConfig
+    {
+        public VL53L5CX_Roi roi;        // zones (0 = the center zones) and distance window
+        public ushort rearm_frames;     // empty frames before sleeping again, 0 = 30
+        public ushort poll_ms;          // INT latch poll period, 0 = 50
+        public fixed byte reserved[12];
+
+        // Status 5 and 9 up to maxDistanceMm on the center zones
+        public static VL53L5CX_IdleConfig Create(short maxDistanceMm = 2000, ushort rearmFrames = 30, ushort pollMs = 50)
+        {
+            VL53L5CX_Roi roi = VL53L5CX_Roi.Create();
+            roi.status_mask = (1u << 5) | (1u << 9);
+            roi.max_distance_mm = maxDistanceMm;
+            return new VL53L5CX_IdleConfig { roi = roi, rearm_frames = rearmFrames, poll_ms = pollMs };
+        }
+    }
+
+    // Mirrors VL53L5CX_IdleStats in VL53L5CXSensor.h.
+    [StructLayout(LayoutKind.Sequential)]
+    public unsafe struct VL53L5CX_IdleStats
+    {
+        public ulong wakeups;
+        public ulong idle_ms;           // asleep, no frames read
+        public ulong active_ms;
+        public ulong latch_polls;       // no I2C transaction
+        public byte idle;               // 1 while asleep
+        public fixed byte reserved[7];
+    }
+
+    // Mirrors VL53L5CX_MotionConfig in VL53L5CXSensor.h.
+    [StructLayout(LayoutKind.Sequential)]
+    public unsafe struct VL53L5CX_MotionConfig
+    {
+        public ushort min_distance_mm;  // 400 to 4000, 0 = 400
+        public ushort max_distance_mm;  // at most 1500 beyond min_distance_mm, 0 = 1500
+        public uint threshold;          // score of an aggregate in motion, 0 = 44
+        public byte min_aggregates;     // 0 = 1
+        public byte start_frames;       // 0 = 2
+        public byte stop_frames;        // 0 = 15
+        public fixed byte reserved[5];
+
+        // The firmware window of 400 mm to 1500 mm by default
+        public static VL53L5CX_MotionConfig Create(ushort minDistanceMm = 400, ushort maxDistanceMm = 1500, uint threshold = 44)
+        {
+            return new VL53L5CX_MotionConfig
+            {
+                min_distance_mm = minDistanceMm, max_distance_mm = maxDistanceMm, threshold = threshold,
+                min_aggregates = 1, start_frames = 2, stop_frames = 15
+            };
+        }
+    }
+
+    // Mirrors VL53L5CX_MotionFrame in VL53L5CXSensor.h.
+    [StructLayout(LayoutKind.Sequential)]
+    public unsafe struct VL53L5CX_MotionFrame
+    {
+        public const int MaxAggregates = 32;
+
+        public ulong timestamp_ns;
+        public uint global_indicator_1;
+        public uint global_indicator_2;
+        public byte status;
+        public byte detected_aggregates;    // over the firmware detection threshold
+        public byte aggregates;             // entries of motion used
+        public byte moving;                 // 1 while a motion event is open
+        public uint motion_mask;            // bit i: motion[i] reached the threshold
+        public fixed uint motion[MaxAggregates];
+    }
+
+    // Mirrors VL53L5CX_MotionEvent in VL53L5CXSensor.h.
+    [StructLayout(LayoutKind.Sequential)]
+    public unsafe struct VL53L5CX_MotionEvent
+    {
+        public const byte Stopped = 0;
+        public const byte Started = 1;
+
+        public ulong timestamp_ns;
+        public uint peak;               // highest score since the motion started
+        public uint duration_ms;        // 0 for Started
+        public byte type;
+        public byte aggregates;
+        public fixed byte reserved[6];
+    }
+
+    // Mirrors VL53L5CX_GovernorTier in VL53L5CXSensor.h.
+    [StructLayout(LayoutKind.Sequential)]
+    public struct VL53L5CX_GovernorTier
+    {
+        public byte resolution;         // 16 or 64, 0 = sleep (tier 0 only)
+        public byte frequency_hz;
+        public byte autonomous;         // 1 = autonomous ranging
+        public byte reserved;
+        public ushort integration_ms;   // autonomous only, 0 = 5
+        public ushort hold_ms;          // empty lane before stepping down, sleep: until the next probe
+
+        public static VL53L5CX_GovernorTier Create(byte resolution, byte frequencyHz, ushort holdMs, ushort integrationMs = 0)
+        {
+            return new VL53L5CX_GovernorTier
+            {
+                resolution = resolution, frequency_hz = frequencyHz, autonomous = (byte)((integrationMs != 0) ? 1 : 0),
+                integration_ms = integrationMs, hold_ms = holdMs
+            };
+        }
+    }
+
+    // Mirrors VL53L5CX_GovernorWindow in VL53L5CXSensor.h.
+    [StructLayout(LayoutKind.Sequential)]
+    public unsafe struct VL53L5CX_GovernorWindow
+    {
+        public ushort start_minute;     // local time, minutes after midnight
+        public ushort end_minute;       // exclusive, below start_minute the window spans midnight
+        public byte lowest_tier;
+        public byte highest_tier;
+        public fixed byte reserved[2];
+    }
+
+    // Mirrors VL53L5CX_GovernorConfig in VL53L5CXSensor.h, tiers[] and windows[] spelled out.
+    [StructLayout(LayoutKind.Sequential)]
+    public unsafe struct VL53L5CX_GovernorConfig
+    {
+        public const int MaxTiers = 4;
+        public const int MaxWindows = 4;
+
+        public VL53L5CX_GovernorTier tier0, tier1, tier2, tier3;            // lowest power first
+        public VL53L5CX_GovernorWindow window0, window1, window2, window3;
+        public VL53L5CX_Roi roi;        // occupied lane without presence zones
+        public byte tier_count;
+        public byte window_count;
+        public byte occupied_tier;
+        public byte reserved0;
+        public ushort detail_ms;        // occupied this long moves to the top tier, 0 = never
+        public ushort probe_ms;         // tier 1 time after a sleep, 0 = 1000
+        public fixed byte reserved[8];
+
+        // Asleep; 4x4 autonomous at 5 Hz; 4x4 at 15 Hz when occupied; 8x8 at 15 Hz after 1 s. No schedule.
+        public static VL53L5CX_GovernorConfig Create()
+        {
+            VL53L5CX_Roi roi = VL53L5CX_Roi.Create();
+            roi.status_mask = (1u << 5) | (1u << 9);
+            roi.max_distance_mm = 2000;
+            return new VL53L5CX_GovernorConfig
+            {
+                tier0 = VL53L5CX_GovernorTier.Create(0, 0, 2000),
+                tier1 = VL53L5CX_GovernorTier.Create(16, 5, 30000, 5),
+                tier2 = VL53L5CX_GovernorTier.Create(16, 15, 5000),
+                tier3 = VL53L5CX_GovernorTier.Create(64, 15, 3000),
+                roi = roi, tier_count = 4, occupied_tier = 2, detail_ms = 1000, probe_ms = 1000
+            };
+        }
+    }
+
+    // Mirrors VL53L5CX_GovernorStats in VL53L5CXSensor.h.
+    [StructLayout(LayoutKind.Sequential)]
+    public unsafe struct VL53L5CX_GovernorStats
+    {
+        public fixed ulong tier_ms[VL53L5CX_GovernorConfig.MaxTiers];
+        public ulong switch_ms;         // time the tier changes took
+        public uint switches;
+        public uint failures;           // tier changes the sensor refused
+        public byte tier;
+        public byte sleeping;           // 1 while the sensor sleeps
+        public fixed byte reserved[6];
+    }
+
+    // Mirrors VL53L5CX_CounterConfig in VL53L5CXSensor.h.
+    [StructLayout(LayoutKind.Sequential)]
+    public unsafe struct VL53L5CX_CounterConfig
+    {
+        public const int MaxBlobs = 8;
+        public const byte AcrossRows = 0;
+        public const byte AcrossColumns = 1;
+
+        public VL53L5CX_Roi roi;        // zones (0 = all of them) and rules of the targets
+        public short margin_mm;         // background without setBackground(), see VL53L5CX_BackgroundConfig
+        public ushort learn_frames;
+        public byte axis;
+        public byte line_percent;       // 0 = 50
+        public byte min_zones;          // 0 = 1
+        public byte gate_zones;         // 0 = 2
+        public byte max_misses;         // 0 = 3
+        public fixed byte reserved[7];
+
+        // Status 5 and 9 out to 4000 mm on all zones
+        public static VL53L5CX_CounterConfig Create(byte axis = AcrossRows, byte linePercent = 50, short marginMm = 300)
+        {
+            VL53L5CX_Roi roi = VL53L5CX_Roi.Create();
+            roi.status_mask = (1u << 5) | (1u << 9);
+            roi.max_distance_mm = 4000;
+            return new VL53L5CX_CounterConfig { roi = roi, margin_mm = marginMm, axis = axis, line_percent = linePercent };
+        }
+    }
+
+    // Mirrors VL53L5CX_Blob in VL53L5CXSensor.h.
+    [StructLayout(LayoutKind.Sequential)]
+    public unsafe struct VL53L5CX_Blob
+    {
+        public ulong zone_mask;
+        public uint id;
+        public uint age_frames;
+        public float column;            // centroid in zones
+        public float row;
+        public float distance_mm;       // closest zone
+        public float speed_zones_s;     // along the counting axis
+        public byte zones;
+        public byte misses;
+        public sbyte side;              // of the line: 1 forward, -1 backward, 0 on it
+        public fixed byte reserved[5];
+    }
+
+    // Mirrors VL53L5CX_CrossingEvent in VL53L5CXSensor.h.
+    [StructLayout(LayoutKind.Sequential)]
+    public struct VL53L5CX_CrossingEvent
+    {
+        public const byte Forward = 0;
+        public const byte Backward = 1;
+
+        public ulong timestamp_ns;
+        public uint id;
+        public byte direction;
+        public byte zones;
+        public ushort reserved;
+        public float distance_mm;
+        public uint age_frames;
+    }
+
+    // Mirrors VL53L5CX_PresenceEvent in VL53L5CXSensor.h.
+    [StructLayout(LayoutKind.Sequential)]
+    public struct VL53L5CX_PresenceEvent
+    {
+        public const byte Left = 0;
+        public const byte Entered = 1;
+        public const byte Arriving = 2;
+
+        public ulong timestamp_ns;      // of the frame that decided
+        public ushort zone;
+        public byte type;
+        public byte reserved;
+        public float distance_mm;
+    }
+
+    // Mirrors VL53L5CX_Filter in VL53L5CXSensor.h.
+    [StructLayout(LayoutKind.Sequential)]
+    public struct VL53L5CX_Filter
+    {
+        public const byte None = 0;
+        public const byte Ema = 1;
+        public const byte Median = 2;
+        public const byte Kalman = 3;
+
+        public byte type;
+        public byte window_frames;      // Median: odd, 3..9
+        public ushort reserved;
+        public uint status_mask;        // 0 = status 5 and 9
+        public float ema_alpha;         // Ema: weight of the new distance
+        public float kalman_accel_mm_s2; // Kalman: expected acceleration of a target
+
+        // The defaults of the DLL for the given filter
+        public static VL53L5CX_Filter Create(byte type)
+        {
+            return new VL53L5CX_Filter
+            {
+                type = type, window_frames = 5, status_mask = 0, ema_alpha = 0.3f, kalman_accel_mm_s2 = 2000.0f
+            };
+        }
+    }
+
+    // Mirrors VL53L5CX_Frame in VL53L5CXSensor.h. The struct is blittable, getFrame() writes
+    // straight into it without any marshalling or allocation.
+    [StructLayout(LayoutKind.Sequential)]
+    public unsafe struct VL53L5CX_Frame
+    {
+        public const uint Version = 1;
+        public const int MaxZones = 64;
+
+        // getFrame() results
+        public const int Ready = 1;
+        public const int NotReady = 0;
+        public const int BadVersion = -1;
+        public const int Error = -2;
+
+        public uint version;
+        public uint size;
+        public ulong timestamp_ns;
+        public byte stream_count;
+        public byte resolution;
+        public sbyte silicon_temp_degc;
+        public byte reserved0;
+        public fixed short distance_mm[MaxZones];
+        public fixed ushort range_sigma_mm[MaxZones];
+        public fixed uint signal_per_spad[MaxZones];
+        public fixed byte target_status[MaxZones];
+        public fixed byte reserved1[4];
+
+        public static VL53L5CX_Frame Create()
+        {
+            return new VL53L5CX_Frame { version = Version, size = (uint)sizeof(VL53L5CX_Frame) };
+        }
+
+        // Views of the valid zones of this frame, no copy. They are only valid while the frame
+        // stays where it is (a local, or a field of a pinned object).
+        [UnscopedRef] public Span<short> Distances => MemoryMarshal.CreateSpan(ref distance_mm[0], resolution);
+        [UnscopedRef] public Span<ushort> Sigmas => MemoryMarshal.CreateSpan(ref range_sigma_mm[0], resolution);
+        [UnscopedRef] public Span<uint> Signals => MemoryMarshal.CreateSpan(ref signal_per_spad[0], resolution);
+        [UnscopedRef] public Span<byte> Statuses => MemoryMarshal.CreateSpan(ref target_status[0], resolution);
+    }
 }
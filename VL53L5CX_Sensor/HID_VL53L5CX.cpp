@@ -21,41 +21,151 @@
 
 #include "pch.h" // use stdafx.h in Visual Studio 2017 and earlier
 #include "HID_VL53L5CX.h"
+#ifdef HID_VL53L5CX_HAS_FT260
 #include "HID_VL53L5CX_IO.h"
+#endif
+#include "HID_VL53L5CX_Log.h"
 #include "vl53l5cx_api.h"
 #include <stdexcept>
-#include <iostream>
+#include <string>
+#include <string.h>
 
 void HID_VL53L5CX::clearErrorStruct()
 {
     // Set last error struct to no-error condition
     lastError.lastErrorCode = SF_VL53L5CX_ERROR_TYPE::VL53_NO_ERROR;
     lastError.lastErrorValue = 0;
+
+    // Every public method starts here
+    armDeadline(operationTimeoutMs);
+}
+
+void HID_VL53L5CX::reportError()
+{
+    // A transfer that ran into the deadline fails with the transport status
+    if ((Dev != nullptr) && (Dev->platform.deadline_expired || (CheckDeadline(&Dev->platform) != VL53L5CX_STATUS_OK)))
+        lastError.lastErrorCode = SF_VL53L5CX_ERROR_TYPE::DEADLINE_EXCEEDED;
+
+    uint32_t code = (uint32_t)lastError.lastErrorCode;
+    if (metrics != nullptr)
+        HID_VL53L5CX_Metrics::add(metrics->data()->driverErrors[(code < HID_VL53L5CX_METRICS_ERROR_CODES) ? code : (HID_VL53L5CX_METRICS_ERROR_CODES - 1)]);
+
+    SAFE_CALLBACK(errorCallback, lastError.lastErrorCode, lastError.lastErrorValue);
+    if (errorContextCallback != nullptr)
+        errorContextCallback(lastError.lastErrorCode, lastError.lastErrorValue, errorCallbackData);
+}
+
+void HID_VL53L5CX::armDeadline(uint32_t budgetMs)
+{
+    if (Dev == nullptr)
+        return;
+
+    uint64_t deadlineNs = scopeDeadlineNs;
+    if (budgetMs != 0)
+    {
+        uint64_t budgetEndNs = clock->nowNs() + (uint64_t)budgetMs * 1000000;
+        if ((deadlineNs == 0) || (budgetEndNs < deadlineNs))
+            deadlineNs = budgetEndNs;
+    }
+    Dev->platform.deadline_ns = deadlineNs;
+    Dev->platform.deadline_expired = 0;
+}
+
+uint32_t HID_VL53L5CX::frameBudgetMs()
+{
+    if (!ranging || (framePeriodUs == 0) || (frameTimeoutPercent == 0))
+        return operationTimeoutMs;
+
+    // A frame read that takes longer than a few frame periods is stuck, not slow
+    uint32_t budgetMs = (uint32_t)(((uint64_t)framePeriodUs * frameTimeoutPercent / 100 + 999) / 1000);
+    if ((operationTimeoutMs != 0) && (operationTimeoutMs < budgetMs))
+        budgetMs = operationTimeoutMs;
+    return budgetMs;
+}
+
+void HID_VL53L5CX::setOperationTimeout(uint32_t timeoutMs)
+{
+    operationTimeoutMs = timeoutMs;
+}
+
+void HID_VL53L5CX::setFrameTimeout(uint32_t percentOfFramePeriod)
+{
+    frameTimeoutPercent = percentOfFramePeriod;
+}
+
+uint64_t HID_VL53L5CX::pushDeadline(uint32_t timeoutMs)
+{
+    uint64_t previousNs = scopeDeadlineNs;
+    uint64_t deadlineNs = clock->nowNs() + (uint64_t)timeoutMs * 1000000;
+    if ((scopeDeadlineNs == 0) || (deadlineNs < scopeDeadlineNs))
+        scopeDeadlineNs = deadlineNs;
+    return previousNs;
 }
 
+void HID_VL53L5CX::popDeadline(uint64_t previousNs)
+{
+    scopeDeadlineNs = previousNs;
+}
+
+#ifdef HID_VL53L5CX_HAS_FT260
 // Constructor
 //   initialize FT260 DLL, connect to FT260 over USB and initialize the sensor device 
 // throws an exception on error
-HID_VL53L5CX::HID_VL53L5CX(uint8_t address)
+HID_VL53L5CX::HID_VL53L5CX(uint8_t address, HID_VL53L5CX_Clock *_clock)
 {
-    FT260_STATUS ftStatus = FT260_OTHER_ERROR;
-    FT260_HANDLE mhandle = INVALID_HANDLE_VALUE;
+    ownedTransport = new HID_VL53L5CX_IO(address);
+    try {
+        initSensor(ownedTransport, _clock);
+    }
+    catch (...) {
+        delete Dev;
+        delete metrics;
+        delete ownedTransport;
+        throw;
+    }
+}
+#endif
 
+// Constructor
+//   initialize the sensor device behind a caller supplied transport
+// throws an exception on error
+HID_VL53L5CX::HID_VL53L5CX(HID_VL53L5CX_Transport *transport, HID_VL53L5CX_Clock *_clock)
+{
+    try {
+        initSensor(transport, _clock);
+    }
+    catch (...) {
+        delete Dev;
+        delete metrics;
+        throw;
+    }
+}
+
+void HID_VL53L5CX::initSensor(HID_VL53L5CX_Transport *transport, HID_VL53L5CX_Clock *_clock)
+{
     clearErrorStruct();
 
+    VL53L5CX_i2c = transport;
+
     // create platform device configuration structure
     Dev = new VL53L5CX_Configuration(); 
 
-    Dev->platform.VL53L5CX_i2c = &VL53L5CX_i2c;
+    Dev->platform.VL53L5CX_i2c = VL53L5CX_i2c;
+
+    // all ULD waits go through this clock
+    clock = (_clock != nullptr) ? _clock : HID_VL53L5CX_Clock::systemClock();
+    Dev->platform.clock = clock;
+
+    // count the bus traffic from the very first access
+    metrics = new HID_VL53L5CX_Metrics();
+    Dev->platform.metrics = metrics->data();
 
     uint8_t result = 0;
-    uint8_t deviceId = 0;
-    uint8_t revisionId = 0;
     uint8_t isAlive = 0;
 
-    uint8_t i2cstatus = VL53L5CX_i2c.getI2CStatus();
-    if (I2CM_IDLE(i2cstatus)) {
-        printf("I2C is idle\n");
+    uint8_t i2cstatus = VL53L5CX_i2c->getI2CStatus();
+    if (i2cstatus & HID_VL53L5CX_I2C_STATUS_IDLE) {
+        HID_VL53L5CX_LOG(VERBOSE, "I2C is idle");
     }
 
     /* (Optional) Check if there is a VL53L5CX sensor connected */
@@ -63,7 +173,7 @@ HID_VL53L5CX::HID_VL53L5CX(uint8_t address)
     //printf("result = %u, isAlive = %u\n", result, isAlive);
     if (!isAlive || result)
     {
-        printf("VL53L5CX sensor was not detected\n");
+        HID_VL53L5CX_LOG(FAILURE, "VL53L5CX sensor was not detected");
         throw std::runtime_error("VL53L5CX sensor is not present");
     }
 
@@ -72,23 +182,27 @@ HID_VL53L5CX::HID_VL53L5CX(uint8_t address)
     uint8_t imageResolution = getResolution();
     if ( (imageResolution != 16) && (imageResolution != 64) ) {
         /* power on sensor and init */
-        printf("Initializing VL53L5CX sensor. Downloading firmware, please wait\n");
+        HID_VL53L5CX_LOG(INFO, "Initializing VL53L5CX sensor. Downloading firmware, please wait");
         result = vl53l5cx_init(Dev);
-        printf("vl53l5cx_init() returns: %u", result);
+        zoneCount = 0;
+        HID_VL53L5CX_LOG(VERBOSE, "vl53l5cx_init() returns: %u", result);
         if (result)
         {
-            printf("VL53L5CX ULD Loading failed: %d\n", result);
+            HID_VL53L5CX_LOG(FAILURE, "VL53L5CX ULD Loading failed: %d", result);
             throw std::runtime_error("vl53l5cx_init fails: " + std::to_string(result));
         }
     }
 
-    printf("VL53L5CX ULD ready ! (Version : %s)\n", VL53L5CX_API_REVISION);
+    HID_VL53L5CX_LOG(INFO, "VL53L5CX ULD ready ! (Version : %s)", VL53L5CX_API_REVISION);
 }
 
 HID_VL53L5CX::~HID_VL53L5CX()
 {
-    std::cout << "HID_VL53L5CX() destructor called" << std::endl;
+    HID_VL53L5CX_LOG(VERBOSE, "HID_VL53L5CX() destructor called");
+    delete(recorder);
     delete(Dev);
+    delete(metrics);
+    delete(ownedTransport);
 }
 
 void HID_VL53L5CX::setErrorCallback(void (*_errorCallback)(SF_VL53L5CX_ERROR_TYPE errorCode, uint32_t errorValue))
@@ -96,17 +210,27 @@ void HID_VL53L5CX::setErrorCallback(void (*_errorCallback)(SF_VL53L5CX_ERROR_TYP
     errorCallback = _errorCallback;
 }
 
+void HID_VL53L5CX::setErrorCallback(void (*_errorCallback)(SF_VL53L5CX_ERROR_TYPE errorCode, uint32_t errorValue, void *userData),
+    void *userData)
+{
+    errorContextCallback = _errorCallback;
+    errorCallbackData = userData;
+}
+
 bool HID_VL53L5CX::setRangingFrequency(uint8_t newFrequency)
 {
     clearErrorStruct();
 
     uint8_t result = vl53l5cx_set_ranging_frequency_hz(Dev, newFrequency);
     if (result == 0)
+    {
+        framePeriodUs = (newFrequency != 0) ? 1000000 / newFrequency : 0;
         return true;
+    }
 
     lastError.lastErrorCode = SF_VL53L5CX_ERROR_TYPE::INVALID_FREQUENCY_SETTING;
     lastError.lastErrorValue = static_cast<uint32_t>(result);
-    SAFE_CALLBACK(errorCallback, lastError.lastErrorCode, lastError.lastErrorValue);
+    reportError();
     return false;
 }
 
@@ -118,13 +242,14 @@ uint8_t HID_VL53L5CX::getRangingFrequency()
     uint8_t result = vl53l5cx_get_ranging_frequency_hz(Dev, &frequency);
     if (result == 0)
     {
+        framePeriodUs = (frequency != 0) ? 1000000 / frequency : 0;
         return frequency;
     }
     else
     {
         lastError.lastErrorCode = SF_VL53L5CX_ERROR_TYPE::INVALID_FREQUENCY_SETTING;
         lastError.lastErrorValue = static_cast<uint32_t>(result);
-        SAFE_CALLBACK(errorCallback, lastError.lastErrorCode, lastError.lastErrorValue);
+        reportError();
         return 0;
     }
 }
@@ -145,7 +270,7 @@ bool HID_VL53L5CX::setRangingMode(SF_VL53L5CX_RANGING_MODE rangingMode)
 
     lastError.lastErrorCode = SF_VL53L5CX_ERROR_TYPE::INVALID_RANGING_MODE;
     lastError.lastErrorValue = static_cast<uint32_t>(result);
-    SAFE_CALLBACK(errorCallback, lastError.lastErrorCode, lastError.lastErrorValue);
+    reportError();
     return false;
 }
 
@@ -165,7 +290,7 @@ SF_VL53L5CX_RANGING_MODE HID_VL53L5CX::getRangingMode()
 
     lastError.lastErrorCode = SF_VL53L5CX_ERROR_TYPE::INVALID_RANGING_MODE;
     lastError.lastErrorValue = static_cast<uint32_t>(result);
-    SAFE_CALLBACK(errorCallback, lastError.lastErrorCode, lastError.lastErrorValue);
+    reportError();
     return SF_VL53L5CX_RANGING_MODE::VL53_NO_ERROR;
 }
 
@@ -173,14 +298,27 @@ bool HID_VL53L5CX::startRanging()
 {
     clearErrorStruct();
 
+    // The frame budget needs the frame period
+    uint8_t frequency = 0;
+    if ((framePeriodUs == 0) && (vl53l5cx_get_ranging_frequency_hz(Dev, &frequency) == 0) && (frequency != 0))
+        framePeriodUs = 1000000 / frequency;
+
     uint8_t result = vl53l5cx_start_ranging(Dev);
 
     if (result == 0)
+    {
+        // stream counts and poll times of the previous session mean nothing now
+        lastStreamCount = 255;
+        pollsSinceFrame = 0;
+        idlePollNs = 0;
+        readyPollNs = 0;
+        ranging = true;
         return true;
+    }
 
     lastError.lastErrorCode = SF_VL53L5CX_ERROR_TYPE::CANNOT_START_RANGING;
     lastError.lastErrorValue = static_cast<uint32_t>(result);
-    SAFE_CALLBACK(errorCallback, lastError.lastErrorCode, lastError.lastErrorValue);
+    reportError();
     return false;
 }
 
@@ -191,26 +329,39 @@ bool HID_VL53L5CX::stopRanging()
     uint8_t result = vl53l5cx_stop_ranging(Dev);
 
     if (result == 0)
+    {
+        ranging = false;
         return true;
+    }
 
     lastError.lastErrorCode = SF_VL53L5CX_ERROR_TYPE::CANNOT_STOP_RANGING;
     lastError.lastErrorValue = static_cast<uint32_t>(result);
-    SAFE_CALLBACK(errorCallback, lastError.lastErrorCode, lastError.lastErrorValue);
+    reportError();
     return false;
 }
 
 bool HID_VL53L5CX::isDataReady()
 {
     clearErrorStruct();
+    armDeadline(frameBudgetMs());
     uint8_t dataReady = 0;
 
     uint8_t result = vl53l5cx_check_data_ready(Dev, &dataReady);
     if (result == 0)
+    {
+        uint64_t pollNs = clock->nowNs();
+        HID_VL53L5CX_Metrics::add(metrics->data()->dataReadyPolls);
+        pollsSinceFrame++;
+        if (dataReady == 0)
+            idlePollNs = pollNs;
+        else if (readyPollNs == 0)
+            readyPollNs = pollNs;
         return dataReady != 0;
+    }
 
     lastError.lastErrorCode = SF_VL53L5CX_ERROR_TYPE::CANNOT_GET_DATA_READY;
     lastError.lastErrorValue = static_cast<uint32_t>(result);
-    SAFE_CALLBACK(errorCallback, lastError.lastErrorCode, lastError.lastErrorValue);
+    reportError();
     return false;
 }
 
@@ -223,14 +374,15 @@ uint8_t HID_VL53L5CX::getResolution()
     if (result == 0)
     {
         if (resolution == 64)
-            return (uint8_t)SF_VL53L5CX_RANGING_RESOLUTION::RES_8X8;
+            zoneCount = (uint8_t)SF_VL53L5CX_RANGING_RESOLUTION::RES_8X8;
         else
-            return (uint8_t)SF_VL53L5CX_RANGING_RESOLUTION::RES_4X4;
+            zoneCount = (uint8_t)SF_VL53L5CX_RANGING_RESOLUTION::RES_4X4;
+        return zoneCount;
     }
 
     lastError.lastErrorCode = SF_VL53L5CX_ERROR_TYPE::CANNOT_GET_RESOLUTION;
     lastError.lastErrorValue = static_cast<uint32_t>(result);
-    SAFE_CALLBACK(errorCallback, lastError.lastErrorCode, lastError.lastErrorValue);
+    reportError();
     return (uint8_t)SF_VL53L5CX_RANGING_RESOLUTION::VL53_NO_ERROR;
 }
 
@@ -241,28 +393,90 @@ bool HID_VL53L5CX::setResolution(uint8_t resolution)
     uint8_t result = vl53l5cx_set_resolution(Dev, resolution);
 
     if (result == 0)
-        return true;
+    {
+        zoneCount = resolution;
+
+        // The motion indicator maps zones to aggregates per resolution
+        if (!motionIndicator)
+            return true;
+        result = vl53l5cx_motion_indicator_set_resolution(Dev, &motionConfig, resolution);
+        if (result == 0)
+            return true;
+        lastError.lastErrorCode = SF_VL53L5CX_ERROR_TYPE::CANNOT_SET_MOTION_INDICATOR;
+        lastError.lastErrorValue = static_cast<uint32_t>(result);
+        reportError();
+        return false;
+    }
 
     lastError.lastErrorCode = SF_VL53L5CX_ERROR_TYPE::CANNOT_SET_RESOLUTION;
     lastError.lastErrorValue = static_cast<uint32_t>(result);
-    SAFE_CALLBACK(errorCallback, lastError.lastErrorCode, lastError.lastErrorValue);
+    reportError();
     return false;
 }
 
+uint8_t HID_VL53L5CX::getZoneCount()
+{
+    // getResolution() updates zoneCount only when the sensor answered
+    if (zoneCount == 0)
+        getResolution();
+    return zoneCount;
+}
+
 bool HID_VL53L5CX::getRangingData(VL53L5CX_ResultsData* pRangingData)
 {
     clearErrorStruct();
+    armDeadline(frameBudgetMs());
 
     uint8_t result = vl53l5cx_get_ranging_data(Dev, pRangingData);
     if (result == 0)
+    {
+        uint64_t nowNs = clock->nowNs();
+        countFrame(pRangingData, nowNs);
+        if (recorder != nullptr)
+            recorder->record(nowNs, Dev, pRangingData, zoneCount);
         return true;
+    }
+
+    HID_VL53L5CX_Metrics::add(metrics->data()->framesCorrupted);
 
     lastError.lastErrorCode = SF_VL53L5CX_ERROR_TYPE::CANNOT_GET_RANGING_DATA;
     lastError.lastErrorValue = static_cast<uint32_t>(result);
-    SAFE_CALLBACK(errorCallback, lastError.lastErrorCode, lastError.lastErrorValue);
+    reportError();
     return false;
 }
 
+void HID_VL53L5CX::countFrame(const VL53L5CX_ResultsData *pRangingData, uint64_t nowNs)
+{
+    HID_VL53L5CX_MetricsBlock *block = metrics->data();
+    HID_VL53L5CX_Metrics::add(block->framesDelivered);
+
+    // the firmware counts 0..254, any gap is a frame nobody read
+    uint8_t streamCount = Dev->streamcount;
+    if ((lastStreamCount != 255) && (streamCount != 255))
+    {
+        uint32_t step = ((uint32_t)streamCount + 255 - lastStreamCount) % 255;
+        if (step > 1)
+            HID_VL53L5CX_Metrics::add(block->framesDropped, step - 1);
+    }
+    lastStreamCount = streamCount;
+
+    HID_VL53L5CX_Metrics::observe(block->pollsPerFrame, pollsSinceFrame);
+    pollsSinceFrame = 0;
+
+    // the frame got ready somewhere between the last empty poll and the first ready one
+    if ((readyPollNs != 0) && (readyPollNs <= nowNs))
+    {
+        uint64_t readyNs = readyPollNs;
+        if ((idlePollNs != 0) && (idlePollNs < readyPollNs))
+            readyNs -= (readyPollNs - idlePollNs) / 2;
+        HID_VL53L5CX_Metrics::observe(block->frameAgeUs, (nowNs - readyNs) / 1000);
+    }
+    idlePollNs = readyPollNs;
+    readyPollNs = 0;
+
+    metrics->setSiliconTemperature(pRangingData->silicon_temp_degc);
+}
+
 bool HID_VL53L5CX::setPowerMode(SF_VL53L5CX_POWER_MODE powerMode)
 {
     clearErrorStruct();
@@ -280,7 +494,7 @@ bool HID_VL53L5CX::setPowerMode(SF_VL53L5CX_POWER_MODE powerMode)
 
     lastError.lastErrorCode = SF_VL53L5CX_ERROR_TYPE::CANNOT_SET_POWER_MODE;
     lastError.lastErrorValue = static_cast<uint32_t>(result);
-    SAFE_CALLBACK(errorCallback, lastError.lastErrorCode, lastError.lastErrorValue);
+    reportError();
     return false;
 }
 
@@ -311,7 +525,7 @@ SF_VL53L5CX_POWER_MODE HID_VL53L5CX::getPowerMode()
 
     lastError.lastErrorCode = SF_VL53L5CX_ERROR_TYPE::CANNOT_GET_POWER_MODE;
     lastError.lastErrorValue = static_cast<uint32_t>(result);
-    SAFE_CALLBACK(errorCallback, lastError.lastErrorCode, lastError.lastErrorValue);
+    reportError();
     return SF_VL53L5CX_POWER_MODE::VL53_NO_ERROR;
 }
 
@@ -324,7 +538,7 @@ bool HID_VL53L5CX::setIntegrationTime(uint32_t timeMsec)
     {
         lastError.lastErrorCode = SF_VL53L5CX_ERROR_TYPE::INVALID_INTEGRATION_TIME;
         lastError.lastErrorValue = UNKNOWN_ERROR_VALUE;
-        SAFE_CALLBACK(errorCallback, lastError.lastErrorCode, lastError.lastErrorValue);
+        reportError();
         return false;
     }
 
@@ -335,7 +549,7 @@ bool HID_VL53L5CX::setIntegrationTime(uint32_t timeMsec)
 
     lastError.lastErrorCode = SF_VL53L5CX_ERROR_TYPE::CANNOT_SET_INTEGRATION_TIME;
     lastError.lastErrorValue = static_cast<uint32_t>(result);
-    SAFE_CALLBACK(errorCallback, lastError.lastErrorCode, lastError.lastErrorValue);
+    reportError();
     return false;
 }
 
@@ -352,7 +566,7 @@ uint32_t HID_VL53L5CX::getIntegrationTime()
 
     lastError.lastErrorCode = SF_VL53L5CX_ERROR_TYPE::CANNOT_GET_INTEGRATION_TIME;
     lastError.lastErrorValue = static_cast<uint32_t>(result);
-    SAFE_CALLBACK(errorCallback, lastError.lastErrorCode, lastError.lastErrorValue);
+    reportError();
     return result;
 }
 
@@ -364,7 +578,7 @@ bool HID_VL53L5CX::setSharpenerPercent(uint8_t percent)
     {
         lastError.lastErrorCode = SF_VL53L5CX_ERROR_TYPE::INVALID_SHARPENER_VALUE;
         lastError.lastErrorValue = UNKNOWN_ERROR_VALUE;
-        SAFE_CALLBACK(errorCallback, lastError.lastErrorCode, lastError.lastErrorValue);
+        reportError();
     }
 
     uint8_t result = vl53l5cx_set_sharpener_percent(Dev, percent);
@@ -374,7 +588,7 @@ bool HID_VL53L5CX::setSharpenerPercent(uint8_t percent)
 
     lastError.lastErrorCode = SF_VL53L5CX_ERROR_TYPE::CANNOT_SET_SHARPENER_VALUE;
     lastError.lastErrorValue = static_cast<uint32_t>(result);
-    SAFE_CALLBACK(errorCallback, lastError.lastErrorCode, lastError.lastErrorValue);
+    reportError();
     return false;
 }
 
@@ -390,7 +604,7 @@ uint8_t HID_VL53L5CX::getSharpenerPercent()
 
     lastError.lastErrorCode = SF_VL53L5CX_ERROR_TYPE::CANNOT_GET_SHARPENER_VALUE;
     lastError.lastErrorValue = static_cast<uint32_t>(result);
-    SAFE_CALLBACK(errorCallback, lastError.lastErrorCode, lastError.lastErrorValue);
+    reportError();
     return 0xff;
 }
 
@@ -411,7 +625,7 @@ bool HID_VL53L5CX::setTargetOrder(SF_VL53L5CX_TARGET_ORDER order)
 
     lastError.lastErrorCode = SF_VL53L5CX_ERROR_TYPE::CANNOT_SET_TARGET_ORDER;
     lastError.lastErrorValue = static_cast<uint32_t>(result);
-    SAFE_CALLBACK(errorCallback, lastError.lastErrorCode, lastError.lastErrorValue);
+    reportError();
     return false;
 }
 
@@ -432,6 +646,177 @@ SF_VL53L5CX_TARGET_ORDER HID_VL53L5CX::getTargetOrder()
 
     lastError.lastErrorCode = SF_VL53L5CX_ERROR_TYPE::CANNOT_GET_TARGET_ORDER;
     lastError.lastErrorValue = static_cast<uint32_t>(result);
-    SAFE_CALLBACK(errorCallback, lastError.lastErrorCode, lastError.lastErrorValue);
+    reportError();
     return SF_VL53L5CX_TARGET_ORDER::VL53_NO_ERROR;
 }
+
+bool HID_VL53L5CX::applyProfile(const HID_VL53L5CX_Profile &profile)
+{
+    bool wasRanging = ranging;
+    if (wasRanging && !stopRanging())
+        return false;
+
+    bool applied = ((profile.resolution == 0) || setResolution(profile.resolution))
+        && ((profile.rangingMode == SF_VL53L5CX_RANGING_MODE::VL53_NO_ERROR) || setRangingMode(profile.rangingMode))
+        && ((profile.frequencyHz == 0) || setRangingFrequency(profile.frequencyHz))
+        && ((profile.integrationTimeMs == 0) || setIntegrationTime(profile.integrationTimeMs))
+        && ((profile.sharpenerPercent == 0xff) || setSharpenerPercent(profile.sharpenerPercent))
+        && ((profile.targetOrder == SF_VL53L5CX_TARGET_ORDER::VL53_NO_ERROR) || setTargetOrder(profile.targetOrder));
+
+    // Keep the error of the setting that failed, not of the restart
+    HID_VL53L5CX_Error failure = lastError;
+    if (wasRanging && !startRanging())
+        return false;
+    if (!applied)
+        lastError = failure;
+    return applied;
+}
+
+bool HID_VL53L5CX::setDetectionThresholds(const VL53L5CX_DetectionThresholds *thresholds)
+{
+    bool wasRanging = ranging;
+    if (wasRanging && !stopRanging())
+        return false;
+
+    clearErrorStruct();
+    uint8_t result = 0;
+    if (thresholds != nullptr)
+    {
+        VL53L5CX_DetectionThresholds scaled[VL53L5CX_NB_THRESHOLDS];
+        memcpy(scaled, thresholds, sizeof(scaled));
+        result = vl53l5cx_set_detection_thresholds(Dev, scaled);
+    }
+    if (result == 0)
+        result = vl53l5cx_set_detection_thresholds_enable(Dev, (thresholds != nullptr) ? 1 : 0);
+
+    HID_VL53L5CX_Error failure = lastError;
+    if (result != 0)
+    {
+        failure.lastErrorCode = SF_VL53L5CX_ERROR_TYPE::CANNOT_SET_DETECTION_THRESHOLDS;
+        failure.lastErrorValue = static_cast<uint32_t>(result);
+        lastError = failure;
+        reportError();
+    }
+
+    // Keep the error of the thresholds, not of the restart
+    if (wasRanging && !startRanging())
+        return false;
+    lastError = failure;
+    return result == 0;
+}
+
+bool HID_VL53L5CX::setMotionIndicator(uint16_t minMm, uint16_t maxMm)
+{
+    bool wasRanging = ranging;
+    if (wasRanging && !stopRanging())
+        return false;
+
+    // init() sets the firmware defaults and the map of the current resolution
+    uint8_t resolution = getZoneCount();
+    clearErrorStruct();
+    uint8_t result = vl53l5cx_motion_indicator_init(Dev, &motionConfig, resolution);
+    if (result == 0)
+        result = vl53l5cx_motion_indicator_set_distance_motion(Dev, &motionConfig, minMm, maxMm);
+    motionIndicator = (result == 0);
+
+    HID_VL53L5CX_Error failure = lastError;
+    if (result != 0)
+    {
+        failure.lastErrorCode = SF_VL53L5CX_ERROR_TYPE::CANNOT_SET_MOTION_INDICATOR;
+        failure.lastErrorValue = static_cast<uint32_t>(result);
+        lastError = failure;
+        reportError();
+    }
+
+    // Keep the error of the motion indicator, not of the restart
+    if (wasRanging && !startRanging())
+        return false;
+    lastError = failure;
+    return result == 0;
+}
+
+bool HID_VL53L5CX::setInterrupt(bool enable)
+{
+    lastStreamCount = 255;
+    idlePollNs = 0;
+    readyPollNs = 0;
+    return VL53L5CX_i2c->setInterrupt(enable);
+}
+
+bool HID_VL53L5CX::interruptFired()
+{
+    if (!VL53L5CX_i2c->interruptFired())
+        return false;
+
+    // The frames before this one were skipped on purpose
+    lastStreamCount = 255;
+    idlePollNs = 0;
+    readyPollNs = 0;
+    return true;
+}
+
+bool HID_VL53L5CX::startRecording(const char *path, bool raw)
+{
+    clearErrorStruct();
+    stopRecording();
+
+    uint8_t resolution = getResolution();
+    uint8_t frequency = getRangingFrequency();
+    SF_VL53L5CX_RANGING_MODE mode = getRangingMode();
+    clearErrorStruct();
+
+    HID_VL53L5CX_SessionHeader header;
+    HID_VL53L5CX_Recorder::initHeader(header, Dev, resolution, frequency,
+        (mode == SF_VL53L5CX_RANGING_MODE::AUTONOMOUS) ? VL53L5CX_RANGING_MODE_AUTONOMOUS : VL53L5CX_RANGING_MODE_CONTINUOUS,
+        clock->nowNs());
+
+    try {
+        recorder = new HID_VL53L5CX_Recorder(path, header,
+            raw ? HID_VL53L5CX_RECORD_ENCODING::RAW : HID_VL53L5CX_RECORD_ENCODING::COMPACT);
+    }
+    catch (const std::exception &e) {
+        HID_VL53L5CX_LOG(FAILURE, "%s", e.what());
+        lastError.lastErrorCode = SF_VL53L5CX_ERROR_TYPE::CANNOT_START_RECORDING;
+        lastError.lastErrorValue = UNKNOWN_ERROR_VALUE;
+        reportError();
+        return false;
+    }
+    return true;
+}
+
+void HID_VL53L5CX::stopRecording()
+{
+    if (recorder == nullptr)
+        return;
+
+    recorder->close();
+    HID_VL53L5CX_LOG(INFO, "Recording closed: %llu frames, %llu dropped",
+        (unsigned long long)recorder->recordedCount(), (unsigned long long)recorder->droppedCount());
+    delete recorder;
+    recorder = nullptr;
+}
+
+uint64_t HID_VL53L5CX::getRecordedFrames()
+{
+    return (recorder != nullptr) ? recorder->recordedCount() : 0;
+}
+
+uint64_t HID_VL53L5CX::getDroppedFrames()
+{
+    return (recorder != nullptr) ? recorder->droppedCount() : 0;
+}
+
+const HID_VL53L5CX_MetricsBlock *HID_VL53L5CX::getMetrics()
+{
+    return metrics->data();
+}
+
+const char *HID_VL53L5CX::getMetricsName()
+{
+    return metrics->name();
+}
+
+void HID_VL53L5CX::countFrameCallback(uint64_t durationNs)
+{
+    HID_VL53L5CX_Metrics::observe(metrics->data()->frameCallbackUs, durationNs / 1000);
+}
@@ -25,8 +25,13 @@
 
 //#include "LibFT260.h"
 #include "HID_VL53L5CX_Constants.h"
-#include "HID_VL53L5CX_IO.h"
+#include "HID_VL53L5CX_Transport.h"
+#include "HID_VL53L5CX_Clock.h"
+#include "HID_VL53L5CX_Recorder.h"
+#include "HID_VL53L5CX_Metrics.h"
 #include "vl53l5cx_api.h"
+#include "vl53l5cx_plugin_detection_thresholds.h"
+#include "vl53l5cx_plugin_motion_indicator.h"
 
 struct HID_VL53L5CX_Error
 {
@@ -37,6 +42,20 @@ struct HID_VL53L5CX_Error
     uint32_t lastErrorValue = 0;
 };
 
+// Ranging configuration applied in one go by applyProfile().
+// Fields left at their default are not changed.
+struct HID_VL53L5CX_Profile
+{
+    uint8_t resolution = 0;                 // 16 (4x4) or 64 (8x8), 0 = unchanged
+    uint8_t frequencyHz = 0;                // 0 = unchanged
+    SF_VL53L5CX_RANGING_MODE rangingMode = SF_VL53L5CX_RANGING_MODE::VL53_NO_ERROR;
+    uint32_t integrationTimeMs = 0;         // autonomous mode only, 0 = unchanged
+    uint8_t sharpenerPercent = 0xff;        // 0..99, 0xff = unchanged
+    SF_VL53L5CX_TARGET_ORDER targetOrder = SF_VL53L5CX_TARGET_ORDER::VL53_NO_ERROR;
+};
+
+// Not thread safe, all methods share one ULD buffer and lastError. Threads that
+// share a sensor go through HID_VL53L5CX_AsyncSensor (HID_VL53L5CX_Async.h).
 class HID_VL53L5CX
 {
 private:
@@ -44,18 +63,84 @@ private:
     // Function must accept a SF_VL53L5CX_ERROR_TYPE as errorCode and an uint32_t as errorValue.
     void (*errorCallback)(SF_VL53L5CX_ERROR_TYPE errorCode, uint32_t errorValue) = nullptr;
 
-    // Clears the error struct to a no-error state.
+    // Error callback that also gets a pointer back, e.g. to the object owning the sensor.
+    void (*errorContextCallback)(SF_VL53L5CX_ERROR_TYPE errorCode, uint32_t errorValue, void *userData) = nullptr;
+    void *errorCallbackData = nullptr;
+
+    // Clears the error struct to a no-error state and starts the time budget of the
+    // public method calling it.
     void clearErrorStruct();
 
+    // Stores lastError as DEADLINE_EXCEEDED if the deadline cut the ULD call short,
+    // counts it in the metrics (driverErrors), then calls the error callbacks.
+    void reportError();
+
+    // Time budgets, 0 = none: every public method, frame reads in percent of the
+    // frame period, and the deadline of the innermost HID_VL53L5CX_DeadlineScope.
+    uint32_t operationTimeoutMs = 0;
+    uint32_t frameTimeoutPercent = 200;
+    uint32_t framePeriodUs = 0;         // 0 = frequency unknown
+    uint64_t scopeDeadlineNs = 0;
+
+    // Sets the platform deadline to budgetMs from now, or earlier if a scope says so.
+    void armDeadline(uint32_t budgetMs);
+
+    // Budget of isDataReady() and getRangingData().
+    uint32_t frameBudgetMs();
+
+    // Transport created (and owned) by the FT260 constructor, nullptr otherwise.
+    HID_VL53L5CX_Transport *ownedTransport = nullptr;
+
+    // Active recording session, nullptr when not recording.
+    HID_VL53L5CX_Recorder *recorder = nullptr;
+
+    // Shared memory metrics, created with the sensor.
+    HID_VL53L5CX_Metrics *metrics = nullptr;
+
+    // Data ready polls since the last delivered frame, time of the last poll
+    // that saw no data and of the first one that saw the next frame (0 = none yet).
+    uint32_t pollsSinceFrame = 0;
+    uint64_t idlePollNs = 0;
+    uint64_t readyPollNs = 0;
+
+    // Resolution last read from or written to the sensor, 0 = unknown.
+    uint8_t zoneCount = 0;
+
+    // True between a successful startRanging() and stopRanging().
+    bool ranging = false;
+
+    // Stream count of the last delivered frame, 255 after a start ranging.
+    uint8_t lastStreamCount = 255;
+
+    // Motion indicator settings, mapped again on every resolution change while
+    // motionIndicator is set.
+    VL53L5CX_Motion_Configuration motionConfig;
+    bool motionIndicator = false;
+
+    // Updates the frame metrics after getRangingData() read a frame.
+    void countFrame(const VL53L5CX_ResultsData *pRangingData, uint64_t nowNs);
+
+    // Checks the sensor is present and downloads the firmware if needed.
+    // throws an exception on error
+    void initSensor(HID_VL53L5CX_Transport *transport, HID_VL53L5CX_Clock *clock);
+
 public:
-    HID_VL53L5CX_IO VL53L5CX_i2c{ (DEFAULT_I2C_ADDR >> 1) };      // I2C driver object
-    VL53L5CX_Configuration *Dev;        // Sensor configuration struct
+    HID_VL53L5CX_Transport *VL53L5CX_i2c;   // I2C driver object
+    VL53L5CX_Configuration *Dev = nullptr;     // Sensor configuration struct
+    HID_VL53L5CX_Clock *clock;          // Time source for waits and timestamps
 
     // This struct holds the last error which happened (if any).
     HID_VL53L5CX_Error lastError;
 
+#ifdef HID_VL53L5CX_HAS_FT260
     // Constructor: opens USB connection and initializes the sensor
-    HID_VL53L5CX(uint8_t address = (DEFAULT_I2C_ADDR >> 1));
+    // If no clock is given the high resolution system clock is used.
+    HID_VL53L5CX(uint8_t address = (DEFAULT_I2C_ADDR >> 1), HID_VL53L5CX_Clock *clock = nullptr);
+#endif
+
+    // Constructor: initializes the sensor behind an existing transport (simulated
+    // or replayed sensors). The transport is not owned and must outlive this object.
+    HID_VL53L5CX(HID_VL53L5CX_Transport *transport, HID_VL53L5CX_Clock *clock = nullptr);
 
     // destructor needs to free the platform structure and clean up.
     ~HID_VL53L5CX();
@@ -63,6 +148,27 @@ public:
     // Set the error callback function.
     void setErrorCallback(void (*errorCallback)(SF_VL53L5CX_ERROR_TYPE errorCode, uint32_t errorValue));
 
+    // Set an error callback that gets userData back. Error callbacks are called from inside
+    // the failing method and must not throw; the method returns false after them anyway.
+    void setErrorCallback(void (*errorCallback)(SF_VL53L5CX_ERROR_TYPE errorCode, uint32_t errorValue, void *userData),
+        void *userData);
+
+    // Time budget of every method, on the sensor clock. A bus access does not start after it
+    // and ULD polling gives up at it, the method then fails with DEADLINE_EXCEEDED. 0 (the
+    // default) leaves the ULD budgets, also on the sensor clock: 2 s per DCI command, 5 s of
+    // polling to stop ranging. The bus accesses after the polling add to that, on a wedged
+    // bus stopRanging() fails after 5.2 s (tof_sim, "stopRanging (ULD budgets)").
+    void setOperationTimeout(uint32_t timeoutMs);
+
+    // Budget of isDataReady() and getRangingData() while ranging, in percent of the frame
+    // period (200 by default, 0 = the operation timeout). The shorter of both applies.
+    void setFrameTimeout(uint32_t percentOfFramePeriod);
+
+    // Used by HID_VL53L5CX_DeadlineScope: limits all calls to timeoutMs from now, returns
+    // the deadline to restore.
+    uint64_t pushDeadline(uint32_t timeoutMs);
+    void popDeadline(uint64_t previousNs);
+
     // Returns true if the sensor's sampling frequency was changed accordingly or false otherwise.
     // If this function returns false an error entry will be stored in the lastError struct.
     bool setRangingFrequency(uint8_t newFrequency);
@@ -86,9 +192,43 @@ public:
     // If this function returns false an error entry will be stored in the lastError struct.
     bool stopRanging();
 
+    // Returns true if the sensor is ranging.
+    bool isRanging() const { return ranging; }
+
+    // Returns true if every setting of the profile was applied or false otherwise.
+    // Resolution goes first since it limits the frequency. If the sensor is ranging it is
+    // stopped for the change and started again, also when a setting failed.
+    // If this function returns false an error entry will be stored in the lastError struct.
+    bool applyProfile(const HID_VL53L5CX_Profile &profile);
+
     // Returns true if data is ready.
     bool isDataReady();
 
+    // Returns true if the detection thresholds were programmed or false otherwise.
+    // thresholds holds VL53L5CX_NB_THRESHOLDS checkers in user units (it is copied, the
+    // ULD scales them in place), the last one with VL53L5CX_LAST_THRESHOLD in zone_num.
+    // INT then only fires for frames that meet them. nullptr disables the thresholds,
+    // INT fires for every frame again. If the sensor is ranging it is stopped for the
+    // change and started again.
+    // If this function returns false an error entry will be stored in the lastError struct.
+    bool setDetectionThresholds(const VL53L5CX_DetectionThresholds *thresholds);
+
+    // Returns true if the motion indicator was programmed or false otherwise. The firmware
+    // then scores the motion between minMm and maxMm (400 to 4000 mm, at most 1500 mm
+    // apart) per aggregate of zones in the motion_indicator block of every frame. The
+    // zone to aggregate map follows later resolution changes. If the sensor is ranging
+    // it is stopped for the change and started again.
+    // If this function returns false an error entry will be stored in the lastError struct.
+    bool setMotionIndicator(uint16_t minMm, uint16_t maxMm);
+
+    // Arms the host side latch of the sensor INT line, see HID_VL53L5CX_Transport. False
+    // if the transport cannot see INT. Frames left unread while waiting for INT do not
+    // count as dropped.
+    bool setInterrupt(bool enable);
+
+    // True if INT fired since the last call, no I2C transaction.
+    bool interruptFired();
+
     // Returns the current ranging resolution.
     uint8_t getResolution();
 
@@ -96,6 +236,10 @@ public:
     // If this function returns false an error entry will be stored in the lastError struct.
     bool setResolution(uint8_t resolution);
 
+    // Returns the current ranging resolution without reading it from the sensor, unless it
+    // is not known yet. If this function returns 0 an error entry will be stored in the lastError struct.
+    uint8_t getZoneCount();
+
     // Returns true if the ranging data was read from the sensor or false otherwise.
     // Data will be stored in the VL53L5CX_ResultsData struct passed as a pointer.
     // If this function returns false an error entry will be stored in the lastError struct.
@@ -133,5 +277,47 @@ public:
     // If this function returns SF_VL53L5CX_TARGET_ORDER::ERROR an error entry will be stored in the lastError struct.
     SF_VL53L5CX_TARGET_ORDER getTargetOrder();
 
+    // Returns true if a recording file was created or false otherwise.
+    // Every frame returned by getRangingData() is then appended to the file, raw (as read
+    // from the sensor, can be replayed) or compact (distance, sigma and status only).
+    // Any previous recording is closed first.
+    // If this function returns false an error entry will be stored in the lastError struct.
+    bool startRecording(const char *path, bool raw = true);
+
+    // Flushes and closes the current recording, if any.
+    void stopRecording();
+
+    // Frames recorded and frames dropped because the writer could not keep up.
+    uint64_t getRecordedFrames();
+    uint64_t getDroppedFrames();
+
+    // Counters published in shared memory, see HID_VL53L5CX_Metrics.h.
+    const HID_VL53L5CX_MetricsBlock *getMetrics();
+
+    // Name of the shared memory segment, empty if it could not be created.
+    const char *getMetricsName();
+
+    // Counts the time spent in one frame callback, see HID_VL53L5CX_Stream.h.
+    void countFrameCallback(uint64_t durationNs);
+
+};
+
+// Limits every call on the sensor while it exists to timeoutMs from now, on top of
+// the operation and frame budgets, e.g. for a controller with a hard decision budget.
+// Scopes nest, the earliest deadline wins.
+class HID_VL53L5CX_DeadlineScope
+{
+private:
+    HID_VL53L5CX *sensor;
+    uint64_t previousNs;
+
+public:
+    HID_VL53L5CX_DeadlineScope(HID_VL53L5CX *_sensor, uint32_t timeoutMs)
+        : sensor(_sensor), previousNs(_sensor->pushDeadline(timeoutMs)) {}
+    ~HID_VL53L5CX_DeadlineScope() { sensor->popDeadline(previousNs); }
+
+    HID_VL53L5CX_DeadlineScope(const HID_VL53L5CX_DeadlineScope&) = delete;
+    HID_VL53L5CX_DeadlineScope& operator=(const HID_VL53L5CX_DeadlineScope&) = delete;
 };
+
 #endif
\ No newline at end of file
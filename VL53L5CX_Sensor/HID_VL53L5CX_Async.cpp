@@ -0,0 +1,567 @@
+/*
+  This file implements the asynchronous sensor facade.
+*/
+
+#include "pch.h" // use stdafx.h in Visual Studio 2017 and earlier
+#include "HID_VL53L5CX_Async.h"
+#include "HID_VL53L5CX_Log.h"
+#include "HID_VL53L5CX_Stream.h"
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+static uint64_t wallNowNs()
+{
+    return HID_VL53L5CX_Clock::systemClock()->nowNs();
+}
+
+// Milliseconds left until deadlineNs (system clock), at least 1 so a scope never starts expired
+static uint32_t msUntil(uint64_t deadlineNs)
+{
+    uint64_t nowNs = wallNowNs();
+    return (nowNs < deadlineNs) ? (uint32_t)((deadlineNs - nowNs + 999999) / 1000000) : 1;
+}
+
+bool HID_VL53L5CX_AsyncState::complete(HID_VL53L5CX_ASYNC_STATUS result, const HID_VL53L5CX_Error &failure)
+{
+    std::function<void()> next;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (status != HID_VL53L5CX_ASYNC_STATUS::PENDING)
+            return false;
+        status = result;
+        error = failure;
+        next.swap(continuation);
+    }
+    done.notify_all();
+
+    if (dispatcher != nullptr)
+        dispatcher->completed(this, std::move(next));
+    else if (next)
+        next();
+    return true;
+}
+
+HID_VL53L5CX_ASYNC_STATUS HID_VL53L5CX_AsyncState::getStatus() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return status;
+}
+
+HID_VL53L5CX_Error HID_VL53L5CX_AsyncState::getError() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return error;
+}
+
+bool HID_VL53L5CX_AsyncState::expire()
+{
+    if ((deadlineNs != UINT64_MAX) && (wallNowNs() >= deadlineNs))
+        complete(HID_VL53L5CX_ASYNC_STATUS::TIMED_OUT);
+    return !pending();
+}
+
+HID_VL53L5CX_ASYNC_STATUS HID_VL53L5CX_AsyncState::wait()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    while (status == HID_VL53L5CX_ASYNC_STATUS::PENDING)
+    {
+        if (deadlineNs == UINT64_MAX)
+        {
+            done.wait(guard);
+            continue;
+        }
+
+        uint64_t nowNs = wallNowNs();
+        if (nowNs >= deadlineNs)
+        {
+            guard.unlock();
+            complete(HID_VL53L5CX_ASYNC_STATUS::TIMED_OUT);
+            guard.lock();
+            continue;
+        }
+        done.wait_for(guard, std::chrono::nanoseconds(deadlineNs - nowNs));
+    }
+    return status;
+}
+
+void HID_VL53L5CX_AsyncState::then(std::function<void()> fn)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (status == HID_VL53L5CX_ASYNC_STATUS::PENDING)
+        {
+            continuation = std::move(fn);
+            return;
+        }
+    }
+
+    if (dispatcher != nullptr)
+        dispatcher->post(std::move(fn));
+    else
+        fn();
+}
+
+HID_VL53L5CX_CancelToken HID_VL53L5CX_CancelToken::create()
+{
+    HID_VL53L5CX_CancelToken token;
+    token.shared = std::make_shared<Shared>();
+    return token;
+}
+
+void HID_VL53L5CX_CancelToken::cancel()
+{
+    if (!shared)
+        return;
+
+    std::vector<std::weak_ptr<HID_VL53L5CX_AsyncState>> states;
+    {
+        std::lock_guard<std::mutex> guard(shared->lock);
+        shared->cancelled = true;
+        states.swap(shared->states);
+    }
+
+    // Outside the lock, continuations may issue new operations with this token
+    for (std::weak_ptr<HID_VL53L5CX_AsyncState> &weak : states)
+    {
+        std::shared_ptr<HID_VL53L5CX_AsyncState> state = weak.lock();
+        if (state)
+            state->complete(HID_VL53L5CX_ASYNC_STATUS::CANCELLED);
+    }
+}
+
+bool HID_VL53L5CX_CancelToken::cancelled() const
+{
+    if (!shared)
+        return false;
+    std::lock_guard<std::mutex> guard(shared->lock);
+    return shared->cancelled;
+}
+
+void HID_VL53L5CX_CancelToken::attach(const std::shared_ptr<HID_VL53L5CX_AsyncState> &state)
+{
+    if (!shared)
+        return;
+
+    {
+        std::lock_guard<std::mutex> guard(shared->lock);
+        if (!shared->cancelled)
+        {
+            // Operations already completed need no cancelling
+            shared->states.erase(std::remove_if(shared->states.begin(), shared->states.end(),
+                [](const std::weak_ptr<HID_VL53L5CX_AsyncState> &weak) { return weak.expired(); }),
+                shared->states.end());
+            shared->states.push_back(state);
+            return;
+        }
+    }
+    state->complete(HID_VL53L5CX_ASYNC_STATUS::CANCELLED);
+}
+
+void HID_VL53L5CX_Dispatcher::post(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        jobs.push_back(std::move(job));
+    }
+    wake.notify_one();
+}
+
+void HID_VL53L5CX_Dispatcher::watch(const std::shared_ptr<HID_VL53L5CX_AsyncState> &state)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        watched.push_back(state);
+    }
+    wake.notify_one();
+}
+
+void HID_VL53L5CX_Dispatcher::completed(HID_VL53L5CX_AsyncState *state, std::function<void()> continuation)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (size_t i = 0; i < watched.size(); i++)
+        {
+            if (watched[i].get() == state)
+            {
+                watched[i] = watched.back();
+                watched.pop_back();
+                break;
+            }
+        }
+        if (continuation)
+            jobs.push_back(std::move(continuation));
+    }
+    wake.notify_one();
+}
+
+size_t HID_VL53L5CX_Dispatcher::runUntil(uint64_t endNs, bool idleExit)
+{
+    size_t ran = 0;
+    std::vector<std::shared_ptr<HID_VL53L5CX_AsyncState>> expired;
+    std::unique_lock<std::mutex> guard(lock);
+    for (;;)
+    {
+        if (stopped)
+        {
+            stopped = false;
+            break;
+        }
+
+        if (!jobs.empty())
+        {
+            std::function<void()> job = std::move(jobs.front());
+            jobs.pop_front();
+            guard.unlock();
+            job();
+            ran++;
+            guard.lock();
+            continue;
+        }
+
+        // Deadlines, the earliest one left decides how long to sleep
+        uint64_t nowNs = wallNowNs();
+        uint64_t wakeNs = endNs;
+        for (const std::shared_ptr<HID_VL53L5CX_AsyncState> &state : watched)
+        {
+            if (state->deadlineNs <= nowNs)
+                expired.push_back(state);
+            else if (state->deadlineNs < wakeNs)
+                wakeNs = state->deadlineNs;
+        }
+        if (!expired.empty())
+        {
+            guard.unlock();
+            for (std::shared_ptr<HID_VL53L5CX_AsyncState> &state : expired)
+                state->expire();
+            expired.clear();
+            guard.lock();
+            continue;
+        }
+
+        if ((idleExit && watched.empty()) || (nowNs >= endNs))
+            break;
+        if (wakeNs == UINT64_MAX)
+            wake.wait(guard);
+        else
+            wake.wait_for(guard, std::chrono::nanoseconds(wakeNs - nowNs));
+    }
+    return ran;
+}
+
+size_t HID_VL53L5CX_Dispatcher::run()
+{
+    return runUntil(UINT64_MAX, false);
+}
+
+size_t HID_VL53L5CX_Dispatcher::runFor(uint32_t timeoutMs)
+{
+    return runUntil(wallNowNs() + (uint64_t)timeoutMs * 1000000, false);
+}
+
+size_t HID_VL53L5CX_Dispatcher::runUntilIdle()
+{
+    return runUntil(UINT64_MAX, true);
+}
+
+void HID_VL53L5CX_Dispatcher::stop()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopped = true;
+    }
+    wake.notify_all();
+}
+
+HID_VL53L5CX_AsyncSensor::HID_VL53L5CX_AsyncSensor(Opener open, HID_VL53L5CX_Dispatcher *_dispatcher, uint32_t _pollMs)
+    : opener(std::move(open)), dispatcher(_dispatcher), pollMs(_pollMs)
+{
+    io = std::thread(&HID_VL53L5CX_AsyncSensor::ioLoop, this);
+}
+
+HID_VL53L5CX_AsyncSensor::~HID_VL53L5CX_AsyncSensor()
+{
+    std::vector<std::shared_ptr<HID_VL53L5CX_AsyncState>> cancelled;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+        for (std::deque<Job> &queue : commands)
+        {
+            for (Job &job : queue)
+                cancelled.push_back(job.state);
+            queue.clear();
+        }
+        cancelled.insert(cancelled.end(), frameWaiters.begin(), frameWaiters.end());
+        frameWaiters.clear();
+        if (current)
+            cancelled.push_back(current);
+    }
+    wake.notify_one();
+
+    for (std::shared_ptr<HID_VL53L5CX_AsyncState> &state : cancelled)
+        state->complete(HID_VL53L5CX_ASYNC_STATUS::CANCELLED);
+
+    io.join();
+    delete sensor;
+}
+
+uint64_t HID_VL53L5CX_AsyncSensor::deadline(uint32_t timeoutMs)
+{
+    return (timeoutMs == 0) ? UINT64_MAX : wallNowNs() + (uint64_t)timeoutMs * 1000000;
+}
+
+void HID_VL53L5CX_AsyncSensor::enqueue(const std::shared_ptr<HID_VL53L5CX_AsyncState> &state,
+    HID_VL53L5CX_CancelToken &cancel, HID_VL53L5CX_ASYNC_PRIORITY priority, std::function<void()> run)
+{
+    if (dispatcher != nullptr)
+        dispatcher->watch(state);
+    cancel.attach(state);
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!stopping)
+        {
+            commands[(int)priority].push_back({ state, std::move(run) });
+            wake.notify_one();
+            return;
+        }
+    }
+    state->complete(HID_VL53L5CX_ASYNC_STATUS::CANCELLED);
+}
+
+static HID_VL53L5CX_Error notInitialized()
+{
+    HID_VL53L5CX_Error failure;
+    failure.lastErrorCode = SF_VL53L5CX_ERROR_TYPE::DEVICE_NOT_ALIVE;
+    return failure;
+}
+
+void HID_VL53L5CX_AsyncSensor::ioLoop()
+{
+    VL53L5CX_Frame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.version = VL53L5CX_FRAME_VERSION;
+    frame.size = sizeof(VL53L5CX_Frame);
+
+    std::vector<FrameState> waiters;
+    for (;;)
+    {
+        // States are only completed outside the lock, their continuation may issue new operations
+        Job job;
+        bool commandQueued;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            current = nullptr;
+            wake.wait(guard, [this]() {
+                return stopping || !frameWaiters.empty() || !commands[0].empty() || !commands[1].empty();
+            });
+            if (stopping)
+                return;
+
+            // Timed out or cancelled waiters are dropped here
+            frameWaiters.erase(std::remove_if(frameWaiters.begin(), frameWaiters.end(),
+                [](const FrameState &waiter) { return !waiter->pending(); }), frameWaiters.end());
+            waiters = frameWaiters;
+
+            std::deque<Job> &queue = commands[0].empty() ? commands[1] : commands[0];
+            if (!queue.empty())
+            {
+                job = std::move(queue.front());
+                queue.pop_front();
+                current = job.state;
+            }
+            commandQueued = !commands[0].empty() || !commands[1].empty();
+        }
+
+        // Frame reads first, then one command
+        bool busy = !waiters.empty() && pollFrame(waiters, frame, job.run || commandQueued);
+
+        // A command that timed out or was cancelled while queued is skipped
+        if (job.run && !job.state->expire())
+        {
+            job.run();
+            busy = true;
+        }
+        waiters.clear();
+
+        if (!busy && !commandQueued)
+            idle();
+    }
+}
+
+bool HID_VL53L5CX_AsyncSensor::pollFrame(const std::vector<FrameState> &waiters, VL53L5CX_Frame &frame,
+    bool commandQueued)
+{
+    bool pending = false;
+    uint64_t deadlineNs = UINT64_MAX;
+    for (const FrameState &waiter : waiters)
+    {
+        if (!waiter->expire())
+        {
+            pending = true;
+            if (waiter->deadlineNs < deadlineNs)
+                deadlineNs = waiter->deadlineNs;
+        }
+    }
+    if (!pending)
+        return true;
+
+    // Without a sensor nothing but a queued init() can deliver a frame
+    if (sensor == nullptr)
+    {
+        if (commandQueued)
+            return false;
+        for (const FrameState &waiter : waiters)
+            waiter->complete(HID_VL53L5CX_ASYNC_STATUS::FAILED, notInitialized());
+        return true;
+    }
+
+    // The frame budget of the sensor applies too, the shorter one wins. Nothing on the
+    // frame path throws, failures end up in lastError.
+    int32_t result;
+    if (deadlineNs == UINT64_MAX)
+        result = HID_VL53L5CX_Stream::readFrame(sensor, &frame);
+    else
+    {
+        HID_VL53L5CX_DeadlineScope scope(sensor, msUntil(deadlineNs));
+        result = HID_VL53L5CX_Stream::readFrame(sensor, &frame);
+    }
+    if (result == VL53L5CX_FRAME_NOT_READY)
+        return false;
+
+    // One frame for everybody waiting, the value is only read once DONE
+    HID_VL53L5CX_Error failure = sensor->lastError;
+    for (const FrameState &waiter : waiters)
+    {
+        if (result == VL53L5CX_FRAME_READY)
+        {
+            waiter->value = frame;
+            waiter->complete(HID_VL53L5CX_ASYNC_STATUS::DONE);
+        }
+        else
+            waiter->complete(HID_VL53L5CX_ASYNC_STATUS::FAILED, failure);
+    }
+    return true;
+}
+
+void HID_VL53L5CX_AsyncSensor::idle()
+{
+    // A virtual clock only moves when slept on
+    if ((sensor != nullptr) && (sensor->clock != HID_VL53L5CX_Clock::systemClock()))
+    {
+        sensor->clock->sleepMs(pollMs);
+        return;
+    }
+
+    std::unique_lock<std::mutex> guard(lock);
+    wake.wait_for(guard, std::chrono::milliseconds(pollMs),
+        [this]() { return stopping || !commands[0].empty() || !commands[1].empty(); });
+}
+
+bool HID_VL53L5CX_AsyncSensor::execute(const std::function<void(HID_VL53L5CX*)> &op, uint64_t deadlineNs,
+    HID_VL53L5CX_Error &failure)
+{
+    if (sensor == nullptr)
+    {
+        failure = notInitialized();
+        return false;
+    }
+
+    try {
+        if (deadlineNs == UINT64_MAX)
+            op(sensor);
+        else
+        {
+            HID_VL53L5CX_DeadlineScope scope(sensor, msUntil(deadlineNs));
+            op(sensor);
+        }
+        failure = sensor->lastError;
+    }
+    catch (const std::exception &e) {
+        // op comes from call() and may be anything, init() for one throws. Nobody would
+        // catch it on this thread
+        HID_VL53L5CX_LOG(FAILURE, "Async operation: %s", e.what());
+        failure = sensor->lastError;
+        if (failure.lastErrorCode == SF_VL53L5CX_ERROR_TYPE::VL53_NO_ERROR)
+            failure.lastErrorCode = SF_VL53L5CX_ERROR_TYPE::UNKNOWN_ERROR;
+    }
+    return failure.lastErrorCode == SF_VL53L5CX_ERROR_TYPE::VL53_NO_ERROR;
+}
+
+HID_VL53L5CX_Future<bool> HID_VL53L5CX_AsyncSensor::submit(uint32_t timeoutMs, HID_VL53L5CX_CancelToken cancel,
+    std::function<bool(HID_VL53L5CX*)> op)
+{
+    std::shared_ptr<HID_VL53L5CX_AsyncResult<bool>> state =
+        std::make_shared<HID_VL53L5CX_AsyncResult<bool>>(deadline(timeoutMs), dispatcher);
+
+    enqueue(state, cancel, HID_VL53L5CX_ASYNC_PRIORITY::NORMAL, [this, state, op]() {
+        HID_VL53L5CX_Error failure;
+        bool ok = execute([&state, &op](HID_VL53L5CX *s) { state->value = op(s); }, state->deadlineNs, failure)
+            && state->value;
+        if (!ok && (failure.lastErrorCode == SF_VL53L5CX_ERROR_TYPE::VL53_NO_ERROR))
+            failure.lastErrorCode = SF_VL53L5CX_ERROR_TYPE::UNKNOWN_ERROR;
+        state->complete(ok ? HID_VL53L5CX_ASYNC_STATUS::DONE : HID_VL53L5CX_ASYNC_STATUS::FAILED, failure);
+    });
+    return HID_VL53L5CX_Future<bool>(state);
+}
+
+HID_VL53L5CX_Future<bool> HID_VL53L5CX_AsyncSensor::init(uint32_t timeoutMs, HID_VL53L5CX_CancelToken cancel)
+{
+    std::shared_ptr<HID_VL53L5CX_AsyncResult<bool>> state =
+        std::make_shared<HID_VL53L5CX_AsyncResult<bool>>(deadline(timeoutMs), dispatcher);
+
+    enqueue(state, cancel, HID_VL53L5CX_ASYNC_PRIORITY::NORMAL, [this, state]() {
+        if (sensor == nullptr)
+        {
+            try {
+                sensor = opener();
+            }
+            catch (const std::exception &e) {
+                HID_VL53L5CX_LOG(FAILURE, "Async init: %s", e.what());
+            }
+        }
+
+        HID_VL53L5CX_Error failure;
+        if (sensor == nullptr)
+            failure.lastErrorCode = SF_VL53L5CX_ERROR_TYPE::DEVICE_INITIALIZATION_ERROR;
+        state->value = (sensor != nullptr);
+        state->complete(state->value ? HID_VL53L5CX_ASYNC_STATUS::DONE : HID_VL53L5CX_ASYNC_STATUS::FAILED, failure);
+    });
+    return HID_VL53L5CX_Future<bool>(state);
+}
+
+HID_VL53L5CX_Future<bool> HID_VL53L5CX_AsyncSensor::applyProfile(const HID_VL53L5CX_Profile &profile, uint32_t timeoutMs,
+    HID_VL53L5CX_CancelToken cancel)
+{
+    return submit(timeoutMs, cancel, [profile](HID_VL53L5CX *s) { return s->applyProfile(profile); });
+}
+
+HID_VL53L5CX_Future<bool> HID_VL53L5CX_AsyncSensor::start(uint32_t timeoutMs, HID_VL53L5CX_CancelToken cancel)
+{
+    return submit(timeoutMs, cancel, [](HID_VL53L5CX *s) { return s->startRanging(); });
+}
+
+HID_VL53L5CX_Future<bool> HID_VL53L5CX_AsyncSensor::stop(uint32_t timeoutMs, HID_VL53L5CX_CancelToken cancel)
+{
+    return submit(timeoutMs, cancel, [](HID_VL53L5CX *s) { return s->stopRanging(); });
+}
+
+HID_VL53L5CX_Future<VL53L5CX_Frame> HID_VL53L5CX_AsyncSensor::nextFrame(uint32_t timeoutMs, HID_VL53L5CX_CancelToken cancel)
+{
+    FrameState state = std::make_shared<HID_VL53L5CX_AsyncResult<VL53L5CX_Frame>>(deadline(timeoutMs), dispatcher);
+    if (dispatcher != nullptr)
+        dispatcher->watch(state);
+    cancel.attach(state);
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!stopping)
+        {
+            frameWaiters.push_back(state);
+            wake.notify_one();
+            return HID_VL53L5CX_Future<VL53L5CX_Frame>(state);
+        }
+    }
+    state->complete(HID_VL53L5CX_ASYNC_STATUS::CANCELLED);
+    return HID_VL53L5CX_Future<VL53L5CX_Frame>(state);
+}
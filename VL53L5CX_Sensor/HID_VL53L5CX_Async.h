@@ -0,0 +1,341 @@
+#pragma once
+/*
+  This file declares the asynchronous sensor facade.
+
+  HID_VL53L5CX_AsyncSensor runs every operation on an I/O thread of its own
+  and returns a HID_VL53L5CX_Future right away, so a controller thread never
+  blocks on the ULD polling sleeps, a firmware download or a slow FT260
+  read. The I/O thread is the only caller of the HID_VL53L5CX, which shares
+  one ULD buffer and one lastError between all its methods, so any number of
+  application threads can use one sensor through it without a lock held
+  across multi-millisecond DCI commands.
+
+  Frame reads come first: while a nextFrame() is waiting the I/O thread
+  polls the sensor between two commands, and a frame completes every
+  nextFrame() waiting for it. Commands run one at a time in the order they
+  were issued, HIGH priority ones ahead of NORMAL ones.
+
+  Every operation takes a timeout and an optional cancellation token. The
+  future completes with TIMED_OUT or CANCELLED as soon as either happens,
+  even if the I/O thread is still busy with it. The timeout also goes down
+  to the bus (HID_VL53L5CX_DeadlineScope), so the ULD call in progress gives
+  up at the same time instead of after its own budget of seconds; an
+  operation that has not started yet is skipped. A cancellation only takes
+  effect between two ULD calls.
+
+  Completions are delivered on a HID_VL53L5CX_Dispatcher, the run loop of
+  the controller thread. Several sensors (and any other work posted to it)
+  share one dispatcher, which is how one thread multiplexes them. Without a
+  dispatcher continuations run on the thread that completes the future.
+
+  With C++20 a future can be co_await'ed from a HID_VL53L5CX_Coroutine; the
+  coroutine resumes on the dispatcher. The rest only needs C++14.
+*/
+
+#ifndef __HID_VL53L5CX_Async__
+#define __HID_VL53L5CX_Async__
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "HID_VL53L5CX.h"
+#include "VL53L5CXSensor.h"
+
+#if defined(__cpp_impl_coroutine) && (__cpp_impl_coroutine >= 201902L)
+#include <coroutine>
+#define HID_VL53L5CX_HAS_COROUTINES
+#endif
+
+enum class HID_VL53L5CX_ASYNC_STATUS : uint8_t
+{
+    PENDING = 0,
+    DONE = 1,           // completed, value() holds the result
+    FAILED = 2,         // the sensor reported an error, see error()
+    TIMED_OUT = 3,      // the timeout expired first
+    CANCELLED = 4       // the cancellation token was triggered first
+};
+
+enum class HID_VL53L5CX_ASYNC_PRIORITY : uint8_t
+{
+    HIGH = 0,           // short reads that should not wait behind configuration
+    NORMAL = 1          // configuration and everything else
+};
+
+class HID_VL53L5CX_Dispatcher;
+
+// Completion state shared by a future, the I/O thread and the dispatcher.
+// The first complete() wins, later ones are ignored.
+class HID_VL53L5CX_AsyncState
+{
+private:
+    mutable std::mutex lock;
+    std::condition_variable done;
+    HID_VL53L5CX_ASYNC_STATUS status = HID_VL53L5CX_ASYNC_STATUS::PENDING;
+    HID_VL53L5CX_Error error;
+    std::function<void()> continuation;
+
+public:
+    const uint64_t deadlineNs;          // system clock, UINT64_MAX = none
+    HID_VL53L5CX_Dispatcher *const dispatcher;
+
+    HID_VL53L5CX_AsyncState(uint64_t _deadlineNs, HID_VL53L5CX_Dispatcher *_dispatcher)
+        : deadlineNs(_deadlineNs), dispatcher(_dispatcher) {}
+    virtual ~HID_VL53L5CX_AsyncState() {}
+
+    // Returns false if the state was already complete.
+    bool complete(HID_VL53L5CX_ASYNC_STATUS result, const HID_VL53L5CX_Error &failure = HID_VL53L5CX_Error());
+
+    HID_VL53L5CX_ASYNC_STATUS getStatus() const;
+    HID_VL53L5CX_Error getError() const;
+    bool pending() const { return getStatus() == HID_VL53L5CX_ASYNC_STATUS::PENDING; }
+
+    // Completes with TIMED_OUT if the deadline passed, returns true if no longer pending.
+    bool expire();
+
+    // Blocks until complete, completing with TIMED_OUT at the deadline.
+    HID_VL53L5CX_ASYNC_STATUS wait();
+
+    // Runs fn (on the dispatcher if any) once complete, right away if it already is.
+    // Only one continuation per state.
+    void then(std::function<void()> fn);
+};
+
+template <typename T>
+class HID_VL53L5CX_AsyncResult : public HID_VL53L5CX_AsyncState
+{
+public:
+    T value;                    // written by the I/O thread before complete(DONE)
+
+    HID_VL53L5CX_AsyncResult(uint64_t deadlineNs, HID_VL53L5CX_Dispatcher *dispatcher)
+        : HID_VL53L5CX_AsyncState(deadlineNs, dispatcher), value() {}
+};
+
+// Cancels every operation it was passed to. A default constructed token
+// cannot be cancelled, create() makes one that can. Copies share the state.
+class HID_VL53L5CX_CancelToken
+{
+private:
+    struct Shared
+    {
+        std::mutex lock;
+        bool cancelled = false;
+        std::vector<std::weak_ptr<HID_VL53L5CX_AsyncState>> states;
+    };
+    std::shared_ptr<Shared> shared;
+
+public:
+    static HID_VL53L5CX_CancelToken create();
+
+    // Completes every pending operation of this token with CANCELLED, and any
+    // operation issued with it afterwards.
+    void cancel();
+    bool cancelled() const;
+
+    // Links an operation to the token, completes it right away if already cancelled.
+    void attach(const std::shared_ptr<HID_VL53L5CX_AsyncState> &state);
+};
+
+// Result of an asynchronous operation, a cheap shared handle.
+template <typename T>
+class HID_VL53L5CX_Future
+{
+private:
+    std::shared_ptr<HID_VL53L5CX_AsyncResult<T>> state;
+
+public:
+    explicit HID_VL53L5CX_Future(std::shared_ptr<HID_VL53L5CX_AsyncResult<T>> _state) : state(std::move(_state)) {}
+
+    HID_VL53L5CX_ASYNC_STATUS status() const { return state->getStatus(); }
+    bool ready() const { return !state->pending(); }
+    bool ok() const { return status() == HID_VL53L5CX_ASYNC_STATUS::DONE; }
+
+    // Blocks the calling thread until complete or timed out. Not on the dispatcher thread
+    // if the operation relies on it for its deadline.
+    HID_VL53L5CX_ASYNC_STATUS wait() const { return state->wait(); }
+
+    // Result, only meaningful when status() is DONE.
+    const T &value() const { return state->value; }
+
+    // Error reported by the sensor when status() is FAILED.
+    HID_VL53L5CX_Error error() const { return state->getError(); }
+
+    // Gives up on this operation only.
+    void cancel() { state->complete(HID_VL53L5CX_ASYNC_STATUS::CANCELLED); }
+
+    // Calls fn(*this) once complete, on the dispatcher if the sensor has one.
+    void then(std::function<void(const HID_VL53L5CX_Future<T>&)> fn) const
+    {
+        HID_VL53L5CX_Future<T> self = *this;
+        state->then([self, fn]() { fn(self); });
+    }
+
+#ifdef HID_VL53L5CX_HAS_COROUTINES
+    bool await_ready() const { return ready(); }
+    void await_suspend(std::coroutine_handle<> coroutine) const
+    {
+        // Without a dispatcher the coroutine may resume, and destroy this awaiter, inside then()
+        std::shared_ptr<HID_VL53L5CX_AsyncResult<T>> keep = state;
+        keep->then([coroutine]() { coroutine.resume(); });
+    }
+    HID_VL53L5CX_Future<T> await_resume() const { return *this; }
+#endif
+};
+
+// Run loop of a controller thread: runs posted jobs and expires operation
+// deadlines. All methods except the run functions may be called from any thread.
+class HID_VL53L5CX_Dispatcher
+{
+private:
+    std::mutex lock;
+    std::condition_variable wake;
+    std::deque<std::function<void()>> jobs;
+    std::vector<std::shared_ptr<HID_VL53L5CX_AsyncState>> watched;
+    bool stopped = false;
+
+    // Runs until endNs (system clock), stop() or, if idleExit, nothing is left to do.
+    size_t runUntil(uint64_t endNs, bool idleExit);
+
+    // Queues the continuation and forgets the state in one step, so runUntilIdle()
+    // never sees a completed operation before its continuation.
+    friend class HID_VL53L5CX_AsyncState;
+    void completed(HID_VL53L5CX_AsyncState *state, std::function<void()> continuation);
+
+public:
+    HID_VL53L5CX_Dispatcher() {}
+
+    void post(std::function<void()> job);
+
+    // Completes state with TIMED_OUT at its deadline, unless it completed before.
+    // A watched operation keeps runUntilIdle() running.
+    void watch(const std::shared_ptr<HID_VL53L5CX_AsyncState> &state);
+
+    // Runs jobs until stop(). Returns the number of jobs run.
+    size_t run();
+
+    // Runs jobs for at most timeoutMs, or until stop().
+    size_t runFor(uint32_t timeoutMs);
+
+    // Runs jobs until no job is queued and no operation is watched, or until stop().
+    size_t runUntilIdle();
+
+    // Makes the run functions return, also the next one if none is running.
+    void stop();
+
+    HID_VL53L5CX_Dispatcher(const HID_VL53L5CX_Dispatcher&) = delete;
+    HID_VL53L5CX_Dispatcher& operator=(const HID_VL53L5CX_Dispatcher&) = delete;
+};
+
+class HID_VL53L5CX_AsyncSensor
+{
+public:
+    // Creates the sensor on the I/O thread (firmware download included), may throw.
+    typedef std::function<HID_VL53L5CX*()> Opener;
+
+private:
+    struct Job
+    {
+        std::shared_ptr<HID_VL53L5CX_AsyncState> state;
+        std::function<void()> run;
+    };
+    typedef std::shared_ptr<HID_VL53L5CX_AsyncResult<VL53L5CX_Frame>> FrameState;
+
+    Opener opener;
+    HID_VL53L5CX_Dispatcher *dispatcher;
+    uint32_t pollMs;
+    HID_VL53L5CX *sensor = nullptr;     // only used on the I/O thread
+
+    std::mutex lock;
+    std::condition_variable wake;
+    std::deque<Job> commands[2];        // per HID_VL53L5CX_ASYNC_PRIORITY
+    std::vector<FrameState> frameWaiters;
+    std::shared_ptr<HID_VL53L5CX_AsyncState> current;     // command in progress
+    bool stopping = false;
+    std::thread io;
+
+    void ioLoop();
+    void enqueue(const std::shared_ptr<HID_VL53L5CX_AsyncState> &state, HID_VL53L5CX_CancelToken &cancel,
+        HID_VL53L5CX_ASYNC_PRIORITY priority, std::function<void()> run);
+
+    // One poll for the frame waiters, returns false if it found nothing to do.
+    bool pollFrame(const std::vector<FrameState> &waiters, VL53L5CX_Frame &frame, bool commandQueued);
+
+    // Waits pollMs for the next poll, returns early for a new command if the sensor runs in real time.
+    void idle();
+
+    // Runs op(sensor) within deadlineNs (system clock, UINT64_MAX = none), catching what a
+    // call() op throws. False with failure set if there is no sensor yet, op threw or op
+    // left an error in lastError (DEADLINE_EXCEEDED if it ran out of time).
+    bool execute(const std::function<void(HID_VL53L5CX*)> &op, uint64_t deadlineNs, HID_VL53L5CX_Error &failure);
+
+    // Runs op(sensor) as a NORMAL command: DONE if it returns true, FAILED with lastError otherwise.
+    HID_VL53L5CX_Future<bool> submit(uint32_t timeoutMs, HID_VL53L5CX_CancelToken cancel,
+        std::function<bool(HID_VL53L5CX*)> op);
+
+    static uint64_t deadline(uint32_t timeoutMs);
+
+public:
+    // Starts the I/O thread, the sensor is only created by init(). Completions go to
+    // dispatcher if given. nextFrame() polls every pollMs on the sensor clock.
+    // A timeout of 0 means no timeout.
+    HID_VL53L5CX_AsyncSensor(Opener open, HID_VL53L5CX_Dispatcher *dispatcher = nullptr, uint32_t pollMs = 10);
+
+    // Cancels every pending operation, waits for the ULD call in progress and deletes the sensor.
+    ~HID_VL53L5CX_AsyncSensor();
+
+    HID_VL53L5CX_Future<bool> init(uint32_t timeoutMs, HID_VL53L5CX_CancelToken cancel = HID_VL53L5CX_CancelToken());
+    HID_VL53L5CX_Future<bool> applyProfile(const HID_VL53L5CX_Profile &profile, uint32_t timeoutMs,
+        HID_VL53L5CX_CancelToken cancel = HID_VL53L5CX_CancelToken());
+    HID_VL53L5CX_Future<bool> start(uint32_t timeoutMs, HID_VL53L5CX_CancelToken cancel = HID_VL53L5CX_CancelToken());
+    HID_VL53L5CX_Future<bool> stop(uint32_t timeoutMs, HID_VL53L5CX_CancelToken cancel = HID_VL53L5CX_CancelToken());
+
+    // Next frame the sensor delivers after the I/O thread got to this operation.
+    HID_VL53L5CX_Future<VL53L5CX_Frame> nextFrame(uint32_t timeoutMs,
+        HID_VL53L5CX_CancelToken cancel = HID_VL53L5CX_CancelToken());
+
+    // Runs any HID_VL53L5CX method as a command, e.g.
+    //   call<uint32_t>([](HID_VL53L5CX *s) { return s->getIntegrationTime(); }, 100)
+    // DONE with the return value, FAILED if the method stored an error in lastError.
+    template <typename T>
+    HID_VL53L5CX_Future<T> call(std::function<T(HID_VL53L5CX*)> op, uint32_t timeoutMs,
+        HID_VL53L5CX_CancelToken cancel = HID_VL53L5CX_CancelToken(),
+        HID_VL53L5CX_ASYNC_PRIORITY priority = HID_VL53L5CX_ASYNC_PRIORITY::NORMAL)
+    {
+        std::shared_ptr<HID_VL53L5CX_AsyncResult<T>> state =
+            std::make_shared<HID_VL53L5CX_AsyncResult<T>>(deadline(timeoutMs), dispatcher);
+
+        enqueue(state, cancel, priority, [this, state, op]() {
+            HID_VL53L5CX_Error failure;
+            bool ok = execute([&state, &op](HID_VL53L5CX *s) { state->value = op(s); }, state->deadlineNs, failure);
+            state->complete(ok ? HID_VL53L5CX_ASYNC_STATUS::DONE : HID_VL53L5CX_ASYNC_STATUS::FAILED, failure);
+        });
+        return HID_VL53L5CX_Future<T>(state);
+    }
+
+    HID_VL53L5CX_AsyncSensor(const HID_VL53L5CX_AsyncSensor&) = delete;
+    HID_VL53L5CX_AsyncSensor& operator=(const HID_VL53L5CX_AsyncSensor&) = delete;
+};
+
+#ifdef HID_VL53L5CX_HAS_COROUTINES
+// Fire and forget coroutine: starts right away and runs to its end, resuming
+// on the dispatcher after each co_await of a HID_VL53L5CX_Future.
+struct HID_VL53L5CX_Coroutine
+{
+    struct promise_type
+    {
+        HID_VL53L5CX_Coroutine get_return_object() { return HID_VL53L5CX_Coroutine(); }
+        std::suspend_never initial_suspend() noexcept { return std::suspend_never(); }
+        std::suspend_never final_suspend() noexcept { return std::suspend_never(); }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+#endif
+
+#endif // __HID_VL53L5CX_Async__
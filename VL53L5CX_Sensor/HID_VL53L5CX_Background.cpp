@@ -0,0 +1,308 @@
+/*
+  This file implements the background depth model.
+*/
+
+#include "pch.h" // use stdafx.h in Visual Studio 2017 and earlier
+#include "HID_VL53L5CX_Background.h"
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef HID_VL53L5CX_ROI_SSE2
+#include <emmintrin.h>
+
+// All ones in the lanes of the four zones from base on that are set in zones
+static __m128 floatLanes(uint64_t zones, uint32_t base)
+{
+    const __m128i lanes = _mm_setr_epi32(1, 2, 4, 8);
+    __m128i bits = _mm_set1_epi32((int)((zones >> base) & 0xF));
+    return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(bits, lanes), lanes));
+}
+
+static __m128 blend(__m128 mask, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// Eight distances to two times four floats
+static void loadZones(const int16_t *values, __m128 &low, __m128 &high)
+{
+    __m128i v = _mm_loadu_si128((const __m128i *)values);
+    low = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+    high = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+}
+
+#endif // HID_VL53L5CX_ROI_SSE2
+
+HID_VL53L5CX_Background::HID_VL53L5CX_Background(const VL53L5CX_BackgroundConfig &_config, bool _vectorised)
+    : config(_config), vectorised(_vectorised), lastForeground(0), emptyFrames(0)
+{
+    margin = (config.margin_mm != 0) ? config.margin_mm : 300;
+    sigmas = ((config.sigma_tenths != 0) ? config.sigma_tenths : 30) / 10.0f;
+    window = (config.adapt_frames != 0) ? config.adapt_frames : 900;
+    learnFrames = (config.learn_frames != 0) ? config.learn_frames : 15;
+    window = std::max(window, (float)learnFrames);
+    reset(0);
+}
+
+VL53L5CX_BackgroundConfig HID_VL53L5CX_Background::defaults()
+{
+    VL53L5CX_BackgroundConfig config;
+    memset(&config, 0, sizeof(config));
+    config.roi = HID_VL53L5CX_Roi::defaults();
+    config.roi.status_mask = (1u << 5) | (1u << 9);
+    config.roi.max_distance_mm = 4000;
+    config.margin_mm = 300;
+    config.learn_frames = 15;
+    config.adapt_frames = 900;
+    config.sigma_tenths = 30;
+    return config;
+}
+
+bool HID_VL53L5CX_Background::check(const VL53L5CX_BackgroundConfig &config)
+{
+    return (config.roi.min_distance_mm < config.roi.max_distance_mm) && (config.margin_mm >= 0);
+}
+
+uint64_t HID_VL53L5CX_Background::closerZones(const int16_t *distances, const int16_t *thresholds, uint8_t resolution, bool vectorised)
+{
+    uint32_t zones = std::min(resolution, (uint8_t)VL53L5CX_FRAME_MAX_ZONES);
+#ifdef HID_VL53L5CX_ROI_SSE2
+    if (vectorised)
+    {
+        // 16 zones per step, the arrays always hold 64
+        uint64_t closer = 0;
+        for (uint32_t i = 0; i < zones; i += 16)
+        {
+            __m128i low = _mm_cmplt_epi16(_mm_loadu_si128((const __m128i *)(distances + i)), _mm_loadu_si128((const __m128i *)(thresholds + i)));
+            __m128i high = _mm_cmplt_epi16(_mm_loadu_si128((const __m128i *)(distances + i + 8)), _mm_loadu_si128((const __m128i *)(thresholds + i + 8)));
+            closer |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_packs_epi16(low, high)) << i;
+        }
+        return closer & HID_VL53L5CX_Roi::allZones((uint8_t)zones);
+    }
+#endif
+    (void)vectorised;
+    uint64_t closer = 0;
+    for (uint32_t i = 0; i < zones; i++)
+        closer |= (uint64_t)(distances[i] < thresholds[i]) << i;
+    return closer;
+}
+
+void HID_VL53L5CX_Background::reset(uint8_t _resolution)
+{
+    resolution = _resolution;
+    rules = config.roi;
+    rules.zone_mask = ((config.roi.zone_mask != 0) ? config.roi.zone_mask : UINT64_MAX) & HID_VL53L5CX_Roi::allZones(resolution);
+    learned = 0;
+    lastForeground.store(0, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> guard(lock);
+    memset(counts, 0, sizeof(counts));
+    memset(means, 0, sizeof(means));
+    memset(variances, 0, sizeof(variances));
+    for (uint32_t zone = 0; zone < VL53L5CX_FRAME_MAX_ZONES; zone++)
+        thresholds[zone] = INT16_MIN;
+}
+
+void HID_VL53L5CX_Background::accumulate(const int16_t *distances, uint64_t zones)
+{
+    // Welford's update; once the count reaches the window it stays there and
+    // every new frame weighs 1 / window, older ones fade out exponentially
+#ifdef HID_VL53L5CX_ROI_SSE2
+    if (vectorised)
+    {
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 limit = _mm_set1_ps(window);
+        for (uint32_t base = 0; base < resolution; base += 8)
+        {
+            if (((zones >> base) & 0xFF) == 0)
+                continue;
+            __m128 z[2];
+            loadZones(&distances[base], z[0], z[1]);
+            for (uint32_t half = 0; half < 2; half++)
+            {
+                uint32_t zone = base + 4 * half;
+                __m128 selected = floatLanes(zones, zone);
+                __m128 n = _mm_loadu_ps(&counts[zone]);
+                __m128 mean = _mm_loadu_ps(&means[zone]);
+                __m128 variance = _mm_loadu_ps(&variances[zone]);
+                __m128 count = _mm_min_ps(_mm_add_ps(n, one), limit);
+                __m128 delta = _mm_sub_ps(z[half], mean);
+                __m128 updated = _mm_add_ps(mean, _mm_div_ps(delta, count));
+                __m128 spread = _mm_sub_ps(_mm_mul_ps(delta, _mm_sub_ps(z[half], updated)), variance);
+                __m128 widened = _mm_add_ps(variance, _mm_div_ps(spread, count));
+                _mm_storeu_ps(&counts[zone], blend(selected, count, n));
+                _mm_storeu_ps(&means[zone], blend(selected, updated, mean));
+                _mm_storeu_ps(&variances[zone], blend(selected, widened, variance));
+            }
+        }
+        return;
+    }
+#endif
+
+    for (uint64_t bits = zones; bits != 0; bits &= bits - 1)
+    {
+        uint32_t zone = HID_VL53L5CX_Roi::lowestZone(bits);
+        float z = (float)distances[zone];
+        float count = std::min(counts[zone] + 1.0f, window);
+        float delta = z - means[zone];
+        float updated = means[zone] + delta / count;
+        variances[zone] = variances[zone] + (delta * (z - updated) - variances[zone]) / count;
+        means[zone] = updated;
+        counts[zone] = count;
+    }
+}
+
+void HID_VL53L5CX_Background::refresh()
+{
+    // Zones valid in less than half of the learning frames have no depth of their own
+    float known = learnFrames / 2.0f;
+    float far = std::max(rules.max_distance_mm - margin, (float)INT16_MIN);
+#ifdef HID_VL53L5CX_ROI_SSE2
+    if (vectorised)
+    {
+        const __m128 half = _mm_set1_ps(known);
+        const __m128 band = _mm_set1_ps(margin);
+        const __m128 k = _mm_set1_ps(sigmas);
+        const __m128 end = _mm_set1_ps(far);
+        const __m128 lowest = _mm_set1_ps((float)INT16_MIN);
+        const __m128 highest = _mm_set1_ps((float)INT16_MAX);
+        for (uint32_t base = 0; base < resolution; base += 8)
+        {
+            __m128i limits[2];
+            for (uint32_t h = 0; h < 2; h++)
+            {
+                uint32_t zone = base + 4 * h;
+                __m128 sigma = _mm_sqrt_ps(_mm_max_ps(_mm_loadu_ps(&variances[zone]), _mm_setzero_ps()));
+                __m128 threshold = _mm_sub_ps(_mm_loadu_ps(&means[zone]), _mm_max_ps(band, _mm_mul_ps(k, sigma)));
+                threshold = blend(_mm_cmpge_ps(_mm_loadu_ps(&counts[zone]), half), threshold, end);
+                threshold = _mm_min_ps(_mm_max_ps(threshold, lowest), highest);
+                limits[h] = _mm_cvttps_epi32(threshold);
+            }
+            _mm_storeu_si128((__m128i *)&thresholds[base], _mm_packs_epi32(limits[0], limits[1]));
+        }
+        return;
+    }
+#endif
+
+    for (uint32_t zone = 0; zone < resolution; zone++)
+    {
+        float sigma = sqrtf(std::max(variances[zone], 0.0f));
+        float threshold = (counts[zone] >= known) ? (means[zone] - std::max(margin, sigmas * sigma)) : far;
+        threshold = std::min(std::max(threshold, (float)INT16_MIN), (float)INT16_MAX);
+        thresholds[zone] = (int16_t)threshold;
+    }
+}
+
+uint64_t HID_VL53L5CX_Background::update(const VL53L5CX_Frame &frame)
+{
+    if ((frame.resolution != 16) && (frame.resolution != 64))
+        return 0;
+    if (frame.resolution != resolution)
+        reset(frame.resolution);
+
+    uint64_t valid = HID_VL53L5CX_Roi::validZones(frame, rules) & rules.zone_mask;
+    uint64_t foreground = 0;
+    if (!learning())
+        foreground = valid & closerZones(frame.distance_mm, thresholds, resolution, vectorised);
+    lastForeground.store(foreground, std::memory_order_relaxed);
+    if (foreground != 0)
+        return foreground;
+
+    // Only the empty lane is background
+    std::lock_guard<std::mutex> guard(lock);
+    accumulate(frame.distance_mm, valid);
+    emptyFrames.fetch_add(1, std::memory_order_relaxed);
+    if (learning() && (++learned < learnFrames))
+        return 0;
+    refresh();
+    return 0;
+}
+
+bool HID_VL53L5CX_Background::zone(uint32_t zone, float &meanMm, float &sigmaMm)
+{
+    if (learning() || (zone >= resolution))
+        return false;
+    std::lock_guard<std::mutex> guard(lock);
+    if (counts[zone] < learnFrames / 2.0f)
+        return false;
+    meanMm = means[zone];
+    sigmaMm = sqrtf(std::max(variances[zone], 0.0f));
+    return true;
+}
+
+bool HID_VL53L5CX_Background::save(const char *path, uint64_t calibrationFingerprint)
+{
+    if (learning())
+        return false;
+
+    HID_VL53L5CX_BackgroundFile header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, HID_VL53L5CX_BACKGROUND_MAGIC, sizeof(header.magic));
+    header.version = HID_VL53L5CX_BACKGROUND_VERSION;
+    header.headerSize = sizeof(header);
+    header.resolution = resolution;
+    header.calibrationFingerprint = calibrationFingerprint;
+    header.savedUnixMs = (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    FILE *file = nullptr;
+#ifdef _MSC_VER
+    if (fopen_s(&file, path, "wb") != 0)
+        file = nullptr;
+#else
+    file = fopen(path, "wb");
+#endif
+    if (file == nullptr)
+        return false;
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        fwrite(&header, sizeof(header), 1, file);
+        fwrite(counts, sizeof(counts), 1, file);
+        fwrite(means, sizeof(means), 1, file);
+        fwrite(variances, sizeof(variances), 1, file);
+    }
+
+    bool ok = (ferror(file) == 0);
+    ok = (fclose(file) == 0) && ok;
+    return ok;
+}
+
+bool HID_VL53L5CX_Background::load(const char *path, uint64_t calibrationFingerprint)
+{
+    FILE *file = nullptr;
+#ifdef _MSC_VER
+    if (fopen_s(&file, path, "rb") != 0)
+        file = nullptr;
+#else
+    file = fopen(path, "rb");
+#endif
+    if (file == nullptr)
+        return false;
+
+    HID_VL53L5CX_BackgroundFile header;
+    float loaded[3][VL53L5CX_FRAME_MAX_ZONES];
+    bool ok = (fread(&header, sizeof(header), 1, file) == 1)
+        && (memcmp(header.magic, HID_VL53L5CX_BACKGROUND_MAGIC, sizeof(header.magic)) == 0)
+        && (header.version == HID_VL53L5CX_BACKGROUND_VERSION) && (header.headerSize == sizeof(header))
+        && ((header.resolution == 16) || (header.resolution == 64))
+        && (header.calibrationFingerprint == calibrationFingerprint)
+        && (fread(loaded, sizeof(loaded), 1, file) == 1);
+    fclose(file);
+    if (!ok)
+        return false;
+
+    reset(header.resolution);
+    std::lock_guard<std::mutex> guard(lock);
+    memcpy(counts, loaded[0], sizeof(counts));
+    memcpy(means, loaded[1], sizeof(means));
+    memcpy(variances, loaded[2], sizeof(variances));
+    for (uint32_t zone = 0; zone < VL53L5CX_FRAME_MAX_ZONES; zone++)
+        counts[zone] = std::min(std::max(counts[zone], 0.0f), window);
+    learned = learnFrames;
+    refresh();
+    return true;
+}
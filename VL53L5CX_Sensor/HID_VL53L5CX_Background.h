@@ -0,0 +1,128 @@
+#pragma once
+/*
+  This file declares the background depth model.
+
+  A fixed distance window breaks as soon as a lane has a wall or a fixture
+  within range. The model learns what the empty lane looks like instead:
+  the running mean and variance of the distance of every zone (Welford's
+  update), so a zone is foreground when its target is closer than the mean
+  by margin_mm and by sigma_tenths / 10 standard deviations, whatever
+  stands behind it. Noisy zones (a glossy floor, the edge of a fixture) get
+  a wider band on their own.
+
+  Only frames without foreground update the statistics, a person standing
+  in the lane never becomes background. Without a model the first
+  learn_frames frames are taken as empty; after that the statistics cover
+  the last adapt_frames empty frames (the count stops growing, so older
+  frames weigh out and the model follows slow drift of the floor or the
+  sensor temperature). Zones that never had a valid target see through to
+  max_distance_mm.
+
+  The statistics are arrays of 64 zones like VL53L5CX_Frame, updated four
+  zones per step with SSE2 (one otherwise), and so are the thresholds the
+  foreground test compares against, 16 zones per step. Nothing is allocated
+  per frame.
+
+  save() writes the model with the fingerprint of the calibration data it
+  was learned with (HID_VL53L5CX_Recorder::calibrationFingerprint()), load()
+  only takes back a model with the same fingerprint and resolution, so a
+  restarted sensor has a foreground from its first frame on.
+*/
+
+#ifndef __HID_VL53L5CX_Background__
+#define __HID_VL53L5CX_Background__
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include "HID_VL53L5CX_Roi.h"
+#include "VL53L5CXSensor.h"
+
+const char HID_VL53L5CX_BACKGROUND_MAGIC[4] = { 'V', 'L', '5', 'B' };
+const uint16_t HID_VL53L5CX_BACKGROUND_VERSION = 1;
+
+// Saved model, little endian. Followed by float counts[64], means[64] and variances[64].
+struct HID_VL53L5CX_BackgroundFile
+{
+    char magic[4];                  // "VL5B"
+    uint16_t version;
+    uint16_t headerSize;            // sizeof(HID_VL53L5CX_BackgroundFile)
+    uint8_t resolution;             // 16 or 64
+    uint8_t reserved[7];
+    uint64_t calibrationFingerprint;
+    uint64_t savedUnixMs;
+};
+
+class HID_VL53L5CX_Background
+{
+private:
+    VL53L5CX_BackgroundConfig config;
+    bool vectorised;
+    float margin;
+    float sigmas;
+    float window;
+    uint32_t learnFrames;
+
+    uint8_t resolution = 0;
+    VL53L5CX_Roi rules;                 // zone_mask resolved for the resolution
+    uint32_t learned = 0;               // frames learned from, learnFrames once there is a model
+
+    // Per zone statistics of the empty lane, guarded by lock against save()
+    std::mutex lock;
+    float counts[VL53L5CX_FRAME_MAX_ZONES];
+    float means[VL53L5CX_FRAME_MAX_ZONES];
+    float variances[VL53L5CX_FRAME_MAX_ZONES];
+    int16_t thresholds[VL53L5CX_FRAME_MAX_ZONES];   // foreground is closer
+
+    std::atomic<uint64_t> lastForeground;
+    std::atomic<uint64_t> emptyFrames;
+
+    void reset(uint8_t resolution);
+    void accumulate(const int16_t *distances, uint64_t zones);
+    void refresh();
+
+public:
+    // config must pass check(), it is copied. vectorised = false runs the scalar kernels.
+    HID_VL53L5CX_Background(const VL53L5CX_BackgroundConfig &config, bool vectorised = true);
+
+    // Model with the default rules: status 5 and 9, 10 mm < distance < 4000 mm, all zones,
+    // 300 mm and three standard deviations, 15 frames to learn, a window of 900 frames.
+    static VL53L5CX_BackgroundConfig defaults();
+
+    // False if the distance window of the ROI is empty or the margin negative.
+    static bool check(const VL53L5CX_BackgroundConfig &config);
+
+    // Zones i < resolution with distances[i] < thresholds[i]. Both arrays hold
+    // VL53L5CX_FRAME_MAX_ZONES values.
+    static uint64_t closerZones(const int16_t *distances, const int16_t *thresholds, uint8_t resolution, bool vectorised = true);
+
+    // Classifies the zones of one frame and learns from it if it has no foreground.
+    // Returns the foreground, 0 while learning. A resolution change learns again.
+    uint64_t update(const VL53L5CX_Frame &frame);
+
+    // Foreground of the last frame.
+    uint64_t foreground() const { return lastForeground.load(std::memory_order_relaxed); }
+
+    // True until there is a model.
+    bool learning() const { return learned < learnFrames; }
+
+    // Mean and standard deviation of zone in mm. False while learning or if the
+    // zone never had a valid target.
+    bool zone(uint32_t zone, float &meanMm, float &sigmaMm);
+
+    // Frames the statistics were updated with.
+    uint64_t emptyCount() const { return emptyFrames.load(std::memory_order_relaxed); }
+
+    // Writes the model, false while learning or if the file cannot be written.
+    // Safe against a concurrent update().
+    bool save(const char *path, uint64_t calibrationFingerprint);
+
+    // Replaces the model by a saved one, false if it cannot be read, is not a model
+    // or was saved with other calibration data. Not while update() runs.
+    bool load(const char *path, uint64_t calibrationFingerprint);
+
+    HID_VL53L5CX_Background(const HID_VL53L5CX_Background&) = delete;
+    HID_VL53L5CX_Background& operator=(const HID_VL53L5CX_Background&) = delete;
+};
+
+#endif // __HID_VL53L5CX_Background__
@@ -0,0 +1,191 @@
+/*
+  This file implements the timing layer used by the platform functions.
+*/
+
+#include "pch.h" // use stdafx.h in Visual Studio 2017 and earlier
+#include "HID_VL53L5CX_Clock.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <timeapi.h>
+#pragma comment(lib, "winmm.lib")
+#else
+#include <time.h>
+#include <errno.h>
+#endif
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+HID_VL53L5CX_Clock* HID_VL53L5CX_Clock::systemClock()
+{
+    static HID_VL53L5CX_SystemClock clock;
+    return &clock;
+}
+
+#ifdef _WIN32
+
+// Waitable timer of a thread, closed when the thread exits (or for the main
+// thread, when the process does).
+struct ThreadTimer
+{
+    HANDLE handle = NULL;
+
+    ~ThreadTimer()
+    {
+        if (handle != NULL)
+            CloseHandle(handle);
+    }
+};
+
+// One waitable timer per thread, created lazily on first wait.
+static HANDLE threadTimer(bool highResolution)
+{
+    static thread_local ThreadTimer timer;
+    if (timer.handle == NULL)
+    {
+        timer.handle = CreateWaitableTimerExW(NULL, NULL,
+            highResolution ? CREATE_WAITABLE_TIMER_HIGH_RESOLUTION : 0,
+            TIMER_ALL_ACCESS);
+    }
+    return timer.handle;
+}
+
+HID_VL53L5CX_SystemClock::HID_VL53L5CX_SystemClock()
+{
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    qpcFrequency = (uint64_t)frequency.QuadPart;
+
+    // Probe for high resolution timer support
+    HANDLE probe = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    highResolutionTimers = (probe != NULL);
+    periodRaised = false;
+    if (probe != NULL)
+        CloseHandle(probe);
+
+    if (highResolutionTimers)
+    {
+        // High resolution timers typically wake within ~0.5 ms
+        spinThresholdNs = 500000ULL;
+    }
+    else
+    {
+        // Older Windows: raise the scheduler resolution to 1 ms instead
+        periodRaised = (timeBeginPeriod(1) == TIMERR_NOERROR);
+        spinThresholdNs = 1500000ULL;
+    }
+}
+
+HID_VL53L5CX_SystemClock::~HID_VL53L5CX_SystemClock()
+{
+    // Every timeBeginPeriod() needs its timeEndPeriod(), the raised resolution
+    // costs power system wide until then
+    if (periodRaised)
+        timeEndPeriod(1);
+}
+
+uint64_t HID_VL53L5CX_SystemClock::nowNs()
+{
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    uint64_t ticks = (uint64_t)counter.QuadPart;
+
+    // Split to avoid overflowing 64 bits on long uptimes
+    uint64_t seconds = ticks / qpcFrequency;
+    uint64_t remainder = ticks % qpcFrequency;
+    return seconds * 1000000000ULL + (remainder * 1000000000ULL) / qpcFrequency;
+}
+
+void HID_VL53L5CX_SystemClock::sleepUntilNs(uint64_t deadlineNs)
+{
+    uint64_t now = nowNs();
+    if (deadlineNs <= now)
+        return;
+
+    uint64_t remaining = deadlineNs - now;
+    if (remaining > spinThresholdNs)
+    {
+        HANDLE timer = threadTimer(highResolutionTimers);
+        if (timer != NULL)
+        {
+            // Relative due time in 100 ns units
+            LARGE_INTEGER dueTime;
+            dueTime.QuadPart = -(LONGLONG)((remaining - spinThresholdNs) / 100ULL);
+            if (SetWaitableTimer(timer, &dueTime, 0, NULL, NULL, FALSE))
+                WaitForSingleObject(timer, INFINITE);
+        }
+        else
+        {
+            Sleep((DWORD)((remaining - spinThresholdNs) / 1000000ULL));
+        }
+    }
+
+    // Finish the wait precisely
+    while (nowNs() < deadlineNs)
+        YieldProcessor();
+}
+
+#else
+
+HID_VL53L5CX_SystemClock::HID_VL53L5CX_SystemClock()
+{
+    // clock_nanosleep() is already accurate to tens of microseconds, no spinning needed
+    spinThresholdNs = 0;
+}
+
+HID_VL53L5CX_SystemClock::~HID_VL53L5CX_SystemClock()
+{
+}
+
+uint64_t HID_VL53L5CX_SystemClock::nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void HID_VL53L5CX_SystemClock::sleepUntilNs(uint64_t deadlineNs)
+{
+    struct timespec ts;
+    ts.tv_sec = (time_t)(deadlineNs / 1000000000ULL);
+    ts.tv_nsec = (long)(deadlineNs % 1000000000ULL);
+
+    // Absolute sleeps can simply be restarted after a signal
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+    {
+    }
+}
+
+#endif
+
+HID_VL53L5CX_VirtualClock::HID_VL53L5CX_VirtualClock(uint64_t startNs)
+    : now(startNs), sleepCount(0), sleptNs(0)
+{
+}
+
+uint64_t HID_VL53L5CX_VirtualClock::nowNs()
+{
+    return now.load(std::memory_order_acquire);
+}
+
+void HID_VL53L5CX_VirtualClock::sleepUntilNs(uint64_t deadlineNs)
+{
+    sleepCount.fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t current = now.load(std::memory_order_acquire);
+    while (deadlineNs > current)
+    {
+        if (now.compare_exchange_weak(current, deadlineNs, std::memory_order_acq_rel))
+        {
+            sleptNs.fetch_add(deadlineNs - current, std::memory_order_relaxed);
+            break;
+        }
+    }
+}
+
+void HID_VL53L5CX_VirtualClock::advanceNs(uint64_t durationNs)
+{
+    now.fetch_add(durationNs, std::memory_order_acq_rel);
+}
@@ -0,0 +1,99 @@
+#pragma once
+/*
+  This file declares the timing layer used by the platform functions.
+
+  Win32 Sleep() rounds every wait up to the scheduler tick (about 15.6 ms by
+  default), so WaitMs(1) in the ULD boot poll and the 10 ms sensor poll interval
+  were really much longer. All waits and timestamps in the driver go through a
+  HID_VL53L5CX_Clock instead, which gives sub-millisecond waits on real hardware
+  and can be swapped for a virtual clock when running without a sensor.
+*/
+
+#ifndef __HID_VL53L5CX_Clock__
+#define __HID_VL53L5CX_Clock__
+
+#include <stdint.h>
+#include <atomic>
+
+class HID_VL53L5CX_Clock
+{
+public:
+    virtual ~HID_VL53L5CX_Clock() {}
+
+    // Monotonic time in nanoseconds since an arbitrary epoch.
+    virtual uint64_t nowNs() = 0;
+
+    // Blocks until the clock reaches the absolute time deadlineNs.
+    virtual void sleepUntilNs(uint64_t deadlineNs) = 0;
+
+    // Blocks for at least durationNs nanoseconds.
+    void sleepNs(uint64_t durationNs) { sleepUntilNs(nowNs() + durationNs); }
+
+    void sleepUs(uint64_t durationUs) { sleepNs(durationUs * 1000ULL); }
+
+    void sleepMs(uint32_t durationMs) { sleepNs((uint64_t)durationMs * 1000000ULL); }
+
+    uint64_t nowUs() { return nowNs() / 1000ULL; }
+
+    uint64_t nowMs() { return nowNs() / 1000000ULL; }
+
+    // Process wide high resolution clock used when nothing else is injected.
+    static HID_VL53L5CX_Clock* systemClock();
+};
+
+// Wall clock implementation.
+//   Windows: QueryPerformanceCounter timestamps, high resolution waitable timers
+//            (Windows 10 1803+) with a short spin for the last part of the wait.
+//   POSIX:   CLOCK_MONOTONIC timestamps and absolute clock_nanosleep().
+class HID_VL53L5CX_SystemClock : public HID_VL53L5CX_Clock
+{
+private:
+    // Remaining time below which a wait is finished by spinning rather than sleeping.
+    uint64_t spinThresholdNs;
+
+#ifdef _WIN32
+    // QueryPerformanceFrequency() result, counts per second.
+    uint64_t qpcFrequency;
+
+    // True when CREATE_WAITABLE_TIMER_HIGH_RESOLUTION is supported by the OS.
+    bool highResolutionTimers;
+
+    // True when the constructor raised the scheduler resolution with timeBeginPeriod(1).
+    bool periodRaised;
+#endif
+
+public:
+    HID_VL53L5CX_SystemClock();
+
+    // Gives back the scheduler resolution raised by the constructor.
+    ~HID_VL53L5CX_SystemClock();
+
+    uint64_t nowNs() override;
+
+    void sleepUntilNs(uint64_t deadlineNs) override;
+};
+
+// Deterministic clock for tests and simulation. Time only moves when a caller
+// sleeps or advances it explicitly, so nothing ever blocks.
+class HID_VL53L5CX_VirtualClock : public HID_VL53L5CX_Clock
+{
+private:
+    std::atomic<uint64_t> now;
+
+public:
+    HID_VL53L5CX_VirtualClock(uint64_t startNs = 0);
+
+    uint64_t nowNs() override;
+
+    // Jumps straight to the deadline (if it is in the future).
+    void sleepUntilNs(uint64_t deadlineNs) override;
+
+    // Moves virtual time forward by durationNs.
+    void advanceNs(uint64_t durationNs);
+
+    // Number of sleeps and total virtual time spent sleeping, for reports.
+    std::atomic<uint64_t> sleepCount;
+    std::atomic<uint64_t> sleptNs;
+};
+
+#endif // __HID_VL53L5CX_Clock__
@@ -76,6 +76,10 @@ enum class SF_VL53L5CX_ERROR_TYPE : uint8_t
     CANNOT_SET_TARGET_ORDER,
     CANNOT_GET_TARGET_ORDER,
     INVALID_TARGET_ORDER,
+    CANNOT_START_RECORDING,
+    DEADLINE_EXCEEDED,          // the time budget ran out, lastErrorValue holds the ULD status
+    CANNOT_SET_DETECTION_THRESHOLDS,
+    CANNOT_SET_MOTION_INDICATOR,
     UNKNOWN_ERROR
 };
 
@@ -0,0 +1,430 @@
+/*
+  This file implements the temporal zone filter.
+*/
+
+#include "pch.h" // use stdafx.h in Visual Studio 2017 and earlier
+#include "HID_VL53L5CX_Filter.h"
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+#ifdef HID_VL53L5CX_ROI_SSE2
+#include <emmintrin.h>
+#endif
+
+// KALMAN: velocity variance of a zone seen for the first time, (1 m/s)^2
+const float KALMAN_INITIAL_VELOCITY_VARIANCE = 1e6f;
+
+// KALMAN: innovations beyond this many standard deviations are outliers, this many in a row a new target
+const float KALMAN_GATE_SIGMAS = 6.0f;
+const float KALMAN_RESTART_FRAMES = 2.0f;
+
+// Longest frame gap the Kalman filter predicts over, a stalled stream would blow up the covariance
+const float KALMAN_MAX_DT = 1.0f;
+
+static uint32_t frameZones(const VL53L5CX_Frame &frame)
+{
+    return (frame.resolution < VL53L5CX_FRAME_MAX_ZONES) ? frame.resolution : VL53L5CX_FRAME_MAX_ZONES;
+}
+
+// Rounds to the nearest (even) mm like cvtps_epi32 and saturates like packs_epi32
+static int16_t toDistance(float mm)
+{
+    return (int16_t)lrintf(std::min(std::max(mm, (float)INT16_MIN), (float)INT16_MAX));
+}
+
+#ifdef HID_VL53L5CX_ROI_SSE2
+
+// 16-bit lanes of the eight zones from base on that are set in zones
+static __m128i zoneLanes(uint64_t zones, uint32_t base)
+{
+    const __m128i lanes = _mm_setr_epi16(1, 2, 4, 8, 16, 32, 64, 128);
+    __m128i bits = _mm_set1_epi16((short)((zones >> base) & 0xFF));
+    return _mm_cmpeq_epi16(_mm_and_si128(bits, lanes), lanes);
+}
+
+// 32-bit lanes of the four zones from base on that are set in zones
+static __m128 floatLanes(uint64_t zones, uint32_t base)
+{
+    const __m128i lanes = _mm_setr_epi32(1, 2, 4, 8);
+    __m128i bits = _mm_set1_epi32((int)((zones >> base) & 0xF));
+    return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(bits, lanes), lanes));
+}
+
+static __m128 blend(__m128 mask, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static __m128i blend(__m128i mask, __m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// Eight int16 (distances) or uint16 (sigmas) to two times four floats
+static void loadZones(const int16_t *values, __m128 &low, __m128 &high)
+{
+    __m128i v = _mm_loadu_si128((const __m128i *)values);
+    low = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+    high = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+}
+
+static void loadZones(const uint16_t *values, __m128 &low, __m128 &high)
+{
+    __m128i v = _mm_loadu_si128((const __m128i *)values);
+    low = _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, _mm_setzero_si128()));
+    high = _mm_cvtepi32_ps(_mm_unpackhi_epi16(v, _mm_setzero_si128()));
+}
+
+// Writes the filtered distances of the valid zones among the eight from base on
+static void storeDistances(int16_t *distances, __m128 low, __m128 high, uint64_t valid, uint32_t base)
+{
+    const __m128 lowest = _mm_set1_ps((float)INT16_MIN);
+    const __m128 highest = _mm_set1_ps((float)INT16_MAX);
+    low = _mm_min_ps(_mm_max_ps(low, lowest), highest);
+    high = _mm_min_ps(_mm_max_ps(high, lowest), highest);
+    __m128i filtered = _mm_packs_epi32(_mm_cvtps_epi32(low), _mm_cvtps_epi32(high));
+    __m128i raw = _mm_loadu_si128((const __m128i *)&distances[base]);
+    _mm_storeu_si128((__m128i *)&distances[base], blend(zoneLanes(valid, base), filtered, raw));
+}
+
+#endif // HID_VL53L5CX_ROI_SSE2
+
+HID_VL53L5CX_Filter::HID_VL53L5CX_Filter(const VL53L5CX_Filter &_config, bool _vectorised)
+    : config(_config), vectorised(_vectorised)
+{
+    rules = HID_VL53L5CX_Roi::defaults();
+    rules.zone_mask = UINT64_MAX;
+    rules.status_mask = (config.status_mask != 0) ? config.status_mask : ((1u << 5) | (1u << 9));
+    rules.min_distance_mm = 0;
+    rules.max_distance_mm = INT16_MAX;
+    reset();
+}
+
+VL53L5CX_Filter HID_VL53L5CX_Filter::defaults(uint8_t type)
+{
+    VL53L5CX_Filter config;
+    config.type = type;
+    config.window_frames = 5;
+    config.reserved = 0;
+    config.status_mask = 0;
+    config.ema_alpha = 0.3f;
+    config.kalman_accel_mm_s2 = 2000.0f;
+    return config;
+}
+
+bool HID_VL53L5CX_Filter::check(const VL53L5CX_Filter &config)
+{
+    switch (config.type)
+    {
+    case VL53L5CX_FILTER_NONE:
+        return true;
+    case VL53L5CX_FILTER_EMA:
+        return (config.ema_alpha > 0.0f) && (config.ema_alpha <= 1.0f);
+    case VL53L5CX_FILTER_MEDIAN:
+        return (config.window_frames >= 3) && (config.window_frames <= HID_VL53L5CX_FILTER_MAX_WINDOW) && (config.window_frames & 1);
+    case VL53L5CX_FILTER_KALMAN:
+        return (config.kalman_accel_mm_s2 > 0.0f) && (config.kalman_accel_mm_s2 < 1e6f);
+    default:
+        return false;
+    }
+}
+
+void HID_VL53L5CX_Filter::reset()
+{
+    resolution = 0;
+    initialized = 0;
+    lastFrameNs = 0;
+    head = 0;
+    memset(value, 0, sizeof(value));
+    memset(velocity, 0, sizeof(velocity));
+    memset(p00, 0, sizeof(p00));
+    memset(p01, 0, sizeof(p01));
+    memset(p11, 0, sizeof(p11));
+    memset(misses, 0, sizeof(misses));
+    memset(last, 0, sizeof(last));
+    memset(history, 0, sizeof(history));
+}
+
+void HID_VL53L5CX_Filter::apply(VL53L5CX_Frame &frame)
+{
+    if (config.type == VL53L5CX_FILTER_NONE)
+        return;
+
+    if (frame.resolution != resolution)
+    {
+        reset();
+        resolution = frame.resolution;
+    }
+
+    // Seconds since the previous frame, 0 for the first one
+    float dt = 0.0f;
+    if ((lastFrameNs != 0) && (frame.timestamp_ns > lastFrameNs))
+        dt = std::min((float)((double)(frame.timestamp_ns - lastFrameNs) / 1e9), KALMAN_MAX_DT);
+    lastFrameNs = frame.timestamp_ns;
+
+    uint64_t valid = HID_VL53L5CX_Roi::validZones(frame, rules, vectorised);
+    uint64_t fresh = valid & ~initialized;
+    initialized |= valid;
+
+    switch (config.type)
+    {
+    case VL53L5CX_FILTER_EMA:
+        ema(frame, valid, fresh);
+        break;
+    case VL53L5CX_FILTER_MEDIAN:
+        median(frame, valid, fresh);
+        break;
+    case VL53L5CX_FILTER_KALMAN:
+        kalman(frame, valid, fresh, dt);
+        break;
+    }
+}
+
+void HID_VL53L5CX_Filter::ema(VL53L5CX_Frame &frame, uint64_t valid, uint64_t fresh)
+{
+    uint32_t zones = frameZones(frame);
+    const float alpha = config.ema_alpha;
+
+#ifdef HID_VL53L5CX_ROI_SSE2
+    if (vectorised)
+    {
+        const __m128 alphas = _mm_set1_ps(alpha);
+        for (uint32_t base = 0; base < zones; base += 8)
+        {
+            __m128 z[2], filtered[2];
+            loadZones(&frame.distance_mm[base], z[0], z[1]);
+            for (uint32_t half = 0; half < 2; half++)
+            {
+                uint32_t zone = base + 4 * half;
+                __m128 e = _mm_loadu_ps(&value[zone]);
+                __m128 updated = _mm_add_ps(e, _mm_mul_ps(alphas, _mm_sub_ps(z[half], e)));
+                updated = blend(floatLanes(fresh, zone), z[half], updated);
+                e = blend(floatLanes(valid, zone), updated, e);
+                _mm_storeu_ps(&value[zone], e);
+                filtered[half] = e;
+            }
+            storeDistances(frame.distance_mm, filtered[0], filtered[1], valid, base);
+        }
+        return;
+    }
+#endif
+
+    for (uint32_t i = 0; i < zones; i++)
+    {
+        if (!((valid >> i) & 1))
+            continue;
+        float z = (float)frame.distance_mm[i];
+        value[i] = ((fresh >> i) & 1) ? z : (value[i] + alpha * (z - value[i]));
+        frame.distance_mm[i] = toDistance(value[i]);
+    }
+}
+
+void HID_VL53L5CX_Filter::median(VL53L5CX_Frame &frame, uint64_t valid, uint64_t fresh)
+{
+    uint32_t zones = frameZones(frame);
+    const uint32_t window = config.window_frames;
+    const uint32_t middle = window / 2;
+
+    // Invalid zones repeat their last valid distance, so every zone shares the history rows.
+    // A zone seen for the first time fills its whole history.
+#ifdef HID_VL53L5CX_ROI_SSE2
+    if (vectorised)
+    {
+        for (uint32_t base = 0; base < zones; base += 8)
+        {
+            __m128i validLanes = zoneLanes(valid, base);
+            __m128i freshLanes = zoneLanes(fresh, base);
+            __m128i z = _mm_loadu_si128((const __m128i *)&frame.distance_mm[base]);
+            __m128i latest = blend(validLanes, z, _mm_loadu_si128((const __m128i *)&last[base]));
+            _mm_storeu_si128((__m128i *)&last[base], latest);
+
+            __m128i rows[HID_VL53L5CX_FILTER_MAX_WINDOW];
+            for (uint32_t row = 0; row < window; row++)
+            {
+                __m128i past = (row == head) ? latest : _mm_loadu_si128((const __m128i *)&history[row][base]);
+                past = blend(freshLanes, z, past);
+                _mm_storeu_si128((__m128i *)&history[row][base], past);
+                rows[row] = past;
+            }
+
+            // Odd-even transposition sort across the rows, every lane is sorted on its own
+            for (uint32_t pass = 0; pass < window; pass++)
+            {
+                for (uint32_t row = pass & 1; row + 1 < window; row += 2)
+                {
+                    __m128i low = _mm_min_epi16(rows[row], rows[row + 1]);
+                    rows[row + 1] = _mm_max_epi16(rows[row], rows[row + 1]);
+                    rows[row] = low;
+                }
+            }
+            _mm_storeu_si128((__m128i *)&frame.distance_mm[base], blend(validLanes, rows[middle], z));
+        }
+        head = (head + 1) % window;
+        return;
+    }
+#endif
+
+    for (uint32_t i = 0; i < zones; i++)
+    {
+        bool isValid = (valid >> i) & 1;
+        bool isFresh = (fresh >> i) & 1;
+        if (isValid)
+            last[i] = frame.distance_mm[i];
+
+        int16_t rows[HID_VL53L5CX_FILTER_MAX_WINDOW];
+        for (uint32_t row = 0; row < window; row++)
+        {
+            if (isFresh)
+                history[row][i] = frame.distance_mm[i];
+            else if (row == head)
+                history[row][i] = last[i];
+            rows[row] = history[row][i];
+        }
+
+        if (isValid)
+        {
+            std::nth_element(rows, rows + middle, rows + window);
+            frame.distance_mm[i] = rows[middle];
+        }
+    }
+    head = (head + 1) % window;
+}
+
+void HID_VL53L5CX_Filter::kalman(VL53L5CX_Frame &frame, uint64_t valid, uint64_t fresh, float dt)
+{
+    uint32_t zones = frameZones(frame);
+
+    // Process noise of a random acceleration over dt
+    const float q = config.kalman_accel_mm_s2 * config.kalman_accel_mm_s2;
+    const float q00 = q * dt * dt * dt * dt / 4.0f;
+    const float q01 = q * dt * dt * dt / 2.0f;
+    const float q11 = q * dt * dt;
+    const float gate = KALMAN_GATE_SIGMAS * KALMAN_GATE_SIGMAS;
+
+#ifdef HID_VL53L5CX_ROI_SSE2
+    if (vectorised)
+    {
+        const __m128 dts = _mm_set1_ps(dt);
+        const __m128 q00s = _mm_set1_ps(q00);
+        const __m128 q01s = _mm_set1_ps(q01);
+        const __m128 q11s = _mm_set1_ps(q11);
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 initialVariance = _mm_set1_ps(KALMAN_INITIAL_VELOCITY_VARIANCE);
+        const __m128 gates = _mm_set1_ps(gate);
+        const __m128 restartFrames = _mm_set1_ps(KALMAN_RESTART_FRAMES);
+
+        for (uint32_t base = 0; base < zones; base += 8)
+        {
+            __m128 z[2], sigma[2], filtered[2];
+            loadZones(&frame.distance_mm[base], z[0], z[1]);
+            loadZones(&frame.range_sigma_mm[base], sigma[0], sigma[1]);
+            for (uint32_t half = 0; half < 2; half++)
+            {
+                uint32_t zone = base + 4 * half;
+
+                // Predict
+                __m128 v = _mm_loadu_ps(&velocity[zone]);
+                __m128 x = _mm_add_ps(_mm_loadu_ps(&value[zone]), _mm_mul_ps(v, dts));
+                __m128 a = _mm_loadu_ps(&p00[zone]);
+                __m128 b = _mm_loadu_ps(&p01[zone]);
+                __m128 c = _mm_loadu_ps(&p11[zone]);
+                a = _mm_add_ps(_mm_add_ps(a, _mm_mul_ps(dts, _mm_add_ps(_mm_add_ps(b, b), _mm_mul_ps(dts, c)))), q00s);
+                b = _mm_add_ps(_mm_add_ps(b, _mm_mul_ps(dts, c)), q01s);
+                c = _mm_add_ps(c, q11s);
+
+                // Update with the measurement
+                __m128 s = _mm_max_ps(sigma[half], one);
+                __m128 r = _mm_mul_ps(s, s);
+                s = _mm_add_ps(a, r);
+                __m128 k0 = _mm_div_ps(a, s);
+                __m128 k1 = _mm_div_ps(b, s);
+                __m128 y = _mm_sub_ps(z[half], x);
+                __m128 xu = _mm_add_ps(x, _mm_mul_ps(k0, y));
+                __m128 vu = _mm_add_ps(v, _mm_mul_ps(k1, y));
+                __m128 cu = _mm_sub_ps(c, _mm_mul_ps(k1, b));
+                __m128 au = _mm_mul_ps(_mm_sub_ps(one, k0), a);
+                __m128 bu = _mm_mul_ps(_mm_sub_ps(one, k0), b);
+
+                // Outside the gate: the prediction stands, unless the previous one was outside too
+                __m128 isValid = floatLanes(valid, zone);
+                __m128 isFresh = floatLanes(fresh, zone);
+                __m128 m = _mm_loadu_ps(&misses[zone]);
+                __m128 m1 = _mm_add_ps(m, one);
+                __m128 outside = _mm_andnot_ps(isFresh, _mm_cmpgt_ps(_mm_mul_ps(y, y), _mm_mul_ps(gates, s)));
+                __m128 restart = _mm_and_ps(outside, _mm_cmpge_ps(m1, restartFrames));
+                __m128 skip = _mm_andnot_ps(restart, outside);
+                _mm_storeu_ps(&misses[zone], blend(isValid, _mm_and_ps(skip, m1), m));
+
+                // A zone seen for the first time starts at its distance, at rest
+                __m128 start = _mm_or_ps(isFresh, restart);
+                xu = blend(start, z[half], xu);
+                vu = blend(start, zero, vu);
+                au = blend(start, r, au);
+                bu = blend(start, zero, bu);
+                cu = blend(start, initialVariance, cu);
+
+                __m128 accept = _mm_andnot_ps(skip, isValid);
+                x = blend(accept, xu, x);
+                _mm_storeu_ps(&value[zone], x);
+                _mm_storeu_ps(&velocity[zone], blend(accept, vu, v));
+                _mm_storeu_ps(&p00[zone], blend(accept, au, a));
+                _mm_storeu_ps(&p01[zone], blend(accept, bu, b));
+                _mm_storeu_ps(&p11[zone], blend(accept, cu, c));
+                filtered[half] = x;
+            }
+            storeDistances(frame.distance_mm, filtered[0], filtered[1], valid, base);
+        }
+        return;
+    }
+#endif
+
+    for (uint32_t i = 0; i < zones; i++)
+    {
+        float v = velocity[i];
+        float x = value[i] + v * dt;
+        float a = p00[i] + dt * (p01[i] + p01[i] + dt * p11[i]) + q00;
+        float b = p01[i] + dt * p11[i] + q01;
+        float c = p11[i] + q11;
+
+        if ((valid >> i) & 1)
+        {
+            float z = (float)frame.distance_mm[i];
+            float s = std::max((float)frame.range_sigma_mm[i], 1.0f);
+            float r = s * s;
+            s = a + r;
+            float y = z - x;
+            bool isFresh = (fresh >> i) & 1;
+            bool outside = !isFresh && (y * y > gate * s);
+            bool restart = outside && (misses[i] + 1.0f >= KALMAN_RESTART_FRAMES);
+            misses[i] = (outside && !restart) ? (misses[i] + 1.0f) : 0.0f;
+
+            if (isFresh || restart)
+            {
+                x = z;
+                v = 0.0f;
+                a = r;
+                b = 0.0f;
+                c = KALMAN_INITIAL_VELOCITY_VARIANCE;
+            }
+            else if (!outside)
+            {
+                float k0 = a / s;
+                float k1 = b / s;
+                x = x + k0 * y;
+                v = v + k1 * y;
+                c = c - k1 * b;
+                a = (1.0f - k0) * a;
+                b = (1.0f - k0) * b;
+            }
+            frame.distance_mm[i] = toDistance(x);
+        }
+
+        value[i] = x;
+        velocity[i] = v;
+        p00[i] = a;
+        p01[i] = b;
+        p11[i] = c;
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+/*
+  This file declares the temporal zone filter.
+
+  A filter keeps state for every zone of the frames it sees and replaces the
+  distance of each valid zone by a filtered one, so a target that jumps for a
+  single frame (a multipath echo, a passing reflection) does not reach the
+  ROI reduction and the gate logic behind it. Three filters, chosen by a
+  VL53L5CX_Filter (VL53L5CXSensor.h):
+
+  - EMA: exponential moving average, cheapest, lags a moving target.
+  - MEDIAN: median of the last window_frames distances, removes single
+    frame outliers completely and keeps edges, lags by half the window.
+  - KALMAN: 1-D constant velocity model per zone with range_sigma_mm as the
+    measurement noise, follows a moving target without lag and trusts noisy
+    zones less. A distance far outside what the model expects is replaced
+    by the prediction; when the next one is too, the zone starts over there
+    (a new target, not an outlier).
+
+  The state lives in arrays of 64 zones (structure of arrays like
+  VL53L5CX_Frame) so all zones of a frame are updated together: eight zones
+  per step with SSE2, one otherwise. Nothing is allocated per frame. Zones
+  without a valid target keep their state (the Kalman filter predicts) and
+  their distance is left as it is, their status says it is not valid anyway.
+  A resolution change starts over.
+*/
+
+#ifndef __HID_VL53L5CX_Filter__
+#define __HID_VL53L5CX_Filter__
+
+#include <stdint.h>
+#include "HID_VL53L5CX_Roi.h"
+#include "VL53L5CXSensor.h"
+
+// Longest median window
+#define HID_VL53L5CX_FILTER_MAX_WINDOW 9
+
+class HID_VL53L5CX_Filter
+{
+private:
+    VL53L5CX_Filter config;
+    VL53L5CX_Roi rules;                 // targets that update a zone
+    bool vectorised;
+
+    uint8_t resolution = 0;
+    uint64_t initialized = 0;           // zones that had a valid target since the start
+    uint64_t lastFrameNs = 0;
+    uint32_t head = 0;                  // MEDIAN: history row of the next frame
+
+    // Per zone state
+    float value[VL53L5CX_FRAME_MAX_ZONES];          // EMA, KALMAN position in mm
+    float velocity[VL53L5CX_FRAME_MAX_ZONES];       // KALMAN, mm/s
+    float p00[VL53L5CX_FRAME_MAX_ZONES];            // KALMAN covariance of position and velocity
+    float p01[VL53L5CX_FRAME_MAX_ZONES];
+    float p11[VL53L5CX_FRAME_MAX_ZONES];
+    float misses[VL53L5CX_FRAME_MAX_ZONES];         // KALMAN: distances in a row outside the gate
+    int16_t last[VL53L5CX_FRAME_MAX_ZONES];         // MEDIAN: last valid distance
+    int16_t history[HID_VL53L5CX_FILTER_MAX_WINDOW][VL53L5CX_FRAME_MAX_ZONES];
+
+    void ema(VL53L5CX_Frame &frame, uint64_t valid, uint64_t fresh);
+    void median(VL53L5CX_Frame &frame, uint64_t valid, uint64_t fresh);
+    void kalman(VL53L5CX_Frame &frame, uint64_t valid, uint64_t fresh, float dt);
+
+public:
+    // config must pass check(). vectorised = false runs the scalar kernels,
+    // they give the same results.
+    HID_VL53L5CX_Filter(const VL53L5CX_Filter &config, bool vectorised = true);
+
+    // Filter of this type with the default parameters: alpha 0.3, a window of
+    // 5 frames, 2000 mm/s^2 of acceleration, status 5 and 9.
+    static VL53L5CX_Filter defaults(uint8_t type);
+
+    // False if a parameter is out of range.
+    static bool check(const VL53L5CX_Filter &config);
+
+    // Forgets every zone, the next frame starts the filter over.
+    void reset();
+
+    // Filters the distances of frame in place.
+    void apply(VL53L5CX_Frame &frame);
+
+    const VL53L5CX_Filter &getConfig() const { return config; }
+};
+
+#endif // __HID_VL53L5CX_Filter__
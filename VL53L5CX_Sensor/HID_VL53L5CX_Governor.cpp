@@ -0,0 +1,350 @@
+/*
+  This file implements the power and frame rate governor.
+*/
+
+#include "pch.h" // use stdafx.h in Visual Studio 2017 and earlier
+#include "HID_VL53L5CX_Governor.h"
+#include "HID_VL53L5CX_Log.h"
+#include "HID_VL53L5CX_Roi.h"
+#include <algorithm>
+#include <ctime>
+#include <string.h>
+
+const uint32_t MINUTES_PER_DAY = 24 * 60;
+const uint64_t NS_PER_MINUTE = 60ULL * 1000000000ULL;
+
+// Minutes after midnight, local time
+static int32_t localMinuteOfDay()
+{
+    std::time_t now = std::time(nullptr);
+    std::tm local;
+#ifdef _WIN32
+    if (localtime_s(&local, &now) != 0)
+        return 0;
+#else
+    if (localtime_r(&now, &local) == nullptr)
+        return 0;
+#endif
+    return local.tm_hour * 60 + local.tm_min;
+}
+
+HID_VL53L5CX_Governor::HID_VL53L5CX_Governor(const VL53L5CX_GovernorConfig &_config, int32_t minuteOfDay)
+    : config(_config), startMinute(minuteOfDay), tier(0), sleeping(false), switchNs(0), switches(0), failures(0)
+{
+    for (uint32_t i = 0; i < VL53L5CX_GOVERNOR_TIERS; i++)
+    {
+        uint16_t holdMs = config.tiers[i].hold_ms;
+        if (holdMs == 0)
+            holdMs = (config.tiers[i].resolution == 0) ? 2000 : 5000;
+        holdNs[i] = (uint64_t)holdMs * 1000000ULL;
+        tierNs[i].store(0, std::memory_order_relaxed);
+    }
+    probeNs = (uint64_t)((config.probe_ms != 0) ? config.probe_ms : 1000) * 1000000ULL;
+    detailNs = (uint64_t)config.detail_ms * 1000000ULL;
+    rules = config.roi;
+}
+
+VL53L5CX_GovernorConfig HID_VL53L5CX_Governor::defaults()
+{
+    VL53L5CX_GovernorConfig config;
+    memset(&config, 0, sizeof(config));
+    config.tiers[0].hold_ms = 2000;
+
+    config.tiers[1].resolution = 16;
+    config.tiers[1].frequency_hz = 5;
+    config.tiers[1].autonomous = 1;
+    config.tiers[1].integration_ms = 5;
+    config.tiers[1].hold_ms = 30000;
+
+    config.tiers[2].resolution = 16;
+    config.tiers[2].frequency_hz = 15;
+    config.tiers[2].hold_ms = 5000;
+
+    config.tiers[3].resolution = 64;
+    config.tiers[3].frequency_hz = 15;
+    config.tiers[3].hold_ms = 3000;
+
+    config.roi = HID_VL53L5CX_Roi::defaults();
+    config.roi.status_mask = (1u << 5) | (1u << 9);
+    config.roi.max_distance_mm = 2000;
+    config.tier_count = 4;
+    config.occupied_tier = 2;
+    config.detail_ms = 1000;
+    config.probe_ms = 1000;
+    return config;
+}
+
+bool HID_VL53L5CX_Governor::check(const VL53L5CX_GovernorConfig &config)
+{
+    if ((config.tier_count == 0) || (config.tier_count > VL53L5CX_GOVERNOR_TIERS) || (config.window_count > VL53L5CX_GOVERNOR_WINDOWS))
+        return false;
+    if ((config.roi.min_distance_mm < 0) || (config.roi.min_distance_mm >= config.roi.max_distance_mm))
+        return false;
+
+    for (uint32_t i = 0; i < config.tier_count; i++)
+    {
+        const VL53L5CX_GovernorTier &tier = config.tiers[i];
+        if (tier.resolution == 0)
+        {
+            // Asleep, tier 1 probes the lane
+            if ((i != 0) || (config.tier_count < 2))
+                return false;
+            continue;
+        }
+        uint8_t maxHz = (tier.resolution == 16) ? 60 : 15;
+        if (((tier.resolution != 16) && (tier.resolution != 64)) || (tier.frequency_hz == 0) || (tier.frequency_hz > maxHz)
+            || (tier.autonomous > 1))
+            return false;
+        uint32_t integrationMs = (tier.integration_ms != 0) ? tier.integration_ms : 5;
+        if (tier.autonomous && ((integrationMs < 2) || (integrationMs > 1000) || (integrationMs * tier.frequency_hz >= 1000)))
+            return false;
+    }
+    if ((config.occupied_tier >= config.tier_count) || (config.tiers[config.occupied_tier].resolution == 0))
+        return false;
+
+    // Zones named for one resolution are other zones in the other
+    if ((config.roi.zone_mask != 0) && !fixedResolution(config))
+        return false;
+
+    for (uint32_t i = 0; i < config.window_count; i++)
+    {
+        const VL53L5CX_GovernorWindow &window = config.windows[i];
+        if ((window.start_minute >= MINUTES_PER_DAY) || (window.end_minute >= MINUTES_PER_DAY)
+            || (window.lowest_tier > window.highest_tier) || (window.highest_tier >= config.tier_count))
+            return false;
+    }
+    return true;
+}
+
+bool HID_VL53L5CX_Governor::fixedResolution(const VL53L5CX_GovernorConfig &config)
+{
+    uint8_t resolution = 0;
+    for (uint32_t i = 0; i < config.tier_count; i++)
+    {
+        if (config.tiers[i].resolution == 0)
+            continue;
+        if ((resolution != 0) && (config.tiers[i].resolution != resolution))
+            return false;
+        resolution = config.tiers[i].resolution;
+    }
+    return true;
+}
+
+HID_VL53L5CX_Profile HID_VL53L5CX_Governor::profile(const VL53L5CX_GovernorTier &tier)
+{
+    HID_VL53L5CX_Profile profile;
+    profile.resolution = tier.resolution;
+    profile.frequencyHz = tier.frequency_hz;
+    if (tier.autonomous)
+    {
+        profile.rangingMode = SF_VL53L5CX_RANGING_MODE::AUTONOMOUS;
+        profile.integrationTimeMs = (tier.integration_ms != 0) ? tier.integration_ms : 5;
+    }
+    else
+    {
+        profile.rangingMode = SF_VL53L5CX_RANGING_MODE::CONTINUOUS;
+    }
+    return profile;
+}
+
+void HID_VL53L5CX_Governor::resolve(uint8_t _resolution)
+{
+    resolution = _resolution;
+    rules = config.roi;
+    uint64_t all = HID_VL53L5CX_Roi::allZones(resolution);
+    rules.zone_mask = ((config.roi.zone_mask != 0) ? config.roi.zone_mask : HID_VL53L5CX_Roi::centerZones(resolution)) & all;
+}
+
+void HID_VL53L5CX_Governor::account(uint64_t nowNs)
+{
+    if (nowNs > lastNs)
+    {
+        tierNs[tier.load(std::memory_order_relaxed)].fetch_add(nowNs - lastNs, std::memory_order_relaxed);
+        lastNs = nowNs;
+    }
+}
+
+void HID_VL53L5CX_Governor::limits(uint64_t nowNs, uint8_t &lowest, uint8_t &highest) const
+{
+    lowest = 0;
+    highest = (uint8_t)(config.tier_count - 1);
+    if (config.window_count == 0)
+        return;
+
+    uint32_t minute = (uint32_t)(((uint64_t)startMinute + (nowNs - startNs) / NS_PER_MINUTE) % MINUTES_PER_DAY);
+    for (uint32_t i = 0; i < config.window_count; i++)
+    {
+        const VL53L5CX_GovernorWindow &window = config.windows[i];
+        bool inside = (window.start_minute <= window.end_minute)
+            ? ((minute >= window.start_minute) && (minute < window.end_minute))
+            : ((minute >= window.start_minute) || (minute < window.end_minute));
+        if (inside)
+        {
+            lowest = window.lowest_tier;
+            highest = window.highest_tier;
+            return;
+        }
+    }
+}
+
+bool HID_VL53L5CX_Governor::enter(HID_VL53L5CX *sensor, uint8_t to)
+{
+    // The change is charged to the tier it leaves
+    const VL53L5CX_GovernorTier &target = config.tiers[to];
+    bool asleep = sleeping.load(std::memory_order_relaxed);
+    uint64_t beginNs = sensor->clock->nowNs();
+    bool entered;
+    if (target.resolution == 0)
+    {
+        wasRanging = sensor->isRanging();
+        entered = (!wasRanging || sensor->stopRanging()) && sensor->setPowerMode(SF_VL53L5CX_POWER_MODE::SLEEP);
+        if (!entered && wasRanging && !sensor->isRanging())
+            sensor->startRanging();
+    }
+    else
+    {
+        // Only what differs from the tier the sensor holds, the sensor keeps it asleep
+        HID_VL53L5CX_Profile change = profile(target);
+        if (configured < config.tier_count)
+        {
+            const VL53L5CX_GovernorTier &held = config.tiers[configured];
+            if (held.resolution == target.resolution)
+                change.resolution = 0;
+            if (held.frequency_hz == target.frequency_hz)
+                change.frequencyHz = 0;
+            if (held.autonomous == target.autonomous)
+                change.rangingMode = SF_VL53L5CX_RANGING_MODE::VL53_NO_ERROR;
+            if (profile(held).integrationTimeMs == change.integrationTimeMs)
+                change.integrationTimeMs = 0;
+        }
+        entered = (!asleep || sensor->setPowerMode(SF_VL53L5CX_POWER_MODE::WAKEUP))
+            && sensor->applyProfile(change)
+            && (!asleep || !wasRanging || sensor->startRanging());
+        configured = entered ? to : UINT8_MAX;
+    }
+
+    uint64_t endNs = sensor->clock->nowNs();
+    account(endNs);
+    switchNs.fetch_add(endNs - beginNs, std::memory_order_relaxed);
+    quietSinceNs = endNs;
+
+    uint8_t from = tier.load(std::memory_order_relaxed);
+    if (!entered)
+    {
+        // Tried again after the hold time of the tier, not on every frame
+        failures.fetch_add(1, std::memory_order_relaxed);
+        HID_VL53L5CX_LOG(WARNING, "Governor: the sensor refused tier %u, staying in tier %u", (uint32_t)to, (uint32_t)from);
+        return false;
+    }
+    tier.store(to, std::memory_order_relaxed);
+    sleeping.store(target.resolution == 0, std::memory_order_relaxed);
+    switches.fetch_add(1, std::memory_order_relaxed);
+    HID_VL53L5CX_LOG(VERBOSE, "Governor: tier %u -> %u", (uint32_t)from, (uint32_t)to);
+    return true;
+}
+
+bool HID_VL53L5CX_Governor::start(HID_VL53L5CX *sensor)
+{
+    if (startMinute < 0)
+        startMinute = localMinuteOfDay();
+    startNs = sensor->clock->nowNs();
+    lastNs = startNs;
+    occupiedSinceNs = 0;
+    probing = false;
+    configured = UINT8_MAX;
+
+    uint8_t lowest, highest;
+    limits(startNs, lowest, highest);
+    uint8_t to = std::min(std::max(config.occupied_tier, lowest), highest);
+    if (!enter(sensor, to))
+        return false;
+    HID_VL53L5CX_LOG(INFO, "Governor: %u tiers, %u schedule windows, starting in tier %u",
+        (uint32_t)config.tier_count, (uint32_t)config.window_count, (uint32_t)to);
+    return true;
+}
+
+bool HID_VL53L5CX_Governor::stop(HID_VL53L5CX *sensor)
+{
+    if (!sleeping.load(std::memory_order_relaxed))
+        return true;
+    if (!sensor->setPowerMode(SF_VL53L5CX_POWER_MODE::WAKEUP) || (wasRanging && !sensor->startRanging()))
+        return false;
+    sleeping.store(false, std::memory_order_relaxed);
+    return true;
+}
+
+bool HID_VL53L5CX_Governor::awake(HID_VL53L5CX *sensor)
+{
+    bool asleep = sleeping.load(std::memory_order_relaxed);
+    if (!asleep && ((config.window_count == 0) || (config.tiers[0].resolution != 0)))
+        return true;
+
+    uint64_t nowNs = sensor->clock->nowNs();
+    uint8_t lowest, highest;
+    limits(nowNs, lowest, highest);
+    if (!asleep)
+    {
+        // A window that only allows sleep starts before the next frame is read
+        return (highest != 0) || !enter(sensor, 0);
+    }
+    account(nowNs);
+    if (highest == 0)
+        return false;
+    if ((lowest == 0) && (nowNs - quietSinceNs < holdNs[0]))
+        return false;
+
+    // Below the floor of the schedule the sensor stays up, otherwise it only looks
+    if (!enter(sensor, std::max(lowest, (uint8_t)1)))
+        return false;
+    probing = (lowest == 0);
+    return true;
+}
+
+void HID_VL53L5CX_Governor::update(HID_VL53L5CX *sensor, const VL53L5CX_Frame &frame, const HID_VL53L5CX_Presence *presence)
+{
+    account(frame.timestamp_ns);
+    if (sleeping.load(std::memory_order_relaxed))
+        return;
+    if (frame.resolution != resolution)
+        resolve(frame.resolution);
+
+    uint64_t nowNs = frame.timestamp_ns;
+    bool occupied = (presence != nullptr) ? (presence->occupied() != 0) : (HID_VL53L5CX_Roi::validZones(frame, rules) != 0);
+    uint8_t current = tier.load(std::memory_order_relaxed);
+    uint8_t target = current;
+    if (occupied)
+    {
+        probing = false;
+        quietSinceNs = nowNs;
+        if (occupiedSinceNs == 0)
+            occupiedSinceNs = nowNs;
+        target = std::max(current, config.occupied_tier);
+        if ((detailNs != 0) && (nowNs - occupiedSinceNs >= detailNs))
+            target = (uint8_t)(config.tier_count - 1);
+    }
+    else
+    {
+        occupiedSinceNs = 0;
+        uint64_t hold = probing ? probeNs : holdNs[current];
+        if ((current > 0) && (nowNs >= quietSinceNs + hold))
+            target = current - 1;
+    }
+
+    uint8_t lowest, highest;
+    limits(nowNs, lowest, highest);
+    target = std::min(std::max(target, lowest), highest);
+    if ((target != current) && enter(sensor, target))
+        probing = false;
+}
+
+void HID_VL53L5CX_Governor::stats(VL53L5CX_GovernorStats &out) const
+{
+    memset(&out, 0, sizeof(out));
+    for (uint32_t i = 0; i < VL53L5CX_GOVERNOR_TIERS; i++)
+        out.tier_ms[i] = tierNs[i].load(std::memory_order_relaxed) / 1000000ULL;
+    out.switch_ms = switchNs.load(std::memory_order_relaxed) / 1000000ULL;
+    out.switches = switches.load(std::memory_order_relaxed);
+    out.failures = failures.load(std::memory_order_relaxed);
+    out.tier = tier.load(std::memory_order_relaxed);
+    out.sleeping = sleeping.load(std::memory_order_relaxed) ? 1 : 0;
+}
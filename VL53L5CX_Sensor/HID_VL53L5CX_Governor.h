@@ -0,0 +1,131 @@
+#pragma once
+/*
+  This file declares the power and frame rate governor.
+
+  A lane sensor ranging 8x8 at 15 Hz all day spends nearly all of it on an
+  empty lane: the sensor at full power, the bridge busy with frames nobody
+  looks at. The governor moves the sensor between tiers instead, from
+  lowest power to highest, for example: asleep, 4x4 autonomous at 5 Hz with
+  a short integration, 4x4 continuous at 15 Hz, 8x8 for detail.
+
+  Every frame read, update() asks the presence detector (or without one the
+  ROI) if the lane is occupied. Occupied, the sensor goes straight to
+  occupied_tier, and after detail_ms of occupancy to the top tier. Empty for
+  hold_ms of its tier, it steps down one tier. Tier changes go through
+  HID_VL53L5CX::applyProfile(), one stop and start of ranging each, and
+  only set what differs from the tier the sensor holds.
+
+  Tier 0 may be a sleep tier: ranging stops and the sensor goes to its low
+  power mode, the host reads nothing. Every hold_ms of the sleep tier
+  awake() wakes it into tier 1 for probe_ms to look at the lane, so a person
+  is seen at most hold_ms plus probe_ms after arriving.
+
+  A schedule of up to four daily windows (local time) bounds the tiers, for
+  example sleep only at night or at least 4x4 at 15 Hz during rush hours.
+  The time of day is taken once at start() and runs on the sensor clock from
+  there. Tiers of different resolutions (the defaults go from 4x4 to 8x8)
+  only suit stages that follow the resolution: presence zones and ROIs with
+  zone_mask 0 (the center zones of the resolution), the filter and the
+  tracker, which start over. A background model, the people counter or
+  explicit zone masks need tiers of one resolution, see fixedResolution().
+*/
+
+#ifndef __HID_VL53L5CX_Governor__
+#define __HID_VL53L5CX_Governor__
+
+#include <stdint.h>
+#include <atomic>
+#include "HID_VL53L5CX.h"
+#include "HID_VL53L5CX_Presence.h"
+#include "VL53L5CXSensor.h"
+
+class HID_VL53L5CX_Governor
+{
+private:
+    VL53L5CX_GovernorConfig config;
+    int32_t startMinute;                // time of day at start(), -1 = local time
+    uint64_t holdNs[VL53L5CX_GOVERNOR_TIERS];
+    uint64_t probeNs;
+    uint64_t detailNs;
+
+    // Only used by the thread that reads frames
+    uint8_t resolution = 0;
+    VL53L5CX_Roi rules;                 // zone_mask resolved for the resolution
+    uint64_t startNs = 0;
+    uint64_t quietSinceNs = 0;          // last occupied frame or tier change
+    uint64_t occupiedSinceNs = 0;       // 0 while the lane is empty
+    uint64_t lastNs = 0;                // tierNs is counted up to here
+    bool wasRanging = false;            // when the sensor went to sleep
+    bool probing = false;               // woken from sleep, probe_ms instead of hold_ms
+    uint8_t configured = UINT8_MAX;     // ranging tier the sensor holds, UINT8_MAX = not known
+
+    std::atomic<uint8_t> tier;
+    std::atomic<bool> sleeping;
+    std::atomic<uint64_t> tierNs[VL53L5CX_GOVERNOR_TIERS];
+    std::atomic<uint64_t> switchNs;
+    std::atomic<uint32_t> switches;
+    std::atomic<uint32_t> failures;
+
+    void account(uint64_t nowNs);
+    void resolve(uint8_t resolution);
+
+    // Tiers the schedule allows at nowNs.
+    void limits(uint64_t nowNs, uint8_t &lowest, uint8_t &highest) const;
+
+    // Moves the sensor to tier 'to', false if the sensor refused. The tier is kept then.
+    bool enter(HID_VL53L5CX *sensor, uint8_t to);
+
+public:
+    // config must pass check(), it is copied. minuteOfDay is the time of day at start()
+    // in minutes after midnight, -1 = the local time then.
+    HID_VL53L5CX_Governor(const VL53L5CX_GovernorConfig &config, int32_t minuteOfDay = -1);
+
+    // Four tiers: asleep, ranging 1 s every 2 s; 4x4 autonomous at 5 Hz, 5 ms integration,
+    // 30 s before sleeping; 4x4 at 15 Hz, 5 s; 8x8 at 15 Hz, 3 s. Occupied lanes go to 4x4
+    // at 15 Hz, 8x8 after 1 s. The center zones, status 5 and 9, 10 mm < distance < 2000 mm
+    // without presence zones. No schedule.
+    static VL53L5CX_GovernorConfig defaults();
+
+    // False if a tier is not one the sensor takes (sleep only as tier 0, the frequency
+    // limit of the resolution, an integration time longer than the frame period), or
+    // occupied_tier, a window or the distance window of the ROI is wrong, or the ROI has
+    // a zone_mask and the tiers change resolution.
+    static bool check(const VL53L5CX_GovernorConfig &config);
+
+    // True if every ranging tier has the same resolution. Otherwise what only fits one
+    // resolution starts over with every change: the background model learns again (the
+    // person in front of the sensor too), the people counter drops its blobs, and zone
+    // masks name other zones.
+    static bool fixedResolution(const VL53L5CX_GovernorConfig &config);
+    bool fixedResolution() const { return fixedResolution(config); }
+
+    // Ranging configuration of a ranging tier.
+    static HID_VL53L5CX_Profile profile(const VL53L5CX_GovernorTier &tier);
+
+    // Puts the sensor in occupied_tier, within the schedule. False if the sensor refused,
+    // the sensor error tells why. Not while frames are read.
+    bool start(HID_VL53L5CX *sensor);
+
+    // Wakes the sensor if it sleeps and leaves it in the tier it is in.
+    bool stop(HID_VL53L5CX *sensor);
+
+    // True if frames are to be read. Asleep, wakes the sensor up to probe the lane every
+    // hold_ms of the sleep tier, or when the schedule does not allow sleep anymore. Awake,
+    // puts it to sleep as soon as a window that only allows sleep starts.
+    bool awake(HID_VL53L5CX *sensor);
+
+    // Moves the sensor between tiers after a frame was read. presence decides if it is
+    // not nullptr, after it saw the frame.
+    void update(HID_VL53L5CX *sensor, const VL53L5CX_Frame &frame, const HID_VL53L5CX_Presence *presence);
+
+    // True while the sensor sleeps, until awake() wakes it. Safe from any thread.
+    bool asleep() const { return sleeping.load(std::memory_order_relaxed); }
+
+    // Safe against a concurrent awake() or update(). Time is counted up to their last call.
+    void stats(VL53L5CX_GovernorStats &stats) const;
+
+    HID_VL53L5CX_Governor(const HID_VL53L5CX_Governor&) = delete;
+    HID_VL53L5CX_Governor& operator=(const HID_VL53L5CX_Governor&) = delete;
+};
+
+#endif // __HID_VL53L5CX_Governor__
@@ -23,15 +23,8 @@
 #include "HID_VL53L5CX_IO.h"
 #include "HID_VL53L5CX_Constants.h"
 #include <stdexcept>
+#include "HID_VL53L5CX_Log.h"
 #include <string>
-#include <iostream>
-
-//#define DEBUG	1
-#ifdef DEBUG
-#define D(x)   x
-#else
-#define D(x)
-#endif
 
 #define highByte(x)		( ((x) >> (8)) & 0xFF )
 #define lowByte(x)		( (x) & 0xFF )
@@ -42,7 +35,7 @@ HID_VL53L5CX_IO::HID_VL53L5CX_IO(uint8_t address)
     FT260_STATUS ftStatus = FT260_OTHER_ERROR;
     FT260_HANDLE mhandle = INVALID_HANDLE_VALUE;
     
-    std::cout << "HID_VL53L5CX_IO() constructor" << std::endl;
+    HID_VL53L5CX_LOG(VERBOSE, "HID_VL53L5CX_IO() constructor");
     _address = address;
 
     // Open device by VID/PID
@@ -51,7 +44,7 @@ HID_VL53L5CX_IO::HID_VL53L5CX_IO(uint8_t address)
     {
         //printf("Open device by VID/PID failed: %s\n", FT260StatusToString(ftStatus));
         std::string error(FT260StatusToString(ftStatus));
-        std::cerr << "FT260_OpenByVidPid fails: " << error << std::endl;
+        HID_VL53L5CX_LOG(FAILURE, "FT260_OpenByVidPid fails: %s", error.c_str());
         throw std::runtime_error("FT260 Open fails error: " + error);
     }
 
@@ -60,7 +53,7 @@ HID_VL53L5CX_IO::HID_VL53L5CX_IO(uint8_t address)
     //Initialize as an I2C Master, read/write to an I2C slave
     ftStatus = FT260_I2CMaster_Init(mhandle, I2C_100KHZ);
     if (ftStatus != FT260_OK) {
-        printf("FT260_I2CMaster_Init() returns: %d\n", ftStatus);
+        HID_VL53L5CX_LOG(FAILURE, "FT260_I2CMaster_Init() returns: %d", ftStatus);
         std::string error(FT260StatusToString(ftStatus));
         throw std::runtime_error("FT260_I2CMaster_Init fails error: " + error);
     }
@@ -69,8 +62,7 @@ HID_VL53L5CX_IO::HID_VL53L5CX_IO(uint8_t address)
 
 HID_VL53L5CX_IO::~HID_VL53L5CX_IO()
 {
-    D(std::cout << "HID_VL53L5CX_IO() destructor called" << std::endl; )
-    std::cout << "HID_VL53L5CX_IO() destructor called" << std::endl;
+    HID_VL53L5CX_LOG(VERBOSE, "HID_VL53L5CX_IO() destructor called");
     FT260_Close(_handle);
 }
 
@@ -82,6 +74,36 @@ uint8_t HID_VL53L5CX_IO::getI2CStatus()
     return status;
 }
 
+bool HID_VL53L5CX_IO::setInterrupt(bool enable)
+{
+    FT260_STATUS ftStatus = FT260_SetWakeupInterrupt(_handle, enable ? TRUE : FALSE);
+    if ((ftStatus == FT260_OK) && enable)
+        ftStatus = FT260_SetInterruptTriggerType(_handle, FT260_INTR_FALLING_EDGE, FT260_INTR_DELY_1MS);
+    if (ftStatus != FT260_OK)
+    {
+        HID_VL53L5CX_LOG(WARNING, "FT260 interrupt setup fails: %s", FT260StatusToString(ftStatus));
+        return false;
+    }
+
+    // An edge latched before arming is not a wake up
+    BOOL flag = FALSE;
+    FT260_CleanInterruptFlag(_handle, &flag);
+    return true;
+}
+
+bool HID_VL53L5CX_IO::interruptFired()
+{
+    // Returns the latch as it was before clearing it
+    BOOL flag = FALSE;
+    FT260_STATUS ftStatus = FT260_CleanInterruptFlag(_handle, &flag);
+    if (ftStatus != FT260_OK)
+    {
+        HID_VL53L5CX_LOG(WARNING, "FT260_CleanInterruptFlag() fails: %d", ftStatus);
+        return false;
+    }
+    return flag != FALSE;
+}
+
 const char* HID_VL53L5CX_IO::FT260StatusToString(FT260_STATUS status)
 {
     switch (status)
@@ -136,7 +158,7 @@ uint8_t HID_VL53L5CX_IO::writeMultipleBytes(uint16_t registerAddress, uint8_t* b
     uint32_t bytesToSend = bufferSize;
     uint8_t adrbuffer[3] = {};
 
-    D(printf("Write %u bytes starting at address: 0x%04X\n", bytesToSend, registerAddress); )
+    HID_VL53L5CX_LOG(VERBOSE, "Write %u bytes starting at address: 0x%04X", bytesToSend, registerAddress);
 
     // first write register address
     numBytesToWrite = sizeof(uint16_t);
@@ -145,7 +167,7 @@ uint8_t HID_VL53L5CX_IO::writeMultipleBytes(uint16_t registerAddress, uint8_t* b
     ftStatus = FT260_I2CMaster_Write(_handle, _address, FT260_I2C_START, adrbuffer, numBytesToWrite, &writeLength);
     if ((ftStatus != FT260_OK) || (writeLength != numBytesToWrite))
     {
-        printf("FT260_I2CMaster_Write setting register fails: %d\n", ftStatus);
+        HID_VL53L5CX_LOG(WARNING, "FT260_I2CMaster_Write setting register fails: %d", ftStatus);
         return ftStatus;
     }
 
@@ -154,7 +176,7 @@ uint8_t HID_VL53L5CX_IO::writeMultipleBytes(uint16_t registerAddress, uint8_t* b
     ftStatus = FT260_I2CMaster_Write(_handle, _address, FT260_I2C_STOP, buffer, numBytesToWrite, &writeLength);
     if ((ftStatus != FT260_OK) || (writeLength != numBytesToWrite))
     {
-        printf("FT260_I2CMaster_Write data write multiple fails: %d wrote: %d\n", ftStatus, writeLength);
+        HID_VL53L5CX_LOG(WARNING, "FT260_I2CMaster_Write data write multiple fails: %d wrote: %lu", ftStatus, writeLength);
         return ftStatus;
     }
 
@@ -170,7 +192,7 @@ uint8_t HID_VL53L5CX_IO::readMultipleBytes(uint16_t registerAddress, uint8_t* bu
     DWORD numBytesToWrite = 0;
     uint8_t adrbuffer[3] = {};
 
-    D(printf("Reading %u bytes starting at address: 0x%04X\n", bufferSize, registerAddress); )
+    HID_VL53L5CX_LOG(VERBOSE, "Reading %u bytes starting at address: 0x%04X", bufferSize, registerAddress);
 
     // first write register to read
     numBytesToWrite = sizeof(uint16_t);
@@ -179,14 +201,15 @@ uint8_t HID_VL53L5CX_IO::readMultipleBytes(uint16_t registerAddress, uint8_t* bu
     ftStatus = FT260_I2CMaster_Write(_handle, _address, FT260_I2C_START_AND_STOP, adrbuffer, numBytesToWrite, &writeLength);
     if ((ftStatus != FT260_OK) || (writeLength != numBytesToWrite))
     {
-        printf("FT260_I2CMaster_Write setting register fails: %d\n", ftStatus);
+        HID_VL53L5CX_LOG(WARNING, "FT260_I2CMaster_Write setting register fails: %d", ftStatus);
         return ftStatus;
     }
 
     // Now lets read the byte specified
     numBytesToRead = bufferSize;
-    ftStatus = FT260_I2CMaster_Read(_handle, _address, FT260_I2C_START_AND_STOP, buffer, numBytesToRead, &readLength, 5000);
-    D(printf("FT260_I2C_Read  ftStatus : % d  Read Length : %d\n", ftStatus, readLength); )
+    ftStatus = FT260_I2CMaster_Read(_handle, _address, FT260_I2C_START_AND_STOP, buffer, numBytesToRead, &readLength,
+        HID_VL53L5CX_readTimeoutMs(numBytesToRead, _timeoutMs));
+    HID_VL53L5CX_LOG(VERBOSE, "FT260_I2C_Read  ftStatus : % d  Read Length : %lu", ftStatus, readLength);
 
         return ftStatus;
 }
@@ -200,7 +223,7 @@ uint8_t HID_VL53L5CX_IO::readSingleByte(uint16_t registerAddress, uint8_t& value
     DWORD numBytesToWrite = 0;
     uint8_t buffer[3] = {};
 
-    D(printf("Read 1 byte at address: 0x%04X\n", registerAddress); )
+    HID_VL53L5CX_LOG(VERBOSE, "Read 1 byte at address: 0x%04X", registerAddress);
 
     // first write register to read
     numBytesToWrite = sizeof(uint16_t);
@@ -209,21 +232,22 @@ uint8_t HID_VL53L5CX_IO::readSingleByte(uint16_t registerAddress, uint8_t& value
     ftStatus = FT260_I2CMaster_Write(_handle, _address, FT260_I2C_START_AND_STOP, buffer, numBytesToWrite, &writeLength);
     if ((ftStatus != FT260_OK) || (writeLength != numBytesToWrite))
     {
-        printf("FT260_I2CMaster_Write setting register fails: %d\n", ftStatus);
+        HID_VL53L5CX_LOG(WARNING, "FT260_I2CMaster_Write setting register fails: %d", ftStatus);
         return ftStatus;
     }
 
     // Now lets read the byte specified
     numBytesToRead = 1;
     value = 0;
-    ftStatus = FT260_I2CMaster_Read(_handle, _address, FT260_I2C_START_AND_STOP, buffer, numBytesToRead, &readLength, 5000);
+    ftStatus = FT260_I2CMaster_Read(_handle, _address, FT260_I2C_START_AND_STOP, buffer, numBytesToRead, &readLength,
+        HID_VL53L5CX_readTimeoutMs(numBytesToRead, _timeoutMs));
     if ((ftStatus != FT260_OK) || (readLength != numBytesToRead))
     {
-        printf("FT260_I2CMaster_Read() fails: %d\n", ftStatus);
+        HID_VL53L5CX_LOG(WARNING, "FT260_I2CMaster_Read() fails: %d", ftStatus);
         return ftStatus;
     }
     value = buffer[0];
-    D(printf("FT260_I2C_Read  ftStatus : % d  Read Length : %d, value: 0x%02X\n", ftStatus, readLength, value); )
+    HID_VL53L5CX_LOG(VERBOSE, "FT260_I2C_Read  ftStatus : % d  Read Length : %lu, value: 0x%02X", ftStatus, readLength, value);
 
     return ftStatus;
 }
@@ -235,7 +259,7 @@ uint8_t HID_VL53L5CX_IO::writeSingleByte(uint16_t registerAddress, uint8_t const
     DWORD numBytesToWrite = 0;
     uint8_t buffer[3] = {};
 
-    D(printf("Write 1 byte (0x%02X) at address: 0x%04X\n", value, registerAddress); )
+    HID_VL53L5CX_LOG(VERBOSE, "Write 1 byte (0x%02X) at address: 0x%04X", value, registerAddress);
 
     // first write register to write
     buffer[0] = highByte(registerAddress);
@@ -245,7 +269,7 @@ uint8_t HID_VL53L5CX_IO::writeSingleByte(uint16_t registerAddress, uint8_t const
     ftStatus = FT260_I2CMaster_Write(_handle, _address, FT260_I2C_START_AND_STOP, buffer, numBytesToWrite, &writeLength);
     if ((ftStatus != FT260_OK) || (writeLength != numBytesToWrite))
     {
-        printf("FT260_I2CMaster_Write setting register fails: %d\n", ftStatus);
+        HID_VL53L5CX_LOG(WARNING, "FT260_I2CMaster_Write setting register fails: %d", ftStatus);
         return ftStatus;
     }
 
@@ -26,8 +26,9 @@
 
 #include "LibFT260.h"
 #include "HID_VL53L5CX_Constants.h"
+#include "HID_VL53L5CX_Transport.h"
 
-class HID_VL53L5CX_IO
+class HID_VL53L5CX_IO : public HID_VL53L5CX_Transport
 {
 private:
 	// I2C instance
@@ -36,6 +37,9 @@ private:
 	// Sensor address
 	uint8_t _address;
 
+	// Time left until the caller's deadline, 0 = none
+	uint32_t _timeoutMs = 0;
+
 public:
 	//  constructor needs to know the device I2C address will create FT260 handle
 	HID_VL53L5CX_IO(uint8_t address);
@@ -43,21 +47,27 @@ public:
 	// destructor needs to close the handle and clean up
 	~HID_VL53L5CX_IO();
 
-	uint8_t getI2CStatus();
+	uint8_t getI2CStatus() override;
+
+	void setTimeoutMs(uint32_t timeoutMs) override { _timeoutMs = timeoutMs; }
+
+	// The sensor INT goes to the FT260 interrupt input (GPIO3), which latches its falling edge.
+	bool setInterrupt(bool enable) override;
+	bool interruptFired() override;
 
 	const char* FT260StatusToString(FT260_STATUS status);
 
 	// Read a single byte from a register.
-	uint8_t readSingleByte(uint16_t registerAddress, uint8_t &value);
+	uint8_t readSingleByte(uint16_t registerAddress, uint8_t &value) override;
 
 	// Write a single byte into a register.
-	uint8_t writeSingleByte(uint16_t registerAddress, uint8_t value);
+	uint8_t writeSingleByte(uint16_t registerAddress, uint8_t value) override;
 
 	// Read multiple bytes from a register into buffer byte array.
-	uint8_t readMultipleBytes(uint16_t registerAddress, uint8_t* buffer, uint16_t bufferSize);
+	uint8_t readMultipleBytes(uint16_t registerAddress, uint8_t* buffer, uint16_t bufferSize) override;
 
 	// Write multiple bytes to register from buffer byte array.
-	uint8_t writeMultipleBytes(uint16_t registerAddress, uint8_t* buffer, uint16_t bufferSize);
+	uint8_t writeMultipleBytes(uint16_t registerAddress, uint8_t* buffer, uint16_t bufferSize) override;
 
 };
 
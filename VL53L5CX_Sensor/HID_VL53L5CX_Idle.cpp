@@ -0,0 +1,163 @@
+/*
+  This file implements the wake-on-approach idle mode.
+*/
+
+#include "pch.h" // use stdafx.h in Visual Studio 2017 and earlier
+#include "HID_VL53L5CX_Idle.h"
+#include "HID_VL53L5CX_Log.h"
+#include "HID_VL53L5CX_Roi.h"
+#include <string.h>
+
+HID_VL53L5CX_Idle::HID_VL53L5CX_Idle(const VL53L5CX_IdleConfig &_config)
+    : config(_config), sleeping(false), wakeups(0), latchPolls(0), idleNs(0), activeNs(0)
+{
+    rearmFrames = (config.rearm_frames != 0) ? config.rearm_frames : 30;
+    pollNs = (uint64_t)((config.poll_ms != 0) ? config.poll_ms : 50) * 1000000ULL;
+    rules = config.roi;
+}
+
+VL53L5CX_IdleConfig HID_VL53L5CX_Idle::defaults()
+{
+    VL53L5CX_IdleConfig config;
+    memset(&config, 0, sizeof(config));
+    config.roi = HID_VL53L5CX_Roi::defaults();
+    config.roi.status_mask = (1u << 5) | (1u << 9);
+    config.roi.max_distance_mm = 2000;
+    config.rearm_frames = 30;
+    config.poll_ms = 50;
+    return config;
+}
+
+bool HID_VL53L5CX_Idle::check(const VL53L5CX_IdleConfig &config)
+{
+    return (config.roi.min_distance_mm >= 0) && (config.roi.min_distance_mm < config.roi.max_distance_mm);
+}
+
+uint32_t HID_VL53L5CX_Idle::thresholds(const VL53L5CX_Roi &roi, uint8_t resolution, VL53L5CX_DetectionThresholds *out)
+{
+    memset(out, 0, VL53L5CX_NB_THRESHOLDS * sizeof(VL53L5CX_DetectionThresholds));
+    uint64_t all = HID_VL53L5CX_Roi::allZones(resolution);
+    uint64_t zones = ((roi.zone_mask != 0) ? roi.zone_mask : HID_VL53L5CX_Roi::centerZones(resolution)) & all;
+
+    // The ROI window is open, the checker window closed
+    uint32_t count = 0;
+    for (; (zones != 0) && (count < VL53L5CX_NB_THRESHOLDS); zones &= zones - 1)
+    {
+        VL53L5CX_DetectionThresholds &checker = out[count++];
+        checker.param_low_thresh = roi.min_distance_mm + 1;
+        checker.param_high_thresh = roi.max_distance_mm - 1;
+        checker.measurement = VL53L5CX_DISTANCE_MM;
+        checker.type = VL53L5CX_IN_WINDOW;
+        checker.zone_num = (uint8_t)HID_VL53L5CX_Roi::lowestZone(zones);
+        checker.mathematic_operation = VL53L5CX_OPERATION_NONE;
+    }
+    if (count > 0)
+        out[count - 1].zone_num |= VL53L5CX_LAST_THRESHOLD;
+    return count;
+}
+
+void HID_VL53L5CX_Idle::resolve(uint8_t _resolution)
+{
+    resolution = _resolution;
+    rules = config.roi;
+    uint64_t all = HID_VL53L5CX_Roi::allZones(resolution);
+    rules.zone_mask = ((config.roi.zone_mask != 0) ? config.roi.zone_mask : HID_VL53L5CX_Roi::centerZones(resolution)) & all;
+}
+
+bool HID_VL53L5CX_Idle::start(HID_VL53L5CX *sensor)
+{
+    uint8_t zones = sensor->getZoneCount();
+    if (zones == 0)
+        return false;
+    resolve(zones);
+
+    VL53L5CX_DetectionThresholds checkers[VL53L5CX_NB_THRESHOLDS];
+    uint32_t count = thresholds(config.roi, zones, checkers);
+    if ((count == 0) || !sensor->setDetectionThresholds(checkers))
+        return false;
+    if (!sensor->setInterrupt(true))
+    {
+        HID_VL53L5CX_LOG(WARNING, "Idle mode: the transport cannot see the sensor INT line");
+        sensor->setDetectionThresholds(nullptr);
+        return false;
+    }
+
+    emptyFrames = 0;
+    lastPollNs = sensor->clock->nowNs();
+    lastNs = lastPollNs;
+    sleeping.store(true, std::memory_order_relaxed);
+    HID_VL53L5CX_LOG(INFO, "Idle mode: %u zones watched by the sensor, the host sleeps until INT", count);
+    return true;
+}
+
+bool HID_VL53L5CX_Idle::stop(HID_VL53L5CX *sensor)
+{
+    sensor->setInterrupt(false);
+    return sensor->setDetectionThresholds(nullptr);
+}
+
+void HID_VL53L5CX_Idle::account(uint64_t nowNs)
+{
+    if (nowNs > lastNs)
+    {
+        std::atomic<uint64_t> &total = sleeping.load(std::memory_order_relaxed) ? idleNs : activeNs;
+        total.fetch_add(nowNs - lastNs, std::memory_order_relaxed);
+        lastNs = nowNs;
+    }
+}
+
+bool HID_VL53L5CX_Idle::awake(HID_VL53L5CX *sensor)
+{
+    if (!sleeping.load(std::memory_order_relaxed))
+        return true;
+
+    uint64_t nowNs = sensor->clock->nowNs();
+    if (nowNs - lastPollNs < pollNs)
+        return false;
+    lastPollNs = nowNs;
+    latchPolls.fetch_add(1, std::memory_order_relaxed);
+    bool fired = sensor->interruptFired();
+    account(sensor->clock->nowNs());
+    if (!fired)
+        return false;
+
+    sleeping.store(false, std::memory_order_relaxed);
+    emptyFrames = 0;
+    wakeups.fetch_add(1, std::memory_order_relaxed);
+    HID_VL53L5CX_LOG(VERBOSE, "Idle mode: woken up by INT");
+    return true;
+}
+
+void HID_VL53L5CX_Idle::update(HID_VL53L5CX *sensor, const VL53L5CX_Frame &frame, const HID_VL53L5CX_Presence *presence)
+{
+    account(frame.timestamp_ns);
+    if (sleeping.load(std::memory_order_relaxed))
+        return;
+    if (frame.resolution != resolution)
+        resolve(frame.resolution);
+
+    bool empty = (presence != nullptr) ? (presence->occupied() == 0) : (HID_VL53L5CX_Roi::validZones(frame, rules) == 0);
+    if (!empty)
+    {
+        emptyFrames = 0;
+        return;
+    }
+    if (++emptyFrames < rearmFrames)
+        return;
+
+    // INT fired for the frames of whoever just left, that is no reason to wake up
+    sensor->interruptFired();
+    lastPollNs = sensor->clock->nowNs();
+    sleeping.store(true, std::memory_order_relaxed);
+    HID_VL53L5CX_LOG(VERBOSE, "Idle mode: lane empty for %u frames, asleep", emptyFrames);
+}
+
+void HID_VL53L5CX_Idle::stats(VL53L5CX_IdleStats &out) const
+{
+    memset(&out, 0, sizeof(out));
+    out.wakeups = wakeups.load(std::memory_order_relaxed);
+    out.idle_ms = idleNs.load(std::memory_order_relaxed) / 1000000ULL;
+    out.active_ms = activeNs.load(std::memory_order_relaxed) / 1000000ULL;
+    out.latch_polls = latchPolls.load(std::memory_order_relaxed);
+    out.idle = sleeping.load(std::memory_order_relaxed) ? 1 : 0;
+}
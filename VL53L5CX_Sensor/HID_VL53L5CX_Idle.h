@@ -0,0 +1,95 @@
+#pragma once
+/*
+  This file declares the wake-on-approach idle mode.
+
+  Most of the day nobody walks down the lane, yet streaming reads every
+  frame over the bridge: a data ready poll and a few hundred bytes per
+  frame, all of it for an empty lane. The sensor can decide that itself.
+  Its detection thresholds (vl53l5cx_plugin_detection_thresholds) hold one
+  checker per zone, here a distance window on the zones of the idle ROI,
+  and with them enabled INT only fires for frames with a target in the
+  window.
+
+  While asleep the host reads no frames at all. awake() polls the INT latch
+  of the bridge every poll_ms (one USB request, no I2C transaction) and
+  wakes up when it fired. Awake, every frame is read as usual and update()
+  counts the empty frames in a row: no presence zone occupied, or without a
+  presence detector no zone of the ROI with a valid target in the window.
+  After rearm_frames of them the latch is cleared and the host sleeps again.
+
+  The thresholds stay programmed while awake, the frames read are the same
+  either way. A recording has no INT line, start() fails on a replay.
+*/
+
+#ifndef __HID_VL53L5CX_Idle__
+#define __HID_VL53L5CX_Idle__
+
+#include <stdint.h>
+#include <atomic>
+#include "HID_VL53L5CX.h"
+#include "HID_VL53L5CX_Presence.h"
+#include "VL53L5CXSensor.h"
+
+class HID_VL53L5CX_Idle
+{
+private:
+    VL53L5CX_IdleConfig config;
+    uint32_t rearmFrames;
+    uint64_t pollNs;
+
+    // Only used by the thread that reads frames
+    uint8_t resolution = 0;
+    VL53L5CX_Roi rules;                 // zone_mask resolved for the resolution
+    uint32_t emptyFrames = 0;
+    uint64_t lastPollNs = 0;
+    uint64_t lastNs = 0;                // idleNs and activeNs are counted up to here
+
+    std::atomic<bool> sleeping;
+    std::atomic<uint64_t> wakeups;
+    std::atomic<uint64_t> latchPolls;
+    std::atomic<uint64_t> idleNs;
+    std::atomic<uint64_t> activeNs;
+
+    void account(uint64_t nowNs);
+    void resolve(uint8_t resolution);
+
+public:
+    // config must pass check(), it is copied.
+    HID_VL53L5CX_Idle(const VL53L5CX_IdleConfig &config);
+
+    // Idle mode with the default rules: the center zones, status 5 and 9, 10 mm < distance
+    // < 2000 mm, 30 empty frames to sleep again, the latch polled every 50 ms.
+    static VL53L5CX_IdleConfig defaults();
+
+    // False if the distance window of the ROI is empty or negative.
+    static bool check(const VL53L5CX_IdleConfig &config);
+
+    // One IN_WINDOW distance checker per zone of roi for the resolution, the last one
+    // marked VL53L5CX_LAST_THRESHOLD, the rest of out[VL53L5CX_NB_THRESHOLDS] zeroed.
+    // Returns the number of checkers.
+    static uint32_t thresholds(const VL53L5CX_Roi &roi, uint8_t resolution, VL53L5CX_DetectionThresholds *out);
+
+    // Programs the thresholds for the resolution of the sensor, arms the INT latch and
+    // goes to sleep. False if the thresholds cannot be programmed or the transport does
+    // not see INT, the sensor error tells which. Not while frames are read.
+    bool start(HID_VL53L5CX *sensor);
+
+    // Disables the thresholds and the latch again.
+    static bool stop(HID_VL53L5CX *sensor);
+
+    // True if frames are to be read: awake, or INT fired since the last poll. Asleep the
+    // latch is polled every poll_ms at most, other calls cost nothing.
+    bool awake(HID_VL53L5CX *sensor);
+
+    // Counts the empty frames after a frame was read and goes to sleep after rearm_frames.
+    // presence decides if it is not nullptr, after it saw the frame.
+    void update(HID_VL53L5CX *sensor, const VL53L5CX_Frame &frame, const HID_VL53L5CX_Presence *presence);
+
+    // Safe against a concurrent awake() or update(). Time is counted up to their last call.
+    void stats(VL53L5CX_IdleStats &stats) const;
+
+    HID_VL53L5CX_Idle(const HID_VL53L5CX_Idle&) = delete;
+    HID_VL53L5CX_Idle& operator=(const HID_VL53L5CX_Idle&) = delete;
+};
+
+#endif // __HID_VL53L5CX_Idle__
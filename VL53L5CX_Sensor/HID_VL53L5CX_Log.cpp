@@ -0,0 +1,226 @@
+/*
+  This file implements the driver logger.
+*/
+
+#include "pch.h" // use stdafx.h in Visual Studio 2017 and earlier
+#include "HID_VL53L5CX_Log.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+namespace {
+
+// Bounded multi-producer queue (D. Vyukov), each slot carries the position it
+// is ready for: pos when free for the producer, pos + 1 when holding a message.
+struct LogSlot
+{
+    std::atomic<size_t> sequence;
+    uint8_t level;
+    char message[HID_VL53L5CX_LOG_MESSAGE_SIZE];
+};
+
+struct LogRing
+{
+    LogSlot slots[HID_VL53L5CX_LOG_RING_SIZE];
+    std::atomic<size_t> enqueuePos;
+    std::atomic<size_t> dequeuePos;
+    std::atomic<size_t> delivered;      // messages handed to the sink
+    std::atomic<uint64_t> dropped;
+
+    // The logging thread sleeps on wake while the ring is empty, flush() on delivery
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable delivery;
+    std::atomic<bool> drainWaiting;     // the logging thread sleeps or is about to
+    std::atomic<uint32_t> flushWaiters;
+
+    LogRing() : enqueuePos(0), dequeuePos(0), delivered(0), dropped(0), drainWaiting(false), flushWaiters(0)
+    {
+        for (size_t i = 0; i < HID_VL53L5CX_LOG_RING_SIZE; i++)
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+};
+
+static_assert((HID_VL53L5CX_LOG_RING_SIZE & (HID_VL53L5CX_LOG_RING_SIZE - 1)) == 0,
+    "HID_VL53L5CX_LOG_RING_SIZE must be a power of 2");
+
+// Never destroyed, the logging thread runs (or sleeps on its mutex) until the process exits
+LogRing &ring()
+{
+    static LogRing *instance = new LogRing();
+    return *instance;
+}
+
+std::atomic<HID_VL53L5CX_LogSink> logSink(nullptr);
+
+// Set once by the first message, the logging thread never exits
+std::atomic<bool> drainStarted(false);
+
+void consoleSink(uint8_t level, const char *message)
+{
+    (void)level;
+    fputs(message, stdout);
+    fputc('\n', stdout);
+    fflush(stdout);
+}
+
+// True if the next message to drain is written, not only reserved.
+bool published(LogRing &r)
+{
+    size_t pos = r.dequeuePos.load(std::memory_order_relaxed);
+    return r.slots[pos & (HID_VL53L5CX_LOG_RING_SIZE - 1)].sequence.load(std::memory_order_acquire) == pos + 1;
+}
+
+bool drainOne(LogRing &r)
+{
+    size_t pos = r.dequeuePos.load(std::memory_order_relaxed);
+    LogSlot &slot = r.slots[pos & (HID_VL53L5CX_LOG_RING_SIZE - 1)];
+    if (slot.sequence.load(std::memory_order_acquire) != pos + 1)
+        return false;
+
+    // Single consumer, no need to race for the slot
+    r.dequeuePos.store(pos + 1, std::memory_order_relaxed);
+
+    HID_VL53L5CX_LogSink sink = logSink.load(std::memory_order_acquire);
+    (sink != nullptr ? sink : consoleSink)(slot.level, slot.message);
+
+    slot.sequence.store(pos + HID_VL53L5CX_LOG_RING_SIZE, std::memory_order_release);
+
+    // Pairs with flushWaiters in flush(): either it sees this delivery or we see it waiting
+    r.delivered.fetch_add(1, std::memory_order_seq_cst);
+    if (r.flushWaiters.load(std::memory_order_seq_cst) != 0)
+    {
+        { std::lock_guard<std::mutex> lock(r.mutex); }
+        r.delivery.notify_all();
+    }
+    return true;
+}
+
+void drainThread()
+{
+#ifdef _WIN32
+    // The thread runs in the DLL until the process exits, keep the DLL loaded until then
+    HMODULE module;
+    GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_PIN,
+        (LPCWSTR)&drainThread, &module);
+#endif
+
+    LogRing &r = ring();
+    for (;;)
+    {
+        while (drainOne(r))
+        {
+        }
+
+        std::unique_lock<std::mutex> lock(r.mutex);
+        r.drainWaiting.store(true, std::memory_order_seq_cst);
+
+        // Pairs with the fence in write(): either it sees drainWaiting or we see its message
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        r.wake.wait(lock, [&r] { return published(r); });
+        r.drainWaiting.store(false, std::memory_order_relaxed);
+    }
+}
+
+// Starts the logging thread, once per process.
+void startDrain()
+{
+    bool expected = false;
+    if (!drainStarted.load(std::memory_order_acquire) && drainStarted.compare_exchange_strong(expected, true))
+        std::thread(drainThread).detach();
+}
+
+} // namespace
+
+std::atomic<uint8_t> HID_VL53L5CX_Log::level((uint8_t)HID_VL53L5CX_LOG_LEVEL::INFO);
+
+void HID_VL53L5CX_Log::setSink(HID_VL53L5CX_LogSink sink)
+{
+    logSink.store(sink, std::memory_order_release);
+}
+
+void HID_VL53L5CX_Log::write(HID_VL53L5CX_LOG_LEVEL messageLevel, const char *format, ...)
+{
+    LogRing &r = ring();
+
+    size_t pos = r.enqueuePos.load(std::memory_order_relaxed);
+    LogSlot *slot;
+    for (;;)
+    {
+        slot = &r.slots[pos & (HID_VL53L5CX_LOG_RING_SIZE - 1)];
+        size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+        if (diff == 0)
+        {
+            if (r.enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0)
+        {
+            // Full, the logging thread is behind
+            r.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        else
+        {
+            pos = r.enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->level = (uint8_t)messageLevel;
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(slot->message, HID_VL53L5CX_LOG_MESSAGE_SIZE, format, args);
+    va_end(args);
+    if (length < 0)
+        slot->message[0] = '\0';
+
+    // Diagnostics carried over from printf() end with a newline, the sink adds its own
+    size_t end = strnlen(slot->message, HID_VL53L5CX_LOG_MESSAGE_SIZE);
+    while ((end > 0) && (slot->message[end - 1] == '\n'))
+        slot->message[--end] = '\0';
+
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    startDrain();
+
+    // Pairs with the fence in drainThread(): either it sees this message or we see it asleep.
+    // The mutex is only held by the logging thread to look at the ring before it sleeps.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (r.drainWaiting.load(std::memory_order_seq_cst))
+    {
+        { std::lock_guard<std::mutex> lock(r.mutex); }
+        r.wake.notify_one();
+    }
+}
+
+bool HID_VL53L5CX_Log::flush(uint32_t timeoutMs)
+{
+    LogRing &r = ring();
+    size_t target = r.enqueuePos.load(std::memory_order_acquire);
+    std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+
+    if (r.delivered.load(std::memory_order_acquire) >= target)
+        return true;
+
+    startDrain();
+    std::unique_lock<std::mutex> lock(r.mutex);
+    r.flushWaiters.fetch_add(1, std::memory_order_seq_cst);
+    bool delivered = r.delivery.wait_until(lock, deadline,
+        [&r, target] { return r.delivered.load(std::memory_order_seq_cst) >= target; });
+    r.flushWaiters.fetch_sub(1, std::memory_order_relaxed);
+    return delivered;
+}
+
+uint64_t HID_VL53L5CX_Log::droppedCount()
+{
+    return ring().dropped.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,101 @@
+#pragma once
+/*
+  This file declares the driver logger.
+
+  All diagnostics of the DLL go through HID_VL53L5CX_LOG(). A message below
+  the runtime level costs one relaxed atomic load; a message below
+  HID_VL53L5CX_LOG_COMPILE_LEVEL is not compiled at all. Messages that pass
+  are formatted straight into a slot of a fixed size lock-free ring and
+  handed to the sink by a background thread, so the caller never waits for
+  the console (or for nothing, when running as a service). When the ring is
+  full messages are dropped and counted, never blocked on.
+
+  The logging thread starts with the first message and runs until the
+  process exits, asleep while the ring is empty. On Windows it pins the DLL,
+  FreeLibrary() does not unload code the thread still runs in.
+
+  The default sink prints to stdout. setSink() replaces it, the sink is
+  always called from the logging thread, one message at a time.
+*/
+
+#ifndef __HID_VL53L5CX_Log__
+#define __HID_VL53L5CX_Log__
+
+#include <stdint.h>
+#include <atomic>
+
+// Not DEBUG/ERROR, windows.h and the build may define those as macros.
+enum class HID_VL53L5CX_LOG_LEVEL : uint8_t
+{
+    VERBOSE = 0,        // per frame and per transaction details
+    INFO = 1,           // sensor life cycle
+    WARNING = 2,        // something failed but the driver carries on
+    FAILURE = 3,        // an operation failed
+    OFF = 4
+};
+
+// Messages below this level are removed at compile time.
+#ifndef HID_VL53L5CX_LOG_COMPILE_LEVEL
+#define HID_VL53L5CX_LOG_COMPILE_LEVEL 0
+#endif
+
+// Message size including the terminating NUL, longer messages are truncated.
+const uint32_t HID_VL53L5CX_LOG_MESSAGE_SIZE = 240;
+
+// Messages the ring holds before dropping, must be a power of 2.
+const uint32_t HID_VL53L5CX_LOG_RING_SIZE = 1024;
+
+// Receives one message without trailing newline. level is a HID_VL53L5CX_LOG_LEVEL.
+typedef void (*HID_VL53L5CX_LogSink)(uint8_t level, const char *message);
+
+class HID_VL53L5CX_Log
+{
+private:
+    static std::atomic<uint8_t> level;
+
+public:
+    // Messages below newLevel are ignored. The default is INFO.
+    static void setLevel(HID_VL53L5CX_LOG_LEVEL newLevel)
+    {
+        level.store((uint8_t)newLevel, std::memory_order_relaxed);
+    }
+
+    static HID_VL53L5CX_LOG_LEVEL getLevel() { return (HID_VL53L5CX_LOG_LEVEL)level.load(std::memory_order_relaxed); }
+
+    // True if messageLevel is compiled in. A subtraction rather than a comparison of the
+    // level with 0, which -Wtype-limits reports as always true.
+    static constexpr bool compiled(HID_VL53L5CX_LOG_LEVEL messageLevel)
+    {
+        return (int)messageLevel - HID_VL53L5CX_LOG_COMPILE_LEVEL >= 0;
+    }
+
+    static bool enabled(HID_VL53L5CX_LOG_LEVEL messageLevel)
+    {
+        return (uint8_t)messageLevel >= level.load(std::memory_order_relaxed);
+    }
+
+    // nullptr restores the stdout sink.
+    static void setSink(HID_VL53L5CX_LogSink sink);
+
+    // printf style. Never blocks, drops the message if the ring is full.
+    static void write(HID_VL53L5CX_LOG_LEVEL messageLevel, const char *format, ...)
+#if defined(__GNUC__)
+        __attribute__((format(printf, 2, 3)))
+#endif
+        ;
+
+    // Waits (at most timeoutMs) until every message written so far reached the sink.
+    static bool flush(uint32_t timeoutMs = 1000);
+
+    // Messages dropped because the ring was full.
+    static uint64_t droppedCount();
+};
+
+#define HID_VL53L5CX_LOG(messageLevel, ...)                                                         \
+    do {                                                                                           \
+        if (HID_VL53L5CX_Log::compiled(HID_VL53L5CX_LOG_LEVEL::messageLevel) &&                    \
+            HID_VL53L5CX_Log::enabled(HID_VL53L5CX_LOG_LEVEL::messageLevel))                        \
+            HID_VL53L5CX_Log::write(HID_VL53L5CX_LOG_LEVEL::messageLevel, __VA_ARGS__);            \
+    } while (0)
+
+#endif // __HID_VL53L5CX_Log__
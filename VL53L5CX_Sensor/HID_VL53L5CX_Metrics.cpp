@@ -0,0 +1,196 @@
+/*
+  This file implements the driver metrics.
+*/
+
+#include "pch.h" // use stdafx.h in Visual Studio 2017 and earlier
+#include "HID_VL53L5CX_Metrics.h"
+#include "HID_VL53L5CX_Log.h"
+#include <stdio.h>
+#include <new>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Sensors opened by this process, part of the segment name
+static std::atomic<uint32_t> segmentCount(0);
+
+HID_VL53L5CX_Metrics::HID_VL53L5CX_Metrics()
+{
+    void *memory = nullptr;
+    uint32_t size = sizeof(HID_VL53L5CX_MetricsBlock);
+    uint32_t index = segmentCount.fetch_add(1, std::memory_order_relaxed);
+
+#ifdef _WIN32
+    uint32_t processId = (uint32_t)GetCurrentProcessId();
+    snprintf(segmentName, sizeof(segmentName), HID_VL53L5CX_METRICS_NAMESPACE "VL53L5CX_Metrics_%u_%u", processId, index);
+
+    mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, size, segmentName);
+    if ((mapping == NULL) && (GetLastError() == ERROR_ACCESS_DENIED))
+    {
+        // Global\ without SeCreateGlobalPrivilege, at least the session can scrape it
+        HID_VL53L5CX_LOG(WARNING, "Cannot create metrics segment %s, using the Local\\ namespace", segmentName);
+        snprintf(segmentName, sizeof(segmentName), "Local\\VL53L5CX_Metrics_%u_%u", processId, index);
+        mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, size, segmentName);
+    }
+    if (mapping != NULL)
+    {
+        memory = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+        if (memory == NULL)
+        {
+            CloseHandle(mapping);
+            mapping = nullptr;
+        }
+    }
+#else
+    uint32_t processId = (uint32_t)getpid();
+    snprintf(segmentName, sizeof(segmentName), "/VL53L5CX_Metrics_%u_%u", processId, index);
+
+    // A segment left behind by a crashed process with the same pid is reused
+    int fd = shm_open(segmentName, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd >= 0)
+    {
+        if (ftruncate(fd, size) == 0)
+        {
+            memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (memory == MAP_FAILED)
+                memory = nullptr;
+        }
+        close(fd);
+        if (memory == nullptr)
+            shm_unlink(segmentName);
+    }
+    shared = (memory != nullptr);
+#endif
+
+    if (memory == nullptr)
+    {
+        // Metrics keep working inside the process, they just cannot be scraped
+        HID_VL53L5CX_LOG(WARNING, "Cannot create metrics segment %s", segmentName);
+        segmentName[0] = '\0';
+        memory = ::operator new(size);
+    }
+
+    // Counters start at zero, the header is written before anyone can trust it
+    block = new (memory) HID_VL53L5CX_MetricsBlock();
+    block->siliconTempMinDegC.store(INT64_MAX, std::memory_order_relaxed);
+    block->siliconTempMaxDegC.store(INT64_MIN, std::memory_order_relaxed);
+    block->version = HID_VL53L5CX_METRICS_VERSION;
+    block->size = size;
+    block->processId = processId;
+    block->buckets = HID_VL53L5CX_METRICS_BUCKETS;
+    block->statusCodes = HID_VL53L5CX_METRICS_STATUS_CODES;
+    block->errorCodes = HID_VL53L5CX_METRICS_ERROR_CODES;
+    std::atomic_thread_fence(std::memory_order_release);
+    block->magic = HID_VL53L5CX_METRICS_MAGIC;
+}
+
+HID_VL53L5CX_Metrics::~HID_VL53L5CX_Metrics()
+{
+#ifdef _WIN32
+    if (mapping != nullptr)
+    {
+        UnmapViewOfFile(block);
+        CloseHandle(mapping);
+        return;
+    }
+#else
+    if (shared)
+    {
+        // Agents that still have it mapped keep their view
+        munmap(block, sizeof(HID_VL53L5CX_MetricsBlock));
+        shm_unlink(segmentName);
+        return;
+    }
+#endif
+    ::operator delete(block);
+}
+
+void HID_VL53L5CX_Metrics::observe(HID_VL53L5CX_Histogram &histogram, uint64_t value)
+{
+    uint32_t bucket = 0;
+    while ((bucket < HID_VL53L5CX_METRICS_BUCKETS - 1) && ((value >> bucket) != 0))
+        bucket++;
+
+    add(histogram.buckets[bucket]);
+    add(histogram.count);
+    add(histogram.sum, value);
+
+    uint64_t max = histogram.max.load(std::memory_order_relaxed);
+    while ((value > max) && !histogram.max.compare_exchange_weak(max, value, std::memory_order_relaxed))
+        ;
+}
+
+void HID_VL53L5CX_Metrics::setSiliconTemperature(int8_t degC)
+{
+    block->siliconTempDegC.store(degC, std::memory_order_relaxed);
+
+    // Single writer, no need for a compare and swap
+    if (degC < block->siliconTempMinDegC.load(std::memory_order_relaxed))
+        block->siliconTempMinDegC.store(degC, std::memory_order_relaxed);
+    if (degC > block->siliconTempMaxDegC.load(std::memory_order_relaxed))
+        block->siliconTempMaxDegC.store(degC, std::memory_order_relaxed);
+}
+
+bool HID_VL53L5CX_MetricsView::open(const char *name)
+{
+    close();
+    uint32_t size = sizeof(HID_VL53L5CX_MetricsBlock);
+    const void *memory = nullptr;
+
+#ifdef _WIN32
+    mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name);
+    if (mapping == NULL)
+    {
+        mapping = nullptr;
+        return false;
+    }
+    memory = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, size);
+#else
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    if ((fstat(fd, &info) == 0) && ((uint64_t)info.st_size >= size))
+    {
+        memory = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (memory == MAP_FAILED)
+            memory = nullptr;
+    }
+    ::close(fd);
+#endif
+
+    if (memory == nullptr)
+    {
+        close();
+        return false;
+    }
+    block = (const HID_VL53L5CX_MetricsBlock*)memory;
+
+    // Magic is written last, a segment still being created is rejected
+    bool valid = (block->magic == HID_VL53L5CX_METRICS_MAGIC);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    valid = valid && (block->version == HID_VL53L5CX_METRICS_VERSION) && (block->size == size);
+    if (!valid)
+        close();
+    return valid;
+}
+
+void HID_VL53L5CX_MetricsView::close()
+{
+#ifdef _WIN32
+    if (block != nullptr)
+        UnmapViewOfFile(block);
+    if (mapping != nullptr)
+        CloseHandle(mapping);
+    mapping = nullptr;
+#else
+    if (block != nullptr)
+        munmap((void*)block, sizeof(HID_VL53L5CX_MetricsBlock));
+#endif
+    block = nullptr;
+}
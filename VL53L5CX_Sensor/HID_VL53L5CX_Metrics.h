@@ -0,0 +1,225 @@
+#pragma once
+/*
+  This file declares the driver metrics.
+
+  Every HID_VL53L5CX publishes counters and histograms about the bus, the DCI
+  commands and the frames it delivers in a named shared memory segment. A
+  monitoring agent maps the segment read-only and scrapes it on its own
+  schedule, it never calls into the DLL and never slows the driver down.
+
+  The segment is a single HID_VL53L5CX_MetricsBlock. Every field after the
+  header is a 64-bit counter updated with relaxed atomic adds, so a reader
+  always sees whole values but two fields read one after the other may come
+  from different frames. Readers must check magic and version before trusting
+  the layout; any layout change bumps HID_VL53L5CX_METRICS_VERSION.
+
+  Segment names:
+    Windows: Local\VL53L5CX_Metrics_<pid>_<n>   (CreateFileMapping)
+    POSIX:   /VL53L5CX_Metrics_<pid>_<n>        (shm_open)
+  where n counts the sensors opened by the process, starting at 0.
+
+  Local\ names only exist in the session of the process: an agent running as
+  a service (session 0) cannot open the segment of a desktop application.
+  Built with HID_VL53L5CX_METRICS_NAMESPACE "Global\\" the segment is visible
+  to every session, but creating it needs SeCreateGlobalPrivilege, which
+  services and administrators have and normal users do not. Without it the
+  segment falls back to Local\.
+*/
+
+#ifndef __HID_VL53L5CX_Metrics__
+#define __HID_VL53L5CX_Metrics__
+
+#include <stdint.h>
+#include <atomic>
+#include "HID_VL53L5CX_Clock.h"
+
+const uint32_t HID_VL53L5CX_METRICS_MAGIC = 0x584d3556;    // "V5MX"
+const uint32_t HID_VL53L5CX_METRICS_VERSION = 3;
+
+// Kernel object namespace of the segment on Windows, "Local\\" or "Global\\".
+#ifndef HID_VL53L5CX_METRICS_NAMESPACE
+#define HID_VL53L5CX_METRICS_NAMESPACE "Local\\"
+#endif
+
+// Histogram bucket i counts values in [2^(i-1), 2^i), bucket 0 counts zeros
+// and the last bucket everything above.
+const uint32_t HID_VL53L5CX_METRICS_BUCKETS = 24;
+
+// Transport status codes (FT260_STATUS) with a counter of their own, larger codes share the last one.
+const uint32_t HID_VL53L5CX_METRICS_STATUS_CODES = 32;
+
+// Driver error codes (SF_VL53L5CX_ERROR_TYPE) with a counter of their own, larger codes share the last one.
+const uint32_t HID_VL53L5CX_METRICS_ERROR_CODES = 32;
+
+// Bus transaction types, index of busTransactions[] and busBytes[].
+enum class HID_VL53L5CX_BUS_OP : uint8_t
+{
+    READ_BYTE = 0,      // RdByte
+    WRITE_BYTE = 1,     // WrByte
+    READ_MULTI = 2,     // RdMulti
+    WRITE_MULTI = 3     // WrMulti
+};
+
+typedef std::atomic<uint64_t> HID_VL53L5CX_Counter;
+typedef std::atomic<int64_t> HID_VL53L5CX_Gauge;
+
+// Shared memory readers treat the counters as plain 64-bit integers.
+static_assert(sizeof(HID_VL53L5CX_Counter) == sizeof(uint64_t), "counters must have the size of a uint64_t");
+
+struct HID_VL53L5CX_Histogram
+{
+    HID_VL53L5CX_Counter count;
+    HID_VL53L5CX_Counter sum;
+    HID_VL53L5CX_Counter max;
+    HID_VL53L5CX_Counter buckets[HID_VL53L5CX_METRICS_BUCKETS];
+};
+
+struct HID_VL53L5CX_MetricsBlock
+{
+    // Header, written once before the segment is used
+    uint32_t magic;                 // HID_VL53L5CX_METRICS_MAGIC
+    uint32_t version;               // HID_VL53L5CX_METRICS_VERSION
+    uint32_t size;                  // sizeof(HID_VL53L5CX_MetricsBlock)
+    uint32_t processId;
+    uint32_t buckets;               // HID_VL53L5CX_METRICS_BUCKETS
+    uint32_t statusCodes;           // HID_VL53L5CX_METRICS_STATUS_CODES
+    uint32_t errorCodes;            // HID_VL53L5CX_METRICS_ERROR_CODES
+    uint32_t reserved0;
+    uint64_t reserved[4];
+
+    // Bus, indexed by HID_VL53L5CX_BUS_OP
+    HID_VL53L5CX_Counter busTransactions[4];
+    HID_VL53L5CX_Counter busBytes[4];
+
+    // Failed transactions, indexed by transport status (FT260_STATUS)
+    HID_VL53L5CX_Counter transportErrors[HID_VL53L5CX_METRICS_STATUS_CODES];
+
+    // DCI read/write commands, microseconds from request to answer
+    HID_VL53L5CX_Histogram dciLatencyUs;
+
+    // Data ready polls, all of them and the polls needed per delivered frame
+    HID_VL53L5CX_Counter dataReadyPolls;
+    HID_VL53L5CX_Histogram pollsPerFrame;
+
+    // Frames read, frames the sensor produced but were never read (stream
+    // count gaps) and frames that failed to read or decode
+    HID_VL53L5CX_Counter framesDelivered;
+    HID_VL53L5CX_Counter framesDropped;
+    HID_VL53L5CX_Counter framesCorrupted;
+
+    // Microseconds between the frame becoming ready and getRangingData()
+    // returning it. The ready time is estimated as the midpoint between the
+    // last poll that saw no data and the poll that saw it.
+    HID_VL53L5CX_Histogram frameAgeUs;
+
+    // Silicon temperature of the last frame and the range seen, degrees C
+    HID_VL53L5CX_Gauge siliconTempDegC;
+    HID_VL53L5CX_Gauge siliconTempMinDegC;
+    HID_VL53L5CX_Gauge siliconTempMaxDegC;
+
+    // Frame callbacks of the stream, microseconds spent in the client code.
+    // A consumer slower than the frame period shows up here.
+    HID_VL53L5CX_Histogram frameCallbackUs;
+
+    // Failed HID_VL53L5CX calls, indexed by SF_VL53L5CX_ERROR_TYPE
+    HID_VL53L5CX_Counter driverErrors[HID_VL53L5CX_METRICS_ERROR_CODES];
+};
+
+// Owns the shared memory segment of one sensor.
+class HID_VL53L5CX_Metrics
+{
+private:
+    HID_VL53L5CX_MetricsBlock *block;
+    char segmentName[64];
+
+#ifdef _WIN32
+    void *mapping = nullptr;        // HANDLE
+#else
+    bool shared = false;
+#endif
+
+public:
+    // Creates and initializes the segment. If shared memory is not available
+    // the metrics are still collected in process memory and name() is empty.
+    HID_VL53L5CX_Metrics();
+    ~HID_VL53L5CX_Metrics();
+
+    HID_VL53L5CX_MetricsBlock *data() { return block; }
+
+    // Segment name to open with HID_VL53L5CX_MetricsView, empty if not shared.
+    const char *name() const { return segmentName; }
+
+    static void add(HID_VL53L5CX_Counter &counter, uint64_t value = 1)
+    {
+        counter.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    static void observe(HID_VL53L5CX_Histogram &histogram, uint64_t value);
+
+    // Counts one bus transaction and, if it failed, its transport status.
+    static void transaction(HID_VL53L5CX_MetricsBlock *metrics, HID_VL53L5CX_BUS_OP op, uint32_t bytes, uint8_t status)
+    {
+        add(metrics->busTransactions[(int)op]);
+        add(metrics->busBytes[(int)op], bytes);
+        if (status != 0)
+            add(metrics->transportErrors[(status < HID_VL53L5CX_METRICS_STATUS_CODES) ? status : (HID_VL53L5CX_METRICS_STATUS_CODES - 1)]);
+    }
+
+    void setSiliconTemperature(int8_t degC);
+
+    HID_VL53L5CX_Metrics(const HID_VL53L5CX_Metrics&) = delete;
+    HID_VL53L5CX_Metrics& operator=(const HID_VL53L5CX_Metrics&) = delete;
+};
+
+// Times a DCI command into dciLatencyUs, does nothing without metrics.
+class HID_VL53L5CX_MetricsTimer
+{
+private:
+    HID_VL53L5CX_MetricsBlock *metrics;
+    HID_VL53L5CX_Clock *clock;
+    uint64_t startNs = 0;
+
+public:
+    HID_VL53L5CX_MetricsTimer(HID_VL53L5CX_MetricsBlock *_metrics, HID_VL53L5CX_Clock *_clock)
+        : metrics(_metrics), clock((_clock != nullptr) ? _clock : HID_VL53L5CX_Clock::systemClock())
+    {
+        if (metrics != nullptr)
+            startNs = clock->nowNs();
+    }
+
+    ~HID_VL53L5CX_MetricsTimer()
+    {
+        if (metrics != nullptr)
+            HID_VL53L5CX_Metrics::observe(metrics->dciLatencyUs, (clock->nowNs() - startNs) / 1000);
+    }
+
+    HID_VL53L5CX_MetricsTimer(const HID_VL53L5CX_MetricsTimer&) = delete;
+    HID_VL53L5CX_MetricsTimer& operator=(const HID_VL53L5CX_MetricsTimer&) = delete;
+};
+
+// Read-only view of a segment published by another HID_VL53L5CX, possibly in
+// another process. This is what a monitoring agent does, it needs no DLL.
+class HID_VL53L5CX_MetricsView
+{
+private:
+    const HID_VL53L5CX_MetricsBlock *block = nullptr;
+
+#ifdef _WIN32
+    void *mapping = nullptr;        // HANDLE
+#endif
+
+public:
+    HID_VL53L5CX_MetricsView() {}
+    ~HID_VL53L5CX_MetricsView() { close(); }
+
+    // Returns false if the segment does not exist or has an unknown layout.
+    bool open(const char *name);
+    void close();
+
+    const HID_VL53L5CX_MetricsBlock *data() const { return block; }
+
+    HID_VL53L5CX_MetricsView(const HID_VL53L5CX_MetricsView&) = delete;
+    HID_VL53L5CX_MetricsView& operator=(const HID_VL53L5CX_MetricsView&) = delete;
+};
+
+#endif // __HID_VL53L5CX_Metrics__
@@ -0,0 +1,208 @@
+/*
+  This file implements the motion stream of the motion indicator.
+*/
+
+#include "pch.h" // use stdafx.h in Visual Studio 2017 and earlier
+#include "HID_VL53L5CX_Motion.h"
+#include "HID_VL53L5CX_Roi.h"
+#include <algorithm>
+#include <string.h>
+
+#ifdef HID_VL53L5CX_ROI_SSE2
+#include <emmintrin.h>
+#endif
+
+// Window of the firmware, see vl53l5cx_motion_indicator_set_distance_motion()
+const uint16_t MOTION_MIN_DISTANCE_MM = 400;
+const uint16_t MOTION_MAX_DISTANCE_MM = 4000;
+const uint16_t MOTION_MAX_WINDOW_MM = 1500;
+const uint16_t MOTION_DEFAULT_MAX_DISTANCE_MM = 1500;
+
+HID_VL53L5CX_Motion::HID_VL53L5CX_Motion(const VL53L5CX_MotionConfig &_config, bool _vectorised)
+    : config(_config), vectorised(_vectorised), motionFrames(0), overwritten(0), eventsOverwritten(0)
+{
+    threshold = (config.threshold != 0) ? config.threshold : 44;
+    minAggregates = (config.min_aggregates != 0) ? config.min_aggregates : 1;
+    startFrames = (config.start_frames != 0) ? config.start_frames : 2;
+    stopFrames = (config.stop_frames != 0) ? config.stop_frames : 15;
+    memset(&last, 0, sizeof(last));
+}
+
+VL53L5CX_MotionConfig HID_VL53L5CX_Motion::defaults()
+{
+    VL53L5CX_MotionConfig config;
+    memset(&config, 0, sizeof(config));
+    config.min_distance_mm = MOTION_MIN_DISTANCE_MM;
+    config.max_distance_mm = MOTION_DEFAULT_MAX_DISTANCE_MM;
+    config.threshold = 44;
+    config.min_aggregates = 1;
+    config.start_frames = 2;
+    config.stop_frames = 15;
+    return config;
+}
+
+uint16_t HID_VL53L5CX_Motion::minDistanceMm(const VL53L5CX_MotionConfig &config)
+{
+    return (config.min_distance_mm != 0) ? config.min_distance_mm : MOTION_MIN_DISTANCE_MM;
+}
+
+uint16_t HID_VL53L5CX_Motion::maxDistanceMm(const VL53L5CX_MotionConfig &config)
+{
+    return (config.max_distance_mm != 0) ? config.max_distance_mm : MOTION_DEFAULT_MAX_DISTANCE_MM;
+}
+
+bool HID_VL53L5CX_Motion::check(const VL53L5CX_MotionConfig &config)
+{
+#ifdef VL53L5CX_DISABLE_MOTION_INDICATOR
+    (void)config;
+    return false;
+#else
+    uint16_t minMm = minDistanceMm(config), maxMm = maxDistanceMm(config);
+    return (minMm >= MOTION_MIN_DISTANCE_MM) && (maxMm <= MOTION_MAX_DISTANCE_MM) && (minMm < maxMm)
+        && (maxMm - minMm <= MOTION_MAX_WINDOW_MM);
+#endif
+}
+
+uint32_t HID_VL53L5CX_Motion::reached(const uint32_t *scores, uint32_t count, uint32_t threshold, bool vectorised)
+{
+    count = std::min(count, (uint32_t)VL53L5CX_MOTION_AGGREGATES);
+    uint32_t all = (count >= 32) ? UINT32_MAX : ((1u << count) - 1);
+#ifdef HID_VL53L5CX_ROI_SSE2
+    if (vectorised)
+    {
+        // Four aggregates per step, the array always holds 32. Signed compares are
+        // fine: the ULD divides the scores by 65535, they stay far below 2^31.
+        __m128i limit = _mm_set1_epi32((int)std::min(threshold, (uint32_t)INT32_MAX) - 1);
+        uint32_t mask = 0;
+        for (uint32_t i = 0; i < count; i += 4)
+        {
+            __m128i over = _mm_cmpgt_epi32(_mm_loadu_si128((const __m128i *)(scores + i)), limit);
+            mask |= (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(over)) << i;
+        }
+        return mask & all;
+    }
+#endif
+    (void)vectorised;
+    uint32_t mask = 0;
+    for (uint32_t i = 0; i < count; i++)
+        mask |= (uint32_t)(scores[i] >= threshold) << i;
+    return mask & all;
+}
+
+void HID_VL53L5CX_Motion::emit(uint8_t type, const VL53L5CX_MotionFrame &frame)
+{
+    VL53L5CX_MotionEvent event;
+    memset(&event, 0, sizeof(event));
+    event.timestamp_ns = frame.timestamp_ns;
+    event.peak = peak;
+    if ((type == VL53L5CX_MOTION_EVENT_STOPPED) && (frame.timestamp_ns > startedNs))
+        event.duration_ms = (uint32_t)((frame.timestamp_ns - startedNs) / 1000000ULL);
+    event.type = type;
+    event.aggregates = (uint8_t)HID_VL53L5CX_Roi::zoneCount(frame.motion_mask);
+
+    std::lock_guard<std::mutex> guard(lock);
+    if (eventsQueued == HID_VL53L5CX_MOTION_QUEUE)
+    {
+        // Full: the oldest event makes room
+        eventHead = (eventHead + 1) % HID_VL53L5CX_MOTION_QUEUE;
+        eventsQueued--;
+        eventsOverwritten.fetch_add(1, std::memory_order_relaxed);
+    }
+    events[(eventHead + eventsQueued) % HID_VL53L5CX_MOTION_QUEUE] = event;
+    eventsQueued++;
+}
+
+void HID_VL53L5CX_Motion::update(const VL53L5CX_ResultsData &results, uint64_t timestampNs)
+{
+#ifndef VL53L5CX_DISABLE_MOTION_INDICATOR
+    VL53L5CX_MotionFrame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.timestamp_ns = timestampNs;
+    frame.global_indicator_1 = results.motion_indicator.global_indicator_1;
+    frame.global_indicator_2 = results.motion_indicator.global_indicator_2;
+    frame.status = results.motion_indicator.status;
+    frame.detected_aggregates = results.motion_indicator.nb_of_detected_aggregates;
+    frame.aggregates = (uint8_t)std::min((uint32_t)results.motion_indicator.nb_of_aggregates, (uint32_t)VL53L5CX_MOTION_AGGREGATES);
+    memcpy(frame.motion, results.motion_indicator.motion, sizeof(frame.motion));
+    frame.motion_mask = reached(frame.motion, frame.aggregates, threshold, vectorised);
+
+    uint32_t framePeak = 0;
+    for (uint32_t i = 0; i < frame.aggregates; i++)
+        framePeak = std::max(framePeak, frame.motion[i]);
+    bool motion = HID_VL53L5CX_Roi::zoneCount(frame.motion_mask) >= minAggregates;
+    if (motion)
+    {
+        motionFrames.fetch_add(1, std::memory_order_relaxed);
+        peak = std::max(peak, framePeak);
+    }
+
+    // Frames in a row that disagree with the state flip it
+    streak = (motion != moving) ? streak + 1 : 0;
+    if (!moving)
+    {
+        if (!motion)
+            peak = 0;
+        else if (streak == 1)
+            startedNs = timestampNs;
+        if (streak >= startFrames)
+        {
+            moving = true;
+            streak = 0;
+            emit(VL53L5CX_MOTION_EVENT_STARTED, frame);
+        }
+    }
+    else if (streak >= stopFrames)
+    {
+        moving = false;
+        streak = 0;
+        emit(VL53L5CX_MOTION_EVENT_STOPPED, frame);
+        peak = 0;
+    }
+    frame.moving = moving ? 1 : 0;
+
+    std::lock_guard<std::mutex> guard(lock);
+    last = frame;
+    hasLast = true;
+    if (queued == HID_VL53L5CX_MOTION_QUEUE)
+    {
+        head = (head + 1) % HID_VL53L5CX_MOTION_QUEUE;
+        queued--;
+        overwritten.fetch_add(1, std::memory_order_relaxed);
+    }
+    frames[(head + queued) % HID_VL53L5CX_MOTION_QUEUE] = frame;
+    queued++;
+#else
+    (void)results;
+    (void)timestampNs;
+#endif
+}
+
+bool HID_VL53L5CX_Motion::latest(VL53L5CX_MotionFrame &out)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (hasLast)
+        out = last;
+    return hasLast;
+}
+
+uint32_t HID_VL53L5CX_Motion::read(VL53L5CX_MotionFrame *out, uint32_t capacity)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    uint32_t moved = std::min(capacity, queued);
+    for (uint32_t i = 0; i < moved; i++)
+        out[i] = frames[(head + i) % HID_VL53L5CX_MOTION_QUEUE];
+    head = (head + moved) % HID_VL53L5CX_MOTION_QUEUE;
+    queued -= moved;
+    return moved;
+}
+
+uint32_t HID_VL53L5CX_Motion::readEvents(VL53L5CX_MotionEvent *out, uint32_t capacity)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    uint32_t moved = std::min(capacity, eventsQueued);
+    for (uint32_t i = 0; i < moved; i++)
+        out[i] = events[(eventHead + i) % HID_VL53L5CX_MOTION_QUEUE];
+    eventHead = (eventHead + moved) % HID_VL53L5CX_MOTION_QUEUE;
+    eventsQueued -= moved;
+    return moved;
+}
@@ -0,0 +1,112 @@
+#pragma once
+/*
+  This file declares the motion stream of the motion indicator.
+
+  The VL53L5CX firmware runs a motion detector of its own: within a distance
+  window it compares the histograms of every zone with the ones of earlier
+  frames and reports a score per aggregate of zones, along with two global
+  indicators, in every frame. HID_VL53L5CX::setMotionIndicator() programs
+  the window and the zone to aggregate map; the scores arrive in the
+  motion_indicator block of the ULD results, so the host does no frame
+  differencing of its own.
+
+  Every frame read is turned into a VL53L5CX_MotionFrame: the firmware
+  results and the mask of the aggregates whose score reached the threshold
+  (four aggregates per step with SSE2, one otherwise). A frame with at least
+  min_aggregates of them has motion; start_frames of those in a row open a
+  motion event, stop_frames without close it again.
+
+  Everything lives in fixed arrays: rings of the newest motion frames and
+  events for read() and readEvents(). Nothing is allocated per frame.
+*/
+
+#ifndef __HID_VL53L5CX_Motion__
+#define __HID_VL53L5CX_Motion__
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include "VL53L5CXSensor.h"
+#include "vl53l5cx_api.h"
+
+// Motion frames and events kept for read() and readEvents()
+#define HID_VL53L5CX_MOTION_QUEUE 64
+
+class HID_VL53L5CX_Motion
+{
+private:
+    VL53L5CX_MotionConfig config;
+    bool vectorised;
+    uint32_t threshold;
+    uint8_t minAggregates;
+    uint8_t startFrames;
+    uint8_t stopFrames;
+
+    // Hysteresis of the motion event
+    bool moving = false;
+    uint32_t streak = 0;                // frames in a row that disagree with moving
+    uint64_t startedNs = 0;
+    uint32_t peak = 0;
+
+    // Newest motion frames and events, guarded by lock
+    std::mutex lock;
+    VL53L5CX_MotionFrame frames[HID_VL53L5CX_MOTION_QUEUE];
+    uint32_t head = 0;
+    uint32_t queued = 0;
+    VL53L5CX_MotionFrame last;
+    bool hasLast = false;
+    VL53L5CX_MotionEvent events[HID_VL53L5CX_MOTION_QUEUE];
+    uint32_t eventHead = 0;
+    uint32_t eventsQueued = 0;
+    std::atomic<uint64_t> motionFrames;
+    std::atomic<uint64_t> overwritten;
+    std::atomic<uint64_t> eventsOverwritten;
+
+    void emit(uint8_t type, const VL53L5CX_MotionFrame &frame);
+
+public:
+    // config must pass check(), it is copied. vectorised = false runs the scalar kernel.
+    HID_VL53L5CX_Motion(const VL53L5CX_MotionConfig &config, bool vectorised = true);
+
+    // Motion indicator with the firmware defaults: 400 mm to 1500 mm, a threshold of 44,
+    // one aggregate, 2 frames to start and 15 to stop a motion event.
+    static VL53L5CX_MotionConfig defaults();
+
+    // False if the distance window is not one the firmware takes (see
+    // vl53l5cx_motion_indicator_set_distance_motion()), or if the ULD is built
+    // without the motion indicator results.
+    static bool check(const VL53L5CX_MotionConfig &config);
+
+    // Distance window of config with the defaults filled in.
+    static uint16_t minDistanceMm(const VL53L5CX_MotionConfig &config);
+    static uint16_t maxDistanceMm(const VL53L5CX_MotionConfig &config);
+
+    // Bit i set for the scores[i], i < count, that reach threshold. scores holds
+    // VL53L5CX_MOTION_AGGREGATES values.
+    static uint32_t reached(const uint32_t *scores, uint32_t count, uint32_t threshold, bool vectorised = true);
+
+    // Takes the motion results of one frame.
+    void update(const VL53L5CX_ResultsData &results, uint64_t timestampNs);
+
+    // Copies the motion of the last frame, false before the first one. Safe
+    // against a concurrent update().
+    bool latest(VL53L5CX_MotionFrame &out);
+
+    // Moves up to capacity of the oldest queued motion frames to out, without waiting.
+    uint32_t read(VL53L5CX_MotionFrame *out, uint32_t capacity);
+
+    // Moves up to capacity of the oldest queued motion events to out, without waiting.
+    uint32_t readEvents(VL53L5CX_MotionEvent *out, uint32_t capacity);
+
+    // Frames with motion so far.
+    uint64_t motionCount() const { return motionFrames.load(std::memory_order_relaxed); }
+
+    // Motion frames and events that were overwritten before they were read.
+    uint64_t overwrittenCount() { return overwritten.load(std::memory_order_relaxed); }
+    uint64_t eventsOverwrittenCount() { return eventsOverwritten.load(std::memory_order_relaxed); }
+
+    HID_VL53L5CX_Motion(const HID_VL53L5CX_Motion&) = delete;
+    HID_VL53L5CX_Motion& operator=(const HID_VL53L5CX_Motion&) = delete;
+};
+
+#endif // __HID_VL53L5CX_Motion__
@@ -0,0 +1,188 @@
+/*
+  This file implements the spatial outlier check.
+*/
+
+#include "pch.h" // use stdafx.h in Visual Studio 2017 and earlier
+#include "HID_VL53L5CX_Outliers.h"
+#include <algorithm>
+#include <stdlib.h>
+
+#ifdef HID_VL53L5CX_ROI_SSE2
+#include <emmintrin.h>
+#endif
+
+// Confident neighbours a zone needs to be judged
+const uint32_t OUTLIER_MIN_NEIGHBOURS = 3;
+
+// The up to eight neighbours of every zone of a square grid
+struct NeighbourTable
+{
+    uint8_t count[VL53L5CX_FRAME_MAX_ZONES];
+    uint8_t zone[VL53L5CX_FRAME_MAX_ZONES][8];
+};
+
+static constexpr NeighbourTable neighbourTable(int32_t width)
+{
+    NeighbourTable table = {};
+    for (int32_t zone = 0; zone < width * width; zone++)
+    {
+        for (int32_t dy = -1; dy <= 1; dy++)
+        {
+            for (int32_t dx = -1; dx <= 1; dx++)
+            {
+                int32_t row = zone / width + dy;
+                int32_t column = zone % width + dx;
+                if (((dx == 0) && (dy == 0)) || (row < 0) || (row >= width) || (column < 0) || (column >= width))
+                    continue;
+                table.zone[zone][table.count[zone]++] = (uint8_t)(row * width + column);
+            }
+        }
+    }
+    return table;
+}
+
+static constexpr NeighbourTable NEIGHBOURS_4X4 = neighbourTable(4);
+static constexpr NeighbourTable NEIGHBOURS_8X8 = neighbourTable(8);
+
+static uint64_t findScalar(const VL53L5CX_Frame &frame, uint64_t confident, uint16_t gate, const NeighbourTable &table,
+    uint32_t zones)
+{
+    uint64_t outliers = 0;
+    for (uint32_t zone = 0; zone < zones; zone++)
+    {
+        if (!((confident >> zone) & 1))
+            continue;
+
+        // Insertion sort, eight values at most
+        int16_t values[8];
+        uint32_t count = 0;
+        for (uint32_t i = 0; i < table.count[zone]; i++)
+        {
+            uint32_t neighbour = table.zone[zone][i];
+            if (!((confident >> neighbour) & 1))
+                continue;
+            int16_t value = frame.distance_mm[neighbour];
+            uint32_t j = count++;
+            for (; (j > 0) && (values[j - 1] > value); j--)
+                values[j] = values[j - 1];
+            values[j] = value;
+        }
+        if (count < OUTLIER_MIN_NEIGHBOURS)
+            continue;
+
+        // Even counts take the lower of the two middle values
+        int32_t deviation = abs((int32_t)frame.distance_mm[zone] - values[(count - 1) / 2]);
+        if (std::min(deviation, (int32_t)INT16_MAX) > gate)
+            outliers |= 1ULL << zone;
+    }
+    return outliers;
+}
+
+#ifdef HID_VL53L5CX_ROI_SSE2
+
+// Lanes of the eight zones from base on that are set in zones
+static __m128i zoneLanes(uint64_t zones, uint32_t base)
+{
+    const __m128i lanes = _mm_setr_epi16(1, 2, 4, 8, 16, 32, 64, 128);
+    __m128i bits = _mm_set1_epi16((short)((zones >> base) & 0xFF));
+    return _mm_cmpeq_epi16(_mm_and_si128(bits, lanes), lanes);
+}
+
+static inline void sortPair(__m128i &low, __m128i &high)
+{
+    __m128i smaller = _mm_min_epi16(low, high);
+    high = _mm_max_epi16(low, high);
+    low = smaller;
+}
+
+// Batcher's odd-even merge sort of eight vectors, every lane sorted on its own
+static inline void sortEight(__m128i v[8])
+{
+    sortPair(v[0], v[1]); sortPair(v[2], v[3]); sortPair(v[4], v[5]); sortPair(v[6], v[7]);
+    sortPair(v[0], v[2]); sortPair(v[1], v[3]); sortPair(v[4], v[6]); sortPair(v[5], v[7]);
+    sortPair(v[1], v[2]); sortPair(v[5], v[6]);
+    sortPair(v[0], v[4]); sortPair(v[1], v[5]); sortPair(v[2], v[6]); sortPair(v[3], v[7]);
+    sortPair(v[2], v[4]); sortPair(v[3], v[5]);
+    sortPair(v[1], v[2]); sortPair(v[3], v[4]); sortPair(v[5], v[6]);
+}
+
+// One grid row per vector, lane i is column i. Unconfident zones and the
+// zones beyond the edges are INT16_MAX so they sort last; a confident zone is
+// always closer, the distance window of the rules is exclusive.
+static uint64_t findSse2(const VL53L5CX_Frame &frame, uint64_t confident, uint16_t gate, uint32_t width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i none = _mm_set1_epi16(INT16_MAX);
+    const __m128i eight = _mm_set1_epi16(8);
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i gates = _mm_set1_epi16((short)gate);
+    const __m128i minNeighbours = _mm_set1_epi16((short)(OUTLIER_MIN_NEIGHBOURS - 1));
+    const __m128i firstNone = _mm_setr_epi16(INT16_MAX, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i lastNone = _mm_setr_epi16(0, 0, 0, 0, 0, 0, 0, INT16_MAX);
+    const __m128i columns = (width == 8) ? _mm_set1_epi16(-1) : _mm_setr_epi16(-1, -1, -1, -1, 0, 0, 0, 0);
+
+    // Rows with unconfident zones masked out, a row of nothing above and below the grid
+    __m128i rows[10];
+    rows[0] = none;
+    rows[width + 1] = none;
+    for (uint32_t row = 0; row < width; row++)
+    {
+        const int16_t *zones = &frame.distance_mm[row * width];
+        __m128i distance = (width == 8) ? _mm_loadu_si128((const __m128i *)zones) : _mm_loadl_epi64((const __m128i *)zones);
+        __m128i valid = _mm_and_si128(zoneLanes(confident, row * width), columns);
+        rows[row + 1] = _mm_or_si128(_mm_and_si128(valid, distance), _mm_andnot_si128(valid, none));
+    }
+
+    uint64_t outliers = 0;
+    for (uint32_t row = 1; row <= width; row++)
+    {
+        // Left neighbours move up one lane, right neighbours down
+        __m128i values[8] = {
+            _mm_or_si128(_mm_slli_si128(rows[row - 1], 2), firstNone), rows[row - 1], _mm_or_si128(_mm_srli_si128(rows[row - 1], 2), lastNone),
+            _mm_or_si128(_mm_slli_si128(rows[row], 2), firstNone), _mm_or_si128(_mm_srli_si128(rows[row], 2), lastNone),
+            _mm_or_si128(_mm_slli_si128(rows[row + 1], 2), firstNone), rows[row + 1], _mm_or_si128(_mm_srli_si128(rows[row + 1], 2), lastNone) };
+
+        __m128i count = eight;
+        for (uint32_t i = 0; i < 8; i++)
+            count = _mm_add_epi16(count, _mm_cmpeq_epi16(values[i], none));
+
+        sortEight(values);
+
+        // Lower median of the count real values, at most the fourth
+        __m128i middle = _mm_srai_epi16(_mm_sub_epi16(count, ones), 1);
+        __m128i median = zero;
+        for (uint32_t i = 0; i < 4; i++)
+            median = _mm_or_si128(median, _mm_and_si128(_mm_cmpeq_epi16(middle, _mm_set1_epi16((short)i)), values[i]));
+
+        __m128i difference = _mm_subs_epi16(rows[row], median);
+        __m128i deviation = _mm_max_epi16(difference, _mm_subs_epi16(zero, difference));
+        __m128i outlier = _mm_and_si128(_mm_cmpgt_epi16(deviation, gates), _mm_cmpgt_epi16(count, minNeighbours));
+        outlier = _mm_andnot_si128(_mm_cmpeq_epi16(rows[row], none), outlier);
+        outliers |= (uint64_t)(_mm_movemask_epi8(_mm_packs_epi16(outlier, zero)) & 0xFF) << ((row - 1) * width);
+    }
+    return outliers;
+}
+
+#endif // HID_VL53L5CX_ROI_SSE2
+
+uint64_t HID_VL53L5CX_Outliers::find(const VL53L5CX_Frame &frame, uint64_t confident, uint16_t maxDeviationMm, bool vectorised)
+{
+    uint32_t width;
+    if (frame.resolution == 16)
+        width = 4;
+    else if (frame.resolution == 64)
+        width = 8;
+    else
+        return 0;
+
+    // A deviation beyond INT16_MAX saturates, the gate must stay below it
+    uint16_t gate = std::min(maxDeviationMm, (uint16_t)(INT16_MAX - 1));
+    confident &= HID_VL53L5CX_Roi::allZones(frame.resolution);
+
+#ifdef HID_VL53L5CX_ROI_SSE2
+    if (vectorised)
+        return findSse2(frame, confident, gate, width);
+#endif
+    (void)vectorised;
+    return findScalar(frame, confident, gate, (width == 4) ? NEIGHBOURS_4X4 : NEIGHBOURS_8X8, frame.resolution);
+}
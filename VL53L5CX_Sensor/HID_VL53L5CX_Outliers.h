@@ -0,0 +1,35 @@
+#pragma once
+/*
+  This file declares the spatial outlier check.
+
+  Multipath and the edge of an object make single zones report a distance
+  that has nothing to do with the zones around them. A zone is an outlier
+  when its distance is farther than a gate from the median of its 3x3
+  neighbours, counting only neighbours that are confident themselves (those
+  that pass the status, sigma and signal rules of a VL53L5CX_Roi). Zones with
+  fewer than three confident neighbours are kept, there is nothing to judge
+  them by.
+
+  With SSE2 one grid row is one vector (8 zones at 8x8, 4 at 4x4); the eight
+  neighbours are the rows above and below and all three rows shifted by one
+  zone, and a sorting network gives the median of every zone of the row at
+  once. The scalar version walks the constexpr neighbour tables and gives the
+  same results.
+*/
+
+#ifndef __HID_VL53L5CX_Outliers__
+#define __HID_VL53L5CX_Outliers__
+
+#include <stdint.h>
+#include "HID_VL53L5CX_Roi.h"
+#include "VL53L5CXSensor.h"
+
+class HID_VL53L5CX_Outliers
+{
+public:
+    // Zones of confident (a validZones() result) farther than maxDeviationMm from
+    // the median of their confident neighbours. 0 if the frame is neither 4x4 nor 8x8.
+    static uint64_t find(const VL53L5CX_Frame &frame, uint64_t confident, uint16_t maxDeviationMm, bool vectorised = true);
+};
+
+#endif // __HID_VL53L5CX_Outliers__
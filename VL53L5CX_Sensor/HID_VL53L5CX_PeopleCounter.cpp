@@ -0,0 +1,320 @@
+/*
+  This file implements the people counter.
+*/
+
+#include "pch.h" // use stdafx.h in Visual Studio 2017 and earlier
+#include "HID_VL53L5CX_PeopleCounter.h"
+#include "HID_VL53L5CX_Background.h"
+#include "HID_VL53L5CX_Roi.h"
+#include <algorithm>
+#include <string.h>
+
+// How far past the line a centroid must be to be on a side, in zones
+const float COUNTER_HYSTERESIS_ZONES = 0.5f;
+
+// Weight of the newest movement in the blob speed
+const float COUNTER_SPEED_ALPHA = 0.5f;
+
+// Longest gap between frames a track is predicted over
+const double COUNTER_MAX_DT = 1.0;
+
+HID_VL53L5CX_PeopleCounter::HID_VL53L5CX_PeopleCounter(const VL53L5CX_CounterConfig &_config)
+    : config(_config), overwritten(0), dropped(0)
+{
+    minZones = (config.min_zones != 0) ? config.min_zones : 1;
+    gate = (config.gate_zones != 0) ? config.gate_zones : 2;
+    maxMisses = (config.max_misses != 0) ? config.max_misses : 3;
+    crossings[0].store(0, std::memory_order_relaxed);
+    crossings[1].store(0, std::memory_order_relaxed);
+    memset(events, 0, sizeof(events));
+    memset(published, 0, sizeof(published));
+    reset(0);
+}
+
+VL53L5CX_CounterConfig HID_VL53L5CX_PeopleCounter::defaults()
+{
+    VL53L5CX_CounterConfig config;
+    memset(&config, 0, sizeof(config));
+    config.roi = HID_VL53L5CX_Roi::defaults();
+    config.roi.status_mask = (1u << 5) | (1u << 9);
+    config.roi.max_distance_mm = 4000;
+    config.margin_mm = 300;
+    config.learn_frames = 15;
+    config.axis = VL53L5CX_COUNTER_ACROSS_ROWS;
+    config.line_percent = 50;
+    config.min_zones = 1;
+    config.gate_zones = 2;
+    config.max_misses = 3;
+    return config;
+}
+
+bool HID_VL53L5CX_PeopleCounter::check(const VL53L5CX_CounterConfig &config)
+{
+    return (config.roi.min_distance_mm < config.roi.max_distance_mm) && (config.margin_mm >= 0)
+        && (config.axis <= VL53L5CX_COUNTER_ACROSS_COLUMNS) && (config.line_percent <= 100);
+}
+
+VL53L5CX_BackgroundConfig HID_VL53L5CX_PeopleCounter::backgroundConfig(const VL53L5CX_CounterConfig &config)
+{
+    VL53L5CX_BackgroundConfig background = HID_VL53L5CX_Background::defaults();
+    background.roi = config.roi;
+    background.margin_mm = config.margin_mm;
+    background.learn_frames = config.learn_frames;
+    return background;
+}
+
+void HID_VL53L5CX_PeopleCounter::reset(uint8_t _resolution)
+{
+    resolution = _resolution;
+    uint32_t width = (resolution == 64) ? 8 : 4;
+    zoneMask = ((config.roi.zone_mask != 0) ? config.roi.zone_mask : UINT64_MAX) & HID_VL53L5CX_Roi::allZones(resolution);
+    uint32_t percent = (config.line_percent != 0) ? config.line_percent : 50;
+    line = percent * width / 100.0f - 0.5f;
+
+    memset(state, 0, sizeof(state));
+    lastFrameNs = 0;
+
+    std::lock_guard<std::mutex> guard(lock);
+    publishedCount = 0;
+}
+
+uint32_t HID_VL53L5CX_PeopleCounter::segment(uint64_t foreground, const VL53L5CX_Frame &frame)
+{
+    uint32_t width = (resolution == 64) ? 8 : 4;
+    uint64_t firstColumn = (width == 8) ? 0x0101010101010101ULL : 0x1111ULL;
+    uint64_t firstRow = (width == 8) ? 0xFFULL : 0xFULL;
+
+    uint32_t count = 0;
+    for (uint64_t remaining = foreground; remaining != 0;)
+    {
+        uint64_t blob = HID_VL53L5CX_Roi::connectedZones(foreground, remaining & (0 - remaining), resolution);
+        remaining &= ~blob;
+        uint32_t zones = HID_VL53L5CX_Roi::zoneCount(blob);
+        if (zones < minZones)
+            continue;
+        if (count == VL53L5CX_COUNTER_MAX_BLOBS)
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        // Centroid from the zones per column and per row
+        uint32_t columns = 0, rows = 0;
+        for (uint32_t i = 1; i < width; i++)
+        {
+            columns += i * HID_VL53L5CX_Roi::zoneCount(blob & (firstColumn << i));
+            rows += i * HID_VL53L5CX_Roi::zoneCount(blob & (firstRow << (i * width)));
+        }
+        int16_t closest = INT16_MAX;
+        for (uint64_t bits = blob; bits != 0; bits &= bits - 1)
+            closest = std::min(closest, frame.distance_mm[HID_VL53L5CX_Roi::lowestZone(bits)]);
+
+        Blob &out = found[count++];
+        out.zones = blob;
+        out.column = (float)columns / zones;
+        out.row = (float)rows / zones;
+        out.distance = closest;
+        out.taken = false;
+    }
+    return count;
+}
+
+int8_t HID_VL53L5CX_PeopleCounter::side(const Track &track, int8_t previous) const
+{
+    float position = (config.axis == VL53L5CX_COUNTER_ACROSS_COLUMNS) ? track.column : track.row;
+    if (position > line + COUNTER_HYSTERESIS_ZONES)
+        return 1;
+    if (position < line - COUNTER_HYSTERESIS_ZONES)
+        return -1;
+    return previous;
+}
+
+void HID_VL53L5CX_PeopleCounter::associate(uint32_t count, double dt, uint64_t timestampNs)
+{
+    float columns[VL53L5CX_COUNTER_MAX_BLOBS];
+    float rows[VL53L5CX_COUNTER_MAX_BLOBS];
+    bool matched[VL53L5CX_COUNTER_MAX_BLOBS];
+    for (uint32_t k = 0; k < VL53L5CX_COUNTER_MAX_BLOBS; k++)
+    {
+        columns[k] = state[k].column + (float)(state[k].columnSpeed * dt);
+        rows[k] = state[k].row + (float)(state[k].rowSpeed * dt);
+        matched[k] = false;
+    }
+
+    // The closest pair of track and blob first, until none is within the gate
+    while (true)
+    {
+        float best = gate * gate;
+        uint32_t track = VL53L5CX_COUNTER_MAX_BLOBS, blob = 0;
+        for (uint32_t k = 0; k < VL53L5CX_COUNTER_MAX_BLOBS; k++)
+        {
+            if (!state[k].active || matched[k])
+                continue;
+            for (uint32_t b = 0; b < count; b++)
+            {
+                float column = found[b].column - columns[k];
+                float row = found[b].row - rows[k];
+                if (!found[b].taken && (column * column + row * row <= best))
+                {
+                    best = column * column + row * row;
+                    track = k;
+                    blob = b;
+                }
+            }
+        }
+        if (track == VL53L5CX_COUNTER_MAX_BLOBS)
+            break;
+
+        Track &t = state[track];
+        Blob &b = found[blob];
+        matched[track] = true;
+        b.taken = true;
+        if (dt > 0)
+        {
+            // The first movement of a track is its speed, later ones are smoothed
+            float columnSpeed = (float)((b.column - t.column) / dt);
+            float rowSpeed = (float)((b.row - t.row) / dt);
+            t.columnSpeed = (t.age == 1) ? columnSpeed : (t.columnSpeed + COUNTER_SPEED_ALPHA * (columnSpeed - t.columnSpeed));
+            t.rowSpeed = (t.age == 1) ? rowSpeed : (t.rowSpeed + COUNTER_SPEED_ALPHA * (rowSpeed - t.rowSpeed));
+        }
+        t.age++;
+        t.misses = 0;
+        t.zones = b.zones;
+        t.column = b.column;
+        t.row = b.row;
+        t.distance = b.distance;
+
+        // In the band around the line the side holds, so each real crossing counts once
+        int8_t now = side(t, t.side);
+        if (now != t.side)
+            emit(t, (now > 0) ? VL53L5CX_CROSSING_FORWARD : VL53L5CX_CROSSING_BACKWARD, timestampNs);
+        t.side = now;
+    }
+
+    for (uint32_t k = 0; k < VL53L5CX_COUNTER_MAX_BLOBS; k++)
+    {
+        Track &t = state[k];
+        if (!t.active || matched[k])
+            continue;
+
+        // Coasts on its prediction until it is given up. Compared before counting,
+        // a uint8_t counter past max_misses 255 would wrap to 0
+        t.age++;
+        t.column = columns[k];
+        t.row = rows[k];
+        if (t.misses >= maxMisses)
+            t.active = false;
+        else
+            t.misses++;
+    }
+
+    for (uint32_t b = 0; b < count; b++)
+    {
+        if (found[b].taken)
+            continue;
+        Track *t = nullptr;
+        for (uint32_t k = 0; (k < VL53L5CX_COUNTER_MAX_BLOBS) && (t == nullptr); k++)
+        {
+            if (!state[k].active)
+                t = &state[k];
+        }
+        if (t == nullptr)
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        memset(t, 0, sizeof(*t));
+        t->active = true;
+        t->id = nextId++;
+        t->age = 1;
+        t->zones = found[b].zones;
+        t->column = found[b].column;
+        t->row = found[b].row;
+        t->distance = found[b].distance;
+        t->side = side(*t, 0);
+    }
+}
+
+void HID_VL53L5CX_PeopleCounter::emit(const Track &track, uint8_t direction, uint64_t timestampNs)
+{
+    VL53L5CX_CrossingEvent event;
+    event.timestamp_ns = timestampNs;
+    event.id = track.id;
+    event.direction = direction;
+    event.zones = (uint8_t)HID_VL53L5CX_Roi::zoneCount(track.zones);
+    event.reserved = 0;
+    event.distance_mm = track.distance;
+    event.age_frames = track.age;
+
+    std::lock_guard<std::mutex> guard(lock);
+    if (queued == HID_VL53L5CX_COUNTER_QUEUE)
+    {
+        // Full: the oldest crossing makes room
+        head = (head + 1) % HID_VL53L5CX_COUNTER_QUEUE;
+        queued--;
+        overwritten.fetch_add(1, std::memory_order_relaxed);
+    }
+    events[(head + queued) % HID_VL53L5CX_COUNTER_QUEUE] = event;
+    queued++;
+    crossings[direction].fetch_add(1, std::memory_order_relaxed);
+}
+
+void HID_VL53L5CX_PeopleCounter::publish()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    publishedCount = 0;
+    for (uint32_t k = 0; k < VL53L5CX_COUNTER_MAX_BLOBS; k++)
+    {
+        const Track &track = state[k];
+        if (!track.active)
+            continue;
+        VL53L5CX_Blob &out = published[publishedCount++];
+        memset(&out, 0, sizeof(out));
+        out.zone_mask = track.zones;
+        out.id = track.id;
+        out.age_frames = track.age;
+        out.column = track.column;
+        out.row = track.row;
+        out.distance_mm = track.distance;
+        out.speed_zones_s = (config.axis == VL53L5CX_COUNTER_ACROSS_COLUMNS) ? track.columnSpeed : track.rowSpeed;
+        out.zones = (uint8_t)HID_VL53L5CX_Roi::zoneCount(track.zones);
+        out.misses = track.misses;
+        out.side = track.side;
+    }
+}
+
+void HID_VL53L5CX_PeopleCounter::update(const VL53L5CX_Frame &frame, uint64_t foreground)
+{
+    if ((frame.resolution != 16) && (frame.resolution != 64))
+        return;
+    if (frame.resolution != resolution)
+        reset(frame.resolution);
+
+    double dt = 0;
+    if ((lastFrameNs != 0) && (frame.timestamp_ns > lastFrameNs))
+        dt = std::min((double)(frame.timestamp_ns - lastFrameNs) * 1e-9, COUNTER_MAX_DT);
+    lastFrameNs = frame.timestamp_ns;
+
+    associate(segment(foreground & zoneMask, frame), dt, frame.timestamp_ns);
+    publish();
+}
+
+uint32_t HID_VL53L5CX_PeopleCounter::read(VL53L5CX_CrossingEvent *out, uint32_t capacity)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    uint32_t moved = std::min(capacity, queued);
+    for (uint32_t i = 0; i < moved; i++)
+        out[i] = events[(head + i) % HID_VL53L5CX_COUNTER_QUEUE];
+    head = (head + moved) % HID_VL53L5CX_COUNTER_QUEUE;
+    queued -= moved;
+    return moved;
+}
+
+uint32_t HID_VL53L5CX_PeopleCounter::blobs(VL53L5CX_Blob *out, uint32_t capacity)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    uint32_t copied = std::min(capacity, publishedCount);
+    memcpy(out, published, copied * sizeof(VL53L5CX_Blob));
+    return copied;
+}
@@ -0,0 +1,142 @@
+#pragma once
+/*
+  This file declares the people counter.
+
+  At a turnstile the question is how many people went through in each
+  direction, which one averaged distance cannot answer. The counter works
+  on the foreground of the background model (HID_VL53L5CX_Background): the
+  zones closer than the learned depth of the empty lane, within the zones of
+  its ROI.
+
+  Neighbouring foreground zones (diagonals included) form a blob. The
+  labelling works on the 64-bit zone mask: a seed zone grows by the bitboard
+  dilation of HID_VL53L5CX_Roi::neighbourZones() until it stops changing, so
+  a blob costs a few shifts and ands per ring instead of a pass over a label
+  image. Centroids come from a population count per row and column.
+
+  Blobs are tracked from frame to frame by their centroid, the closest pairs
+  of predicted position and blob first, within gate_zones. A track that moves
+  from one side of the counting line to the other, by more than half a zone
+  past it so a blob on the line does not count twice, adds a crossing in that
+  direction and queues an event. A track that appears on the line counts in
+  the direction it leaves it.
+
+  Everything lives in fixed arrays: VL53L5CX_COUNTER_MAX_BLOBS blobs and
+  tracks, a ring of the newest crossings for read(). Nothing is allocated
+  per frame.
+*/
+
+#ifndef __HID_VL53L5CX_PeopleCounter__
+#define __HID_VL53L5CX_PeopleCounter__
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include "VL53L5CXSensor.h"
+
+// Crossings kept for read()
+#define HID_VL53L5CX_COUNTER_QUEUE 64
+
+class HID_VL53L5CX_PeopleCounter
+{
+private:
+    struct Blob
+    {
+        uint64_t zones;
+        float column;
+        float row;
+        float distance;                 // closest zone
+        bool taken;                     // by a track this frame
+    };
+
+    struct Track
+    {
+        bool active;
+        uint32_t id;
+        uint32_t age;
+        uint8_t misses;
+        int8_t side;                    // of the line, 0 while on it
+        uint64_t zones;
+        float column;
+        float row;
+        float distance;
+        float columnSpeed;              // zones per second
+        float rowSpeed;
+    };
+
+    VL53L5CX_CounterConfig config;
+    uint32_t minZones;
+    float gate;
+    uint8_t maxMisses;
+
+    // Per resolution: the zones of the foreground, the counting line
+    uint8_t resolution = 0;
+    uint64_t zoneMask = 0;
+    float line = 0;
+
+    Track state[VL53L5CX_COUNTER_MAX_BLOBS];
+    Blob found[VL53L5CX_COUNTER_MAX_BLOBS];
+    uint32_t nextId = 1;
+    uint64_t lastFrameNs = 0;
+
+    // Crossings and the tracks of the last frame, guarded by lock
+    std::mutex lock;
+    VL53L5CX_CrossingEvent events[HID_VL53L5CX_COUNTER_QUEUE];
+    uint32_t head = 0;
+    uint32_t queued = 0;
+    VL53L5CX_Blob published[VL53L5CX_COUNTER_MAX_BLOBS];
+    uint32_t publishedCount = 0;
+    std::atomic<uint64_t> crossings[2];
+    std::atomic<uint64_t> overwritten;
+    std::atomic<uint64_t> dropped;
+
+    void reset(uint8_t resolution);
+    uint32_t segment(uint64_t foreground, const VL53L5CX_Frame &frame);
+    void associate(uint32_t count, double dt, uint64_t timestampNs);
+    int8_t side(const Track &track, int8_t previous) const;
+    void emit(const Track &track, uint8_t direction, uint64_t timestampNs);
+    void publish();
+
+public:
+    // config must pass check(), it is copied.
+    HID_VL53L5CX_PeopleCounter(const VL53L5CX_CounterConfig &config);
+
+    // Counter with the default rules: status 5 and 9, 10 mm < distance < 4000 mm,
+    // all zones, 300 mm margin, 15 frames to learn, a line across the rows in the middle.
+    static VL53L5CX_CounterConfig defaults();
+
+    // Background model of the ROI, margin and learning frames of config, the other
+    // settings of HID_VL53L5CX_Background::defaults().
+    static VL53L5CX_BackgroundConfig backgroundConfig(const VL53L5CX_CounterConfig &config);
+
+    // False if the distance window of the ROI is empty, the axis unknown or the line
+    // outside of the field of view.
+    static bool check(const VL53L5CX_CounterConfig &config);
+
+    // The config the counter was made with.
+    const VL53L5CX_CounterConfig &settings() const { return config; }
+
+    // Advances by one frame with its foreground zones. A resolution change starts over.
+    void update(const VL53L5CX_Frame &frame, uint64_t foreground);
+
+    // Moves up to capacity of the oldest queued crossings to out, without waiting.
+    uint32_t read(VL53L5CX_CrossingEvent *out, uint32_t capacity);
+
+    // Copies up to capacity of the tracked blobs of the last frame to out, returns
+    // how many. Safe against a concurrent update().
+    uint32_t blobs(VL53L5CX_Blob *out, uint32_t capacity);
+
+    // Crossings in direction (VL53L5CX_CROSSING_...) so far.
+    uint64_t count(uint8_t direction) const { return crossings[direction & 1].load(std::memory_order_relaxed); }
+
+    // Crossings that were overwritten before they were read.
+    uint64_t overwrittenCount() { return overwritten.load(std::memory_order_relaxed); }
+
+    // Blobs that did not fit next to VL53L5CX_COUNTER_MAX_BLOBS others.
+    uint64_t droppedCount() { return dropped.load(std::memory_order_relaxed); }
+
+    HID_VL53L5CX_PeopleCounter(const HID_VL53L5CX_PeopleCounter&) = delete;
+    HID_VL53L5CX_PeopleCounter& operator=(const HID_VL53L5CX_PeopleCounter&) = delete;
+};
+
+#endif // __HID_VL53L5CX_PeopleCounter__
@@ -0,0 +1,247 @@
+/*
+  This file implements the presence detector.
+*/
+
+#include "pch.h" // use stdafx.h in Visual Studio 2017 and earlier
+#include "HID_VL53L5CX_Presence.h"
+#include "HID_VL53L5CX_Roi.h"
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+// Range rate below which a zone is stationary, a walk is about 1000 mm/s
+const double PRESENCE_STATIONARY_MM_S = 100;
+
+// Range rate window when rate_frames is 0
+const uint32_t PRESENCE_RATE_FRAMES = 8;
+
+static uint32_t rateFrames(const VL53L5CX_PresenceZone &zone)
+{
+    return (zone.rate_frames != 0) ? zone.rate_frames : PRESENCE_RATE_FRAMES;
+}
+
+HID_VL53L5CX_Presence::HID_VL53L5CX_Presence(const VL53L5CX_PresenceZone *_zones, uint32_t count)
+    : zoneCount(std::min(count, (uint32_t)VL53L5CX_PRESENCE_MAX_ZONES)), occupiedZones(0), overwritten(0)
+{
+    memset(state, 0, sizeof(state));
+    memset(events, 0, sizeof(events));
+    memset(motions, 0, sizeof(motions));
+    for (uint32_t i = 0; i < zoneCount; i++)
+    {
+        zones[i] = _zones[i];
+        rois[i] = _zones[i].roi;
+        motions[i].arrival_s = -1;
+    }
+}
+
+bool HID_VL53L5CX_Presence::check(const VL53L5CX_PresenceZone *zones, uint32_t count)
+{
+    if ((zones == nullptr) || (count == 0) || (count > VL53L5CX_PRESENCE_MAX_ZONES))
+        return false;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if ((zones[i].enter_mm <= 0) || (zones[i].exit_mm < zones[i].enter_mm) || (zones[i].trigger_mm < 0))
+            return false;
+        if ((zones[i].rate_frames != 0) && ((zones[i].rate_frames < 3) || (zones[i].rate_frames > VL53L5CX_PRESENCE_MAX_RATE_FRAMES)))
+            return false;
+    }
+    return true;
+}
+
+bool HID_VL53L5CX_Presence::explicitZones(const VL53L5CX_PresenceZone *zones, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (zones[i].roi.zone_mask != 0)
+            return true;
+    }
+    return false;
+}
+
+void HID_VL53L5CX_Presence::setCallback(VL53L5CX_PresenceCallback _callback, void *userData)
+{
+    callback = _callback;
+    callbackData = userData;
+}
+
+void HID_VL53L5CX_Presence::update(const VL53L5CX_Frame &frame)
+{
+    double distances[VL53L5CX_PRESENCE_MAX_ZONES];
+    HID_VL53L5CX_Roi::evaluate(frame, rois, zoneCount, distances, nullptr);
+
+    // The same frame again does not go into the range rate fit
+    bool fresh = (frame.timestamp_ns != lastFrameNs) || (frame.stream_count != lastStreamCount);
+    lastFrameNs = frame.timestamp_ns;
+    lastStreamCount = frame.stream_count;
+    VL53L5CX_ZoneMotion current[VL53L5CX_PRESENCE_MAX_ZONES];
+
+    for (uint32_t i = 0; i < zoneCount; i++)
+    {
+        const VL53L5CX_PresenceZone &zone = zones[i];
+        ZoneState &s = state[i];
+        double distance = distances[i];
+
+        if (fresh)
+        {
+            VL53L5CX_ZoneMotion &motion = current[i];
+            fit(i, frame.timestamp_ns, distance, motion);
+            if (motion.motion != VL53L5CX_MOTION_APPROACHING)
+                s.arriving = false;
+            else if (!s.arriving && !s.occupied && (zone.arrival_ms != 0) && (motion.arrival_s * 1000 <= zone.arrival_ms))
+            {
+                s.arriving = true;
+                emit(i, VL53L5CX_PRESENCE_ARRIVING, frame.timestamp_ns, motion.distance_mm);
+            }
+        }
+
+        // Between the thresholds nothing counts, the state holds
+        bool closer = (distance > 0) && (distance < zone.enter_mm);
+        bool farther = (distance == 0) || (distance > zone.exit_mm);
+
+        if (!s.occupied)
+        {
+            s.closer = closer ? (uint16_t)std::min(s.closer + 1, (int)UINT16_MAX) : 0;
+            if (s.closer >= std::max(zone.enter_frames, (uint16_t)1))
+            {
+                s.occupied = true;
+                s.farther = 0;
+                s.dwell = 0;
+                occupiedZones.fetch_or(1u << i, std::memory_order_relaxed);
+                emit(i, VL53L5CX_PRESENCE_ENTERED, frame.timestamp_ns, distance);
+            }
+        }
+        else
+        {
+            s.dwell = (s.dwell < UINT32_MAX) ? (s.dwell + 1) : s.dwell;
+            s.farther = farther ? (uint16_t)std::min(s.farther + 1, (int)UINT16_MAX) : 0;
+            if ((s.farther >= std::max(zone.exit_frames, (uint16_t)1)) && (s.dwell >= zone.min_dwell_frames))
+            {
+                s.occupied = false;
+                s.closer = 0;
+                occupiedZones.fetch_and(~(1u << i), std::memory_order_relaxed);
+                emit(i, VL53L5CX_PRESENCE_LEFT, frame.timestamp_ns, distance);
+            }
+        }
+    }
+
+    if (fresh)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        memcpy(motions, current, zoneCount * sizeof(VL53L5CX_ZoneMotion));
+    }
+}
+
+void HID_VL53L5CX_Presence::fit(uint32_t zone, uint64_t timestampNs, double distance, VL53L5CX_ZoneMotion &motion)
+{
+    ZoneState &s = state[zone];
+    uint32_t window = rateFrames(zones[zone]);
+
+    if (distance > 0)
+    {
+        // A clock that does not advance starts over
+        if ((s.samples == 0) || (timestampNs <= s.newestNs))
+        {
+            s.samples = 0;
+            s.next = 0;
+            s.baseNs = timestampNs;
+        }
+        s.seconds[s.next] = (double)(timestampNs - s.baseNs) * 1e-9;
+        s.distances[s.next] = distance;
+        s.next = (s.next + 1) % window;
+        s.samples = std::min(s.samples + 1, window);
+        s.newestNs = timestampNs;
+        s.gap = 0;
+    }
+    else if (++s.gap >= window)
+        s.samples = 0;
+
+    memset(&motion, 0, sizeof(motion));
+    motion.arrival_s = -1;
+    motion.samples = (uint8_t)s.samples;
+    if (s.samples == 0)
+        return;
+    motion.timestamp_ns = s.newestNs;
+    if (s.samples < 3)
+    {
+        motion.distance_mm = (float)s.distances[(s.next + window - 1) % window];
+        return;
+    }
+
+    // Least squares line, centred on the means so long tracks keep their precision
+    double meanSeconds = 0, meanDistance = 0;
+    for (uint32_t k = 0; k < s.samples; k++)
+    {
+        meanSeconds += s.seconds[k];
+        meanDistance += s.distances[k];
+    }
+    meanSeconds /= s.samples;
+    meanDistance /= s.samples;
+    double tt = 0, td = 0;
+    for (uint32_t k = 0; k < s.samples; k++)
+    {
+        double dt = s.seconds[k] - meanSeconds;
+        tt += dt * dt;
+        td += dt * (s.distances[k] - meanDistance);
+    }
+    double velocity = (tt > 0) ? (td / tt) : 0;
+    double fitted = meanDistance + velocity * ((double)(s.newestNs - s.baseNs) * 1e-9 - meanSeconds);
+
+    motion.distance_mm = (float)fitted;
+    motion.velocity_mm_s = (float)velocity;
+    if (fabs(velocity) < PRESENCE_STATIONARY_MM_S)
+        motion.motion = VL53L5CX_MOTION_STATIONARY;
+    else
+        motion.motion = (velocity < 0) ? VL53L5CX_MOTION_APPROACHING : VL53L5CX_MOTION_LEAVING;
+
+    double trigger = (zones[zone].trigger_mm != 0) ? zones[zone].trigger_mm : zones[zone].enter_mm;
+    if (fitted <= trigger)
+        motion.arrival_s = 0;
+    else if (motion.motion == VL53L5CX_MOTION_APPROACHING)
+        motion.arrival_s = (float)((fitted - trigger) / -velocity);
+}
+
+void HID_VL53L5CX_Presence::emit(uint32_t zone, uint8_t type, uint64_t timestampNs, double distance)
+{
+    VL53L5CX_PresenceEvent event;
+    event.timestamp_ns = timestampNs;
+    event.zone = (uint16_t)zone;
+    event.type = type;
+    event.reserved = 0;
+    event.distance_mm = (float)distance;
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (queued == HID_VL53L5CX_PRESENCE_QUEUE)
+        {
+            // Full: the oldest event makes room
+            head = (head + 1) % HID_VL53L5CX_PRESENCE_QUEUE;
+            queued--;
+            overwritten.fetch_add(1, std::memory_order_relaxed);
+        }
+        events[(head + queued) % HID_VL53L5CX_PRESENCE_QUEUE] = event;
+        queued++;
+    }
+
+    if (callback != nullptr)
+        callback(&event, callbackData);
+}
+
+bool HID_VL53L5CX_Presence::motion(uint32_t zone, VL53L5CX_ZoneMotion &motion)
+{
+    if (zone >= zoneCount)
+        return false;
+    std::lock_guard<std::mutex> guard(lock);
+    motion = motions[zone];
+    return true;
+}
+
+uint32_t HID_VL53L5CX_Presence::read(VL53L5CX_PresenceEvent *out, uint32_t capacity)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    uint32_t moved = std::min(capacity, queued);
+    for (uint32_t i = 0; i < moved; i++)
+        out[i] = events[(head + i) % HID_VL53L5CX_PRESENCE_QUEUE];
+    head = (head + moved) % HID_VL53L5CX_PRESENCE_QUEUE;
+    queued -= moved;
+    return moved;
+}
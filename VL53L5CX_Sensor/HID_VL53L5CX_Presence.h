@@ -0,0 +1,118 @@
+#pragma once
+/*
+  This file declares the presence detector.
+
+  A gate controller wants to know when someone enters or leaves a zone, not
+  a distance per frame that it has to interpret itself. The detector is fed
+  every frame the sensor delivers and keeps one small state machine per
+  presence zone (VL53L5CXSensor.h): the ROI of the zone reduces the frame to
+  one distance, consecutive frames closer than enter_mm make the zone
+  occupied, consecutive frames farther than exit_mm (or without any valid
+  zone) make it free again once it was occupied long enough. The work per
+  frame is one ROI evaluation for all zones (zones with the same rules share
+  the validity pass) and a few compares per zone, whatever happened before.
+
+  For a gate, how fast someone approaches matters more than how close they
+  are. Every zone also fits a straight line (least squares) through its last
+  rate_frames distances over the host timestamps of their frames; the slope
+  is the range rate, the line at the newest frame the distance, and the two
+  give the time until trigger_mm is reached. Frames without a valid distance
+  leave gaps the fit does not mind, as many in a row as the window long
+  forget the zone. The same frame fed twice (same stream count and
+  timestamp) counts once. A zone that is predicted to arrive within
+  arrival_ms sends ARRIVING once, until it stops approaching or is entered.
+
+  Events go to an optional callback on the thread that fed the frame and to
+  a fixed ring of the newest events that another thread drains with read().
+  Nothing is allocated per frame.
+*/
+
+#ifndef __HID_VL53L5CX_Presence__
+#define __HID_VL53L5CX_Presence__
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include "VL53L5CXSensor.h"
+
+// Events kept for read()
+#define HID_VL53L5CX_PRESENCE_QUEUE 64
+
+class HID_VL53L5CX_Presence
+{
+private:
+    struct ZoneState
+    {
+        bool occupied;
+        uint16_t closer;                // frames in a row closer than enter_mm
+        uint16_t farther;               // frames in a row farther than exit_mm or empty
+        uint32_t dwell;                 // frames since it became occupied
+
+        // Range rate fit over the last rate_frames valid distances, next is the oldest once full
+        double seconds[VL53L5CX_PRESENCE_MAX_RATE_FRAMES];     // since baseNs
+        double distances[VL53L5CX_PRESENCE_MAX_RATE_FRAMES];
+        uint64_t baseNs;
+        uint64_t newestNs;
+        uint32_t samples;
+        uint32_t next;
+        uint32_t gap;                   // frames in a row without a valid distance
+        bool arriving;                  // ARRIVING sent
+    };
+
+    VL53L5CX_PresenceZone zones[VL53L5CX_PRESENCE_MAX_ZONES];
+    VL53L5CX_Roi rois[VL53L5CX_PRESENCE_MAX_ZONES];
+    ZoneState state[VL53L5CX_PRESENCE_MAX_ZONES];
+    uint32_t zoneCount;
+    std::atomic<uint32_t> occupiedZones;
+    uint64_t lastFrameNs = 0;
+    uint8_t lastStreamCount = 0;
+
+    VL53L5CX_PresenceCallback callback = nullptr;
+    void *callbackData = nullptr;
+
+    // Ring of events, head is the oldest
+    std::mutex lock;
+    VL53L5CX_PresenceEvent events[HID_VL53L5CX_PRESENCE_QUEUE];
+    uint32_t head = 0;
+    uint32_t queued = 0;
+    std::atomic<uint64_t> overwritten;
+    VL53L5CX_ZoneMotion motions[VL53L5CX_PRESENCE_MAX_ZONES];
+
+    void emit(uint32_t zone, uint8_t type, uint64_t timestampNs, double distance);
+    void fit(uint32_t zone, uint64_t timestampNs, double distance, VL53L5CX_ZoneMotion &motion);
+
+public:
+    // zones must pass check(), they are copied.
+    HID_VL53L5CX_Presence(const VL53L5CX_PresenceZone *zones, uint32_t count);
+
+    // False if count is 0 or too large, a zone has its thresholds the wrong way round or
+    // a range rate window shorter than 3 or longer than VL53L5CX_PRESENCE_MAX_RATE_FRAMES.
+    static bool check(const VL53L5CX_PresenceZone *zones, uint32_t count);
+
+    // True if a zone names its zones (zone_mask != 0), they only fit one resolution.
+    static bool explicitZones(const VL53L5CX_PresenceZone *zones, uint32_t count);
+    bool explicitZones() const { return explicitZones(zones, zoneCount); }
+
+    // Called with every event by the thread calling update(). Not while update() runs.
+    void setCallback(VL53L5CX_PresenceCallback callback, void *userData);
+
+    // Advances every zone by one frame.
+    void update(const VL53L5CX_Frame &frame);
+
+    // Moves up to capacity of the oldest queued events to out, without waiting.
+    uint32_t read(VL53L5CX_PresenceEvent *out, uint32_t capacity);
+
+    // Range rate of zone as of the last frame. False if there is no such zone.
+    bool motion(uint32_t zone, VL53L5CX_ZoneMotion &motion);
+
+    // Bit i set: zone i is occupied.
+    uint32_t occupied() const { return occupiedZones.load(std::memory_order_relaxed); }
+
+    // Events that were overwritten before they were read.
+    uint64_t overwrittenCount() { return overwritten.load(std::memory_order_relaxed); }
+
+    HID_VL53L5CX_Presence(const HID_VL53L5CX_Presence&) = delete;
+    HID_VL53L5CX_Presence& operator=(const HID_VL53L5CX_Presence&) = delete;
+};
+
+#endif // __HID_VL53L5CX_Presence__
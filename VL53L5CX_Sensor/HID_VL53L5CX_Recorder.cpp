@@ -0,0 +1,476 @@
+/*
+  This file implements the frame recorder and the memory mapped reader.
+*/
+
+#include "pch.h" // use stdafx.h in Visual Studio 2017 and earlier
+#include "HID_VL53L5CX_Recorder.h"
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Records are padded so every header (and the index) stays 8 byte aligned
+static uint32_t align8(uint32_t size)
+{
+    return (size + 7U) & ~7U;
+}
+
+HID_VL53L5CX_Recorder::HID_VL53L5CX_Recorder(const char *path, const HID_VL53L5CX_SessionHeader &header,
+    HID_VL53L5CX_RECORD_ENCODING _encoding, uint32_t queueDepth)
+    : file(nullptr), encoding(_encoding), zones(header.resolution), head(0), tail(0), stopping(false), fileOffset(0),
+      recorded(0), dropped(0), written(0)
+{
+#ifdef _MSC_VER
+    if (fopen_s(&file, path, "wb") != 0)
+        file = nullptr;
+#else
+    file = fopen(path, "wb");
+#endif
+    if (file == nullptr)
+        throw std::runtime_error("Cannot create recording: " + std::string(path));
+
+    // Large stdio buffer, the writer thread flushes whenever it catches up
+    setvbuf(file, nullptr, _IOFBF, 1 << 20);
+
+    if (zones != VL53L5CX_RESOLUTION_8X8)
+        zones = VL53L5CX_RESOLUTION_4X4;
+
+    HID_VL53L5CX_SessionHeader session = header;
+    memcpy(session.magic, HID_VL53L5CX_RECORDING_MAGIC, sizeof(session.magic));
+    session.version = HID_VL53L5CX_RECORDING_VERSION;
+    session.headerSize = sizeof(HID_VL53L5CX_SessionHeader);
+    fwrite(&session, sizeof(session), 1, file);
+    fileOffset = sizeof(session);
+    written.store(fileOffset, std::memory_order_relaxed);
+
+    // Slots are big enough for the largest raw frame or compact record
+    uint32_t payload = (uint32_t)VL53L5CX_TEMPORARY_BUFFER_SIZE;
+    if (compactSize(VL53L5CX_RESOLUTION_8X8, VL53L5CX_NB_TARGET_PER_ZONE) > payload)
+        payload = compactSize(VL53L5CX_RESOLUTION_8X8, VL53L5CX_NB_TARGET_PER_ZONE);
+    slotSize = align8(sizeof(HID_VL53L5CX_RecordHeader) + payload);
+    slotCount = (queueDepth < 2) ? 2 : queueDepth;
+    slots.assign((size_t)slotSize * slotCount, 0);
+    index.reserve(4096);
+
+    writer = std::thread(&HID_VL53L5CX_Recorder::writerLoop, this);
+}
+
+HID_VL53L5CX_Recorder::~HID_VL53L5CX_Recorder()
+{
+    close();
+}
+
+bool HID_VL53L5CX_Recorder::record(uint64_t timestampNs, const VL53L5CX_Configuration *dev, const VL53L5CX_ResultsData *results,
+    uint8_t resolution)
+{
+    if (encoding == HID_VL53L5CX_RECORD_ENCODING::RAW)
+    {
+        // vl53l5cx_get_ranging_data() left the swapped frame in temp_buffer,
+        // swapping it again gives back the bytes read from the sensor
+        uint32_t h = head.load(std::memory_order_relaxed);
+        if ((h - tail.load(std::memory_order_acquire) >= slotCount)
+            || (sizeof(HID_VL53L5CX_RecordHeader) + dev->data_read_size > slotSize))
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        uint8_t *slot = &slots[(size_t)(h % slotCount) * slotSize];
+        HID_VL53L5CX_RecordHeader *record = (HID_VL53L5CX_RecordHeader*)slot;
+        uint8_t *payload = slot + sizeof(HID_VL53L5CX_RecordHeader);
+        memcpy(payload, dev->temp_buffer, dev->data_read_size);
+        SwapBuffer(payload, (uint16_t)dev->data_read_size);
+
+        // The frame size follows the resolution of the moment, the padding gives it back
+        record->size = align8(sizeof(HID_VL53L5CX_RecordHeader) + dev->data_read_size);
+        record->encoding = (uint16_t)HID_VL53L5CX_RECORD_ENCODING::RAW;
+        record->streamCount = dev->streamcount;
+        record->padding = (uint8_t)(record->size - sizeof(HID_VL53L5CX_RecordHeader) - dev->data_read_size);
+        record->timestampNs = timestampNs;
+
+        head.store(h + 1, std::memory_order_release);
+    }
+    else
+    {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) >= slotCount)
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        uint8_t targets = VL53L5CX_NB_TARGET_PER_ZONE;
+        uint8_t frameZones = zones;
+        if ((resolution == VL53L5CX_RESOLUTION_4X4) || (resolution == VL53L5CX_RESOLUTION_8X8))
+            frameZones = resolution;
+        uint32_t count = (uint32_t)frameZones * targets;
+
+        uint8_t *slot = &slots[(size_t)(h % slotCount) * slotSize];
+        HID_VL53L5CX_RecordHeader *record = (HID_VL53L5CX_RecordHeader*)slot;
+        uint8_t *payload = slot + sizeof(HID_VL53L5CX_RecordHeader);
+
+        HID_VL53L5CX_CompactFrame *compact = (HID_VL53L5CX_CompactFrame*)payload;
+        compact->zones = frameZones;
+        compact->targets = targets;
+        compact->siliconTempDegC = results->silicon_temp_degc;
+        compact->reserved = 0;
+
+        uint8_t *p = payload + sizeof(HID_VL53L5CX_CompactFrame);
+        memcpy(p, results->distance_mm, count * sizeof(int16_t));
+        p += count * sizeof(int16_t);
+        memcpy(p, results->range_sigma_mm, count * sizeof(uint16_t));
+        p += count * sizeof(uint16_t);
+        memcpy(p, results->target_status, count);
+        p += count;
+        memcpy(p, results->nb_target_detected, frameZones);
+
+        record->size = align8(sizeof(HID_VL53L5CX_RecordHeader) + compactSize(frameZones, targets));
+        record->encoding = (uint16_t)HID_VL53L5CX_RECORD_ENCODING::COMPACT;
+        record->streamCount = dev->streamcount;
+        record->padding = 0;
+        record->timestampNs = timestampNs;
+
+        head.store(h + 1, std::memory_order_release);
+    }
+
+    recorded.fetch_add(1, std::memory_order_relaxed);
+    wake.notify_one();
+    return true;
+}
+
+bool HID_VL53L5CX_Recorder::recordRaw(uint64_t timestampNs, uint8_t streamCount, const uint8_t *frame, uint32_t size)
+{
+    uint32_t h = head.load(std::memory_order_relaxed);
+    if ((h - tail.load(std::memory_order_acquire) >= slotCount)
+        || (sizeof(HID_VL53L5CX_RecordHeader) + size > slotSize))
+    {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    uint8_t *slot = &slots[(size_t)(h % slotCount) * slotSize];
+    HID_VL53L5CX_RecordHeader *record = (HID_VL53L5CX_RecordHeader*)slot;
+    memcpy(slot + sizeof(HID_VL53L5CX_RecordHeader), frame, size);
+
+    record->size = align8(sizeof(HID_VL53L5CX_RecordHeader) + size);
+    record->encoding = (uint16_t)HID_VL53L5CX_RECORD_ENCODING::RAW;
+    record->streamCount = streamCount;
+    record->padding = (uint8_t)(record->size - sizeof(HID_VL53L5CX_RecordHeader) - size);
+    record->timestampNs = timestampNs;
+
+    head.store(h + 1, std::memory_order_release);
+    recorded.fetch_add(1, std::memory_order_relaxed);
+    wake.notify_one();
+    return true;
+}
+
+void HID_VL53L5CX_Recorder::writerLoop()
+{
+    for (;;)
+    {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        uint32_t h = head.load(std::memory_order_acquire);
+
+        if (t == h)
+        {
+            if (stopping.load(std::memory_order_acquire)
+                && (head.load(std::memory_order_acquire) == t))
+                break;
+
+            // Caught up: push what we have to the OS and wait for more.
+            // record() does not take the lock, so a wake up can be missed; the timeout bounds that.
+            fflush(file);
+            std::unique_lock<std::mutex> guard(wakeLock);
+            wake.wait_for(guard, std::chrono::milliseconds(5));
+            continue;
+        }
+
+        while (t != h)
+        {
+            const uint8_t *slot = &slots[(size_t)(t % slotCount) * slotSize];
+            const HID_VL53L5CX_RecordHeader *record = (const HID_VL53L5CX_RecordHeader*)slot;
+
+            fwrite(slot, record->size, 1, file);
+            index.push_back({ record->timestampNs, fileOffset });
+            fileOffset += record->size;
+            written.fetch_add(record->size, std::memory_order_relaxed);
+
+            t++;
+            tail.store(t, std::memory_order_release);
+        }
+    }
+}
+
+void HID_VL53L5CX_Recorder::close()
+{
+    if (file == nullptr)
+        return;
+
+    stopping.store(true, std::memory_order_release);
+    wake.notify_one();
+    if (writer.joinable())
+        writer.join();
+
+    HID_VL53L5CX_IndexTrailer trailer;
+    memcpy(trailer.magic, HID_VL53L5CX_INDEX_MAGIC, sizeof(trailer.magic));
+    trailer.entrySize = sizeof(HID_VL53L5CX_IndexEntry);
+    trailer.entryCount = index.size();
+    trailer.indexOffset = fileOffset;
+
+    if (!index.empty())
+        fwrite(index.data(), sizeof(HID_VL53L5CX_IndexEntry), index.size(), file);
+    fwrite(&trailer, sizeof(trailer), 1, file);
+    written.fetch_add(index.size() * sizeof(HID_VL53L5CX_IndexEntry) + sizeof(trailer), std::memory_order_relaxed);
+
+    fclose(file);
+    file = nullptr;
+}
+
+void HID_VL53L5CX_Recorder::initHeader(HID_VL53L5CX_SessionHeader &header, const VL53L5CX_Configuration *dev,
+    uint8_t resolution, uint8_t frequencyHz, uint8_t rangingMode, uint64_t startTimeNs)
+{
+    memset(&header, 0, sizeof(header));
+    header.resolution = resolution;
+    header.targetsPerZone = VL53L5CX_NB_TARGET_PER_ZONE;
+    header.frequencyHz = frequencyHz;
+    header.rangingMode = rangingMode;
+    header.dataReadSize = dev->data_read_size;
+    outputEnables(header.outputEnables);
+    header.calibrationFingerprint = calibrationFingerprint(dev);
+    header.startTimeNs = startTimeNs;
+    header.startUnixMs = (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+uint64_t HID_VL53L5CX_Recorder::calibrationFingerprint(const VL53L5CX_Configuration *dev)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (uint32_t i = 0; i < (uint32_t)VL53L5CX_OFFSET_BUFFER_SIZE; i++)
+        hash = (hash ^ dev->offset_data[i]) * 1099511628211ULL;
+    for (uint32_t i = 0; i < (uint32_t)VL53L5CX_XTALK_BUFFER_SIZE; i++)
+        hash = (hash ^ dev->xtalk_data[i]) * 1099511628211ULL;
+    return hash;
+}
+
+void HID_VL53L5CX_Recorder::outputEnables(uint32_t enables[4])
+{
+    // Mirrors output_bh_enable in vl53l5cx_start_ranging()
+    enables[0] = 0x00000007U;
+    enables[1] = 0x00000000U;
+    enables[2] = 0x00000000U;
+    enables[3] = 0xC0000000U;
+#ifndef VL53L5CX_DISABLE_AMBIENT_PER_SPAD
+    enables[0] += (uint32_t)8;
+#endif
+#ifndef VL53L5CX_DISABLE_NB_SPADS_ENABLED
+    enables[0] += (uint32_t)16;
+#endif
+#ifndef VL53L5CX_DISABLE_NB_TARGET_DETECTED
+    enables[0] += (uint32_t)32;
+#endif
+#ifndef VL53L5CX_DISABLE_SIGNAL_PER_SPAD
+    enables[0] += (uint32_t)64;
+#endif
+#ifndef VL53L5CX_DISABLE_RANGE_SIGMA_MM
+    enables[0] += (uint32_t)128;
+#endif
+#ifndef VL53L5CX_DISABLE_DISTANCE_MM
+    enables[0] += (uint32_t)256;
+#endif
+#ifndef VL53L5CX_DISABLE_REFLECTANCE_PERCENT
+    enables[0] += (uint32_t)512;
+#endif
+#ifndef VL53L5CX_DISABLE_TARGET_STATUS
+    enables[0] += (uint32_t)1024;
+#endif
+#ifndef VL53L5CX_DISABLE_MOTION_INDICATOR
+    enables[0] += (uint32_t)2048;
+#endif
+}
+
+uint32_t HID_VL53L5CX_Recorder::compactSize(uint8_t zones, uint8_t targets)
+{
+    uint32_t count = (uint32_t)zones * targets;
+    return sizeof(HID_VL53L5CX_CompactFrame) + count * (sizeof(int16_t) + sizeof(uint16_t) + 1) + zones;
+}
+
+HID_VL53L5CX_RecordingReader::~HID_VL53L5CX_RecordingReader()
+{
+    unmap();
+}
+
+void HID_VL53L5CX_RecordingReader::unmap()
+{
+#ifdef _WIN32
+    if (base != nullptr)
+        UnmapViewOfFile(base);
+    if (mappingHandle != nullptr)
+        CloseHandle((HANDLE)mappingHandle);
+    if (fileHandle != nullptr)
+        CloseHandle((HANDLE)fileHandle);
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+#else
+    if (base != nullptr)
+        munmap((void*)base, (size_t)length);
+    if (fd >= 0)
+        ::close(fd);
+    fd = -1;
+#endif
+    base = nullptr;
+    length = 0;
+    entries = nullptr;
+    entryCount = 0;
+    scannedIndex.clear();
+}
+
+bool HID_VL53L5CX_RecordingReader::open(const char *path)
+{
+    unmap();
+
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE)
+        return false;
+    fileHandle = handle;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(handle, &size) || (size.QuadPart < (LONGLONG)sizeof(HID_VL53L5CX_SessionHeader)))
+    {
+        unmap();
+        return false;
+    }
+    length = (uint64_t)size.QuadPart;
+
+    mappingHandle = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mappingHandle == nullptr)
+    {
+        unmap();
+        return false;
+    }
+    base = (const uint8_t*)MapViewOfFile((HANDLE)mappingHandle, FILE_MAP_READ, 0, 0, 0);
+#else
+    fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if ((fstat(fd, &st) != 0) || ((uint64_t)st.st_size < sizeof(HID_VL53L5CX_SessionHeader)))
+    {
+        unmap();
+        return false;
+    }
+    length = (uint64_t)st.st_size;
+
+    void *view = mmap(nullptr, (size_t)length, PROT_READ, MAP_SHARED, fd, 0);
+    base = (view == MAP_FAILED) ? nullptr : (const uint8_t*)view;
+#endif
+    if (base == nullptr)
+    {
+        unmap();
+        return false;
+    }
+
+    const HID_VL53L5CX_SessionHeader *session = header();
+    if ((memcmp(session->magic, HID_VL53L5CX_RECORDING_MAGIC, sizeof(session->magic)) != 0)
+        || (session->version < 1) || (session->version > HID_VL53L5CX_RECORDING_VERSION)
+        || (session->headerSize < sizeof(HID_VL53L5CX_SessionHeader)) || (session->headerSize > length))
+    {
+        unmap();
+        return false;
+    }
+
+    // Use the index written at close() when it is there and consistent
+    if (length >= session->headerSize + sizeof(HID_VL53L5CX_IndexTrailer))
+    {
+        const HID_VL53L5CX_IndexTrailer *trailer =
+            (const HID_VL53L5CX_IndexTrailer*)(base + length - sizeof(HID_VL53L5CX_IndexTrailer));
+        if ((memcmp(trailer->magic, HID_VL53L5CX_INDEX_MAGIC, sizeof(trailer->magic)) == 0)
+            && (trailer->entrySize == sizeof(HID_VL53L5CX_IndexEntry))
+            && (trailer->indexOffset + trailer->entryCount * sizeof(HID_VL53L5CX_IndexEntry)
+                + sizeof(HID_VL53L5CX_IndexTrailer) == length))
+        {
+            entries = (const HID_VL53L5CX_IndexEntry*)(base + trailer->indexOffset);
+            entryCount = trailer->entryCount;
+            return true;
+        }
+    }
+
+    // No index (recording was not closed): walk the records
+    uint64_t offset = session->headerSize;
+    while (offset + sizeof(HID_VL53L5CX_RecordHeader) <= length)
+    {
+        const HID_VL53L5CX_RecordHeader *record = (const HID_VL53L5CX_RecordHeader*)(base + offset);
+        if ((record->size < sizeof(HID_VL53L5CX_RecordHeader) + record->padding) || (offset + record->size > length)
+            || ((record->encoding != (uint16_t)HID_VL53L5CX_RECORD_ENCODING::RAW)
+                && (record->encoding != (uint16_t)HID_VL53L5CX_RECORD_ENCODING::COMPACT)))
+            break;
+        scannedIndex.push_back({ record->timestampNs, offset });
+        offset += record->size;
+    }
+    entries = scannedIndex.data();
+    entryCount = scannedIndex.size();
+    return true;
+}
+
+const HID_VL53L5CX_SessionHeader *HID_VL53L5CX_RecordingReader::header() const
+{
+    return (const HID_VL53L5CX_SessionHeader*)base;
+}
+
+HID_VL53L5CX_RecordView HID_VL53L5CX_RecordingReader::frame(uint64_t i) const
+{
+    const HID_VL53L5CX_RecordHeader *record = (const HID_VL53L5CX_RecordHeader*)(base + entries[i].offset);
+
+    HID_VL53L5CX_RecordView view;
+    view.timestampNs = record->timestampNs;
+    view.streamCount = record->streamCount;
+    view.encoding = (HID_VL53L5CX_RECORD_ENCODING)record->encoding;
+    view.data = (const uint8_t*)(record + 1);
+    view.size = record->size - (uint32_t)sizeof(HID_VL53L5CX_RecordHeader) - record->padding;
+    return view;
+}
+
+uint64_t HID_VL53L5CX_RecordingReader::findByTime(uint64_t timestampNs) const
+{
+    const HID_VL53L5CX_IndexEntry *found = std::lower_bound(entries, entries + entryCount, timestampNs,
+        [](const HID_VL53L5CX_IndexEntry &entry, uint64_t t) { return entry.timestampNs < t; });
+    return (uint64_t)(found - entries);
+}
+
+bool HID_VL53L5CX_RecordingReader::decodeCompact(const HID_VL53L5CX_RecordView &record, VL53L5CX_ResultsData *results)
+{
+    if ((record.encoding != HID_VL53L5CX_RECORD_ENCODING::COMPACT)
+        || (record.size < sizeof(HID_VL53L5CX_CompactFrame)))
+        return false;
+
+    const HID_VL53L5CX_CompactFrame *compact = (const HID_VL53L5CX_CompactFrame*)record.data;
+    if ((compact->zones > VL53L5CX_RESOLUTION_8X8) || (compact->targets != VL53L5CX_NB_TARGET_PER_ZONE)
+        || (record.size < HID_VL53L5CX_Recorder::compactSize(compact->zones, compact->targets)))
+        return false;
+
+    uint32_t count = (uint32_t)compact->zones * compact->targets;
+    memset(results, 0, sizeof(*results));
+    results->silicon_temp_degc = compact->siliconTempDegC;
+
+    const uint8_t *p = record.data + sizeof(HID_VL53L5CX_CompactFrame);
+    memcpy(results->distance_mm, p, count * sizeof(int16_t));
+    p += count * sizeof(int16_t);
+    memcpy(results->range_sigma_mm, p, count * sizeof(uint16_t));
+    p += count * sizeof(uint16_t);
+    memcpy(results->target_status, p, count);
+    p += count;
+    memcpy(results->nb_target_detected, p, compact->zones);
+    return true;
+}
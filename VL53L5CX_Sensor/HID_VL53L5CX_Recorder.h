@@ -0,0 +1,223 @@
+#pragma once
+/*
+  This file declares the frame recording format, the recorder and the reader.
+
+  A recording is an append-only file:
+
+    [session header][record][record]...[index][trailer]
+
+  Every record is a HID_VL53L5CX_RecordHeader followed by either the raw frame
+  exactly as it was read over I2C (it can be fed back through the ULD) or a
+  compact decoded copy of the distance, sigma and status grids. The index at
+  the end lists (timestamp, offset) of every record so a reader can map the
+  file and seek by time. A file without index (process killed while recording)
+  is still readable, the reader rebuilds the index by walking the records.
+
+  The resolution may change while recording (setResolution(), a profile, the
+  governor). Every record describes its own frame: a COMPACT record carries
+  its zone count, a RAW record (version 2) the padding after the frame, so
+  its exact size tells the resolution. Version 1 files only have the frame
+  size of the session header.
+
+  The recorder never blocks the acquisition thread: frames are copied into a
+  preallocated ring and written to disk by a separate writer thread. If the
+  ring is full the frame is dropped and counted.
+*/
+
+#ifndef __HID_VL53L5CX_Recorder__
+#define __HID_VL53L5CX_Recorder__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "vl53l5cx_api.h"
+
+const char HID_VL53L5CX_RECORDING_MAGIC[4] = { 'V', 'L', '5', 'R' };
+const char HID_VL53L5CX_INDEX_MAGIC[4] = { 'V', 'L', '5', 'I' };
+const uint16_t HID_VL53L5CX_RECORDING_VERSION = 2;
+
+enum class HID_VL53L5CX_RECORD_ENCODING : uint16_t
+{
+    RAW = 1,        // frame bytes as read from the sensor (before SwapBuffer)
+    COMPACT = 2     // HID_VL53L5CX_CompactFrame followed by the zone grids
+};
+
+// All structures are little endian and naturally aligned.
+struct HID_VL53L5CX_SessionHeader
+{
+    char magic[4];                  // "VL5R"
+    uint16_t version;
+    uint16_t headerSize;            // sizeof(HID_VL53L5CX_SessionHeader)
+    uint8_t resolution;             // 16 or 64 when recording started
+    uint8_t targetsPerZone;         // VL53L5CX_NB_TARGET_PER_ZONE
+    uint8_t frequencyHz;
+    uint8_t rangingMode;            // VL53L5CX_RANGING_MODE_xxx
+    uint32_t dataReadSize;          // raw frame size when recording started, 0 if not ranging yet
+    uint32_t outputEnables[4];      // output block mask sent by vl53l5cx_start_ranging()
+    uint64_t calibrationFingerprint; // FNV-1a of offset and xtalk calibration data
+    uint64_t startTimeNs;           // host monotonic clock
+    uint64_t startUnixMs;           // wall clock, to match incidents with other logs
+    uint8_t reserved[8];
+};
+
+struct HID_VL53L5CX_RecordHeader
+{
+    uint32_t size;                  // header + payload, multiple of 8
+    uint16_t encoding;              // HID_VL53L5CX_RECORD_ENCODING
+    uint8_t streamCount;
+    uint8_t padding;                // RAW: bytes after the frame (version 1: 0), COMPACT: 0
+    uint64_t timestampNs;           // host monotonic clock when the frame was read
+};
+
+// Payload of a COMPACT record. Followed by
+//   int16_t  distance_mm[zones * targets]
+//   uint16_t range_sigma_mm[zones * targets]
+//   uint8_t  target_status[zones * targets]
+//   uint8_t  nb_target_detected[zones]
+// padded so the record size is a multiple of 8 bytes.
+struct HID_VL53L5CX_CompactFrame
+{
+    uint8_t zones;
+    uint8_t targets;
+    int8_t siliconTempDegC;
+    uint8_t reserved;
+};
+
+struct HID_VL53L5CX_IndexEntry
+{
+    uint64_t timestampNs;
+    uint64_t offset;                // file offset of the record header
+};
+
+struct HID_VL53L5CX_IndexTrailer
+{
+    char magic[4];                  // "VL5I"
+    uint32_t entrySize;             // sizeof(HID_VL53L5CX_IndexEntry)
+    uint64_t entryCount;
+    uint64_t indexOffset;
+};
+
+class HID_VL53L5CX_Recorder
+{
+private:
+    FILE *file;
+    HID_VL53L5CX_RECORD_ENCODING encoding;
+    uint8_t zones;                  // session resolution, when record() does not know better
+
+    // Single producer / single consumer ring of preallocated slots.
+    uint32_t slotCount;
+    uint32_t slotSize;
+    std::vector<uint8_t> slots;
+    std::atomic<uint32_t> head;     // next slot written by record()
+    std::atomic<uint32_t> tail;     // next slot written to disk
+
+    std::thread writer;
+    std::mutex wakeLock;
+    std::condition_variable wake;
+    std::atomic<bool> stopping;
+
+    // Owned by the writer thread until close()
+    std::vector<HID_VL53L5CX_IndexEntry> index;
+    uint64_t fileOffset;
+
+    std::atomic<uint64_t> recorded;
+    std::atomic<uint64_t> dropped;
+    std::atomic<uint64_t> written;
+
+    void writerLoop();
+
+public:
+    // Creates the file and writes the session header.
+    // throws an exception if the file cannot be created
+    HID_VL53L5CX_Recorder(const char *path, const HID_VL53L5CX_SessionHeader &header,
+        HID_VL53L5CX_RECORD_ENCODING encoding = HID_VL53L5CX_RECORD_ENCODING::RAW,
+        uint32_t queueDepth = 64);
+
+    // Flushes pending records and writes the index.
+    ~HID_VL53L5CX_Recorder();
+
+    // Queues the frame just read by vl53l5cx_get_ranging_data() at the resolution
+    // the sensor ranges at now (16 or 64, 0 = the session resolution). Never blocks,
+    // returns false if the queue is full and the frame was dropped.
+    // Must only be called from one thread (the acquisition thread).
+    bool record(uint64_t timestampNs, const VL53L5CX_Configuration *dev, const VL53L5CX_ResultsData *results,
+        uint8_t resolution = 0);
+
+    // Same for a frame already in wire format (replay, benchmarks).
+    bool recordRaw(uint64_t timestampNs, uint8_t streamCount, const uint8_t *frame, uint32_t size);
+
+    // Stops the writer thread, writes the index and closes the file. Safe to call twice.
+    void close();
+
+    uint64_t recordedCount() { return recorded.load(std::memory_order_relaxed); }
+    uint64_t droppedCount() { return dropped.load(std::memory_order_relaxed); }
+    uint64_t bytesWritten() { return written.load(std::memory_order_relaxed); }
+
+    // Fills the parts of a session header that only depend on the driver state.
+    static void initHeader(HID_VL53L5CX_SessionHeader &header, const VL53L5CX_Configuration *dev,
+        uint8_t resolution, uint8_t frequencyHz, uint8_t rangingMode, uint64_t startTimeNs);
+
+    // FNV-1a hash of the offset and xtalk calibration buffers.
+    static uint64_t calibrationFingerprint(const VL53L5CX_Configuration *dev);
+
+    // Output block mask used by vl53l5cx_start_ranging() with the platform.h options.
+    static void outputEnables(uint32_t enables[4]);
+
+    // Size of a COMPACT payload for the given grid.
+    static uint32_t compactSize(uint8_t zones, uint8_t targets);
+};
+
+// One record of a mapped recording.
+struct HID_VL53L5CX_RecordView
+{
+    uint64_t timestampNs;
+    uint8_t streamCount;
+    HID_VL53L5CX_RECORD_ENCODING encoding;
+    const uint8_t *data;
+    uint32_t size;                  // RAW: the frame size, version 1: with the padding
+};
+
+class HID_VL53L5CX_RecordingReader
+{
+private:
+    const uint8_t *base = nullptr;
+    uint64_t length = 0;
+    std::vector<HID_VL53L5CX_IndexEntry> scannedIndex;
+    const HID_VL53L5CX_IndexEntry *entries = nullptr;
+    uint64_t entryCount = 0;
+
+#ifdef _WIN32
+    void *fileHandle = nullptr;
+    void *mappingHandle = nullptr;
+#else
+    int fd = -1;
+#endif
+
+    void unmap();
+
+public:
+    HID_VL53L5CX_RecordingReader() {}
+    ~HID_VL53L5CX_RecordingReader();
+
+    // Maps the file read-only. Returns false if it is not a valid recording (version 1 or 2).
+    bool open(const char *path);
+
+    const HID_VL53L5CX_SessionHeader *header() const;
+
+    uint64_t frameCount() const { return entryCount; }
+
+    // Returns record number i (0 based).
+    HID_VL53L5CX_RecordView frame(uint64_t i) const;
+
+    // Index of the first record with timestampNs >= time (frameCount() if none).
+    uint64_t findByTime(uint64_t timestampNs) const;
+
+    // Decodes a COMPACT record into the ULD results structure.
+    static bool decodeCompact(const HID_VL53L5CX_RecordView &record, VL53L5CX_ResultsData *results);
+};
+
+#endif // __HID_VL53L5CX_Recorder__
@@ -0,0 +1,152 @@
+/*
+  This file implements the replay sensor.
+*/
+
+#include "pch.h" // use stdafx.h in Visual Studio 2017 and earlier
+#include "HID_VL53L5CX_Replay.h"
+#include <string.h>
+#include <stdexcept>
+#include <string>
+
+HID_VL53L5CX_SimConfig HID_VL53L5CX_ReplaySensor::replayConfig(const HID_VL53L5CX_SimConfig &config)
+{
+    // A replay never downloads firmware, the recorded session already ran
+    HID_VL53L5CX_SimConfig replay = config;
+    replay.firmwareLoaded = true;
+    return replay;
+}
+
+HID_VL53L5CX_ReplaySensor::HID_VL53L5CX_ReplaySensor(HID_VL53L5CX_VirtualClock *_clock, const char *path,
+    HID_VL53L5CX_REPLAY_MODE _mode, const HID_VL53L5CX_SimConfig &_config)
+    : HID_VL53L5CX_SimSensor(_clock, replayConfig(_config)), mode(_mode),
+      wallClock(HID_VL53L5CX_Clock::systemClock()), served(0), released(0), mismatched(0)
+{
+    if (!reader.open(path))
+        throw std::runtime_error("Cannot open recording: " + std::string(path));
+
+    // Start in the recorded configuration, the driver may still change it
+    const HID_VL53L5CX_SessionHeader *header = reader.header();
+    uint8_t side = (header->resolution == VL53L5CX_RESOLUTION_8X8) ? 8 : 4;
+    std::vector<uint8_t> &zoneConfig = dciValue(VL53L5CX_DCI_ZONE_CONFIG, 8);
+    zoneConfig[0] = side;
+    zoneConfig[1] = side;
+
+    if (header->frequencyHz != 0)
+        dciValue(VL53L5CX_DCI_FREQ_HZ, 4)[1] = header->frequencyHz;
+
+    // Same values vl53l5cx_set_ranging_mode() writes
+    std::vector<uint8_t> &rangingMode = dciValue(VL53L5CX_DCI_RANGING_MODE, 8);
+    bool autonomous = (header->rangingMode == VL53L5CX_RANGING_MODE_AUTONOMOUS);
+    rangingMode[1] = autonomous ? 0x03 : 0x01;
+    rangingMode[3] = autonomous ? 0x02 : 0x03;
+}
+
+void HID_VL53L5CX_ReplaySensor::latchSession()
+{
+    // A new start ranging command continues the replay where the last session stopped
+    if (rangingStartTimeNs() == sessionStartNs)
+        return;
+
+    sessionStartNs = rangingStartTimeNs();
+    sessionBase = served.load(std::memory_order_relaxed);
+    sessionTimestampNs = (sessionBase < reader.frameCount()) ? reader.frame(sessionBase).timestampNs : 0;
+    wallStartNs = wallClock->nowNs();
+}
+
+uint64_t HID_VL53L5CX_ReplaySensor::framesAvailable(uint64_t nowNs)
+{
+    if (!isRanging() || (nowNs < rangingStartTimeNs()))
+        return 0;
+
+    latchSession();
+    uint64_t count = reader.frameCount();
+    uint64_t available = 0;
+
+    switch (mode)
+    {
+    case HID_VL53L5CX_REPLAY_MODE::REALTIME:
+    {
+        // Every frame recorded up to the elapsed wall clock time
+        uint64_t elapsed = wallClock->nowNs() - wallStartNs;
+        available = reader.findByTime(sessionTimestampNs + elapsed + 1);
+        break;
+    }
+    case HID_VL53L5CX_REPLAY_MODE::ACCELERATED:
+        available = served.load(std::memory_order_relaxed) + 1;
+        break;
+    case HID_VL53L5CX_REPLAY_MODE::STEPPED:
+        available = released.load(std::memory_order_acquire);
+        break;
+    }
+
+    if (available > count)
+        available = count;
+    return (available > sessionBase) ? (available - sessionBase) : 0;
+}
+
+uint64_t HID_VL53L5CX_ReplaySensor::frameReadyTimeNs(uint64_t frame)
+{
+    // Recorded time, moved onto this session's time line
+    uint64_t index = sessionBase + frame - 1;
+    if (index >= reader.frameCount())
+        return rangingStartTimeNs();
+    return rangingStartTimeNs() + (reader.frame(index).timestampNs - sessionTimestampNs);
+}
+
+void HID_VL53L5CX_ReplaySensor::synthesizeFrame(uint64_t frame, uint64_t readyNs,
+    const std::vector<uint32_t> &blocks, uint8_t *wire, uint32_t size)
+{
+    (void)readyNs;
+
+    uint64_t index = sessionBase + frame - 1;
+    if (index >= reader.frameCount())
+        return;
+
+    HID_VL53L5CX_RecordView record = reader.frame(index);
+    VL53L5CX_ResultsData results;
+    bool replayed = false;
+
+    if (record.encoding == HID_VL53L5CX_RECORD_ENCODING::RAW)
+    {
+        // Version 2 records know their frame size, version 1 only has the one of the session
+        uint32_t rawSize = (reader.header()->version >= 2) ? record.size : reader.header()->dataReadSize;
+        if ((rawSize == size) && (record.size >= size))
+        {
+            memcpy(wire, record.data, size);
+            replayed = true;
+        }
+    }
+    else if (HID_VL53L5CX_RecordingReader::decodeCompact(record, &results))
+    {
+        encodeFrame(frame, blocks, results, wire, size);
+        replayed = true;
+    }
+
+    if (!replayed)
+    {
+        // No target anywhere, but still a well formed frame
+        memset(&results, 0, sizeof(results));
+        encodeFrame(frame, blocks, results, wire, size);
+        mismatched.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (index + 1 > served.load(std::memory_order_relaxed))
+        served.store(index + 1, std::memory_order_release);
+}
+
+void HID_VL53L5CX_ReplaySensor::step(uint32_t frames)
+{
+    released.fetch_add(frames, std::memory_order_release);
+}
+
+bool HID_VL53L5CX_ReplaySensor::exhausted()
+{
+    uint64_t limit = reader.frameCount();
+    if (mode == HID_VL53L5CX_REPLAY_MODE::STEPPED)
+    {
+        uint64_t stepped = released.load(std::memory_order_acquire);
+        if (stepped < limit)
+            limit = stepped;
+    }
+    return served.load(std::memory_order_acquire) >= limit;
+}
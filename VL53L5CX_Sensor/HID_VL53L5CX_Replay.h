@@ -0,0 +1,92 @@
+#pragma once
+/*
+  This file declares the replay sensor.
+
+  HID_VL53L5CX_ReplaySensor plays a recording made by HID_VL53L5CX_Recorder
+  back through the transport seam, so HID_VL53L5CX, the ULD and everything
+  built on top of them (getRange(), filters, presence logic) see the recorded
+  frames exactly as a live sensor would have produced them. It is the
+  simulated sensor with the synthetic scene replaced by the recorded frames:
+  DCI commands, start/stop and bus timing behave the same.
+
+  Raw records are returned byte for byte when the driver is configured as
+  when the frame was recorded (same resolution and output blocks): a replay
+  of a recording that changed resolution changes it at the same frame.
+  Compact records are re-encoded for whatever configuration the driver asks
+  for.
+*/
+
+#ifndef __HID_VL53L5CX_Replay__
+#define __HID_VL53L5CX_Replay__
+
+#include <stdint.h>
+#include <atomic>
+#include "HID_VL53L5CX_Sim.h"
+#include "HID_VL53L5CX_Recorder.h"
+
+enum class HID_VL53L5CX_REPLAY_MODE : uint8_t
+{
+    REALTIME = 0,       // frames become ready at their recorded times (wall clock)
+    ACCELERATED = 1,    // next frame is ready as soon as the previous one was read
+    STEPPED = 2         // frames become ready only when step() is called
+};
+
+class HID_VL53L5CX_ReplaySensor : public HID_VL53L5CX_SimSensor
+{
+private:
+    HID_VL53L5CX_RecordingReader reader;
+    HID_VL53L5CX_REPLAY_MODE mode;
+
+    // Current ranging session: first record it replays and that record's
+    // recorded time. Only used with the sensor lock held.
+    uint64_t sessionStartNs = UINT64_MAX;
+    uint64_t sessionBase = 0;
+    uint64_t sessionTimestampNs = 0;
+
+    // REALTIME: wall clock time the session started.
+    HID_VL53L5CX_Clock *wallClock;
+    uint64_t wallStartNs = 0;
+
+    // Frames handed to the driver and frames released by step().
+    std::atomic<uint64_t> served;
+    std::atomic<uint64_t> released;
+    std::atomic<uint64_t> mismatched;
+
+    static HID_VL53L5CX_SimConfig replayConfig(const HID_VL53L5CX_SimConfig &config);
+
+    // Detects a new start ranging command.
+    void latchSession();
+
+protected:
+    uint64_t framesAvailable(uint64_t nowNs) override;
+    uint64_t frameReadyTimeNs(uint64_t frame) override;
+    void synthesizeFrame(uint64_t frame, uint64_t readyNs,
+        const std::vector<uint32_t> &blocks, uint8_t *wire, uint32_t size) override;
+
+public:
+    // Maps the recording and presets resolution, frequency and ranging mode from
+    // its session header. The sensor starts with firmware loaded (warm start).
+    // throws an exception if the file is not a valid recording
+    HID_VL53L5CX_ReplaySensor(HID_VL53L5CX_VirtualClock *clock, const char *path,
+        HID_VL53L5CX_REPLAY_MODE mode = HID_VL53L5CX_REPLAY_MODE::ACCELERATED,
+        const HID_VL53L5CX_SimConfig &config = HID_VL53L5CX_SimConfig());
+
+    // A recording has no INT line, idle mode needs a live or simulated sensor.
+    bool setInterrupt(bool enable) override { (void)enable; return false; }
+
+    // STEPPED mode: makes the next 'frames' recorded frames ready.
+    void step(uint32_t frames = 1);
+
+    // True if no further frame will become ready on its own: the recording
+    // is over or, in STEPPED mode, every released frame has been read.
+    bool exhausted();
+
+    const HID_VL53L5CX_SessionHeader *session() const { return reader.header(); }
+    uint64_t frameCount() const { return reader.frameCount(); }
+    uint64_t servedCount() { return served.load(std::memory_order_relaxed); }
+
+    // Raw frames that did not match the driver configuration and were replaced by empty frames.
+    uint64_t mismatchCount() { return mismatched.load(std::memory_order_relaxed); }
+};
+
+#endif // __HID_VL53L5CX_Replay__
@@ -0,0 +1,354 @@
+/*
+  This file implements the region of interest kernels.
+*/
+
+#include "pch.h" // use stdafx.h in Visual Studio 2017 and earlier
+#include "HID_VL53L5CX_Roi.h"
+#include "HID_VL53L5CX_Outliers.h"
+#include <algorithm>
+
+#ifdef HID_VL53L5CX_ROI_SSE2
+#include <emmintrin.h>
+#endif
+
+// ROIs with different rules evaluate() keeps the validity masks of
+const uint32_t ROI_RULE_CACHE = 8;
+
+static uint32_t frameZones(const VL53L5CX_Frame &frame)
+{
+    return (frame.resolution < VL53L5CX_FRAME_MAX_ZONES) ? frame.resolution : VL53L5CX_FRAME_MAX_ZONES;
+}
+
+// No POPCNT/TZCNT, the DLL also runs on CPUs without them
+static uint32_t popCount(uint64_t bits)
+{
+    bits = bits - ((bits >> 1) & 0x5555555555555555ULL);
+    bits = (bits & 0x3333333333333333ULL) + ((bits >> 2) & 0x3333333333333333ULL);
+    bits = (bits + (bits >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (uint32_t)((bits * 0x0101010101010101ULL) >> 56);
+}
+
+static uint32_t lowestZone(uint64_t bits)
+{
+    return popCount((bits & (0 - bits)) - 1);
+}
+
+static bool sameRules(const VL53L5CX_Roi &a, const VL53L5CX_Roi &b)
+{
+    return (a.status_mask == b.status_mask) && (a.min_signal == b.min_signal) && (a.min_distance_mm == b.min_distance_mm)
+        && (a.max_distance_mm == b.max_distance_mm) && (a.max_sigma_mm == b.max_sigma_mm) && (a.outlier_cm == b.outlier_cm);
+}
+
+static uint64_t selectedZones(const VL53L5CX_Frame &frame, const VL53L5CX_Roi &roi)
+{
+    uint64_t zones = (roi.zone_mask != 0) ? roi.zone_mask : HID_VL53L5CX_Roi::centerZones(frame.resolution);
+    return zones & HID_VL53L5CX_Roi::allZones(frame.resolution);
+}
+
+// Zones of the whole frame that pass the rules of roi, one zone per step
+static uint64_t validScalar(const VL53L5CX_Frame &frame, const VL53L5CX_Roi &roi)
+{
+    uint32_t zones = frameZones(frame);
+    uint64_t valid = 0;
+    for (uint32_t i = 0; i < zones; i++)
+    {
+        uint32_t status = frame.target_status[i];
+        uint64_t ok = ((roi.status_mask >> (status & 31)) & 1) & (uint64_t)(status < 32)
+            & (uint64_t)(frame.distance_mm[i] > roi.min_distance_mm) & (uint64_t)(frame.distance_mm[i] < roi.max_distance_mm)
+            & (uint64_t)(frame.range_sigma_mm[i] <= roi.max_sigma_mm) & (uint64_t)(frame.signal_per_spad[i] >= roi.min_signal);
+        valid |= ok << i;
+    }
+    return valid;
+}
+
+#ifdef HID_VL53L5CX_ROI_SSE2
+
+// Same, eight zones per step. SSE2 only compares signed, unsigned values are
+// biased by their sign bit first.
+static uint64_t validSse2(const VL53L5CX_Frame &frame, const VL53L5CX_Roi &roi)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i minDistance = _mm_set1_epi16(roi.min_distance_mm);
+    const __m128i maxDistance = _mm_set1_epi16(roi.max_distance_mm);
+    const __m128i bias16 = _mm_set1_epi16((short)0x8000);
+    const __m128i maxSigma = _mm_set1_epi16((short)(roi.max_sigma_mm ^ 0x8000));
+    const __m128i bias32 = _mm_set1_epi32((int)0x80000000);
+    const __m128i minSignal = _mm_set1_epi32((int)(roi.min_signal ^ 0x80000000));
+
+    // A rule accepts one or two status codes, compare against each
+    uint16_t accepted[32];
+    uint32_t acceptedCount = 0;
+    for (uint32_t status = 0; status < 32; status++)
+    {
+        if (roi.status_mask & (1u << status))
+            accepted[acceptedCount++] = (uint16_t)status;
+    }
+
+    uint32_t zones = frameZones(frame);
+    uint64_t valid = 0;
+    for (uint32_t base = 0; base < zones; base += 8)
+    {
+        __m128i distance = _mm_loadu_si128((const __m128i *)&frame.distance_mm[base]);
+        __m128i ok = _mm_and_si128(_mm_cmpgt_epi16(distance, minDistance), _mm_cmplt_epi16(distance, maxDistance));
+
+        __m128i sigma = _mm_xor_si128(_mm_loadu_si128((const __m128i *)&frame.range_sigma_mm[base]), bias16);
+        ok = _mm_andnot_si128(_mm_cmpgt_epi16(sigma, maxSigma), ok);
+
+        __m128i signalLow = _mm_xor_si128(_mm_loadu_si128((const __m128i *)&frame.signal_per_spad[base]), bias32);
+        __m128i signalHigh = _mm_xor_si128(_mm_loadu_si128((const __m128i *)&frame.signal_per_spad[base + 4]), bias32);
+        __m128i weak = _mm_packs_epi32(_mm_cmpgt_epi32(minSignal, signalLow), _mm_cmpgt_epi32(minSignal, signalHigh));
+        ok = _mm_andnot_si128(weak, ok);
+
+        __m128i status = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)&frame.target_status[base]), zero);
+        __m128i statusOk = zero;
+        for (uint32_t i = 0; i < acceptedCount; i++)
+            statusOk = _mm_or_si128(statusOk, _mm_cmpeq_epi16(status, _mm_set1_epi16((short)accepted[i])));
+        ok = _mm_and_si128(ok, statusOk);
+
+        valid |= (uint64_t)(_mm_movemask_epi8(_mm_packs_epi16(ok, zero)) & 0xFF) << base;
+    }
+    return valid & HID_VL53L5CX_Roi::allZones(frame.resolution);
+}
+
+// Lanes of the eight zones from base on that are set in zones
+static __m128i zoneLanes(uint64_t zones, uint32_t base)
+{
+    const __m128i lanes = _mm_setr_epi16(1, 2, 4, 8, 16, 32, 64, 128);
+    __m128i bits = _mm_set1_epi16((short)((zones >> base) & 0xFF));
+    return _mm_cmpeq_epi16(_mm_and_si128(bits, lanes), lanes);
+}
+
+static double meanSse2(const VL53L5CX_Frame &frame, uint64_t zones)
+{
+    const __m128i ones = _mm_set1_epi16(1);
+    __m128i sum = _mm_setzero_si128();
+    for (uint32_t base = 0; (base < VL53L5CX_FRAME_MAX_ZONES) && ((zones >> base) != 0); base += 8)
+    {
+        __m128i distance = _mm_and_si128(_mm_loadu_si128((const __m128i *)&frame.distance_mm[base]), zoneLanes(zones, base));
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(distance, ones));
+    }
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return (double)_mm_cvtsi128_si32(sum) / popCount(zones);
+}
+
+static double minSse2(const VL53L5CX_Frame &frame, uint64_t zones)
+{
+    const __m128i none = _mm_set1_epi16(INT16_MAX);
+    __m128i closest = none;
+    for (uint32_t base = 0; (base < VL53L5CX_FRAME_MAX_ZONES) && ((zones >> base) != 0); base += 8)
+    {
+        __m128i selected = zoneLanes(zones, base);
+        __m128i distance = _mm_loadu_si128((const __m128i *)&frame.distance_mm[base]);
+        distance = _mm_or_si128(_mm_and_si128(selected, distance), _mm_andnot_si128(selected, none));
+        closest = _mm_min_epi16(closest, distance);
+    }
+    closest = _mm_min_epi16(closest, _mm_shuffle_epi32(closest, _MM_SHUFFLE(1, 0, 3, 2)));
+    closest = _mm_min_epi16(closest, _mm_shuffle_epi32(closest, _MM_SHUFFLE(2, 3, 0, 1)));
+    closest = _mm_min_epi16(closest, _mm_shufflelo_epi16(closest, _MM_SHUFFLE(2, 3, 0, 1)));
+    return (double)(int16_t)_mm_extract_epi16(closest, 0);
+}
+
+#endif // HID_VL53L5CX_ROI_SSE2
+
+// Zones of the whole frame that pass the rules of roi and are no outliers among them
+static uint64_t validFrame(const VL53L5CX_Frame &frame, const VL53L5CX_Roi &roi, bool vectorised)
+{
+#ifdef HID_VL53L5CX_ROI_SSE2
+    uint64_t valid = vectorised ? validSse2(frame, roi) : validScalar(frame, roi);
+#else
+    uint64_t valid = validScalar(frame, roi);
+#endif
+    if (roi.outlier_cm != 0)
+        valid &= ~HID_VL53L5CX_Outliers::find(frame, valid, (uint16_t)(roi.outlier_cm * 10), vectorised);
+    return valid;
+}
+
+static double meanScalar(const VL53L5CX_Frame &frame, uint64_t zones)
+{
+    int32_t sum = 0;
+    for (uint64_t bits = zones; bits != 0; bits &= bits - 1)
+        sum += frame.distance_mm[lowestZone(bits)];
+    return (double)sum / popCount(zones);
+}
+
+static double minScalar(const VL53L5CX_Frame &frame, uint64_t zones)
+{
+    int16_t closest = INT16_MAX;
+    for (uint64_t bits = zones; bits != 0; bits &= bits - 1)
+        closest = std::min(closest, frame.distance_mm[lowestZone(bits)]);
+    return (double)closest;
+}
+
+static double median(const VL53L5CX_Frame &frame, uint64_t zones)
+{
+    int16_t values[VL53L5CX_FRAME_MAX_ZONES];
+    uint32_t count = 0;
+    for (uint64_t bits = zones; bits != 0; bits &= bits - 1)
+        values[count++] = frame.distance_mm[lowestZone(bits)];
+
+    // Even counts take the mean of the two middle values
+    uint32_t middle = count / 2;
+    std::nth_element(values, values + middle, values + count);
+    if (count & 1)
+        return (double)values[middle];
+    return ((double)*std::max_element(values, values + middle) + values[middle]) / 2.0;
+}
+
+static double signalWeighted(const VL53L5CX_Frame &frame, uint64_t zones)
+{
+    uint64_t weights = 0;
+    int64_t sum = 0;
+    for (uint64_t bits = zones; bits != 0; bits &= bits - 1)
+    {
+        uint32_t zone = lowestZone(bits);
+        weights += frame.signal_per_spad[zone];
+        sum += (int64_t)frame.signal_per_spad[zone] * frame.distance_mm[zone];
+    }
+
+    // No signal reported at all, every zone counts the same
+    if (weights == 0)
+        return meanScalar(frame, zones);
+    return (double)sum / (double)weights;
+}
+
+VL53L5CX_Roi HID_VL53L5CX_Roi::defaults()
+{
+    VL53L5CX_Roi roi;
+    roi.zone_mask = 0;
+    roi.status_mask = 1u << 5;
+    roi.min_signal = 0;
+    roi.min_distance_mm = 10;
+    roi.max_distance_mm = 1200;
+    roi.max_sigma_mm = UINT16_MAX;
+    roi.reduction = VL53L5CX_ROI_MEAN;
+    roi.outlier_cm = 0;
+    return roi;
+}
+
+uint64_t HID_VL53L5CX_Roi::centerZones(uint8_t resolution)
+{
+    switch (resolution)
+    {
+    case 16:
+        return (1ULL << 5) | (1ULL << 6) | (1ULL << 9) | (1ULL << 10);
+    case 64:
+        return 0x00003c3c3c3c0000ULL;      // rows 2..5, columns 2..5
+    default:
+        return allZones(resolution);
+    }
+}
+
+uint64_t HID_VL53L5CX_Roi::allZones(uint8_t resolution)
+{
+    return (resolution >= VL53L5CX_FRAME_MAX_ZONES) ? UINT64_MAX : ((1ULL << resolution) - 1);
+}
+
+uint64_t HID_VL53L5CX_Roi::validZones(const VL53L5CX_Frame &frame, const VL53L5CX_Roi &roi, bool vectorised)
+{
+    return validFrame(frame, roi, vectorised) & selectedZones(frame, roi);
+}
+
+double HID_VL53L5CX_Roi::reduce(const VL53L5CX_Frame &frame, uint64_t zones, uint8_t reduction, bool vectorised)
+{
+    zones &= allZones(frame.resolution);
+    if (zones == 0)
+        return 0;
+
+    switch (reduction)
+    {
+    case VL53L5CX_ROI_MIN:
+#ifdef HID_VL53L5CX_ROI_SSE2
+        if (vectorised)
+            return minSse2(frame, zones);
+#endif
+        return minScalar(frame, zones);
+    case VL53L5CX_ROI_MEDIAN:
+        return median(frame, zones);
+    case VL53L5CX_ROI_SIGNAL_WEIGHTED:
+        return signalWeighted(frame, zones);
+    default:
+#ifdef HID_VL53L5CX_ROI_SSE2
+        if (vectorised)
+            return meanSse2(frame, zones);
+#endif
+        (void)vectorised;
+        return meanScalar(frame, zones);
+    }
+}
+
+uint32_t HID_VL53L5CX_Roi::evaluate(const VL53L5CX_Frame &frame, const VL53L5CX_Roi *rois, uint32_t count,
+    double *distances, uint8_t *validCounts, bool vectorised)
+{
+    // Validity masks of the whole frame, one per set of rules seen so far
+    const VL53L5CX_Roi *rules[ROI_RULE_CACHE];
+    uint64_t valid[ROI_RULE_CACHE];
+    uint32_t cached = 0;
+    uint32_t passes = 0;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t slot = 0;
+        while ((slot < cached) && !sameRules(*rules[slot], rois[i]))
+            slot++;
+        if (slot == cached)
+        {
+            // Full: the oldest rules make room
+            if (cached == ROI_RULE_CACHE)
+                slot = passes % ROI_RULE_CACHE;
+            else
+                cached++;
+            valid[slot] = validFrame(frame, rois[i], vectorised);
+            rules[slot] = &rois[i];
+            passes++;
+        }
+
+        uint64_t zones = valid[slot] & selectedZones(frame, rois[i]);
+        distances[i] = reduce(frame, zones, rois[i].reduction, vectorised);
+        if (validCounts != nullptr)
+            validCounts[i] = (uint8_t)popCount(zones);
+    }
+    return passes;
+}
+
+uint32_t HID_VL53L5CX_Roi::zoneCount(uint64_t zones)
+{
+    return popCount(zones);
+}
+
+uint32_t HID_VL53L5CX_Roi::lowestZone(uint64_t zones)
+{
+    return popCount((zones & (0 - zones)) - 1);
+}
+
+uint64_t HID_VL53L5CX_Roi::neighbourZones(uint64_t zones, uint8_t resolution)
+{
+    // Shifting by one zone must not wrap into the next row
+    uint32_t width = (resolution == 64) ? 8 : 4;
+    uint64_t notFirstColumn = (width == 8) ? 0xFEFEFEFEFEFEFEFEULL : 0xEEEEULL;
+    uint64_t notLastColumn = (width == 8) ? 0x7F7F7F7F7F7F7F7FULL : 0x7777ULL;
+    uint64_t row = zones | ((zones << 1) & notFirstColumn) | ((zones >> 1) & notLastColumn);
+    return (row | (row << width) | (row >> width)) & allZones((uint8_t)(width * width));
+}
+
+uint64_t HID_VL53L5CX_Roi::connectedZones(uint64_t zones, uint64_t seed, uint8_t resolution)
+{
+    // Grows one ring of neighbours per step, a blob of n zones takes at most n steps
+    uint64_t blob = seed & zones;
+    uint64_t grown = blob;
+    do
+    {
+        blob = grown;
+        grown = neighbourZones(blob, resolution) & zones;
+    } while (grown != blob);
+    return blob;
+}
+
+bool HID_VL53L5CX_Roi::simd()
+{
+#ifdef HID_VL53L5CX_ROI_SSE2
+    return true;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,76 @@
+#pragma once
+/*
+  This file declares the region of interest kernels.
+
+  A VL53L5CX_Roi (VL53L5CXSensor.h) selects zones of a frame by mask, keeps
+  the targets that pass its rules (status, distance window, sigma, signal)
+  and reduces their distances to one value. Validity is computed for all
+  zones of the frame at once on the SoA arrays of VL53L5CX_Frame, without
+  branches: eight zones per step with SSE2, one zone per step otherwise. The
+  result is a 64-bit mask of valid zones, so several ROIs with the same rules
+  (e.g. one per lane) share one validity pass and only pay for the reduction.
+
+  With outlier_cm set, zones that pass the rules but disagree with their
+  neighbours are dropped as well (HID_VL53L5CX_Outliers.h).
+
+  Mean and min are vectorised too, median and the signal weighted mean walk
+  the set bits of the mask. Define HID_VL53L5CX_NO_SIMD to build the scalar
+  kernels only; they give the same results.
+*/
+
+#ifndef __HID_VL53L5CX_Roi__
+#define __HID_VL53L5CX_Roi__
+
+#include <stdint.h>
+#include "VL53L5CXSensor.h"
+
+#if !defined(HID_VL53L5CX_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)))
+#define HID_VL53L5CX_ROI_SSE2
+#endif
+
+class HID_VL53L5CX_Roi
+{
+public:
+    // The rules getRange() always used: status 5, 10 mm < distance < 1200 mm,
+    // mean of the center zones.
+    static VL53L5CX_Roi defaults();
+
+    // Zones 5, 6, 9, 10 at 4x4, the 4x4 block in the middle at 8x8: the same
+    // part of the field of view.
+    static uint64_t centerZones(uint8_t resolution);
+
+    // All zones of a frame of this resolution.
+    static uint64_t allZones(uint8_t resolution);
+
+    // Zones of roi (all of its zone_mask, or the center) that pass its rules
+    // and, with outlier_cm set, the outlier check.
+    static uint64_t validZones(const VL53L5CX_Frame &frame, const VL53L5CX_Roi &roi, bool vectorised = true);
+
+    // Reduces the distances of zones (a validZones() result) to one value in mm,
+    // 0 if zones is empty.
+    static double reduce(const VL53L5CX_Frame &frame, uint64_t zones, uint8_t reduction, bool vectorised = true);
+
+    // Evaluates count ROIs on one frame, sharing validity passes between ROIs
+    // with equal rules. distances[i] is 0 if no zone of ROI i is valid;
+    // validCounts may be nullptr. Returns the number of validity passes run.
+    static uint32_t evaluate(const VL53L5CX_Frame &frame, const VL53L5CX_Roi *rois, uint32_t count,
+        double *distances, uint8_t *validCounts, bool vectorised = true);
+
+    // Number of zones in a mask.
+    static uint32_t zoneCount(uint64_t zones);
+
+    // Index of the lowest zone of a mask that is not empty.
+    static uint32_t lowestZone(uint64_t zones);
+
+    // zones and the zones next to them, diagonals included, on a 4x4 or 8x8 grid.
+    static uint64_t neighbourZones(uint64_t zones, uint8_t resolution);
+
+    // The zones of zones connected to seed through neighbours, diagonals included:
+    // one blob of a foreground mask. Empty if seed is not in zones.
+    static uint64_t connectedZones(uint64_t zones, uint64_t seed, uint8_t resolution);
+
+    // True if the vectorised kernels are built in, false if they fall back to scalar.
+    static bool simd();
+};
+
+#endif // __HID_VL53L5CX_Roi__
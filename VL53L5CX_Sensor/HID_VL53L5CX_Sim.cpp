@@ -0,0 +1,837 @@
+/*
+  This file implements the simulated VL53L5CX sensor and the benchmark harness.
+*/
+
+#include "pch.h" // use stdafx.h in Visual Studio 2017 and earlier
+#include "HID_VL53L5CX_Sim.h"
+#include "HID_VL53L5CX.h"
+#include "vl53l5cx_api.h"
+#include "vl53l5cx_plugin_detection_thresholds.h"
+#include "vl53l5cx_plugin_motion_indicator.h"
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+// Register map used by the ULD
+const uint16_t SIM_PAGE_SELECT = 0x7fff;
+const uint16_t SIM_DATA_READY = 0x0000;
+const uint16_t SIM_AUTO_STOP_FLAG = 0x2ffc;
+const uint16_t SIM_UI_RANGE_DATA = 0x5440;
+
+// I2C slave address byte sent with every transaction
+const uint32_t SIM_ADDRESS_BYTES = 1;
+
+// Status of a transaction on a wedged bus (FT260_I2C_READ_FAIL)
+const uint8_t SIM_STATUS_BUS_WEDGED = 19;
+
+// Most frames one INT latch request looks back on
+const uint64_t SIM_INTERRUPT_FRAMES = 255;
+
+HID_VL53L5CX_SimSensor::HID_VL53L5CX_SimSensor(HID_VL53L5CX_VirtualClock *_clock, const HID_VL53L5CX_SimConfig &_config)
+    : clock(_clock), config(_config)
+{
+    firmwareLoaded = config.firmwareLoaded;
+    if (firmwareLoaded)
+        resetDci();
+}
+
+void HID_VL53L5CX_SimSensor::chargeTransaction(uint32_t i2cBytes)
+{
+    // 9 clocks per byte (8 data bits + ACK)
+    uint64_t i2cNs = ((uint64_t)i2cBytes * 9ULL * 1000000ULL) / config.i2cClockKHz;
+
+    stats.transactions++;
+    stats.i2cBusyNs += i2cNs;
+    stats.transportBusyNs += i2cNs + config.usbRoundTripNs;
+    clock->advanceNs(i2cNs + config.usbRoundTripNs);
+}
+
+// Firmware defaults of the DCI values the ULD reads back
+void HID_VL53L5CX_SimSensor::resetDci()
+{
+    dci.clear();
+    dci[VL53L5CX_DCI_ZONE_CONFIG] = { 4, 4, 0, 0, 8, 8, 0, 0 };
+    dci[VL53L5CX_DCI_FREQ_HZ] = { 0, 1, 0, 0 };
+    dci[VL53L5CX_DCI_RANGING_MODE] = { 0, 1, 0, 3, 0, 0, 0, 0 };
+
+    uint32_t integrationUs = 5000;
+    std::vector<uint8_t> &integration = dciValue(VL53L5CX_DCI_INT_TIME, 20);
+    memcpy(integration.data(), &integrationUs, sizeof(integrationUs));
+}
+
+std::vector<uint8_t>& HID_VL53L5CX_SimSensor::dciValue(uint16_t index, uint16_t size)
+{
+    std::vector<uint8_t> &value = dci[index];
+    if (value.size() < size)
+        value.resize(size, 0);
+    return value;
+}
+
+uint8_t HID_VL53L5CX_SimSensor::streamCount(uint64_t frame)
+{
+    // The firmware counts 0..254, 255 means "no frame yet"
+    return (uint8_t)((frame - 1) % 255);
+}
+
+uint64_t HID_VL53L5CX_SimSensor::framesAvailable(uint64_t nowNs)
+{
+    if (!ranging || nowNs < rangingStartNs)
+        return 0;
+    return (nowNs - rangingStartNs) / framePeriodNs;
+}
+
+uint64_t HID_VL53L5CX_SimSensor::frameReadyTimeNs(uint64_t frame)
+{
+    return rangingStartNs + frame * framePeriodNs;
+}
+
+void HID_VL53L5CX_SimSensor::startSession()
+{
+    std::vector<uint8_t> &list = dciValue(VL53L5CX_DCI_OUTPUT_LIST, 48);
+    std::vector<uint8_t> &enables = dciValue(VL53L5CX_DCI_OUTPUT_ENABLES, 16);
+
+    // Same size rule as vl53l5cx_start_ranging(), the block sizes are already resolved
+    frameBlocks.clear();
+    frameSize = 0;
+    for (uint32_t i = 0; i < (uint32_t)(list.size() / 4); i++)
+    {
+        uint32_t bh, enable;
+        memcpy(&bh, &list[i * 4], 4);
+        memcpy(&enable, &enables[(i / 32) * 4], 4);
+        if ((bh == 0) || ((enable & (1U << (i % 32))) == 0))
+            continue;
+
+        union Block_header header;
+        header.bytes = bh;
+        if ((header.type >= 0x1) && (header.type < 0x0d))
+            frameSize += header.type * header.size;
+        else
+            frameSize += header.size;
+        frameSize += 4;
+
+        if (bh != VL53L5CX_START_BH)
+            frameBlocks.push_back(bh);
+    }
+    frameSize += 24;
+
+    std::vector<uint8_t> &rangeData = dciValue(SIM_UI_RANGE_DATA, 12);
+    rangeData[8] = (uint8_t)(frameSize & 0xff);
+    rangeData[9] = (uint8_t)(frameSize >> 8);
+
+    uint8_t frequency = dciValue(VL53L5CX_DCI_FREQ_HZ, 4)[1];
+    if (frequency == 0)
+        frequency = 1;
+    framePeriodNs = 1000000000ULL / frequency;
+
+    frameBuffer.assign(frameSize, 0);
+    ranging = true;
+    rangingStartNs = clock->nowNs() + config.commandLatencyNs;
+    lastFrameRead = 0;
+    interruptFrame = 0;
+}
+
+// A UI command is complete once its last byte lands on VL53L5CX_UI_CMD_END
+void HID_VL53L5CX_SimSensor::handleCommand(uint16_t registerAddress, const uint8_t *buffer, uint16_t size)
+{
+    // Without firmware nobody answers, the ULD polls until it times out
+    if (!firmwareLoaded)
+    {
+        commandDoneNs = UINT64_MAX;
+        return;
+    }
+    commandDoneNs = clock->nowNs() + config.commandLatencyNs;
+
+    if ((registerAddress == SIM_AUTO_STOP_FLAG) && (size == 4))
+    {
+        // Start ranging command {0x00, 0x03, 0x00, 0x00}
+        if (buffer[1] == 0x03)
+            startSession();
+        return;
+    }
+
+    if (size < 12)
+        return;
+
+    const uint8_t *footer = &buffer[size - 8];
+    uint16_t index = (uint16_t)((buffer[0] << 8) | buffer[1]);
+    uint16_t dataSize = (uint16_t)((buffer[2] << 4) | (buffer[3] >> 4));
+
+    if ((footer[4] == 0x05) && (footer[5] == 0x01) && (dataSize + 12 <= size))
+    {
+        // DCI write, the data is in firmware (swapped) order
+        std::vector<uint8_t> value(buffer + 4, buffer + 4 + dataSize);
+        SwapBuffer(value.data(), dataSize);
+        dci[index] = value;
+    }
+    else if ((footer[4] == 0x00) && (footer[5] == 0x02))
+    {
+        // DCI read, answer is [header][data][footer] in firmware order
+        std::vector<uint8_t> &value = dciValue(index, dataSize);
+        dciAnswer.assign(dataSize + 12, 0);
+        memcpy(dciAnswer.data(), buffer, 4);
+        memcpy(&dciAnswer[4], value.data(), dataSize);
+        SwapBuffer(dciAnswer.data(), (uint16_t)dciAnswer.size());
+    }
+
+    // Anything else (NVM, offset, xtalk, default configuration) is just acknowledged
+}
+
+uint8_t HID_VL53L5CX_SimSensor::getI2CStatus()
+{
+    return HID_VL53L5CX_I2C_STATUS_IDLE;
+}
+
+uint8_t HID_VL53L5CX_SimSensor::registerValue(uint16_t registerAddress)
+{
+    if (registerAddress == SIM_PAGE_SELECT)
+        return page;
+
+    if (page == 0)
+    {
+        switch (registerAddress)
+        {
+        case 0x00: return 0xF0;                 // device id
+        case 0x01: return 0x02;                 // revision id
+        case 0x06:                              // GO2 status 0
+            return (uint8_t)(((powerState == 0x02) ? 0x00 : 0x01) | (mcuStop ? 0x80 : 0x00));
+        case 0x07: return mcuStop ? 0x84 : 0x00;
+        case 0x09: return powerState;
+        default: break;
+        }
+    }
+    else if (page == 1)
+    {
+        if (registerAddress == 0x21)
+            return 0x10;                        // FW access granted
+    }
+    return 0;
+}
+
+void HID_VL53L5CX_SimSensor::setTimeoutMs(uint32_t _timeoutMs)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    timeoutMs = _timeoutMs;
+}
+
+void HID_VL53L5CX_SimSensor::setWedged(bool _wedged)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    wedged = _wedged;
+}
+
+uint8_t HID_VL53L5CX_SimSensor::wedgedRead(uint16_t size)
+{
+    // The register address still goes out, the answer never comes
+    chargeTransaction(SIM_ADDRESS_BYTES + 2);
+    clock->advanceNs((uint64_t)HID_VL53L5CX_readTimeoutMs(size, timeoutMs) * 1000000);
+    return SIM_STATUS_BUS_WEDGED;
+}
+
+uint8_t HID_VL53L5CX_SimSensor::readSingleByte(uint16_t registerAddress, uint8_t &value)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (wedged)
+        return wedgedRead(1);
+
+    chargeTransaction(SIM_ADDRESS_BYTES + 2);
+    value = registerValue(registerAddress);
+    chargeTransaction(SIM_ADDRESS_BYTES + 1);
+    stats.bytesRead += 1;
+    return 0;
+}
+
+uint8_t HID_VL53L5CX_SimSensor::writeSingleByte(uint16_t registerAddress, uint8_t value)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (wedged)
+    {
+        chargeTransaction(SIM_ADDRESS_BYTES + 3);
+        return SIM_STATUS_BUS_WEDGED;
+    }
+
+    chargeTransaction(SIM_ADDRESS_BYTES + 3);
+    stats.bytesWritten += 1;
+
+    if (registerAddress == SIM_PAGE_SELECT)
+    {
+        page = value;
+    }
+    else if (page == 0)
+    {
+        if (registerAddress == 0x09)
+        {
+            powerState = value;
+        }
+        else if (registerAddress == 0x14)
+        {
+            mcuStop = value;
+            if (mcuStop)
+                ranging = false;
+        }
+    }
+    return 0;
+}
+
+uint8_t HID_VL53L5CX_SimSensor::readMultipleBytes(uint16_t registerAddress, uint8_t* buffer, uint16_t bufferSize)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (wedged)
+        return wedgedRead(bufferSize);
+
+    // register address write, the sensor latches its answer here
+    chargeTransaction(SIM_ADDRESS_BYTES + 2);
+    uint64_t now = clock->nowNs();
+
+    memset(buffer, 0, bufferSize);
+    if (page != 2)
+    {
+        for (uint16_t i = 0; i < bufferSize; i++)
+            buffer[i] = registerValue((uint16_t)(registerAddress + i));
+    }
+    else
+    {
+        if ((registerAddress == VL53L5CX_UI_CMD_STATUS) && (bufferSize >= 4))
+        {
+            if (now >= commandDoneNs)
+            {
+                buffer[0] = 0x02;
+                buffer[1] = 0x03;
+            }
+        }
+        else if (registerAddress == VL53L5CX_UI_CMD_START)
+        {
+            // No DCI command answered yet, the buffer is left as it is
+            if (!dciAnswer.empty())
+                memcpy(buffer, dciAnswer.data(), (bufferSize < dciAnswer.size()) ? bufferSize : dciAnswer.size());
+        }
+        else if ((registerAddress == SIM_DATA_READY) && (bufferSize == 4))
+        {
+            uint64_t frame = framesAvailable(now);
+            buffer[0] = (frame == 0) ? 0xff : streamCount(frame);
+            if (frame != 0)
+            {
+                buffer[1] = 0x05;
+                buffer[2] = 0x05;
+                buffer[3] = 0x10;
+            }
+        }
+        else if (registerAddress == SIM_DATA_READY)
+        {
+            uint64_t frame = framesAvailable(now);
+            if (frame != 0)
+            {
+                uint64_t readyNs = frameReadyTimeNs(frame);
+                memset(frameBuffer.data(), 0, frameBuffer.size());
+                synthesizeFrame(frame, readyNs, frameBlocks, frameBuffer.data(), frameSize);
+                frameBuffer[0] = streamCount(frame);
+                memcpy(buffer, frameBuffer.data(), (bufferSize < frameSize) ? bufferSize : frameSize);
+
+                if (frame != lastFrameRead)
+                {
+                    framesRead++;
+                    framesSkipped += frame - lastFrameRead - 1;
+                    lastFrameRead = frame;
+                    lastFrameReadyNs = readyNs;
+                }
+            }
+        }
+    }
+
+    chargeTransaction(SIM_ADDRESS_BYTES + bufferSize);
+    stats.bytesRead += bufferSize;
+    return 0;
+}
+
+uint8_t HID_VL53L5CX_SimSensor::writeMultipleBytes(uint16_t registerAddress, uint8_t* buffer, uint16_t bufferSize)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (wedged)
+    {
+        chargeTransaction(SIM_ADDRESS_BYTES + 2);
+        return SIM_STATUS_BUS_WEDGED;
+    }
+
+    chargeTransaction(SIM_ADDRESS_BYTES + 2);
+    chargeTransaction(SIM_ADDRESS_BYTES + bufferSize);
+    stats.bytesWritten += bufferSize;
+
+    if (page == 0x0b)
+    {
+        // Last firmware chunk written, the MCU boots with default settings
+        firmwareLoaded = true;
+        commandDoneNs = 0;
+        resetDci();
+    }
+    else if ((page == 2) && (bufferSize > 0)
+        && ((uint32_t)registerAddress + bufferSize - 1 == VL53L5CX_UI_CMD_END))
+    {
+        handleCommand(registerAddress, buffer, bufferSize);
+    }
+    return 0;
+}
+
+// Writes a little endian value of 'width' bytes
+static void putValue(uint8_t *data, uint32_t width, uint32_t value)
+{
+    for (uint32_t i = 0; i < width; i++)
+        data[i] = (uint8_t)(value >> (8 * i));
+}
+
+void HID_VL53L5CX_SimSensor::synthesizeFrame(uint64_t frame, uint64_t readyNs,
+    const std::vector<uint32_t> &blocks, uint8_t *wire, uint32_t size)
+{
+    VL53L5CX_ResultsData results;
+    sceneResults(frame, readyNs, results);
+    sceneMotion(frame, results);
+    encodeFrame(frame, blocks, results, wire, size);
+}
+
+void HID_VL53L5CX_SimSensor::sceneMotion(uint64_t frame, VL53L5CX_ResultsData &results)
+{
+#if !defined(VL53L5CX_DISABLE_MOTION_INDICATOR) && !defined(VL53L5CX_DISABLE_DISTANCE_MM)
+    VL53L5CX_Motion_Configuration motion;
+    memcpy(&motion, dciValue(VL53L5CX_DCI_MOTION_DETECTOR_CFG, sizeof(motion)).data(), sizeof(motion));
+    if ((motion.nb_of_aggregates == 0) || (frame < 2))
+        return;
+
+    // Inverse of vl53l5cx_motion_indicator_set_distance_motion()
+    double minMm = (motion.ref_bin_offset / 2048.5 + 4.0) * 37.5348;
+    double maxMm = minMm + (motion.feature_length * 15.01392 - 30.02784) * 10.0;
+    uint32_t detection = motion.detection_threshold / 65536;
+
+    VL53L5CX_ResultsData previous;
+    sceneResults(frame - 1, frameReadyTimeNs(frame - 1), previous);
+    uint32_t aggregates = std::min((uint32_t)motion.nb_of_aggregates, (uint32_t)32);
+    for (uint32_t zone = 0; zone < VL53L5CX_RESOLUTION_8X8; zone++)
+    {
+        int32_t id = motion.map_id[zone];
+        if ((id < 0) || ((uint32_t)id >= aggregates))
+            continue;
+        uint32_t e = zone * VL53L5CX_NB_TARGET_PER_ZONE;
+        int32_t now = results.distance_mm[e], before = previous.distance_mm[e];
+        if (((now < minMm) || (now > maxMm)) && ((before < minMm) || (before > maxMm)))
+            continue;
+        results.motion_indicator.motion[id] = std::max(results.motion_indicator.motion[id], (uint32_t)abs(now - before));
+    }
+
+    results.motion_indicator.nb_of_aggregates = (uint8_t)aggregates;
+    for (uint32_t i = 0; i < aggregates; i++)
+    {
+        results.motion_indicator.global_indicator_1 += results.motion_indicator.motion[i];
+        if (results.motion_indicator.motion[i] >= detection)
+            results.motion_indicator.nb_of_detected_aggregates++;
+    }
+#else
+    (void)frame;
+    (void)results;
+#endif
+}
+
+void HID_VL53L5CX_SimSensor::sceneResults(uint64_t frame, uint64_t readyNs, VL53L5CX_ResultsData &results)
+{
+    (void)frame;
+
+    // Scene distance at the time the frame was captured
+    int64_t distance = (int64_t)config.targetDistanceMm
+        + ((int64_t)config.targetVelocityMmPerS * (int64_t)(readyNs / 1000000ULL)) / 1000;
+    if (distance < 0)
+        distance = 0;
+
+    // Flat target seen by the first target of every zone, the second target behind it
+    bool second = (VL53L5CX_NB_TARGET_PER_ZONE > 1) && (config.secondTargetDistanceMm != 0);
+    memset(&results, 0, sizeof(results));
+    results.silicon_temp_degc = config.siliconTemperatureC;
+    for (uint32_t zone = 0; zone < VL53L5CX_RESOLUTION_8X8; zone++)
+    {
+        uint32_t e = zone * VL53L5CX_NB_TARGET_PER_ZONE;
+#ifndef VL53L5CX_DISABLE_AMBIENT_PER_SPAD
+        results.ambient_per_spad[zone] = 2;
+#endif
+#ifndef VL53L5CX_DISABLE_NB_SPADS_ENABLED
+        results.nb_spads_enabled[zone] = 16 * 256;
+#endif
+#ifndef VL53L5CX_DISABLE_NB_TARGET_DETECTED
+        results.nb_target_detected[zone] = second ? 2 : 1;
+#endif
+#ifndef VL53L5CX_DISABLE_SIGNAL_PER_SPAD
+        results.signal_per_spad[e] = 500;
+#endif
+#ifndef VL53L5CX_DISABLE_RANGE_SIGMA_MM
+        results.range_sigma_mm[e] = 3;
+#endif
+#ifndef VL53L5CX_DISABLE_DISTANCE_MM
+        results.distance_mm[e] = (int16_t)(distance + (zone % 4));
+#endif
+#ifndef VL53L5CX_DISABLE_REFLECTANCE_PERCENT
+        results.reflectance[e] = 40;
+#endif
+#ifndef VL53L5CX_DISABLE_TARGET_STATUS
+        results.target_status[e] = 5;
+#endif
+        if (second)
+        {
+            uint32_t behind = e + ((VL53L5CX_NB_TARGET_PER_ZONE > 1) ? 1 : 0);
+#ifndef VL53L5CX_DISABLE_SIGNAL_PER_SPAD
+            results.signal_per_spad[behind] = 150;
+#endif
+#ifndef VL53L5CX_DISABLE_RANGE_SIGMA_MM
+            results.range_sigma_mm[behind] = 8;
+#endif
+#ifndef VL53L5CX_DISABLE_DISTANCE_MM
+            results.distance_mm[behind] = (int16_t)config.secondTargetDistanceMm;
+#endif
+#ifndef VL53L5CX_DISABLE_REFLECTANCE_PERCENT
+            results.reflectance[behind] = 20;
+#endif
+#ifndef VL53L5CX_DISABLE_TARGET_STATUS
+            results.target_status[behind] = 5;
+#endif
+            (void)behind;
+        }
+        (void)e;
+    }
+}
+
+// Checker value of the first target of zone in firmware units, false if the
+// checker needs a valid target and the zone has none
+static bool checkerValue(const VL53L5CX_DetectionThresholds &checker, const VL53L5CX_ResultsData &results,
+    uint32_t zone, const std::vector<uint8_t> &validStatus, int64_t &value)
+{
+    uint32_t e = zone * VL53L5CX_NB_TARGET_PER_ZONE;
+    bool valid = false;
+#ifndef VL53L5CX_DISABLE_TARGET_STATUS
+    for (uint8_t status : validStatus)
+        valid = valid || ((status != 0) && (results.target_status[e] == status));
+#endif
+    (void)e; (void)validStatus;
+
+    switch (checker.measurement)
+    {
+#ifndef VL53L5CX_DISABLE_DISTANCE_MM
+    case VL53L5CX_DISTANCE_MM:
+        value = (int64_t)results.distance_mm[e] * 4;
+        return valid;
+#endif
+#ifndef VL53L5CX_DISABLE_SIGNAL_PER_SPAD
+    case VL53L5CX_SIGNAL_PER_SPAD_KCPS:
+        value = (int64_t)results.signal_per_spad[e] * 2048;
+        return valid;
+#endif
+#ifndef VL53L5CX_DISABLE_RANGE_SIGMA_MM
+    case VL53L5CX_RANGE_SIGMA_MM:
+        value = (int64_t)results.range_sigma_mm[e] * 128;
+        return valid;
+#endif
+#ifndef VL53L5CX_DISABLE_AMBIENT_PER_SPAD
+    case VL53L5CX_AMBIENT_PER_SPAD_KCPS:
+        value = (int64_t)results.ambient_per_spad[zone] * 2048;
+        return true;
+#endif
+#ifndef VL53L5CX_DISABLE_NB_TARGET_DETECTED
+    case VL53L5CX_NB_TARGET_DETECTED:
+        value = results.nb_target_detected[zone];
+        return true;
+#endif
+#ifndef VL53L5CX_DISABLE_TARGET_STATUS
+    case VL53L5CX_TARGET_STATUS:
+        value = results.target_status[e];
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+bool HID_VL53L5CX_SimSensor::thresholdsMet(const VL53L5CX_ResultsData &results)
+{
+    const uint32_t checkerSize = (uint32_t)sizeof(VL53L5CX_DetectionThresholds);
+    const std::vector<uint8_t> &checkers = dciValue(VL53L5CX_DCI_DET_THRESH_START, VL53L5CX_NB_THRESHOLDS * checkerSize);
+    const std::vector<uint8_t> &validStatus = dciValue(VL53L5CX_DCI_DET_THRESH_VALID_STATUS, 8);
+
+    // Checkers of a zone combine in order, the first one of a zone is always OR
+    bool met[VL53L5CX_RESOLUTION_8X8] = {};
+    bool seen[VL53L5CX_RESOLUTION_8X8] = {};
+    for (uint32_t i = 0; i < VL53L5CX_NB_THRESHOLDS; i++)
+    {
+        VL53L5CX_DetectionThresholds checker;
+        memcpy(&checker, &checkers[i * checkerSize], checkerSize);
+        uint32_t zone = checker.zone_num & (uint8_t)~VL53L5CX_LAST_THRESHOLD;
+        if (zone < VL53L5CX_RESOLUTION_8X8)
+        {
+            int64_t value = 0;
+            bool hit = checkerValue(checker, results, zone, validStatus, value);
+            int64_t low = checker.param_low_thresh, high = checker.param_high_thresh;
+            switch (checker.type)
+            {
+            case VL53L5CX_IN_WINDOW: hit = hit && (value >= low) && (value <= high); break;
+            case VL53L5CX_OUT_OF_WINDOW: hit = hit && ((value < low) || (value > high)); break;
+            case VL53L5CX_LESS_THAN_EQUAL_MIN_CHECKER: hit = hit && (value <= low); break;
+            case VL53L5CX_GREATER_THAN_MAX_CHECKER: hit = hit && (value > high); break;
+            case VL53L5CX_EQUAL_MIN_CHECKER: hit = hit && (value == low); break;
+            case VL53L5CX_NOT_EQUAL_MIN_CHECKER: hit = hit && (value != low); break;
+            default: hit = false; break;
+            }
+            if (seen[zone] && (checker.mathematic_operation == VL53L5CX_OPERATION_AND))
+                met[zone] = met[zone] && hit;
+            else
+                met[zone] = met[zone] || hit;
+            seen[zone] = true;
+        }
+        if (checker.zone_num & VL53L5CX_LAST_THRESHOLD)
+            break;
+    }
+
+    for (uint32_t zone = 0; zone < VL53L5CX_RESOLUTION_8X8; zone++)
+    {
+        if (met[zone])
+            return true;
+    }
+    return false;
+}
+
+bool HID_VL53L5CX_SimSensor::setInterrupt(bool enable)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    clock->advanceNs(config.usbRoundTripNs);
+    stats.transportBusyNs += config.usbRoundTripNs;
+    interruptArmed = enable;
+    interruptFrame = framesAvailable(clock->nowNs());
+    return true;
+}
+
+bool HID_VL53L5CX_SimSensor::interruptFired()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    clock->advanceNs(config.usbRoundTripNs);
+    stats.transportBusyNs += config.usbRoundTripNs;
+    stats.interruptPolls++;
+    if (!interruptArmed)
+        return false;
+
+    uint64_t frames = framesAvailable(clock->nowNs());
+    if (frames <= interruptFrame)
+        return false;
+    uint64_t first = std::max(interruptFrame + 1, (frames > SIM_INTERRUPT_FRAMES) ? frames - SIM_INTERRUPT_FRAMES : 1);
+    interruptFrame = frames;
+
+    // Without thresholds INT pulses once per frame
+    bool thresholds = dciValue(VL53L5CX_DCI_DET_THRESH_GLOBAL_CONFIG, 8)[1] == 1;
+    if (!thresholds)
+        return true;
+    VL53L5CX_ResultsData results;
+    for (uint64_t frame = first; frame <= frames; frame++)
+    {
+        sceneResults(frame, frameReadyTimeNs(frame), results);
+        sceneMotion(frame, results);
+        if (thresholdsMet(results))
+            return true;
+    }
+    return false;
+}
+
+void HID_VL53L5CX_SimSensor::encodeFrame(uint64_t frame, const std::vector<uint32_t> &blocks,
+    const VL53L5CX_ResultsData &results, uint8_t *wire, uint32_t size)
+{
+    // Header and footer ids must match or the ULD reports a corrupted frame
+    wire[0x8] = (uint8_t)(frame >> 8);
+    wire[0x9] = (uint8_t)frame;
+    wire[size - 4] = wire[0x8];
+    wire[size - 3] = wire[0x9];
+
+    // Data is laid out in host order (after SwapBuffer) and swapped at the end.
+    // Values are scaled back to the firmware fixed point formats.
+    uint32_t pos = 16;
+    for (uint32_t bh : blocks)
+    {
+        union Block_header header;
+        header.bytes = bh;
+        // Typed blocks hold 'size' elements of 'type' bytes, others 'size' raw bytes
+        bool typed = (header.type >= 0x1) && (header.type < 0xd);
+        uint32_t width = typed ? header.type : 1;
+        uint32_t count = typed ? header.size : 0;
+        uint32_t msize = width * header.size;
+        if (pos + 4 + msize > size - 8)
+            break;
+
+        memcpy(&wire[pos], &bh, 4);
+        uint8_t *data = &wire[pos + 4];
+
+        for (uint32_t e = 0; e < count; e++)
+        {
+            uint8_t *element = &data[e * width];
+            bool zone = e < VL53L5CX_RESOLUTION_8X8;
+            bool target = e < (uint32_t)(VL53L5CX_RESOLUTION_8X8 * VL53L5CX_NB_TARGET_PER_ZONE);
+
+            switch (header.idx)
+            {
+#ifndef VL53L5CX_DISABLE_AMBIENT_PER_SPAD
+            case VL53L5CX_AMBIENT_RATE_IDX:
+                if (zone) putValue(element, width, results.ambient_per_spad[e] * 2048);
+                break;
+#endif
+#ifndef VL53L5CX_DISABLE_NB_SPADS_ENABLED
+            case VL53L5CX_SPAD_COUNT_IDX:
+                if (zone) putValue(element, width, results.nb_spads_enabled[e]);
+                break;
+#endif
+#ifndef VL53L5CX_DISABLE_NB_TARGET_DETECTED
+            case VL53L5CX_NB_TARGET_DETECTED_IDX:
+                if (zone) putValue(element, width, results.nb_target_detected[e]);
+                break;
+#endif
+#ifndef VL53L5CX_DISABLE_SIGNAL_PER_SPAD
+            case VL53L5CX_SIGNAL_RATE_IDX:
+                if (target) putValue(element, width, results.signal_per_spad[e] * 2048);
+                break;
+#endif
+#ifndef VL53L5CX_DISABLE_RANGE_SIGMA_MM
+            case VL53L5CX_RANGE_SIGMA_MM_IDX:
+                if (target) putValue(element, width, (uint32_t)results.range_sigma_mm[e] * 128);
+                break;
+#endif
+#ifndef VL53L5CX_DISABLE_DISTANCE_MM
+            case VL53L5CX_DISTANCE_IDX:
+                if (target) putValue(element, width, (uint32_t)(results.distance_mm[e] * 4));
+                break;
+#endif
+#ifndef VL53L5CX_DISABLE_REFLECTANCE_PERCENT
+            case VL53L5CX_REFLECTANCE_EST_PC_IDX:
+                if (target) putValue(element, width, (uint32_t)results.reflectance[e] * 2);
+                break;
+#endif
+#ifndef VL53L5CX_DISABLE_TARGET_STATUS
+            case VL53L5CX_TARGET_STATUS_IDX:
+                if (target) putValue(element, width, results.target_status[e]);
+                break;
+#endif
+            default: break;
+            }
+            (void)zone; (void)target;
+        }
+
+        if (header.idx == VL53L5CX_METADATA_IDX && msize > 8)
+            data[8] = (uint8_t)results.silicon_temp_degc;
+#ifndef VL53L5CX_DISABLE_MOTION_INDICATOR
+        if ((header.idx == VL53L5CX_MOTION_DETEC_IDX) && (msize >= sizeof(results.motion_indicator)))
+        {
+            // Raw copy of the results, the ULD divides the scores by 65535
+            memcpy(data, &results.motion_indicator, sizeof(results.motion_indicator));
+            uint8_t *scores = data + ((const uint8_t *)results.motion_indicator.motion - (const uint8_t *)&results.motion_indicator);
+            for (uint32_t i = 0; i < 32; i++)
+                putValue(&scores[4 * i], 4, results.motion_indicator.motion[i] * 65535);
+        }
+#endif
+
+        pos += 4 + msize;
+    }
+
+    SwapBuffer(wire, (uint16_t)size);
+}
+
+HID_VL53L5CX_SimBusStats HID_VL53L5CX_SimSensor::busStats()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return stats;
+}
+
+uint64_t HID_VL53L5CX_SimSensor::lastFrameReadyTimeNs()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return lastFrameReadyNs;
+}
+
+uint64_t HID_VL53L5CX_SimSensor::frameReadCount()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return framesRead;
+}
+
+uint64_t HID_VL53L5CX_SimSensor::frameSkipCount()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return framesSkipped;
+}
+
+static void checkResult(bool ok, HID_VL53L5CX &sensor, const char *what)
+{
+    if (!ok)
+        throw std::runtime_error(std::string(what) + " fails: " + std::to_string(sensor.lastError.lastErrorValue));
+}
+
+HID_VL53L5CX_SimReport HID_VL53L5CX_SimHarness::run(const HID_VL53L5CX_SimScenario &scenario)
+{
+    HID_VL53L5CX_SimReport report;
+    uint64_t wallStart = HID_VL53L5CX_Clock::systemClock()->nowNs();
+
+    HID_VL53L5CX_VirtualClock clock;
+    HID_VL53L5CX_SimSensor sim(&clock, scenario.sensor);
+
+    uint64_t t = clock.nowNs();
+    HID_VL53L5CX sensor(&sim, &clock);
+    report.coldStartNs = clock.nowNs() - t;
+
+    t = clock.nowNs();
+    checkResult(sensor.setResolution(scenario.resolution), sensor, "setResolution");
+    checkResult(sensor.setRangingFrequency(scenario.frequencyHz), sensor, "setRangingFrequency");
+    checkResult(sensor.setRangingMode(scenario.autonomous ? SF_VL53L5CX_RANGING_MODE::AUTONOMOUS
+        : SF_VL53L5CX_RANGING_MODE::CONTINUOUS), sensor, "setRangingMode");
+    report.reconfigureNs = clock.nowNs() - t;
+
+    t = clock.nowNs();
+    checkResult(sensor.startRanging(), sensor, "startRanging");
+    report.startRangingNs = clock.nowNs() - t;
+
+    // Same loop as VL53L5CXSensor::getRange(): poll, read, sleep
+    VL53L5CX_ResultsData results;
+    HID_VL53L5CX_SimBusStats busStart = sim.busStats();
+    uint64_t streamStart = clock.nowNs();
+    uint64_t latencySum = 0;
+    while (report.framesDelivered < scenario.frames)
+    {
+        report.polls++;
+        if (sensor.isDataReady())
+        {
+            checkResult(sensor.getRangingData(&results), sensor, "getRangingData");
+
+            uint64_t latency = clock.nowNs() - sim.lastFrameReadyTimeNs();
+            if ((report.framesDelivered == 0) || (latency < report.latencyMinNs))
+                report.latencyMinNs = latency;
+            if (latency > report.latencyMaxNs)
+                report.latencyMaxNs = latency;
+            latencySum += latency;
+            report.framesDelivered++;
+        }
+
+        clock.sleepMs(scenario.pollIntervalMs);
+
+        if (report.polls > (uint64_t)scenario.frames * 1000ULL + 1000ULL)
+            throw std::runtime_error("simulated sensor stopped producing frames");
+    }
+    uint64_t streamNs = clock.nowNs() - streamStart;
+    HID_VL53L5CX_SimBusStats busEnd = sim.busStats();
+
+    t = clock.nowNs();
+    checkResult(sensor.stopRanging(), sensor, "stopRanging");
+    report.stopRangingNs = clock.nowNs() - t;
+
+    if (report.framesDelivered)
+        report.latencyAvgNs = latencySum / report.framesDelivered;
+    report.framesMissed = sim.frameSkipCount();
+
+    report.bus.transactions = busEnd.transactions - busStart.transactions;
+    report.bus.bytesWritten = busEnd.bytesWritten - busStart.bytesWritten;
+    report.bus.bytesRead = busEnd.bytesRead - busStart.bytesRead;
+    report.bus.i2cBusyNs = busEnd.i2cBusyNs - busStart.i2cBusyNs;
+    report.bus.transportBusyNs = busEnd.transportBusyNs - busStart.transportBusyNs;
+    if (streamNs)
+    {
+        report.busUtilisation = (double)report.bus.i2cBusyNs / (double)streamNs;
+        report.transportUtilisation = (double)report.bus.transportBusyNs / (double)streamNs;
+    }
+
+    report.virtualNs = clock.nowNs();
+    report.wallNs = HID_VL53L5CX_Clock::systemClock()->nowNs() - wallStart;
+    return report;
+}
@@ -0,0 +1,234 @@
+#pragma once
+/*
+  This file declares the simulated VL53L5CX sensor and the benchmark harness.
+
+  HID_VL53L5CX_SimSensor is a register level model of the sensor behind an
+  FT260 bridge. It answers the ULD boot, DCI and ranging sequences, charges
+  every bus transaction to a virtual clock (USB round trip plus I2C byte time)
+  and produces frames at the configured ranging frequency. Plugged into
+  HID_VL53L5CX through the transport seam it runs the unmodified driver stack
+  much faster than real time and with fully repeatable timing.
+
+  HID_VL53L5CX_SimHarness drives HID_VL53L5CX against the simulated sensor and
+  reports cold start, reconfiguration and frame latency figures.
+*/
+
+#ifndef __HID_VL53L5CX_Sim__
+#define __HID_VL53L5CX_Sim__
+
+#include <stdint.h>
+#include <map>
+#include <mutex>
+#include <vector>
+#include "HID_VL53L5CX_Transport.h"
+#include "HID_VL53L5CX_Clock.h"
+#include "vl53l5cx_api.h"
+
+struct HID_VL53L5CX_SimConfig
+{
+    // Fixed cost of one FT260 HID request/response (one I2C transaction).
+    uint64_t usbRoundTripNs = 1000000ULL;
+
+    // I2C clock of the FT260 master, 100 kHz is what HID_VL53L5CX_IO uses.
+    uint32_t i2cClockKHz = 100;
+
+    // Time the MCU needs to answer a UI command (DCI access, start, stop).
+    uint64_t commandLatencyNs = 200000ULL;
+
+    // True if the sensor already holds firmware (warm start, no download).
+    bool firmwareLoaded = false;
+
+    // Simulated scene: a flat target, optionally moving at a constant speed.
+    uint16_t targetDistanceMm = 800;
+    int32_t targetVelocityMmPerS = 0;
+
+    // A second target behind it in every zone (a person seen through a glass
+    // panel, someone queueing behind), 0 = none. Only with more than one
+    // target per zone (VL53L5CX_NB_TARGET_PER_ZONE).
+    uint16_t secondTargetDistanceMm = 0;
+    int8_t siliconTemperatureC = 30;
+};
+
+// Statistics of the simulated bus.
+struct HID_VL53L5CX_SimBusStats
+{
+    uint64_t transactions = 0;      // FT260 I2C transactions
+    uint64_t bytesWritten = 0;      // payload bytes host -> sensor
+    uint64_t bytesRead = 0;         // payload bytes sensor -> host
+    uint64_t i2cBusyNs = 0;         // time the I2C wires were busy
+    uint64_t transportBusyNs = 0;   // i2cBusyNs plus USB round trips
+    uint64_t interruptPolls = 0;    // INT latch requests, a USB round trip each (in transportBusyNs)
+};
+
+class HID_VL53L5CX_SimSensor : public HID_VL53L5CX_Transport
+{
+private:
+    std::mutex lock;
+
+    // Current register page (register 0x7fff).
+    uint8_t page = 0;
+
+    // Page 0 registers that change the reported state.
+    uint8_t powerState = 0x04;      // 0x09: 4 = wake up, 2 = sleep, 5 = ranging
+    uint8_t mcuStop = 0;            // 0x14: MCU stop requested
+
+    bool firmwareLoaded;
+
+    // DCI values in user (host) byte order, keyed by DCI index.
+    std::map<uint16_t, std::vector<uint8_t>> dci;
+
+    // Pending answer of a DCI read command.
+    std::vector<uint8_t> dciAnswer;
+
+    // UI command completion time, the status reads busy until then.
+    uint64_t commandDoneNs = 0;
+
+    // Ranging session
+    bool ranging = false;
+    uint64_t rangingStartNs = 0;
+    uint64_t framePeriodNs = 0;
+    uint32_t frameSize = 0;
+    std::vector<uint32_t> frameBlocks;
+
+    uint64_t lastFrameRead = 0;
+    uint64_t lastFrameReadyNs = 0;
+    uint64_t framesRead = 0;
+    uint64_t framesSkipped = 0;
+
+    std::vector<uint8_t> frameBuffer;
+
+    // INT line: armed by setInterrupt(), frames up to interruptFrame were looked at
+    bool interruptArmed = false;
+    uint64_t interruptFrame = 0;
+
+    // True if the detection thresholds programmed into the DCI catch results.
+    bool thresholdsMet(const VL53L5CX_ResultsData &results);
+
+    // Motion indicator results of frame 'frame' once the ULD programmed it: per
+    // aggregate of the DCI map the largest change of distance since the previous
+    // frame, in mm, of its zones with a target in the distance window.
+    void sceneMotion(uint64_t frame, VL53L5CX_ResultsData &results);
+
+    HID_VL53L5CX_SimBusStats stats;
+
+    // Bus hang: reads wait for their timeout and fail, writes fail.
+    bool wedged = false;
+    uint32_t timeoutMs = 0;         // see HID_VL53L5CX_Transport::setTimeoutMs()
+    uint8_t wedgedRead(uint16_t size);
+
+    // Charges one FT260 transaction of i2cBytes bytes on the wire to the clock.
+    void chargeTransaction(uint32_t i2cBytes);
+
+    // Registers of pages 0 and 1 (boot, power and MCU status).
+    uint8_t registerValue(uint16_t registerAddress);
+
+    void resetDci();
+    void handleCommand(uint16_t registerAddress, const uint8_t *buffer, uint16_t size);
+    void startSession();
+
+    static uint8_t streamCount(uint64_t frame);
+
+protected:
+    HID_VL53L5CX_VirtualClock *clock;
+    HID_VL53L5CX_SimConfig config;
+
+    // DCI value in host byte order, grown to at least size bytes.
+    std::vector<uint8_t>& dciValue(uint16_t index, uint16_t size);
+
+    bool isRanging() const { return ranging; }
+    uint64_t rangingStartTimeNs() const { return rangingStartNs; }
+
+    // Number of frames completed since ranging started. Called with the sensor lock held.
+    virtual uint64_t framesAvailable(uint64_t nowNs);
+
+    // Time frame number 'frame' (1 based) became ready, used for latency figures.
+    virtual uint64_t frameReadyTimeNs(uint64_t frame);
+
+    // Results (host units) of frame number 'frame' (1 based) of the synthetic scene.
+    virtual void sceneResults(uint64_t frame, uint64_t readyNs, VL53L5CX_ResultsData &results);
+
+    // Produces the wire image (as read from the bus, before SwapBuffer) of
+    // frame number 'frame' (1 based). blocks is the enabled output list.
+    // Byte 0 is overwritten with the stream count afterwards.
+    virtual void synthesizeFrame(uint64_t frame, uint64_t readyNs,
+        const std::vector<uint32_t> &blocks, uint8_t *wire, uint32_t size);
+
+    // Encodes results (host units, as returned by vl53l5cx_get_ranging_data())
+    // into the wire image of a frame with the given output blocks.
+    static void encodeFrame(uint64_t frame, const std::vector<uint32_t> &blocks,
+        const VL53L5CX_ResultsData &results, uint8_t *wire, uint32_t size);
+
+public:
+    HID_VL53L5CX_SimSensor(HID_VL53L5CX_VirtualClock *clock,
+        const HID_VL53L5CX_SimConfig &config = HID_VL53L5CX_SimConfig());
+
+    uint8_t getI2CStatus() override;
+    void setTimeoutMs(uint32_t timeoutMs) override;
+    uint8_t readSingleByte(uint16_t registerAddress, uint8_t &value) override;
+    uint8_t writeSingleByte(uint16_t registerAddress, uint8_t value) override;
+    uint8_t readMultipleBytes(uint16_t registerAddress, uint8_t* buffer, uint16_t bufferSize) override;
+    uint8_t writeMultipleBytes(uint16_t registerAddress, uint8_t* buffer, uint16_t bufferSize) override;
+
+    // INT fires for every frame, or with detection thresholds enabled only for
+    // the frames whose scene results meet them, like the firmware. Every
+    // interruptFired() is charged one USB round trip.
+    bool setInterrupt(bool enable) override;
+    bool interruptFired() override;
+
+    HID_VL53L5CX_SimBusStats busStats();
+
+    // Wedges the bus like a stuck FT260: every read waits for the full read timeout
+    // (HID_VL53L5CX_readTimeoutMs()) on the virtual clock and fails, writes fail.
+    void setWedged(bool wedged);
+
+    // Ready time of the last frame returned to the host, 0 if none yet.
+    uint64_t lastFrameReadyTimeNs();
+
+    // Frames read by the host and frames produced but never read.
+    uint64_t frameReadCount();
+    uint64_t frameSkipCount();
+};
+
+// Workload and driver behaviour for one harness run.
+struct HID_VL53L5CX_SimScenario
+{
+    HID_VL53L5CX_SimConfig sensor;
+
+    uint8_t resolution = 16;            // 16 (4x4) or 64 (8x8)
+    uint8_t frequencyHz = 15;
+    bool autonomous = false;            // ranging mode
+    uint32_t pollIntervalMs = 10;       // sleep between isDataReady() polls
+    uint32_t frames = 100;              // frames to collect
+};
+
+struct HID_VL53L5CX_SimReport
+{
+    uint64_t coldStartNs = 0;           // constructor: probe and firmware download
+    uint64_t reconfigureNs = 0;         // resolution, frequency and mode
+    uint64_t startRangingNs = 0;
+    uint64_t stopRangingNs = 0;
+
+    uint64_t framesDelivered = 0;
+    uint64_t framesMissed = 0;
+    uint64_t polls = 0;
+    uint64_t latencyMinNs = 0;          // frame ready on sensor -> getRangingData() returned
+    uint64_t latencyAvgNs = 0;
+    uint64_t latencyMaxNs = 0;
+
+    HID_VL53L5CX_SimBusStats bus;
+    double busUtilisation = 0;          // i2cBusyNs / streaming time
+    double transportUtilisation = 0;    // transportBusyNs / streaming time
+
+    uint64_t virtualNs = 0;             // simulated time for the whole run
+    uint64_t wallNs = 0;                // real time the run took
+};
+
+class HID_VL53L5CX_SimHarness
+{
+public:
+    // Runs the scenario end to end on a fresh virtual clock and sensor.
+    // throws an exception if the driver reports an error
+    static HID_VL53L5CX_SimReport run(const HID_VL53L5CX_SimScenario &scenario);
+};
+
+#endif // __HID_VL53L5CX_Sim__
@@ -0,0 +1,214 @@
+/*
+  This file implements the frame stream.
+*/
+
+#include "pch.h" // use stdafx.h in Visual Studio 2017 and earlier
+#include "HID_VL53L5CX_Stream.h"
+#include "HID_VL53L5CX_Log.h"
+#include <string.h>
+#include <chrono>
+
+HID_VL53L5CX_Stream::HID_VL53L5CX_Stream(HID_VL53L5CX *_sensor, uint32_t capacity, uint32_t _pollMs,
+    HID_VL53L5CX_ReplaySensor *_replay, const HID_VL53L5CX_Stages &_stages,
+    VL53L5CX_FrameCallback _callback, void *userData, uint32_t everyFrames)
+    : sensor(_sensor), replay(_replay), stages(_stages), pollMs(_pollMs), frames((capacity > 0) ? capacity : 1), queueing(capacity > 0),
+      running(true), queued(0), overwritten(0), readErrors(0)
+{
+    // Before the thread starts, so no frame misses the callback
+    setCallback(_callback, userData, everyFrames);
+    acquisition = std::thread(&HID_VL53L5CX_Stream::acquisitionLoop, this);
+    HID_VL53L5CX_LOG(INFO, "Streaming started, %u frames queued at most", queueing ? (uint32_t)frames.size() : 0);
+}
+
+HID_VL53L5CX_Stream::~HID_VL53L5CX_Stream()
+{
+    running.store(false, std::memory_order_relaxed);
+    acquisition.join();
+    HID_VL53L5CX_LOG(INFO, "Streaming stopped, %llu frames queued, %llu overwritten, %llu read errors",
+        (unsigned long long)queuedCount(), (unsigned long long)overwrittenCount(), (unsigned long long)readErrorCount());
+}
+
+int32_t HID_VL53L5CX_Stream::readFrame(HID_VL53L5CX *sensor, VL53L5CX_Frame *frame, const HID_VL53L5CX_Stages *stages)
+{
+    if ((stages != nullptr) && (stages->idle != nullptr) && !stages->idle->awake(sensor))
+        return VL53L5CX_FRAME_NOT_READY;
+    if ((stages != nullptr) && (stages->governor != nullptr) && !stages->governor->awake(sensor))
+        return VL53L5CX_FRAME_NOT_READY;
+    if (!sensor->isDataReady())
+        return (sensor->lastError.lastErrorCode == SF_VL53L5CX_ERROR_TYPE::VL53_NO_ERROR) ? VL53L5CX_FRAME_NOT_READY : VL53L5CX_FRAME_ERROR;
+
+    VL53L5CX_ResultsData Results;
+    if (!sensor->getRangingData(&Results))
+        return VL53L5CX_FRAME_ERROR;
+
+    uint8_t zones = sensor->getZoneCount();
+    if (zones > VL53L5CX_FRAME_MAX_ZONES)
+        zones = VL53L5CX_FRAME_MAX_ZONES;
+
+    frame->timestamp_ns = sensor->clock->nowNs();
+    frame->stream_count = sensor->Dev->streamcount;
+    frame->resolution = zones;
+    frame->silicon_temp_degc = Results.silicon_temp_degc;
+    for (uint8_t i = 0; i < zones; i++)
+    {
+        frame->distance_mm[i] = Results.distance_mm[VL53L5CX_NB_TARGET_PER_ZONE * i];
+        frame->range_sigma_mm[i] = Results.range_sigma_mm[VL53L5CX_NB_TARGET_PER_ZONE * i];
+        frame->signal_per_spad[i] = Results.signal_per_spad[VL53L5CX_NB_TARGET_PER_ZONE * i];
+        frame->target_status[i] = Results.target_status[VL53L5CX_NB_TARGET_PER_ZONE * i];
+    }
+
+    if (stages == nullptr)
+        return VL53L5CX_FRAME_READY;
+    if (stages->filter != nullptr)
+        stages->filter->apply(*frame);
+    if (stages->presence != nullptr)
+        stages->presence->update(*frame);
+    if (stages->tracker != nullptr)
+        stages->tracker->update(Results, zones, frame->timestamp_ns);
+    uint64_t foreground = 0;
+    if (stages->background != nullptr)
+        foreground = stages->background->update(*frame);
+    if (stages->counter != nullptr)
+        stages->counter->update(*frame, foreground);
+    if (stages->motion != nullptr)
+        stages->motion->update(Results, frame->timestamp_ns);
+    if (stages->idle != nullptr)
+        stages->idle->update(sensor, *frame, stages->presence);
+    if (stages->governor != nullptr)
+        stages->governor->update(sensor, *frame, stages->presence);
+    return VL53L5CX_FRAME_READY;
+}
+
+void HID_VL53L5CX_Stream::acquisitionLoop()
+{
+    VL53L5CX_Frame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.version = VL53L5CX_FRAME_VERSION;
+    frame.size = sizeof(VL53L5CX_Frame);
+
+    while (running.load(std::memory_order_relaxed))
+    {
+        // Failed reads are counted here and by the sensor (driverErrors), nothing on this path throws or allocates
+        int32_t result = readFrame(sensor, &frame, &stages);
+        if (result == VL53L5CX_FRAME_READY)
+        {
+            push(frame);
+            notify(frame);
+            continue;
+        }
+        if (result == VL53L5CX_FRAME_ERROR)
+            readErrors.fetch_add(1, std::memory_order_relaxed);
+
+        if ((replay != nullptr) && replay->exhausted())
+            std::this_thread::sleep_for(std::chrono::milliseconds(pollMs));
+        else
+            sensor->clock->sleepMs(pollMs);
+    }
+}
+
+void HID_VL53L5CX_Stream::push(const VL53L5CX_Frame &frame)
+{
+    uint32_t capacity = (uint32_t)frames.size();
+    bool overflow = false;
+    bool report = false;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        newest = frame;
+        haveNewest = true;
+        if (!queueing)
+            return;
+        if (count == capacity)
+        {
+            head = (head + 1) % capacity;
+            count--;
+            overflow = true;
+
+            // Once per overflow, read() arms it again
+            report = !overflowReported;
+            overflowReported = true;
+        }
+        frames[(head + count) % capacity] = frame;
+        count++;
+    }
+    ready.notify_one();
+
+    queued.fetch_add(1, std::memory_order_relaxed);
+    if (overflow)
+        overwritten.fetch_add(1, std::memory_order_relaxed);
+    if (report)
+        HID_VL53L5CX_LOG(WARNING, "Streaming: frame queue full, the oldest frames are overwritten");
+}
+
+void HID_VL53L5CX_Stream::setCallback(VL53L5CX_FrameCallback _callback, void *userData, uint32_t everyFrames)
+{
+    // The callback itself already holds the lock
+    std::unique_lock<std::mutex> guard(callbackLock, std::defer_lock);
+    if (!onAcquisitionThread())
+        guard.lock();
+
+    callback = _callback;
+    callbackData = userData;
+    callbackEvery = (everyFrames > 0) ? everyFrames : 1;
+    callbackSkipped = 0;
+    slowCallbackReported = false;
+}
+
+void HID_VL53L5CX_Stream::notify(const VL53L5CX_Frame &frame)
+{
+    std::lock_guard<std::mutex> guard(callbackLock);
+    uint64_t sinceLastNs = frame.timestamp_ns - lastFrameNs;
+    bool first = (lastFrameNs == 0);
+    lastFrameNs = frame.timestamp_ns;
+
+    if ((callback == nullptr) || (++callbackSkipped < callbackEvery))
+        return;
+    callbackSkipped = 0;
+
+    // Client time is real time, also when the sensor runs on a virtual clock
+    HID_VL53L5CX_Clock *wallClock = HID_VL53L5CX_Clock::systemClock();
+    uint64_t startNs = wallClock->nowNs();
+    callback(&frame, callbackData);
+    uint64_t durationNs = wallClock->nowNs() - startNs;
+    sensor->countFrameCallback(durationNs);
+
+    if (!first && !slowCallbackReported && (durationNs > sinceLastNs))
+    {
+        slowCallbackReported = true;
+        HID_VL53L5CX_LOG(WARNING, "Streaming: frame callback took %llu us, longer than the %llu us between frames",
+            (unsigned long long)(durationNs / 1000), (unsigned long long)(sinceLastNs / 1000));
+    }
+}
+
+bool HID_VL53L5CX_Stream::latest(VL53L5CX_Frame &out)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (!haveNewest)
+        return false;
+    out = newest;
+    return true;
+}
+
+uint32_t HID_VL53L5CX_Stream::read(VL53L5CX_Frame *out, uint32_t capacity, uint32_t timeoutMs)
+{
+    std::unique_lock<std::mutex> guard(lock);
+    if ((count == 0) && (timeoutMs > 0))
+    {
+        ready.wait_for(guard, std::chrono::milliseconds(timeoutMs),
+            [this]() { return count > 0; });
+    }
+
+    uint32_t size = (uint32_t)frames.size();
+    uint32_t n = (count < capacity) ? count : capacity;
+    if (n == 0)
+        return 0;
+
+    // At most two copies, the queued frames may wrap around the end of the ring
+    uint32_t first = (n < size - head) ? n : (size - head);
+    memcpy(out, &frames[head], first * sizeof(VL53L5CX_Frame));
+    memcpy(out + first, &frames[0], (n - first) * sizeof(VL53L5CX_Frame));
+
+    head = (head + n) % size;
+    count -= n;
+    overflowReported = false;
+    return n;
+}
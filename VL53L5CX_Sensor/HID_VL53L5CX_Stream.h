@@ -0,0 +1,153 @@
+#pragma once
+/*
+  This file declares the frame stream.
+
+  A stream owns an acquisition thread that polls one HID_VL53L5CX and copies
+  every frame into a ring of VL53L5CX_Frame (see VL53L5CXSensor.h). Consumers
+  drain the ring in batches with read(), so a client that wakes up every few
+  hundred milliseconds gets everything that arrived meanwhile in one call
+  instead of one call per frame.
+
+  The ring keeps the newest frames: when a consumer falls behind the oldest
+  frames are overwritten and counted. While a stream runs it is the only
+  caller of the sensor, nothing else may call into the HID_VL53L5CX.
+
+  A frame callback is called by the acquisition thread as soon as a frame
+  is read, so a client needs no polling at all. The time spent in the
+  callback is measured (frameCallbackUs in the metrics), a callback that is
+  slower than the frame period delays the next frame and is reported once.
+  The callback cannot delete the stream, it can only requestStop() it.
+*/
+
+#ifndef __HID_VL53L5CX_Stream__
+#define __HID_VL53L5CX_Stream__
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "HID_VL53L5CX.h"
+#include "HID_VL53L5CX_Background.h"
+#include "HID_VL53L5CX_PeopleCounter.h"
+#include "HID_VL53L5CX_Filter.h"
+#include "HID_VL53L5CX_Governor.h"
+#include "HID_VL53L5CX_Idle.h"
+#include "HID_VL53L5CX_Motion.h"
+#include "HID_VL53L5CX_Presence.h"
+#include "HID_VL53L5CX_Replay.h"
+#include "HID_VL53L5CX_Tracker.h"
+#include "VL53L5CXSensor.h"
+
+// What readFrame() runs on every frame it reads, in this order. Any may be
+// nullptr, they belong to the caller.
+struct HID_VL53L5CX_Stages
+{
+    HID_VL53L5CX_Filter *filter = nullptr;          // zone distances of the frame
+    HID_VL53L5CX_Presence *presence = nullptr;      // after the filter
+    HID_VL53L5CX_Tracker *tracker = nullptr;        // every target of the ULD result
+    HID_VL53L5CX_Background *background = nullptr;  // after the filter
+    HID_VL53L5CX_PeopleCounter *counter = nullptr;  // on the foreground of background
+    HID_VL53L5CX_Motion *motion = nullptr;          // firmware motion scores of the ULD result
+    HID_VL53L5CX_Idle *idle = nullptr;              // frames are only read while it is awake
+    HID_VL53L5CX_Governor *governor = nullptr;      // likewise, changes the tier of the sensor last
+};
+
+class HID_VL53L5CX_Stream
+{
+private:
+    HID_VL53L5CX *sensor;
+    HID_VL53L5CX_ReplaySensor *replay;
+    HID_VL53L5CX_Stages stages;         // only used by the acquisition thread
+    uint32_t pollMs;
+
+    // Ring of frames, head is the oldest
+    std::vector<VL53L5CX_Frame> frames;
+    bool queueing;                      // false: callback only
+    uint32_t head = 0;
+    uint32_t count = 0;
+    VL53L5CX_Frame newest;              // last frame read, also without queue
+    bool haveNewest = false;
+    std::mutex lock;
+    std::condition_variable ready;
+
+    std::thread acquisition;
+    std::atomic<bool> running;
+
+    // Frame callback, only called while holding callbackLock
+    std::mutex callbackLock;
+    VL53L5CX_FrameCallback callback = nullptr;
+    void *callbackData = nullptr;
+    uint32_t callbackEvery = 1;
+    uint32_t callbackSkipped = 0;
+    uint64_t lastFrameNs = 0;
+    bool slowCallbackReported = false;
+
+    std::atomic<uint64_t> queued;
+    std::atomic<uint64_t> overwritten;
+    std::atomic<uint64_t> readErrors;
+    bool overflowReported = false;     // guarded by lock
+
+    void acquisitionLoop();
+    void push(const VL53L5CX_Frame &frame);
+    void notify(const VL53L5CX_Frame &frame);
+
+public:
+    // Starts polling the sensor every pollMs on its clock. The sensor must be
+    // ranging already. With a capacity of 0 nothing is queued, frames only go
+    // to the frame callback. A replayed recording that is over is polled on the
+    // system clock so an accelerated replay does not spin. Frames go through
+    // stages before they are queued, nothing else may update those while the
+    // stream runs. callback gets every frame from the first one on, see
+    // setCallback().
+    HID_VL53L5CX_Stream(HID_VL53L5CX *sensor, uint32_t capacity, uint32_t pollMs,
+        HID_VL53L5CX_ReplaySensor *replay = nullptr, const HID_VL53L5CX_Stages &stages = HID_VL53L5CX_Stages(),
+        VL53L5CX_FrameCallback callback = nullptr, void *userData = nullptr, uint32_t everyFrames = 1);
+
+    // Stops and joins the acquisition thread, frames still queued are lost.
+    // No read() may be in progress.
+    ~HID_VL53L5CX_Stream();
+
+    // Moves up to capacity of the oldest queued frames to out, waiting at most
+    // timeoutMs for the first one. Returns the number of frames moved.
+    uint32_t read(VL53L5CX_Frame *out, uint32_t capacity, uint32_t timeoutMs);
+
+    // Copies the last frame read to out without taking it from the queue.
+    // False if no frame was read yet.
+    bool latest(VL53L5CX_Frame &out);
+
+    // Calls callback(frame, userData) on the acquisition thread for every
+    // everyFrames-th frame, the frame is only valid during the call. nullptr
+    // removes it. When this returns the previous callback is not running
+    // anymore (unless this is called from the callback itself).
+    void setCallback(VL53L5CX_FrameCallback callback, void *userData, uint32_t everyFrames = 1);
+
+    // False if frames only go to the callback.
+    bool queues() const { return queueing; }
+
+    // True on the acquisition thread, that is from the frame callback.
+    bool onAcquisitionThread() const { return std::this_thread::get_id() == acquisition.get_id(); }
+
+    // Ends the acquisition after the frame being handled without waiting for it, so
+    // the frame callback can stop the stream. The destructor still joins the thread
+    // and must run on another one.
+    void requestStop() { running.store(false, std::memory_order_relaxed); }
+
+    // Frames queued since the start, overwritten before they were read and
+    // frames that could not be read from the sensor.
+    uint64_t queuedCount() { return queued.load(std::memory_order_relaxed); }
+    uint64_t overwrittenCount() { return overwritten.load(std::memory_order_relaxed); }
+    uint64_t readErrorCount() { return readErrors.load(std::memory_order_relaxed); }
+
+    // Reads one frame from the sensor into frame if it has one, without waiting.
+    // Returns a getFrame() result (VL53L5CX_FRAME_READY, ..._NOT_READY, ..._ERROR).
+    // A frame read goes through stages unless that is nullptr. While the idle stage
+    // or the governor sleeps nothing is read, the frame is NOT_READY.
+    static int32_t readFrame(HID_VL53L5CX *sensor, VL53L5CX_Frame *frame, const HID_VL53L5CX_Stages *stages = nullptr);
+
+    HID_VL53L5CX_Stream(const HID_VL53L5CX_Stream&) = delete;
+    HID_VL53L5CX_Stream& operator=(const HID_VL53L5CX_Stream&) = delete;
+};
+
+#endif // __HID_VL53L5CX_Stream__
@@ -0,0 +1,194 @@
+/*
+  This file implements the bus and driver tracer.
+*/
+
+#include "pch.h" // use stdafx.h in Visual Studio 2017 and earlier
+#include "HID_VL53L5CX_Trace.h"
+#include <stdio.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+struct TraceBuffer
+{
+    uint32_t threadId;
+    uint32_t capacity;
+    std::unique_ptr<HID_VL53L5CX_TraceEvent[]> events;
+    std::atomic<uint32_t> count;    // written by the owning thread only
+    std::atomic<uint64_t> dropped;
+};
+
+// Buffers outlive their threads so a trace can be saved after the threads exit
+std::mutex registryLock;
+std::vector<TraceBuffer*> registry;
+
+std::atomic<HID_VL53L5CX_Clock*> traceClock(nullptr);
+std::atomic<uint32_t> bufferEvents(65536);
+uint64_t traceStartNs = 0;
+
+thread_local TraceBuffer *threadBuffer = nullptr;
+
+TraceBuffer *registerThread()
+{
+    TraceBuffer *buffer = new TraceBuffer();
+    buffer->capacity = bufferEvents.load(std::memory_order_relaxed);
+    buffer->events.reset(new HID_VL53L5CX_TraceEvent[buffer->capacity]);
+    buffer->count.store(0, std::memory_order_relaxed);
+    buffer->dropped.store(0, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> guard(registryLock);
+    buffer->threadId = (uint32_t)registry.size() + 1;
+    registry.push_back(buffer);
+    threadBuffer = buffer;
+    return buffer;
+}
+
+} // namespace
+
+std::atomic<bool> HID_VL53L5CX_Trace::active(false);
+
+void HID_VL53L5CX_Trace::start(HID_VL53L5CX_Clock *clock, uint32_t eventsPerThread)
+{
+    active.store(false, std::memory_order_relaxed);
+
+    traceClock.store((clock != nullptr) ? clock : HID_VL53L5CX_Clock::systemClock(), std::memory_order_relaxed);
+    bufferEvents.store((eventsPerThread != 0) ? eventsPerThread : 1, std::memory_order_relaxed);
+
+    {
+        std::lock_guard<std::mutex> guard(registryLock);
+        for (TraceBuffer *buffer : registry)
+        {
+            buffer->count.store(0, std::memory_order_relaxed);
+            buffer->dropped.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    traceStartNs = now();
+    active.store(true, std::memory_order_release);
+}
+
+void HID_VL53L5CX_Trace::stop()
+{
+    active.store(false, std::memory_order_release);
+}
+
+uint64_t HID_VL53L5CX_Trace::now()
+{
+    HID_VL53L5CX_Clock *clock = traceClock.load(std::memory_order_relaxed);
+    if (clock == nullptr)
+        clock = HID_VL53L5CX_Clock::systemClock();
+    return clock->nowNs();
+}
+
+void HID_VL53L5CX_Trace::record(HID_VL53L5CX_TRACE_TYPE type, const char *name, uint16_t registerAddress,
+    uint32_t length, uint8_t status, uint64_t startNs, const char *argName, uint32_t argValue)
+{
+    TraceBuffer *buffer = threadBuffer;
+    if (buffer == nullptr)
+        buffer = registerThread();
+
+    uint32_t n = buffer->count.load(std::memory_order_relaxed);
+    if (n >= buffer->capacity)
+    {
+        buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    HID_VL53L5CX_TraceEvent &event = buffer->events[n];
+    event.endNs = now();
+    event.startNs = ((type == HID_VL53L5CX_TRACE_TYPE::READ) || (type == HID_VL53L5CX_TRACE_TYPE::WRITE))
+        ? startNs : event.endNs;
+    event.name = name;
+    event.argName = argName;
+    event.argValue = argValue;
+    event.length = length;
+    event.registerAddress = registerAddress;
+    event.type = type;
+    event.status = status;
+
+    // Publishes the event to writeChromeTrace()
+    buffer->count.store(n + 1, std::memory_order_release);
+}
+
+uint64_t HID_VL53L5CX_Trace::eventCount()
+{
+    std::lock_guard<std::mutex> guard(registryLock);
+    uint64_t total = 0;
+    for (TraceBuffer *buffer : registry)
+        total += buffer->count.load(std::memory_order_acquire);
+    return total;
+}
+
+uint64_t HID_VL53L5CX_Trace::droppedCount()
+{
+    std::lock_guard<std::mutex> guard(registryLock);
+    uint64_t total = 0;
+    for (TraceBuffer *buffer : registry)
+        total += buffer->dropped.load(std::memory_order_relaxed);
+    return total;
+}
+
+// Trace timestamps are microseconds, keep nanosecond precision
+static double toUs(uint64_t ns, uint64_t baseNs)
+{
+    return (ns >= baseNs) ? (double)(ns - baseNs) / 1000.0 : 0.0;
+}
+
+bool HID_VL53L5CX_Trace::writeChromeTrace(const char *path)
+{
+    FILE *file = nullptr;
+#ifdef _MSC_VER
+    if (fopen_s(&file, path, "w") != 0)
+        file = nullptr;
+#else
+    file = fopen(path, "w");
+#endif
+    if (file == nullptr)
+        return false;
+
+    std::lock_guard<std::mutex> guard(registryLock);
+    const char *separator = "";
+
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (TraceBuffer *buffer : registry)
+    {
+        uint32_t count = buffer->count.load(std::memory_order_acquire);
+        if (count == 0)
+            continue;
+
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}",
+            separator, buffer->threadId, buffer->threadId);
+        separator = ",\n";
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            const HID_VL53L5CX_TraceEvent &event = buffer->events[i];
+            switch (event.type)
+            {
+            case HID_VL53L5CX_TRACE_TYPE::READ:
+            case HID_VL53L5CX_TRACE_TYPE::WRITE:
+                fprintf(file, "%s{\"name\":\"%s\",\"cat\":\"i2c\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                    "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"reg\":\"0x%04x\",\"len\":%u,\"status\":%u}}",
+                    separator, event.name, buffer->threadId, toUs(event.startNs, traceStartNs),
+                    toUs(event.endNs, event.startNs), event.registerAddress, event.length, event.status);
+                break;
+            case HID_VL53L5CX_TRACE_TYPE::BEGIN:
+            case HID_VL53L5CX_TRACE_TYPE::END:
+                fprintf(file, "%s{\"name\":\"%s\",\"cat\":\"uld\",\"ph\":\"%s\",\"pid\":1,\"tid\":%u,\"ts\":%.3f",
+                    separator, event.name, (event.type == HID_VL53L5CX_TRACE_TYPE::BEGIN) ? "B" : "E",
+                    buffer->threadId, toUs(event.startNs, traceStartNs));
+                if (event.argName != nullptr)
+                    fprintf(file, ",\"args\":{\"%s\":%u}", event.argName, event.argValue);
+                fprintf(file, "}");
+                break;
+            }
+        }
+    }
+    fprintf(file, "\n]}\n");
+
+    bool ok = (ferror(file) == 0);
+    fclose(file);
+    return ok;
+}
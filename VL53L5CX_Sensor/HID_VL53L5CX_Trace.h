@@ -0,0 +1,141 @@
+#pragma once
+/*
+  This file declares the bus and driver tracer.
+
+  When started, every RdByte/WrByte/RdMulti/WrMulti issued by the ULD is
+  recorded with register, length, transport status and start/end time, and
+  the ULD marks its phases (vl53l5cx_init stages, DCI commands, polling
+  loops) as spans. writeChromeTrace() saves everything in the Chrome trace
+  event format, open it in chrome://tracing or https://ui.perfetto.dev.
+
+  Each thread writes into its own preallocated buffer, recording an event
+  takes no lock and never allocates. A full buffer drops further events.
+  When the tracer is stopped every hook costs one relaxed atomic load and a
+  branch that is always predicted.
+
+  Timestamps come from the clock given to start(), so a trace of a simulated
+  sensor shows the virtual time line.
+*/
+
+#ifndef __HID_VL53L5CX_Trace__
+#define __HID_VL53L5CX_Trace__
+
+#include <stdint.h>
+#include <atomic>
+#include "HID_VL53L5CX_Clock.h"
+
+enum class HID_VL53L5CX_TRACE_TYPE : uint8_t
+{
+    READ,           // I2C read transaction
+    WRITE,          // I2C write transaction
+    BEGIN,          // span start
+    END             // span end
+};
+
+struct HID_VL53L5CX_TraceEvent
+{
+    uint64_t startNs;
+    uint64_t endNs;
+    const char *name;               // static string
+    const char *argName;            // optional argument, static string or nullptr
+    uint32_t argValue;
+    uint32_t length;                // bytes transferred
+    uint16_t registerAddress;
+    HID_VL53L5CX_TRACE_TYPE type;
+    uint8_t status;                 // transport status (0 = OK)
+};
+
+class HID_VL53L5CX_Trace
+{
+private:
+    static std::atomic<bool> active;
+
+    static void record(HID_VL53L5CX_TRACE_TYPE type, const char *name, uint16_t registerAddress,
+        uint32_t length, uint8_t status, uint64_t startNs, const char *argName, uint32_t argValue);
+
+public:
+    // Clears previous events and starts tracing. If no clock is given the
+    // system clock is used. eventsPerThread sizes the buffer of threads that
+    // trace for the first time.
+    // Must not be called while other threads are tracing.
+    static void start(HID_VL53L5CX_Clock *clock = nullptr, uint32_t eventsPerThread = 65536);
+
+    // Stops recording, events are kept until the next start().
+    static void stop();
+
+    static bool enabled() { return active.load(std::memory_order_relaxed); }
+
+    static uint64_t now();
+
+    // I2C transaction that started at startNs and ends now.
+    static void transaction(HID_VL53L5CX_TRACE_TYPE type, const char *name, uint16_t registerAddress,
+        uint32_t length, uint8_t status, uint64_t startNs)
+    {
+        record(type, name, registerAddress, length, status, startNs, nullptr, 0);
+    }
+
+    static void begin(const char *name, const char *argName = nullptr, uint32_t argValue = 0)
+    {
+        record(HID_VL53L5CX_TRACE_TYPE::BEGIN, name, 0, 0, 0, 0, argName, argValue);
+    }
+
+    static void end(const char *name, const char *argName = nullptr, uint32_t argValue = 0)
+    {
+        record(HID_VL53L5CX_TRACE_TYPE::END, name, 0, 0, 0, 0, argName, argValue);
+    }
+
+    // Events recorded and dropped (buffer full) since start().
+    static uint64_t eventCount();
+    static uint64_t droppedCount();
+
+    // Writes all recorded events as Chrome trace JSON. Returns false if the file cannot be written.
+    static bool writeChromeTrace(const char *path);
+};
+
+// Span covering the enclosing scope. next() closes the current span and opens
+// another one, for functions made of consecutive stages.
+class HID_VL53L5CX_TraceSpan
+{
+private:
+    const char *name;
+    const char *argName = nullptr;
+    uint32_t argValue = 0;
+
+public:
+    HID_VL53L5CX_TraceSpan(const char *_name, const char *_argName = nullptr, uint32_t _argValue = 0)
+        : name(_name)
+    {
+        if (HID_VL53L5CX_Trace::enabled())
+            HID_VL53L5CX_Trace::begin(name, _argName, _argValue);
+        else
+            name = nullptr;
+    }
+
+    ~HID_VL53L5CX_TraceSpan()
+    {
+        if (name != nullptr)
+            HID_VL53L5CX_Trace::end(name, argName, argValue);
+    }
+
+    // Value reported when the span ends (e.g. number of polls).
+    void setArg(const char *_argName, uint32_t _argValue)
+    {
+        argName = _argName;
+        argValue = _argValue;
+    }
+
+    void next(const char *_name)
+    {
+        if (name != nullptr)
+            HID_VL53L5CX_Trace::end(name, argName, argValue);
+        argName = nullptr;
+        name = HID_VL53L5CX_Trace::enabled() ? _name : nullptr;
+        if (name != nullptr)
+            HID_VL53L5CX_Trace::begin(name);
+    }
+
+    HID_VL53L5CX_TraceSpan(const HID_VL53L5CX_TraceSpan&) = delete;
+    HID_VL53L5CX_TraceSpan& operator=(const HID_VL53L5CX_TraceSpan&) = delete;
+};
+
+#endif // __HID_VL53L5CX_Trace__
@@ -0,0 +1,309 @@
+/*
+  This file implements the target tracker.
+*/
+
+#include "pch.h" // use stdafx.h in Visual Studio 2017 and earlier
+#include "HID_VL53L5CX_Tracker.h"
+#include "HID_VL53L5CX_Roi.h"
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Detection not taken by a track, and taken by a track started this frame
+const uint8_t NO_TRACK = 0xFF;
+const uint8_t NEW_TRACK = 0xFE;
+
+// Alpha-beta gains of distance and range rate
+const double TRACKER_ALPHA = 0.5;
+const double TRACKER_BETA = 0.2;
+
+// Longest gap between frames a track is predicted over
+const double TRACKER_MAX_DT = 1.0;
+
+HID_VL53L5CX_Tracker::HID_VL53L5CX_Tracker(const VL53L5CX_TrackerConfig &_config)
+    : config(_config), dropped(0)
+{
+    gate = (config.gate_mm != 0) ? config.gate_mm : 300;
+    minZones = (config.min_zones != 0) ? config.min_zones : 1;
+    confirmFrames = (config.confirm_frames != 0) ? config.confirm_frames : 2;
+    maxMisses = (config.max_misses != 0) ? config.max_misses : 5;
+    memset(state, 0, sizeof(state));
+    memset(published, 0, sizeof(published));
+}
+
+VL53L5CX_TrackerConfig HID_VL53L5CX_Tracker::defaults()
+{
+    VL53L5CX_TrackerConfig config;
+    memset(&config, 0, sizeof(config));
+    config.roi = HID_VL53L5CX_Roi::defaults();
+    config.roi.status_mask = (1u << 5) | (1u << 9);
+    config.roi.max_distance_mm = 4000;
+    config.gate_mm = 300;
+    config.min_zones = 1;
+    config.confirm_frames = 2;
+    config.max_misses = 5;
+    return config;
+}
+
+bool HID_VL53L5CX_Tracker::check(const VL53L5CX_TrackerConfig &config)
+{
+    return config.roi.min_distance_mm < config.roi.max_distance_mm;
+}
+
+void HID_VL53L5CX_Tracker::fromResults(const VL53L5CX_ResultsData &results, uint8_t resolution, uint64_t timestampNs,
+    HID_VL53L5CX_Targets &targets)
+{
+    targets.timestampNs = timestampNs;
+    targets.resolution = std::min(resolution, (uint8_t)VL53L5CX_FRAME_MAX_ZONES);
+    for (uint32_t zone = 0; zone < targets.resolution; zone++)
+    {
+#ifndef VL53L5CX_DISABLE_NB_TARGET_DETECTED
+        uint32_t count = std::min((uint32_t)results.nb_target_detected[zone], (uint32_t)VL53L5CX_NB_TARGET_PER_ZONE);
+#else
+        uint32_t count = VL53L5CX_NB_TARGET_PER_ZONE;
+#endif
+        count = std::min(count, (uint32_t)HID_VL53L5CX_TRACKER_TARGETS);
+        targets.count[zone] = (uint8_t)count;
+        for (uint32_t t = 0; t < count; t++)
+        {
+            uint32_t e = VL53L5CX_NB_TARGET_PER_ZONE * zone + t;
+            targets.distance_mm[zone][t] = results.distance_mm[e];
+            targets.range_sigma_mm[zone][t] = results.range_sigma_mm[e];
+            targets.signal_per_spad[zone][t] = results.signal_per_spad[e];
+            targets.target_status[zone][t] = results.target_status[e];
+        }
+    }
+}
+
+uint32_t HID_VL53L5CX_Tracker::detect(const HID_VL53L5CX_Targets &targets)
+{
+    const VL53L5CX_Roi &roi = config.roi;
+    uint64_t all = HID_VL53L5CX_Roi::allZones(resolution);
+    uint64_t selected = ((roi.zone_mask != 0) ? roi.zone_mask : all) & all;
+
+    // Zone major, the detections of a zone are next to each other
+    uint32_t count = 0;
+    for (uint32_t zone = 0; zone < resolution; zone++)
+    {
+        first[zone] = (uint16_t)count;
+        if (!((selected >> zone) & 1))
+            continue;
+        uint32_t zoneTargets = std::min((uint32_t)targets.count[zone], (uint32_t)HID_VL53L5CX_TRACKER_TARGETS);
+        for (uint32_t t = 0; t < zoneTargets; t++)
+        {
+            uint32_t status = targets.target_status[zone][t];
+            int16_t distance = targets.distance_mm[zone][t];
+            if ((status >= 32) || !((roi.status_mask >> status) & 1) || (distance <= roi.min_distance_mm)
+                || (distance >= roi.max_distance_mm) || (targets.range_sigma_mm[zone][t] > roi.max_sigma_mm)
+                || (targets.signal_per_spad[zone][t] < roi.min_signal))
+                continue;
+            detections[count].zone = (uint8_t)zone;
+            detections[count].track = NO_TRACK;
+            detections[count].distance = distance;
+            count++;
+        }
+    }
+    first[resolution] = (uint16_t)count;
+    return count;
+}
+
+void HID_VL53L5CX_Tracker::associate(uint32_t count, double dt)
+{
+    uint32_t width = (resolution == 64) ? 8 : 4;
+    double predicted[VL53L5CX_TRACKER_MAX_TRACKS];
+    uint64_t reach[VL53L5CX_TRACKER_MAX_TRACKS];
+    uint64_t matched[VL53L5CX_TRACKER_MAX_TRACKS];
+    double sum[VL53L5CX_TRACKER_MAX_TRACKS];
+    uint32_t columns[VL53L5CX_TRACKER_MAX_TRACKS];
+    uint32_t rows[VL53L5CX_TRACKER_MAX_TRACKS];
+    for (uint32_t k = 0; k < VL53L5CX_TRACKER_MAX_TRACKS; k++)
+    {
+        predicted[k] = state[k].distance + state[k].velocity * dt;
+        reach[k] = state[k].active ? HID_VL53L5CX_Roi::neighbourZones(state[k].zones, resolution) : 0;
+        matched[k] = 0;
+        sum[k] = 0;
+        columns[k] = 0;
+        rows[k] = 0;
+    }
+
+    // Every detection to the nearest track that reaches its zone, one per zone and track
+    for (uint32_t i = 0; i < count; i++)
+    {
+        Detection &detection = detections[i];
+        uint64_t zone = 1ULL << detection.zone;
+        double best = (double)gate;
+        for (uint32_t k = 0; k < VL53L5CX_TRACKER_MAX_TRACKS; k++)
+        {
+            if (!(reach[k] & zone) || (matched[k] & zone))
+                continue;
+            double difference = fabs(detection.distance - predicted[k]);
+            if (difference <= best)
+            {
+                best = difference;
+                detection.track = (uint8_t)k;
+            }
+        }
+        if (detection.track == NO_TRACK)
+            continue;
+        uint32_t k = detection.track;
+        matched[k] |= zone;
+        sum[k] += detection.distance;
+        columns[k] += detection.zone % width;
+        rows[k] += detection.zone / width;
+    }
+
+    for (uint32_t k = 0; k < VL53L5CX_TRACKER_MAX_TRACKS; k++)
+    {
+        Track &track = state[k];
+        if (!track.active)
+            continue;
+        track.age++;
+        uint32_t zones = HID_VL53L5CX_Roi::zoneCount(matched[k]);
+        if (zones == 0)
+        {
+            // Coasts on its prediction until it is given up. Compared before counting,
+            // a uint8_t counter past max_misses 255 would wrap to 0
+            track.distance = predicted[k];
+            if (track.misses >= maxMisses)
+                track.active = false;
+            else
+                track.misses++;
+            continue;
+        }
+
+        double residual = sum[k] / zones - predicted[k];
+        track.distance = predicted[k] + TRACKER_ALPHA * residual;
+        if (dt > 0)
+            track.velocity += TRACKER_BETA * residual / dt;
+        track.zones = matched[k];
+        track.column = (float)columns[k] / zones;
+        track.row = (float)rows[k] / zones;
+        track.hits++;
+        track.misses = 0;
+    }
+}
+
+void HID_VL53L5CX_Tracker::spawn(uint32_t count, uint32_t width)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (detections[i].track != NO_TRACK)
+            continue;
+
+        // Grows over the detections of neighbouring zones within the gate, breadth first
+        uint32_t head = 0, tail = 0;
+        pending[tail++] = (uint16_t)i;
+        detections[i].track = NEW_TRACK;
+        uint64_t zones = 0;
+        double sum = 0;
+        uint32_t columns = 0, rows = 0;
+        while (head < tail)
+        {
+            const Detection &member = detections[pending[head++]];
+            zones |= 1ULL << member.zone;
+            sum += member.distance;
+            columns += member.zone % width;
+            rows += member.zone / width;
+
+            uint64_t around = HID_VL53L5CX_Roi::neighbourZones(1ULL << member.zone, resolution);
+            for (; around != 0; around &= around - 1)
+            {
+                uint32_t zone = HID_VL53L5CX_Roi::lowestZone(around);
+                for (uint32_t k = first[zone]; k < first[zone + 1]; k++)
+                {
+                    if ((detections[k].track == NO_TRACK) && (abs(detections[k].distance - member.distance) <= gate))
+                    {
+                        detections[k].track = NEW_TRACK;
+                        pending[tail++] = (uint16_t)k;
+                    }
+                }
+            }
+        }
+
+        if (HID_VL53L5CX_Roi::zoneCount(zones) < minZones)
+            continue;
+
+        Track *track = nullptr;
+        for (uint32_t k = 0; (k < VL53L5CX_TRACKER_MAX_TRACKS) && (track == nullptr); k++)
+        {
+            if (!state[k].active)
+                track = &state[k];
+        }
+        if (track == nullptr)
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        track->active = true;
+        track->id = nextId++;
+        track->age = 1;
+        track->hits = 1;
+        track->misses = 0;
+        track->zones = zones;
+        track->distance = sum / tail;
+        track->velocity = 0;
+        track->column = (float)columns / tail;
+        track->row = (float)rows / tail;
+    }
+}
+
+void HID_VL53L5CX_Tracker::publish()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    publishedCount = 0;
+    for (uint32_t k = 0; k < VL53L5CX_TRACKER_MAX_TRACKS; k++)
+    {
+        const Track &track = state[k];
+        if (!track.active || (track.hits < confirmFrames))
+            continue;
+        VL53L5CX_Track &out = published[publishedCount++];
+        memset(&out, 0, sizeof(out));
+        out.zone_mask = track.zones;
+        out.id = track.id;
+        out.age_frames = track.age;
+        out.distance_mm = (float)track.distance;
+        out.velocity_mm_s = (float)track.velocity;
+        out.column = track.column;
+        out.row = track.row;
+        out.zones = (uint8_t)HID_VL53L5CX_Roi::zoneCount(track.zones);
+        out.misses = track.misses;
+    }
+}
+
+void HID_VL53L5CX_Tracker::update(const HID_VL53L5CX_Targets &targets)
+{
+    if ((targets.resolution != 16) && (targets.resolution != 64))
+        return;
+    if (targets.resolution != resolution)
+    {
+        memset(state, 0, sizeof(state));
+        resolution = targets.resolution;
+        lastFrameNs = 0;
+    }
+
+    double dt = 0;
+    if ((lastFrameNs != 0) && (targets.timestampNs > lastFrameNs))
+        dt = std::min((double)(targets.timestampNs - lastFrameNs) * 1e-9, TRACKER_MAX_DT);
+    lastFrameNs = targets.timestampNs;
+
+    uint32_t count = detect(targets);
+    associate(count, dt);
+    spawn(count, (resolution == 64) ? 8 : 4);
+    publish();
+}
+
+void HID_VL53L5CX_Tracker::update(const VL53L5CX_ResultsData &results, uint8_t zones, uint64_t timestampNs)
+{
+    fromResults(results, zones, timestampNs, input);
+    update(input);
+}
+
+uint32_t HID_VL53L5CX_Tracker::tracks(VL53L5CX_Track *out, uint32_t capacity)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    uint32_t copied = std::min(capacity, publishedCount);
+    memcpy(out, published, copied * sizeof(VL53L5CX_Track));
+    return copied;
+}
@@ -0,0 +1,131 @@
+#pragma once
+/*
+  This file declares the target tracker.
+
+  The frame only carries the first target of every zone, so a person behind
+  a glass panel or behind someone else in a queue never shows up in it. The
+  sensor reports up to VL53L5CX_NB_TARGET_PER_ZONE targets per zone (a build
+  option of the ULD, see platform.h) and the tracker looks at all of them.
+
+  Every frame the targets that pass the rules of the tracker ROI become
+  detections. A track takes the detections of the zones it covered in the
+  last frame and their neighbours (a bitboard dilation of its zone mask)
+  that are within the gate of its predicted distance, each detection goes
+  to the nearest such track. What is left over is grouped into new tracks:
+  detections of neighbouring zones within the gate of each other belong to
+  one target. A track without detections is predicted on and ends after
+  max_misses frames. Distance and range rate follow an alpha-beta filter.
+
+  Everything lives in fixed arrays: 64 zones of up to 4 targets, at most
+  VL53L5CX_TRACKER_MAX_TRACKS tracks. The work per frame is bounded by
+  those (each detection checks every track once and at most 9 zones of
+  neighbours), nothing is allocated.
+*/
+
+#ifndef __HID_VL53L5CX_Tracker__
+#define __HID_VL53L5CX_Tracker__
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include "VL53L5CXSensor.h"
+#include "vl53l5cx_api.h"
+
+// Targets per zone the tracker input holds, the most the ULD supports
+#define HID_VL53L5CX_TRACKER_TARGETS 4
+
+// All targets of one frame, independent of the ULD build
+struct HID_VL53L5CX_Targets
+{
+    uint64_t timestampNs;
+    uint8_t resolution;                 // 16 or 64
+    uint8_t count[VL53L5CX_FRAME_MAX_ZONES];                // targets of the zone
+    int16_t distance_mm[VL53L5CX_FRAME_MAX_ZONES][HID_VL53L5CX_TRACKER_TARGETS];
+    uint16_t range_sigma_mm[VL53L5CX_FRAME_MAX_ZONES][HID_VL53L5CX_TRACKER_TARGETS];
+    uint32_t signal_per_spad[VL53L5CX_FRAME_MAX_ZONES][HID_VL53L5CX_TRACKER_TARGETS];
+    uint8_t target_status[VL53L5CX_FRAME_MAX_ZONES][HID_VL53L5CX_TRACKER_TARGETS];
+};
+
+class HID_VL53L5CX_Tracker
+{
+private:
+    struct Detection
+    {
+        uint8_t zone;
+        uint8_t track;                  // index into state, NO_TRACK if none yet
+        int16_t distance;
+    };
+
+    struct Track
+    {
+        bool active;
+        uint32_t id;
+        uint32_t age;
+        uint32_t hits;                  // frames with detections
+        uint8_t misses;
+        uint64_t zones;
+        double distance;
+        double velocity;
+        float column;
+        float row;
+    };
+
+    VL53L5CX_TrackerConfig config;
+    uint16_t gate;
+    uint8_t minZones;
+    uint8_t confirmFrames;
+    uint8_t maxMisses;
+
+    Track state[VL53L5CX_TRACKER_MAX_TRACKS];
+    uint32_t nextId = 1;
+    uint64_t lastFrameNs = 0;
+    uint8_t resolution = 0;
+
+    // Per frame scratch, detections of zone z start at first[z]
+    Detection detections[VL53L5CX_FRAME_MAX_ZONES * HID_VL53L5CX_TRACKER_TARGETS];
+    uint16_t first[VL53L5CX_FRAME_MAX_ZONES + 1];
+    uint16_t pending[VL53L5CX_FRAME_MAX_ZONES * HID_VL53L5CX_TRACKER_TARGETS];
+    HID_VL53L5CX_Targets input;
+
+    // Confirmed tracks of the last frame for tracks(), guarded by lock
+    std::mutex lock;
+    VL53L5CX_Track published[VL53L5CX_TRACKER_MAX_TRACKS];
+    uint32_t publishedCount = 0;
+    std::atomic<uint64_t> dropped;
+
+    uint32_t detect(const HID_VL53L5CX_Targets &targets);
+    void associate(uint32_t count, double dt);
+    void spawn(uint32_t count, uint32_t width);
+    void publish();
+
+public:
+    // config must pass check(), it is copied.
+    HID_VL53L5CX_Tracker(const VL53L5CX_TrackerConfig &config);
+
+    // Tracker with the default rules: status 5 and 9, 10 mm < distance < 4000 mm,
+    // all zones, a gate of 300 mm, 2 frames to confirm and 5 to end a track.
+    static VL53L5CX_TrackerConfig defaults();
+
+    // False if the distance window of the ROI is empty.
+    static bool check(const VL53L5CX_TrackerConfig &config);
+
+    // Copies the targets of a ULD result (VL53L5CX_NB_TARGET_PER_ZONE per zone).
+    static void fromResults(const VL53L5CX_ResultsData &results, uint8_t resolution, uint64_t timestampNs,
+        HID_VL53L5CX_Targets &targets);
+
+    // Advances every track by one frame. A resolution change starts over.
+    void update(const HID_VL53L5CX_Targets &targets);
+    void update(const VL53L5CX_ResultsData &results, uint8_t zones, uint64_t timestampNs);
+
+    // Copies up to capacity of the confirmed tracks of the last frame to out,
+    // returns how many. Safe against a concurrent update().
+    uint32_t tracks(VL53L5CX_Track *out, uint32_t capacity);
+
+    // New tracks that did not fit next to VL53L5CX_TRACKER_MAX_TRACKS others.
+    uint64_t droppedCount() { return dropped.load(std::memory_order_relaxed); }
+
+    HID_VL53L5CX_Tracker(const HID_VL53L5CX_Tracker&) = delete;
+    HID_VL53L5CX_Tracker& operator=(const HID_VL53L5CX_Tracker&) = delete;
+};
+
+#endif // __HID_VL53L5CX_Tracker__
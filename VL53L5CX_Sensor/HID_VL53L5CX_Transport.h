@@ -0,0 +1,75 @@
+#pragma once
+/*
+  This file declares the register transport used by the platform layer.
+
+  The ULD platform functions (RdByte, WrByte, RdMulti, WrMulti) talk to the
+  sensor through this interface. HID_VL53L5CX_IO implements it on top of the
+  FT260 USB-to-I2C bridge; simulated and replayed sensors implement it in
+  software so the whole driver stack can run without hardware.
+*/
+
+#ifndef __HID_VL53L5CX_Transport__
+#define __HID_VL53L5CX_Transport__
+
+#include <stdint.h>
+
+// The FT260 bridge only exists on Windows. Simulation builds may also leave
+// it out explicitly by defining HID_VL53L5CX_NO_FT260.
+#if defined(_WIN32) && !defined(HID_VL53L5CX_NO_FT260)
+#define HID_VL53L5CX_HAS_FT260 1
+#endif
+
+// I2C master status bit reported by getI2CStatus() when the controller is idle
+// (same meaning as the FT260 I2CM_IDLE() bit).
+const uint8_t HID_VL53L5CX_I2C_STATUS_IDLE = 0x20;
+
+// Read wait of a transport when the caller has no deadline. A wedged bus costs
+// this much per transaction, not the seconds the FT260 library allows.
+const uint32_t HID_VL53L5CX_READ_BUDGET_MS = 100;
+
+// Wait budget of one read of size bytes. timeoutMs is what is left of the
+// caller's deadline (0 = none, see setTimeoutMs()), but never less than the
+// transfer needs at 100 kHz (9 bits a byte, twice over, plus a USB margin) so
+// a read in flight is not cut short.
+inline uint32_t HID_VL53L5CX_readTimeoutMs(uint32_t size, uint32_t timeoutMs)
+{
+	uint32_t transferMs = 10 + (size * 18) / 100;
+	if (timeoutMs == 0)
+		return HID_VL53L5CX_READ_BUDGET_MS + transferMs;
+	return (timeoutMs > transferMs) ? timeoutMs : transferMs;
+}
+
+class HID_VL53L5CX_Transport
+{
+public:
+	virtual ~HID_VL53L5CX_Transport() {}
+
+	// Returns the I2C master status byte.
+	virtual uint8_t getI2CStatus() = 0;
+
+	// Time left until the caller's deadline for the next transactions, 0 = no
+	// deadline. The platform layer sets it before every transaction.
+	virtual void setTimeoutMs(uint32_t timeoutMs) { (void)timeoutMs; }
+
+	// Arms (or disarms) a latch of the sensor INT line on the host side, set on
+	// its falling edge. False if the transport cannot see the INT line.
+	virtual bool setInterrupt(bool enable) { (void)enable; return false; }
+
+	// True if INT fired since the last call, clears the latch. Costs one bridge
+	// request, no I2C transaction.
+	virtual bool interruptFired() { return false; }
+
+	// Read a single byte from a register.
+	virtual uint8_t readSingleByte(uint16_t registerAddress, uint8_t &value) = 0;
+
+	// Write a single byte into a register.
+	virtual uint8_t writeSingleByte(uint16_t registerAddress, uint8_t value) = 0;
+
+	// Read multiple bytes from a register into buffer byte array.
+	virtual uint8_t readMultipleBytes(uint16_t registerAddress, uint8_t* buffer, uint16_t bufferSize) = 0;
+
+	// Write multiple bytes to register from buffer byte array.
+	virtual uint8_t writeMultipleBytes(uint16_t registerAddress, uint8_t* buffer, uint16_t bufferSize) = 0;
+};
+
+#endif // __HID_VL53L5CX_Transport__
@@ -1,24 +1,57 @@
 #include "pch.h" // use stdafx.h in Visual Studio 2017 and earlier
 
-#include <iostream>
+#include <exception>
+#include <stdexcept>
+#include <string.h>
 #include "VL53L5CXSensor.h"
 #include "HID_VL53L5CX.h"
+#include "HID_VL53L5CX_Background.h"
+#include "HID_VL53L5CX_PeopleCounter.h"
+#include "HID_VL53L5CX_Filter.h"
+#include "HID_VL53L5CX_Governor.h"
+#include "HID_VL53L5CX_Idle.h"
+#include "HID_VL53L5CX_Motion.h"
+#include "HID_VL53L5CX_Presence.h"
+#include "HID_VL53L5CX_Recorder.h"
+#include "HID_VL53L5CX_Replay.h"
+#include "HID_VL53L5CX_Roi.h"
+#include "HID_VL53L5CX_Stream.h"
+#include "HID_VL53L5CX_Tracker.h"
+#include "HID_VL53L5CX_Trace.h"
+#include "HID_VL53L5CX_Log.h"
 
 // VL53L5CS ranging poll rate in msec
 const uint8_t SensorPollRate = 10;
 
-// Callback called when I2C communication error with sensor
-static void sensorErrorCallback(SF_VL53L5CX_ERROR_TYPE errorCode, uint32_t errorValue)
+// The per frame stages set up on the sensor
+static HID_VL53L5CX_Stages frameStages(void* filter, void* presence, void* tracker, void* background, void* counter,
+    void* motion, void* idle, void* governor)
 {
-    //std::cout << "I2C communication errorCode: " << errorCode << " errorValue: " << errorValue << std::endl;
-    printf("I2C Communication errorCode: %d, errorValue: %d\n", errorCode, errorValue);
-    throw std::runtime_error("FT260 I2C communication error: " + std::to_string(errorValue));
+    HID_VL53L5CX_Stages stages;
+    stages.filter = (HID_VL53L5CX_Filter*)filter;
+    stages.presence = (HID_VL53L5CX_Presence*)presence;
+    stages.tracker = (HID_VL53L5CX_Tracker*)tracker;
+    stages.background = (HID_VL53L5CX_Background*)background;
+    stages.counter = (HID_VL53L5CX_PeopleCounter*)counter;
+    stages.motion = (HID_VL53L5CX_Motion*)motion;
+    stages.idle = (HID_VL53L5CX_Idle*)idle;
+    stages.governor = (HID_VL53L5CX_Governor*)governor;
+    return stages;
+}
+
+// Callback called when I2C communication error with sensor. Runs inside the failing call, possibly on
+// the acquisition thread, so it only logs (into the log ring, nothing is allocated) and forwards.
+static void sensorErrorCallback(SF_VL53L5CX_ERROR_TYPE errorCode, uint32_t errorValue, void* sensor)
+{
+    HID_VL53L5CX_LOG(FAILURE, "I2C Communication errorCode: %d, errorValue: %u", (int)errorCode, errorValue);
+    ((VL53L5CXSensor*)sensor)->onSensorError((uint8_t)errorCode, errorValue);
 }
 
 
 VL53L5CXSensor::VL53L5CXSensor(uint8_t i2c_address)
 {
-    std::cout << "VL53L5CXSensor() Constructor called" << std::endl;
+    HID_VL53L5CX_LOG(VERBOSE, "VL53L5CXSensor() Constructor called");
+    _range_roi = HID_VL53L5CX_Roi::defaults();
     
     // if we call this more than once, get rid of the previous class
     if (_vl53_sensor)
@@ -26,37 +59,568 @@ VL53L5CXSensor::VL53L5CXSensor(uint8_t i2c_address)
     // create an HID vl52 sensor class 
 	//HID_VL53L5CX vl53_sensor(i2c_address);
 	//_vl53_sensor = &vl53_sensor;
+#ifdef HID_VL53L5CX_HAS_FT260
     _vl53_sensor = new HID_VL53L5CX(i2c_address);
-    std::cout << "_vl53_sensor ptr: " << _vl53_sensor << std::endl;
+#else
+    // builds without the FT260 (Linux) can only replay recordings
+    (void)i2c_address;
+    throw std::runtime_error("FT260 support is not built in, use InstantiateReplay()");
+#endif
+    HID_VL53L5CX_LOG(VERBOSE, "_vl53_sensor ptr: %p", _vl53_sensor);
+    HID_VL53L5CX* psensor = (HID_VL53L5CX*)_vl53_sensor;
+    psensor->setErrorCallback(&sensorErrorCallback, this);
+}
+
+// Replays a recording instead of talking to the FT260, see HID_VL53L5CX_Replay.h
+// replay_mode is a HID_VL53L5CX_REPLAY_MODE value
+VL53L5CXSensor::VL53L5CXSensor(const char* recording_path, uint8_t replay_mode)
+{
+    HID_VL53L5CX_LOG(VERBOSE, "VL53L5CXSensor() replay Constructor called");
+    _range_roi = HID_VL53L5CX_Roi::defaults();
+
+    HID_VL53L5CX_REPLAY_MODE mode = (HID_VL53L5CX_REPLAY_MODE)replay_mode;
+    HID_VL53L5CX_VirtualClock* clock = new HID_VL53L5CX_VirtualClock();
+    HID_VL53L5CX_ReplaySensor* replay = nullptr;
+    try {
+        replay = new HID_VL53L5CX_ReplaySensor(clock, recording_path, mode);
+
+        // Real time replays wait on the system clock like a live sensor, the others never sleep
+        _vl53_sensor = new HID_VL53L5CX(replay, (mode == HID_VL53L5CX_REPLAY_MODE::REALTIME) ? nullptr : clock);
+    }
+    catch (...) {
+        delete replay;
+        delete clock;
+        throw;
+    }
+    _replay = replay;
+    _replay_clock = clock;
+
     HID_VL53L5CX* psensor = (HID_VL53L5CX*)_vl53_sensor;
-    psensor->setErrorCallback(&sensorErrorCallback);
+    psensor->setErrorCallback(&sensorErrorCallback, this);
 }
 
 VL53L5CXSensor::~VL53L5CXSensor()
 {
-    std::cout << "VL53L5CXSensor() destructor called" << std::endl;
+    HID_VL53L5CX_LOG(VERBOSE, "VL53L5CXSensor() destructor called");
+    stopStreaming();
     HID_VL53L5CX *psensor = (HID_VL53L5CX*)_vl53_sensor;
     psensor->~HID_VL53L5CX();
+    delete (HID_VL53L5CX_ReplaySensor*)_replay;
+    delete (HID_VL53L5CX_VirtualClock*)_replay_clock;
+    delete (HID_VL53L5CX_Filter*)_filter;
+    delete (HID_VL53L5CX_Presence*)_presence;
+    delete (HID_VL53L5CX_Tracker*)_tracker;
+    delete (HID_VL53L5CX_PeopleCounter*)_counter;
+    delete (HID_VL53L5CX_Background*)_background;
+    delete (HID_VL53L5CX_Idle*)_idle;
+    delete (HID_VL53L5CX_Motion*)_motion;
+    delete (HID_VL53L5CX_Governor*)_governor;
+
+    // the client may exit right after this, let the last messages out
+    HID_VL53L5CX_Log::flush(100);
 }
 
 
 bool VL53L5CXSensor::startRanging()
 {
+	// the acquisition thread owns the sensor, and it is ranging already
+	if (_stream != nullptr)
+		return false;
 	return ((HID_VL53L5CX *)_vl53_sensor)->startRanging();
 }
 
 bool VL53L5CXSensor::stopRanging()
 {
+	stopStreaming();
 	return ((HID_VL53L5CX*)_vl53_sensor)->stopRanging();
 }
 
 bool VL53L5CXSensor::isDataReady()
 {
+	if (_stream != nullptr)
+		return false;
 	return ((HID_VL53L5CX*)_vl53_sensor)->isDataReady();
 }
 
+bool VL53L5CXSensor::startRecording(const char* path, bool raw)
+{
+	if (_stream != nullptr)
+		return false;
+	return ((HID_VL53L5CX*)_vl53_sensor)->startRecording(path, raw);
+}
+
+void VL53L5CXSensor::stopRecording()
+{
+	// the acquisition thread writes into the recording
+	stopStreaming();
+	((HID_VL53L5CX*)_vl53_sensor)->stopRecording();
+}
+
+bool VL53L5CXSensor::replayStep(uint32_t frames)
+{
+	if (_replay == nullptr)
+		return false;
+	((HID_VL53L5CX_ReplaySensor*)_replay)->step(frames);
+	return true;
+}
+
+bool VL53L5CXSensor::getMetricsName(char* buffer, uint32_t size)
+{
+	const char* name = ((HID_VL53L5CX*)_vl53_sensor)->getMetricsName();
+	if ((buffer == nullptr) || (size <= strlen(name)) || (name[0] == '\0'))
+		return false;
+	memcpy(buffer, name, strlen(name) + 1);
+	return true;
+}
+
+bool VL53L5CXSensor::setTimeouts(uint32_t operation_ms, uint32_t frame_percent)
+{
+	// the acquisition thread reads the budgets
+	if (_stream != nullptr)
+		return false;
+	((HID_VL53L5CX*)_vl53_sensor)->setOperationTimeout(operation_ms);
+	((HID_VL53L5CX*)_vl53_sensor)->setFrameTimeout(frame_percent);
+	return true;
+}
+
+bool VL53L5CXSensor::setErrorCallback(VL53L5CX_ErrorCallback callback, void* user_data)
+{
+	// the acquisition thread calls it
+	if (_stream != nullptr)
+		return false;
+	_error_callback = callback;
+	_error_callback_data = user_data;
+	return true;
+}
+
+void VL53L5CXSensor::onSensorError(uint8_t error_code, uint32_t error_value)
+{
+	if (_error_callback != nullptr)
+		_error_callback(error_code, error_value, _error_callback_data);
+}
+
+bool VL53L5CXSensor::getLastError(uint8_t* error_code, uint32_t* error_value)
+{
+	if ((_stream != nullptr) || (error_code == nullptr) || (error_value == nullptr))
+		return false;
+	const HID_VL53L5CX_Error& error = ((HID_VL53L5CX*)_vl53_sensor)->lastError;
+	*error_code = (uint8_t)error.lastErrorCode;
+	*error_value = error.lastErrorValue;
+	return true;
+}
+
+uint64_t VL53L5CXSensor::getErrorCount(uint8_t error_code)
+{
+	if (error_code >= HID_VL53L5CX_METRICS_ERROR_CODES)
+		return 0;
+	return ((HID_VL53L5CX*)_vl53_sensor)->getMetrics()->driverErrors[error_code].load(std::memory_order_relaxed);
+}
+
+bool VL53L5CXSensor::resolutionChanges()
+{
+	return (_governor != nullptr) && !((HID_VL53L5CX_Governor*)_governor)->fixedResolution();
+}
+
+bool VL53L5CXSensor::setRangeRoi(const VL53L5CX_Roi* roi)
+{
+	// zones of one resolution are other zones in the other
+	if ((roi != nullptr) && (roi->zone_mask != 0) && resolutionChanges())
+		return false;
+	_range_roi = (roi != nullptr) ? *roi : HID_VL53L5CX_Roi::defaults();
+	return true;
+}
+
+bool VL53L5CXSensor::setZoneFilter(const VL53L5CX_Filter* filter)
+{
+	// the acquisition thread applies it
+	if ((_stream != nullptr) || ((filter != nullptr) && !HID_VL53L5CX_Filter::check(*filter)))
+		return false;
+	delete (HID_VL53L5CX_Filter*)_filter;
+	_filter = nullptr;
+	if ((filter != nullptr) && (filter->type != VL53L5CX_FILTER_NONE))
+		_filter = new HID_VL53L5CX_Filter(*filter);
+	return true;
+}
+
+bool VL53L5CXSensor::setPresenceZones(const VL53L5CX_PresenceZone* zones, int32_t count)
+{
+	// the acquisition thread feeds it
+	if ((_stream != nullptr) || (count < 0) || ((count > 0) && !HID_VL53L5CX_Presence::check(zones, (uint32_t)count)))
+		return false;
+	if ((count > 0) && HID_VL53L5CX_Presence::explicitZones(zones, (uint32_t)count) && resolutionChanges())
+		return false;
+	delete (HID_VL53L5CX_Presence*)_presence;
+	_presence = nullptr;
+	if (count > 0)
+	{
+		HID_VL53L5CX_Presence* presence = new HID_VL53L5CX_Presence(zones, (uint32_t)count);
+		presence->setCallback(_presence_callback, _presence_callback_data);
+		_presence = presence;
+	}
+	return true;
+}
+
+bool VL53L5CXSensor::setPresenceCallback(VL53L5CX_PresenceCallback callback, void* user_data)
+{
+	// the acquisition thread calls it
+	if (_stream != nullptr)
+		return false;
+	_presence_callback = callback;
+	_presence_callback_data = user_data;
+	if (_presence != nullptr)
+		((HID_VL53L5CX_Presence*)_presence)->setCallback(callback, user_data);
+	return true;
+}
+
+int32_t VL53L5CXSensor::readPresenceEvents(VL53L5CX_PresenceEvent* events, int32_t capacity)
+{
+	if ((_presence == nullptr) || (events == nullptr) || (capacity <= 0))
+		return 0;
+	return (int32_t)((HID_VL53L5CX_Presence*)_presence)->read(events, (uint32_t)capacity);
+}
+
+uint32_t VL53L5CXSensor::getPresenceState()
+{
+	return (_presence != nullptr) ? ((HID_VL53L5CX_Presence*)_presence)->occupied() : 0;
+}
+
+bool VL53L5CXSensor::setTracker(const VL53L5CX_TrackerConfig* config)
+{
+	// the acquisition thread feeds it
+	if ((_stream != nullptr) || ((config != nullptr) && !HID_VL53L5CX_Tracker::check(*config)))
+		return false;
+	delete (HID_VL53L5CX_Tracker*)_tracker;
+	_tracker = nullptr;
+	if (config != nullptr)
+		_tracker = new HID_VL53L5CX_Tracker(*config);
+	return true;
+}
+
+int32_t VL53L5CXSensor::getTracks(VL53L5CX_Track* tracks, int32_t capacity)
+{
+	if ((_tracker == nullptr) || (tracks == nullptr) || (capacity <= 0))
+		return 0;
+	return (int32_t)((HID_VL53L5CX_Tracker*)_tracker)->tracks(tracks, (uint32_t)capacity);
+}
+
+bool VL53L5CXSensor::setBackground(const VL53L5CX_BackgroundConfig* config)
+{
+	// the acquisition thread feeds it
+	// a model of one resolution starts over with every change of it
+	if ((_stream != nullptr) || ((config != nullptr) && (!HID_VL53L5CX_Background::check(*config) || resolutionChanges())))
+		return false;
+	delete (HID_VL53L5CX_Background*)_background;
+	_background = nullptr;
+	_counter_background = false;
+	if (config != nullptr)
+		_background = new HID_VL53L5CX_Background(*config);
+	else if (_counter != nullptr)
+	{
+		// the counter goes on with a model of its own settings
+		VL53L5CX_CounterConfig counter = ((HID_VL53L5CX_PeopleCounter*)_counter)->settings();
+		_background = new HID_VL53L5CX_Background(HID_VL53L5CX_PeopleCounter::backgroundConfig(counter));
+		_counter_background = true;
+	}
+	return true;
+}
+
+bool VL53L5CXSensor::getForeground(uint64_t* foreground)
+{
+	if ((_background == nullptr) || (foreground == nullptr) || ((HID_VL53L5CX_Background*)_background)->learning())
+		return false;
+	*foreground = ((HID_VL53L5CX_Background*)_background)->foreground();
+	return true;
+}
+
+bool VL53L5CXSensor::saveBackground(const char* path)
+{
+	HID_VL53L5CX* psensor = (HID_VL53L5CX*)_vl53_sensor;
+	if ((_background == nullptr) || (path == nullptr) || (psensor->Dev == nullptr))
+		return false;
+	return ((HID_VL53L5CX_Background*)_background)->save(path, HID_VL53L5CX_Recorder::calibrationFingerprint(psensor->Dev));
+}
+
+bool VL53L5CXSensor::loadBackground(const char* path)
+{
+	// the acquisition thread feeds it
+	HID_VL53L5CX* psensor = (HID_VL53L5CX*)_vl53_sensor;
+	if ((_stream != nullptr) || (_background == nullptr) || (path == nullptr) || (psensor->Dev == nullptr))
+		return false;
+	return ((HID_VL53L5CX_Background*)_background)->load(path, HID_VL53L5CX_Recorder::calibrationFingerprint(psensor->Dev));
+}
+
+bool VL53L5CXSensor::setCounter(const VL53L5CX_CounterConfig* config)
+{
+	// the acquisition thread feeds it
+	// so do its background model and blobs
+	if ((_stream != nullptr) || ((config != nullptr) && (!HID_VL53L5CX_PeopleCounter::check(*config) || resolutionChanges())))
+		return false;
+	delete (HID_VL53L5CX_PeopleCounter*)_counter;
+	_counter = nullptr;
+	if (_counter_background)
+	{
+		// a model set with setBackground() stays
+		delete (HID_VL53L5CX_Background*)_background;
+		_background = nullptr;
+		_counter_background = false;
+	}
+	if (config == nullptr)
+		return true;
+	_counter = new HID_VL53L5CX_PeopleCounter(*config);
+	if (_background == nullptr)
+	{
+		_background = new HID_VL53L5CX_Background(HID_VL53L5CX_PeopleCounter::backgroundConfig(*config));
+		_counter_background = true;
+	}
+	return true;
+}
+
+bool VL53L5CXSensor::getCrossingCounts(uint64_t* forward, uint64_t* backward)
+{
+	if ((_counter == nullptr) || (forward == nullptr) || (backward == nullptr))
+		return false;
+	*forward = ((HID_VL53L5CX_PeopleCounter*)_counter)->count(VL53L5CX_CROSSING_FORWARD);
+	*backward = ((HID_VL53L5CX_PeopleCounter*)_counter)->count(VL53L5CX_CROSSING_BACKWARD);
+	return true;
+}
+
+int32_t VL53L5CXSensor::readCrossingEvents(VL53L5CX_CrossingEvent* events, int32_t capacity)
+{
+	if ((_counter == nullptr) || (events == nullptr) || (capacity <= 0))
+		return 0;
+	return (int32_t)((HID_VL53L5CX_PeopleCounter*)_counter)->read(events, (uint32_t)capacity);
+}
+
+int32_t VL53L5CXSensor::getBlobs(VL53L5CX_Blob* blobs, int32_t capacity)
+{
+	if ((_counter == nullptr) || (blobs == nullptr) || (capacity <= 0))
+		return 0;
+	return (int32_t)((HID_VL53L5CX_PeopleCounter*)_counter)->blobs(blobs, (uint32_t)capacity);
+}
+
+bool VL53L5CXSensor::setIdleMode(const VL53L5CX_IdleConfig* config)
+{
+	// the acquisition thread uses it, a recording has no INT line, the governor sleeps on its own
+	HID_VL53L5CX* psensor = (HID_VL53L5CX*)_vl53_sensor;
+	if ((_stream != nullptr) || (_replay != nullptr) || ((config != nullptr) && ((_governor != nullptr) || !HID_VL53L5CX_Idle::check(*config))))
+		return false;
+	if (_idle != nullptr)
+	{
+		HID_VL53L5CX_Idle::stop(psensor);
+		delete (HID_VL53L5CX_Idle*)_idle;
+		_idle = nullptr;
+	}
+	if (config == nullptr)
+		return true;
+	HID_VL53L5CX_Idle* idle = new HID_VL53L5CX_Idle(*config);
+	if (!idle->start(psensor))
+	{
+		delete idle;
+		return false;
+	}
+	_idle = idle;
+	return true;
+}
+
+bool VL53L5CXSensor::getIdleStats(VL53L5CX_IdleStats* stats)
+{
+	if ((_idle == nullptr) || (stats == nullptr))
+		return false;
+	((HID_VL53L5CX_Idle*)_idle)->stats(*stats);
+	return true;
+}
+
+bool VL53L5CXSensor::setMotionIndicator(const VL53L5CX_MotionConfig* config)
+{
+	// the acquisition thread feeds it
+	HID_VL53L5CX* psensor = (HID_VL53L5CX*)_vl53_sensor;
+	if ((_stream != nullptr) || ((config != nullptr) && !HID_VL53L5CX_Motion::check(*config)))
+		return false;
+	delete (HID_VL53L5CX_Motion*)_motion;
+	_motion = nullptr;
+	if (config == nullptr)
+		return true;
+	if (!psensor->setMotionIndicator(HID_VL53L5CX_Motion::minDistanceMm(*config), HID_VL53L5CX_Motion::maxDistanceMm(*config)))
+		return false;
+	_motion = new HID_VL53L5CX_Motion(*config);
+	return true;
+}
+
+bool VL53L5CXSensor::getMotion(VL53L5CX_MotionFrame* motion)
+{
+	if ((_motion == nullptr) || (motion == nullptr))
+		return false;
+	return ((HID_VL53L5CX_Motion*)_motion)->latest(*motion);
+}
+
+int32_t VL53L5CXSensor::readMotionFrames(VL53L5CX_MotionFrame* frames, int32_t capacity)
+{
+	if ((_motion == nullptr) || (frames == nullptr) || (capacity <= 0))
+		return 0;
+	return (int32_t)((HID_VL53L5CX_Motion*)_motion)->read(frames, (uint32_t)capacity);
+}
+
+int32_t VL53L5CXSensor::readMotionEvents(VL53L5CX_MotionEvent* events, int32_t capacity)
+{
+	if ((_motion == nullptr) || (events == nullptr) || (capacity <= 0))
+		return 0;
+	return (int32_t)((HID_VL53L5CX_Motion*)_motion)->readEvents(events, (uint32_t)capacity);
+}
+
+bool VL53L5CXSensor::setGovernor(const VL53L5CX_GovernorConfig* config)
+{
+	// the acquisition thread uses it, a recording cannot change tiers, idle mode sleeps on its own
+	HID_VL53L5CX* psensor = (HID_VL53L5CX*)_vl53_sensor;
+	if ((_stream != nullptr) || (_replay != nullptr) || ((config != nullptr) && ((_idle != nullptr) || !HID_VL53L5CX_Governor::check(*config))))
+		return false;
+
+	// tiers of different resolutions would start these over with every change
+	if ((config != nullptr) && !HID_VL53L5CX_Governor::fixedResolution(*config) && ((_background != nullptr) || (_counter != nullptr)
+		|| (_range_roi.zone_mask != 0) || ((_presence != nullptr) && ((HID_VL53L5CX_Presence*)_presence)->explicitZones())))
+		return false;
+	if (_governor != nullptr)
+	{
+		if (!((HID_VL53L5CX_Governor*)_governor)->stop(psensor))
+			return false;
+		delete (HID_VL53L5CX_Governor*)_governor;
+		_governor = nullptr;
+	}
+	if (config == nullptr)
+		return true;
+	HID_VL53L5CX_Governor* governor = new HID_VL53L5CX_Governor(*config);
+	if (!governor->start(psensor))
+	{
+		delete governor;
+		return false;
+	}
+	_governor = governor;
+	return true;
+}
+
+bool VL53L5CXSensor::getGovernorStats(VL53L5CX_GovernorStats* stats)
+{
+	if ((_governor == nullptr) || (stats == nullptr))
+		return false;
+	((HID_VL53L5CX_Governor*)_governor)->stats(*stats);
+	return true;
+}
+
+bool VL53L5CXSensor::getZoneMotion(int32_t zone, VL53L5CX_ZoneMotion* motion)
+{
+	if ((_presence == nullptr) || (zone < 0) || (motion == nullptr))
+		return false;
+	return ((HID_VL53L5CX_Presence*)_presence)->motion((uint32_t)zone, *motion);
+}
+
+static_assert(sizeof(VL53L5CX_PresenceZone) == 40, "VL53L5CX_PresenceZone layout is part of the C ABI");
+static_assert(sizeof(VL53L5CX_PresenceEvent) == 16, "VL53L5CX_PresenceEvent layout is part of the C ABI");
+static_assert(sizeof(VL53L5CX_ZoneMotion) == 24, "VL53L5CX_ZoneMotion layout is part of the C ABI");
+static_assert(sizeof(VL53L5CX_TrackerConfig) == 32, "VL53L5CX_TrackerConfig layout is part of the C ABI");
+static_assert(sizeof(VL53L5CX_Track) == 40, "VL53L5CX_Track layout is part of the C ABI");
+static_assert(sizeof(VL53L5CX_BackgroundConfig) == 40, "VL53L5CX_BackgroundConfig layout is part of the C ABI");
+static_assert(sizeof(VL53L5CX_CounterConfig) == 40, "VL53L5CX_CounterConfig layout is part of the C ABI");
+static_assert(sizeof(VL53L5CX_Blob) == 40, "VL53L5CX_Blob layout is part of the C ABI");
+static_assert(sizeof(VL53L5CX_CrossingEvent) == 24, "VL53L5CX_CrossingEvent layout is part of the C ABI");
+static_assert(sizeof(VL53L5CX_IdleConfig) == 40, "VL53L5CX_IdleConfig layout is part of the C ABI");
+static_assert(sizeof(VL53L5CX_IdleStats) == 40, "VL53L5CX_IdleStats layout is part of the C ABI");
+static_assert(sizeof(VL53L5CX_MotionConfig) == 16, "VL53L5CX_MotionConfig layout is part of the C ABI");
+static_assert(sizeof(VL53L5CX_MotionFrame) == 152, "VL53L5CX_MotionFrame layout is part of the C ABI");
+static_assert(sizeof(VL53L5CX_MotionEvent) == 24, "VL53L5CX_MotionEvent layout is part of the C ABI");
+static_assert(sizeof(VL53L5CX_GovernorTier) == 8, "VL53L5CX_GovernorTier layout is part of the C ABI");
+static_assert(sizeof(VL53L5CX_GovernorWindow) == 8, "VL53L5CX_GovernorWindow layout is part of the C ABI");
+static_assert(sizeof(VL53L5CX_GovernorConfig) == 104, "VL53L5CX_GovernorConfig layout is part of the C ABI");
+static_assert(sizeof(VL53L5CX_GovernorStats) == 56, "VL53L5CX_GovernorStats layout is part of the C ABI");
+static_assert(sizeof(VL53L5CX_Filter) == 16, "VL53L5CX_Filter layout is part of the C ABI");
+static_assert(sizeof(VL53L5CX_Roi) == 24, "VL53L5CX_Roi layout is part of the C ABI");
+static_assert(sizeof(VL53L5CX_Frame) == 600, "VL53L5CX_Frame layout is part of the C ABI");
+
+/*
+* getFrame() -- copies the next frame into a caller provided VL53L5CX_Frame
+*
+* Zone i of the frame is zone i of the sensor (see getRange() for the 4x4 layout),
+* only the first 'resolution' entries of each array are valid.
+*/
+int32_t VL53L5CXSensor::getFrame(VL53L5CX_Frame* frame)
+{
+	if ((frame == nullptr) || (frame->version != VL53L5CX_FRAME_VERSION) || (frame->size != sizeof(VL53L5CX_Frame)))
+		return VL53L5CX_FRAME_BAD_VERSION;
+
+	// the acquisition thread owns the sensor while streaming
+	if (_stream != nullptr)
+		return (((HID_VL53L5CX_Stream*)_stream)->read(frame, 1, 0) == 1) ? VL53L5CX_FRAME_READY : VL53L5CX_FRAME_NOT_READY;
+
+	HID_VL53L5CX_Stages stages = frameStages(_filter, _presence, _tracker, _background, _counter, _motion, _idle, _governor);
+	return HID_VL53L5CX_Stream::readFrame((HID_VL53L5CX*)_vl53_sensor, frame, &stages);
+}
+
+bool VL53L5CXSensor::startStreaming(uint32_t queue_frames)
+{
+	// the frame callback cannot replace the stream it is called from
+	if ((_stream != nullptr) && ((HID_VL53L5CX_Stream*)_stream)->onAcquisitionThread())
+		return false;
+
+	stopStreaming();
+	HID_VL53L5CX_Stream* stream = new HID_VL53L5CX_Stream((HID_VL53L5CX*)_vl53_sensor, queue_frames, SensorPollRate,
+		(HID_VL53L5CX_ReplaySensor*)_replay, frameStages(_filter, _presence, _tracker, _background, _counter, _motion, _idle, _governor),
+		_frame_callback, _frame_callback_data, _frame_callback_every);
+	_stream = stream;
+	return true;
+}
+
+void VL53L5CXSensor::stopStreaming()
+{
+	HID_VL53L5CX_Stream* stream = (HID_VL53L5CX_Stream*)_stream;
+	if (stream == nullptr)
+		return;
+
+	// from the frame callback: no frame is read after it returns, the stream is deleted
+	// by the next stopStreaming() or startStreaming() on another thread
+	if (stream->onAcquisitionThread())
+	{
+		stream->requestStop();
+		return;
+	}
+
+	delete stream;
+	_stream = nullptr;
+}
+
+bool VL53L5CXSensor::setFrameCallback(VL53L5CX_FrameCallback callback, void* user_data, uint32_t every_n_frames)
+{
+	// kept for the next startStreaming()
+	_frame_callback = callback;
+	_frame_callback_data = user_data;
+	_frame_callback_every = every_n_frames;
+
+	HID_VL53L5CX_Stream* stream = (HID_VL53L5CX_Stream*)_stream;
+	if (stream != nullptr)
+		stream->setCallback(callback, user_data, every_n_frames);
+	return true;
+}
+
+/*
+* readFrames() -- drains the frames queued since the last call in one go
+*
+* Made for clients that wake up periodically: one call (and, from .NET, one
+* P/Invoke transition) returns everything the acquisition thread queued.
+*/
+int32_t VL53L5CXSensor::readFrames(VL53L5CX_Frame* frames, int32_t capacity, int32_t* count, uint32_t timeout_ms)
+{
+	if (count != nullptr)
+		*count = 0;
+	if ((frames == nullptr) || (capacity <= 0) || (count == nullptr))
+		return VL53L5CX_FRAME_ERROR;
+	if ((frames->version != VL53L5CX_FRAME_VERSION) || (frames->size != sizeof(VL53L5CX_Frame)))
+		return VL53L5CX_FRAME_BAD_VERSION;
+	if (_stream == nullptr)
+		return VL53L5CX_FRAME_ERROR;
+
+	*count = (int32_t)((HID_VL53L5CX_Stream*)_stream)->read(frames, (uint32_t)capacity, timeout_ms);
+	return (*count > 0) ? VL53L5CX_FRAME_READY : VL53L5CX_FRAME_NOT_READY;
+}
+
 /*
-* getRange() -- returns the average distance detected
+* getRange() -- returns the distance detected in the range ROI
 * 
 * In 4x4 mode there are 16 separate zones arranged as follows:
 *  
@@ -67,78 +631,96 @@ bool VL53L5CXSensor::isDataReady()
 *
 * If the sensor is arraged as described in the manual.
 * 
-* For our use we probably only want to look at the inner 
-* 4-zones: 5, 6, 9, 10
-* which correspond to the active center of the sensor 
+* By default (setRangeRoi(nullptr)) we only look at the inner
+* 4-zones: 5, 6, 9, 10, or the inner 16 zones in 8x8 mode,
+* which correspond to the active center of the sensor.
+* Returns 0 if no zone is valid, the frame could not be read or the
+* governor keeps the sensor asleep.
 */
 double VL53L5CXSensor::getRange()
 {
-	VL53L5CX_ResultsData 	Results;		/* Results data from VL53L5CX */
+	VL53L5CX_Frame frame;
 	double avg = 0;
 
-    //((HID_VL53L5CX *)_vl53_sensor)->startRanging();
+	// the acquisition thread owns the sensor, the newest frame it read stands in for a new one
+	if (_stream != nullptr)
+	{
+		if (((HID_VL53L5CX_Stream*)_stream)->latest(frame))
+			avg = HID_VL53L5CX_Roi::reduce(frame, HID_VL53L5CX_Roi::validZones(frame, _range_roi), _range_roi.reduction);
+		return(avg);
+	}
+
+	// every frame, asleep it would wait for the next person. The governor wakes up on its own,
+	// but a caller must not wait for its next probe
+	HID_VL53L5CX_Stages stages = frameStages(_filter, _presence, _tracker, _background, _counter, _motion, nullptr, _governor);
 
-    uint8_t loop = 0;
-    while (loop < 1)    // if ranging is disabled this needs to be at least 2 
+    while (true)
     {
         /* Use polling function to know when a new measurement is ready.
          * Another way can be to wait for HW interrupt raised on PIN A3
          * (GPIO 1) when a new measurement is ready */
-        if (((HID_VL53L5CX*)_vl53_sensor)->isDataReady() == true)      // poll on sensor this is non-blocking!
+        int32_t result = HID_VL53L5CX_Stream::readFrame((HID_VL53L5CX*)_vl53_sensor, &frame, &stages);     // non-blocking!
+        if (result == VL53L5CX_FRAME_READY)
         {
-            if (((HID_VL53L5CX*)_vl53_sensor)->getRangingData(&Results))
+            uint64_t zones = HID_VL53L5CX_Roi::validZones(frame, _range_roi);
+            if (HID_VL53L5CX_Log::enabled(HID_VL53L5CX_LOG_LEVEL::VERBOSE))
             {
-                double sum = 0;
-                uint8_t valid_count = 0;
-                /* As the sensor is set in 4x4 mode by default, we have a total
-                 * of 16 zones to examine but we only care about center zones: 5, 6, 9, 10
-                 */
-                int zones[] = { 5, 6, 9, 10 };
-                for (int i : zones)
-                //for (int i = 0; i < 16; i++)
+                uint64_t selected = (_range_roi.zone_mask != 0) ? _range_roi.zone_mask : HID_VL53L5CX_Roi::centerZones(frame.resolution);
+                for (uint32_t i = 0; i < frame.resolution; i++)
                 {
-                    printf("Zone : %3d, Status : %3u, Distance : %4d mm\n",
-                            i,
-                            Results.target_status[VL53L5CX_NB_TARGET_PER_ZONE * i],
-                            Results.distance_mm[VL53L5CX_NB_TARGET_PER_ZONE * i]);
-
-                    // if status = 5 (distance is valid) 
-                    //          AND 
-                    // distance is at least 10mm but < 1219 mm (~4ft) then add it to the average value
-                    if ((Results.target_status[VL53L5CX_NB_TARGET_PER_ZONE * i] == 5) &&
-                        ((Results.distance_mm[VL53L5CX_NB_TARGET_PER_ZONE * i] > 10) &&
-                        (Results.distance_mm[VL53L5CX_NB_TARGET_PER_ZONE * i] < 1200))
-                        )
-                    {
-                        sum += Results.distance_mm[VL53L5CX_NB_TARGET_PER_ZONE * i];
-                        ++valid_count;
-                    }
-                }
-                printf("\n");
-                if (valid_count) {
-                    avg = sum / valid_count;
-                    printf("Avg Distance for %u valid values: %g mm\n", valid_count, avg);
-                }
-                else {
-                    printf("Nothing present\n");
-                    avg = 0;
+                    if (selected & (1ULL << i))
+                        HID_VL53L5CX_LOG(VERBOSE, "Zone : %3u, Status : %3u, Distance : %4d mm", i, frame.target_status[i], frame.distance_mm[i]);
                 }
-                loop++;
             }
+
+            avg = HID_VL53L5CX_Roi::reduce(frame, zones, _range_roi.reduction);
+            if (zones != 0) {
+                HID_VL53L5CX_LOG(VERBOSE, "Avg Distance for %u valid values: %g mm", (uint32_t)HID_VL53L5CX_Roi::zoneCount(zones), avg);
+            }
+            else {
+                HID_VL53L5CX_LOG(VERBOSE, "Nothing present");
+            }
+            break;
         }
 
-        /* Wait a few ms to avoid too high polling */
-        Sleep(SensorPollRate);
-    }
+        /* The failure went to the error callback and counters already, polling would not end on a dead bus */
+        if (result == VL53L5CX_FRAME_ERROR)
+            break;
 
-    //((HID_VL53L5CX *)_vl53_sensor)->stopRanging();
+        /* Nothing is read while the governor keeps the sensor asleep, the lane was empty */
+        if (_governor && ((HID_VL53L5CX_Governor*)_governor)->asleep())
+            break;
+
+        /* A replayed recording that ran out of frames never becomes ready again */
+        if (_replay && ((HID_VL53L5CX_ReplaySensor*)_replay)->exhausted())
+            break;
+
+        /* Wait a few ms to avoid too high polling. Sleep() would round this up to the scheduler tick */
+        ((HID_VL53L5CX*)_vl53_sensor)->clock->sleepMs(SensorPollRate);
+    }
 
     return(avg);
 
 }
 
 extern "C" SENSOR_API void* Instantiate(uint8_t i2c_address) {
-    return (void*) new VL53L5CXSensor(i2c_address);
+    try {
+        return (void*) new VL53L5CXSensor(i2c_address);
+    }
+    catch (const std::exception& e) {
+        HID_VL53L5CX_LOG(FAILURE, "Instantiate: %s", e.what());
+        return nullptr;
+    }
+}
+
+extern "C" SENSOR_API void* InstantiateReplay(const char* recording_path, uint8_t replay_mode) {
+    try {
+        return (void*) new VL53L5CXSensor(recording_path, replay_mode);
+    }
+    catch (const std::exception& e) {
+        HID_VL53L5CX_LOG(FAILURE, "InstantiateReplay: %s", e.what());
+        return nullptr;
+    }
 }
 
 extern "C" SENSOR_API void Conclude(VL53L5CXSensor* t) {
@@ -161,3 +743,189 @@ extern "C" SENSOR_API bool isDataReady(VL53L5CXSensor* t) {
 extern "C" SENSOR_API double getRange(VL53L5CXSensor* t) {
     return t->getRange();
 }
+
+extern "C" SENSOR_API int32_t getFrame(VL53L5CXSensor* t, VL53L5CX_Frame* frame) {
+    return t->getFrame(frame);
+}
+
+extern "C" SENSOR_API bool setRangeRoi(VL53L5CXSensor* t, const VL53L5CX_Roi* roi) {
+    return t->setRangeRoi(roi);
+}
+
+extern "C" SENSOR_API bool setZoneFilter(VL53L5CXSensor* t, const VL53L5CX_Filter* filter) {
+    return t->setZoneFilter(filter);
+}
+
+extern "C" SENSOR_API bool setPresenceZones(VL53L5CXSensor* t, const VL53L5CX_PresenceZone* zones, int32_t count) {
+    return t->setPresenceZones(zones, count);
+}
+
+extern "C" SENSOR_API bool setPresenceCallback(VL53L5CXSensor* t, VL53L5CX_PresenceCallback callback, void* user_data) {
+    return t->setPresenceCallback(callback, user_data);
+}
+
+extern "C" SENSOR_API int32_t readPresenceEvents(VL53L5CXSensor* t, VL53L5CX_PresenceEvent* events, int32_t capacity) {
+    return t->readPresenceEvents(events, capacity);
+}
+
+extern "C" SENSOR_API uint32_t getPresenceState(VL53L5CXSensor* t) {
+    return t->getPresenceState();
+}
+
+extern "C" SENSOR_API bool getZoneMotion(VL53L5CXSensor* t, int32_t zone, VL53L5CX_ZoneMotion* motion) {
+    return t->getZoneMotion(zone, motion);
+}
+
+extern "C" SENSOR_API bool setTracker(VL53L5CXSensor* t, const VL53L5CX_TrackerConfig* config) {
+    return t->setTracker(config);
+}
+
+extern "C" SENSOR_API int32_t getTracks(VL53L5CXSensor* t, VL53L5CX_Track* tracks, int32_t capacity) {
+    return t->getTracks(tracks, capacity);
+}
+
+extern "C" SENSOR_API int32_t getTargetsPerZone(VL53L5CXSensor* t) {
+    (void)t;
+    return (int32_t)VL53L5CX_NB_TARGET_PER_ZONE;
+}
+
+extern "C" SENSOR_API bool setBackground(VL53L5CXSensor* t, const VL53L5CX_BackgroundConfig* config) {
+    return t->setBackground(config);
+}
+
+extern "C" SENSOR_API bool getForeground(VL53L5CXSensor* t, uint64_t* foreground) {
+    return t->getForeground(foreground);
+}
+
+extern "C" SENSOR_API bool saveBackground(VL53L5CXSensor* t, const char* path) {
+    return t->saveBackground(path);
+}
+
+extern "C" SENSOR_API bool loadBackground(VL53L5CXSensor* t, const char* path) {
+    return t->loadBackground(path);
+}
+
+extern "C" SENSOR_API bool setCounter(VL53L5CXSensor* t, const VL53L5CX_CounterConfig* config) {
+    return t->setCounter(config);
+}
+
+extern "C" SENSOR_API bool getCrossingCounts(VL53L5CXSensor* t, uint64_t* forward, uint64_t* backward) {
+    return t->getCrossingCounts(forward, backward);
+}
+
+extern "C" SENSOR_API int32_t readCrossingEvents(VL53L5CXSensor* t, VL53L5CX_CrossingEvent* events, int32_t capacity) {
+    return t->readCrossingEvents(events, capacity);
+}
+
+extern "C" SENSOR_API int32_t getBlobs(VL53L5CXSensor* t, VL53L5CX_Blob* blobs, int32_t capacity) {
+    return t->getBlobs(blobs, capacity);
+}
+
+extern "C" SENSOR_API bool setIdleMode(VL53L5CXSensor* t, const VL53L5CX_IdleConfig* config) {
+    return t->setIdleMode(config);
+}
+
+extern "C" SENSOR_API bool getIdleStats(VL53L5CXSensor* t, VL53L5CX_IdleStats* stats) {
+    return t->getIdleStats(stats);
+}
+
+extern "C" SENSOR_API bool setMotionIndicator(VL53L5CXSensor* t, const VL53L5CX_MotionConfig* config) {
+    return t->setMotionIndicator(config);
+}
+
+extern "C" SENSOR_API bool getMotion(VL53L5CXSensor* t, VL53L5CX_MotionFrame* motion) {
+    return t->getMotion(motion);
+}
+
+extern "C" SENSOR_API int32_t readMotionFrames(VL53L5CXSensor* t, VL53L5CX_MotionFrame* frames, int32_t capacity) {
+    return t->readMotionFrames(frames, capacity);
+}
+
+extern "C" SENSOR_API int32_t readMotionEvents(VL53L5CXSensor* t, VL53L5CX_MotionEvent* events, int32_t capacity) {
+    return t->readMotionEvents(events, capacity);
+}
+
+extern "C" SENSOR_API bool setGovernor(VL53L5CXSensor* t, const VL53L5CX_GovernorConfig* config) {
+    return t->setGovernor(config);
+}
+
+extern "C" SENSOR_API bool getGovernorStats(VL53L5CXSensor* t, VL53L5CX_GovernorStats* stats) {
+    return t->getGovernorStats(stats);
+}
+
+extern "C" SENSOR_API int32_t evaluateRois(const VL53L5CX_Frame* frame, const VL53L5CX_Roi* rois, int32_t count, double* distances_mm, uint8_t* valid_zones) {
+    if ((frame == nullptr) || (rois == nullptr) || (count < 0) || (distances_mm == nullptr))
+        return VL53L5CX_FRAME_ERROR;
+    if ((frame->version != VL53L5CX_FRAME_VERSION) || (frame->size != sizeof(VL53L5CX_Frame)))
+        return VL53L5CX_FRAME_BAD_VERSION;
+    HID_VL53L5CX_Roi::evaluate(*frame, rois, (uint32_t)count, distances_mm, valid_zones);
+    return count;
+}
+
+extern "C" SENSOR_API bool startStreaming(VL53L5CXSensor* t, uint32_t queue_frames) {
+    return t->startStreaming(queue_frames);
+}
+
+extern "C" SENSOR_API void stopStreaming(VL53L5CXSensor* t) {
+    t->stopStreaming();
+}
+
+extern "C" SENSOR_API int32_t readFrames(VL53L5CXSensor* t, VL53L5CX_Frame* frames, int32_t capacity, int32_t* count, uint32_t timeout_ms) {
+    return t->readFrames(frames, capacity, count, timeout_ms);
+}
+
+extern "C" SENSOR_API bool setFrameCallback(VL53L5CXSensor* t, VL53L5CX_FrameCallback callback, void* user_data, uint32_t every_n_frames) {
+    return t->setFrameCallback(callback, user_data, every_n_frames);
+}
+
+extern "C" SENSOR_API bool startRecording(VL53L5CXSensor* t, const char* path, bool raw) {
+    return t->startRecording(path, raw);
+}
+
+extern "C" SENSOR_API void stopRecording(VL53L5CXSensor* t) {
+    t->stopRecording();
+}
+
+extern "C" SENSOR_API bool replayStep(VL53L5CXSensor* t, uint32_t frames) {
+    return t->replayStep(frames);
+}
+
+extern "C" SENSOR_API bool setTimeouts(VL53L5CXSensor* t, uint32_t operation_ms, uint32_t frame_percent) {
+    return t->setTimeouts(operation_ms, frame_percent);
+}
+
+extern "C" SENSOR_API bool setErrorCallback(VL53L5CXSensor* t, VL53L5CX_ErrorCallback callback, void* user_data) {
+    return t->setErrorCallback(callback, user_data);
+}
+
+extern "C" SENSOR_API bool getLastError(VL53L5CXSensor* t, uint8_t* error_code, uint32_t* error_value) {
+    return t->getLastError(error_code, error_value);
+}
+
+extern "C" SENSOR_API uint64_t getErrorCount(VL53L5CXSensor* t, uint8_t error_code) {
+    return t->getErrorCount(error_code);
+}
+
+extern "C" SENSOR_API bool getMetricsName(VL53L5CXSensor* t, char* buffer, uint32_t size) {
+    return t->getMetricsName(buffer, size);
+}
+
+extern "C" SENSOR_API void setLogLevel(uint8_t level) {
+    HID_VL53L5CX_Log::setLevel((HID_VL53L5CX_LOG_LEVEL)level);
+}
+
+extern "C" SENSOR_API void setLogSink(VL53L5CX_LogCallback sink) {
+    HID_VL53L5CX_Log::setSink(sink);
+}
+
+extern "C" SENSOR_API void startTrace() {
+    HID_VL53L5CX_Trace::start();
+}
+
+extern "C" SENSOR_API void stopTrace() {
+    HID_VL53L5CX_Trace::stop();
+}
+
+extern "C" SENSOR_API bool saveTrace(const char* path) {
+    return HID_VL53L5CX_Trace::writeChromeTrace(path);
+}
@@ -2,36 +2,659 @@
 
 #include <cstdint>
 
-#ifdef VL53L5CXSENSOR_EXPORTS
+#if !defined(_WIN32)
+#define SENSOR_API
+#elif defined(VL53L5CXSENSOR_EXPORTS)
 #define SENSOR_API __declspec(dllexport)
 #else
 #define SENSOR_API __declspec(dllimport)
 #endif
 
+// Full ranging frame for the C ABI, filled by getFrame(). The layout is fixed (natural
+// alignment, no padding) so .NET can pass it by reference without marshalling. The caller
+// sets version and size, any layout change bumps VL53L5CX_FRAME_VERSION.
+#define VL53L5CX_FRAME_VERSION		1
+#define VL53L5CX_FRAME_MAX_ZONES	64
+
+typedef struct
+{
+	uint32_t version;					// VL53L5CX_FRAME_VERSION
+	uint32_t size;						// sizeof(VL53L5CX_Frame)
+	uint64_t timestamp_ns;				// monotonic driver clock when the frame was read
+	uint8_t stream_count;				// sensor frame counter, 0..254
+	uint8_t resolution;					// valid zones: 16 (4x4) or 64 (8x8)
+	int8_t silicon_temp_degc;
+	uint8_t reserved0;
+	int16_t distance_mm[VL53L5CX_FRAME_MAX_ZONES];
+	uint16_t range_sigma_mm[VL53L5CX_FRAME_MAX_ZONES];
+	uint32_t signal_per_spad[VL53L5CX_FRAME_MAX_ZONES];	// kcps/spad
+	uint8_t target_status[VL53L5CX_FRAME_MAX_ZONES];	// 5 and 9 mean a valid distance
+	uint8_t reserved1[4];
+} VL53L5CX_Frame;
+
+// Region of interest of a frame for evaluateRois() and getRange(): the zones it covers, which of
+// their targets count and how the valid distances reduce to one. Fixed layout like VL53L5CX_Frame.
+#define VL53L5CX_ROI_MEAN			0
+#define VL53L5CX_ROI_MIN			1	// closest target
+#define VL53L5CX_ROI_MEDIAN			2
+#define VL53L5CX_ROI_SIGNAL_WEIGHTED	3	// mean weighted by signal_per_spad
+
+typedef struct
+{
+	uint64_t zone_mask;					// bit i = zone i, 0 = the center zones of the frame resolution
+	uint32_t status_mask;				// bit s accepts target_status s, e.g. (1 << 5) | (1 << 9)
+	uint32_t min_signal;				// kcps/spad, at least
+	int16_t min_distance_mm;			// distances strictly between min and max count
+	int16_t max_distance_mm;
+	uint16_t max_sigma_mm;				// range_sigma_mm, at most
+	uint8_t reduction;					// VL53L5CX_ROI_...
+	uint8_t outlier_cm;					// zones farther than this from the median of their 3x3 neighbours
+										// that pass the rules do not count, 0 = no outlier check
+} VL53L5CX_Roi;
+
+// Temporal filter of the zone distances for setZoneFilter(), fixed layout like VL53L5CX_Frame. It
+// replaces the distance of every valid zone by a filtered one, zones with another status keep theirs.
+#define VL53L5CX_FILTER_NONE		0
+#define VL53L5CX_FILTER_EMA			1	// exponential moving average
+#define VL53L5CX_FILTER_MEDIAN		2	// median of the last window_frames frames
+#define VL53L5CX_FILTER_KALMAN		3	// constant velocity, range_sigma_mm is the measurement noise
+
+typedef struct
+{
+	uint8_t type;						// VL53L5CX_FILTER_...
+	uint8_t window_frames;				// MEDIAN: odd, 3..9
+	uint16_t reserved;
+	uint32_t status_mask;				// targets that update a zone like VL53L5CX_Roi, 0 = status 5 and 9
+	float ema_alpha;					// EMA: weight of the new distance, 0 < alpha <= 1
+	float kalman_accel_mm_s2;			// KALMAN: process noise, expected acceleration of a target
+} VL53L5CX_Filter;
+
+// Presence zone for setPresenceZones(): an ROI whose distance decides whether someone is there. Fixed layout
+// like VL53L5CX_Frame. It becomes occupied after enter_frames frames in a row closer than enter_mm and free
+// again after exit_frames frames in a row farther than exit_mm (or with no valid zone), but not before it was
+// occupied for min_dwell_frames. Distances between enter_mm and exit_mm keep the state (hysteresis).
+// The range rate is the least squares slope of the distances of the last rate_frames frames, from it the
+// time until the distance reaches trigger_mm is predicted (see getZoneMotion()).
+#define VL53L5CX_PRESENCE_MAX_ZONES	8
+#define VL53L5CX_PRESENCE_MAX_RATE_FRAMES	32
+
+typedef struct
+{
+	VL53L5CX_Roi roi;
+	int16_t enter_mm;
+	int16_t exit_mm;					// at least enter_mm
+	uint16_t enter_frames;				// 0 counts as 1
+	uint16_t exit_frames;				// 0 counts as 1
+	uint16_t min_dwell_frames;
+	int16_t trigger_mm;					// distance the arrival is predicted for, 0 = enter_mm
+	uint8_t rate_frames;				// 3..VL53L5CX_PRESENCE_MAX_RATE_FRAMES, 0 = 8
+	uint8_t reserved;
+	uint16_t arrival_ms;				// ARRIVING event once the predicted arrival is this close, 0 = none
+} VL53L5CX_PresenceZone;
+
+#define VL53L5CX_PRESENCE_LEFT		0
+#define VL53L5CX_PRESENCE_ENTERED	1
+#define VL53L5CX_PRESENCE_ARRIVING	2	// approaching, predicted to reach trigger_mm within arrival_ms
+
+// Range rate of a presence zone, see getZoneMotion(). Approaching means closing in faster than 100 mm/s.
+#define VL53L5CX_MOTION_UNKNOWN		0	// fewer than 3 frames with a valid distance
+#define VL53L5CX_MOTION_STATIONARY	1
+#define VL53L5CX_MOTION_APPROACHING	2
+#define VL53L5CX_MOTION_LEAVING		3
+
+typedef struct
+{
+	uint64_t timestamp_ns;				// newest frame of the fit
+	float distance_mm;					// fitted distance at that time
+	float velocity_mm_s;				// range rate, negative while approaching
+	float arrival_s;					// predicted time until trigger_mm is reached, 0 if closer, -1 if not approaching
+	uint8_t motion;						// VL53L5CX_MOTION_...
+	uint8_t samples;					// frames in the fit
+	uint8_t reserved[2];
+} VL53L5CX_ZoneMotion;
+
+typedef struct
+{
+	uint64_t timestamp_ns;				// of the frame that decided, see VL53L5CX_Frame
+	uint16_t zone;						// index into the zones of setPresenceZones()
+	uint8_t type;						// VL53L5CX_PRESENCE_...
+	uint8_t reserved;
+	float distance_mm;					// ROI distance of that frame, 0 if no zone was valid
+} VL53L5CX_PresenceEvent;
+
+// Target tracker for setTracker(), fixed layout like VL53L5CX_Frame. It follows every target of every zone
+// (up to VL53L5CX_NB_TARGET_PER_ZONE of the build, see getTargetsPerZone()) across frames, so a person behind a
+// glass panel or behind someone else is tracked too. Targets that pass the rules of roi become detections; a
+// track takes those of the zones it covered and their neighbours within gate_mm of its predicted distance,
+// neighbouring detections left over within gate_mm of each other start a new track.
+#define VL53L5CX_TRACKER_MAX_TRACKS	16
+
+typedef struct
+{
+	VL53L5CX_Roi roi;					// zones (0 = all of them) and rules of the targets, reduction unused
+	uint16_t gate_mm;					// 0 = 300
+	uint8_t min_zones;					// zones a new track needs, 0 = 1
+	uint8_t confirm_frames;				// frames with targets before a track is reported, 0 = 2
+	uint8_t max_misses;					// frames without targets before a track ends, 0 = 5
+	uint8_t reserved[3];
+} VL53L5CX_TrackerConfig;
+
+typedef struct
+{
+	uint64_t zone_mask;					// zones of its targets in the last frame that had any
+	uint32_t id;						// 1, 2, ... never reused while the tracker lives
+	uint32_t age_frames;				// since the track started
+	float distance_mm;					// smoothed
+	float velocity_mm_s;				// range rate, negative while approaching
+	float column;						// centroid of zone_mask in zones, column 0 and row 0 hold zone 0
+	float row;
+	uint8_t zones;						// zones in zone_mask
+	uint8_t misses;						// frames in a row without targets, the distance is predicted meanwhile
+	uint8_t reserved[6];
+} VL53L5CX_Track;
+
+// Background depth model for setBackground(), fixed layout like VL53L5CX_Frame. It keeps the running mean and
+// variance of the distance of every zone of the empty lane. A zone whose target passes the rules of roi and is
+// closer than its mean by margin_mm and by sigma_tenths / 10 standard deviations is foreground. Frames without
+// foreground update the statistics, over a window of the last adapt_frames of them; without a model the first
+// learn_frames frames are taken as empty. Zones that had no valid target see through to max_distance_mm.
+typedef struct
+{
+	VL53L5CX_Roi roi;					// zones (0 = all of them) and rules of the targets, reduction unused
+	int16_t margin_mm;					// 0 = 300
+	uint16_t learn_frames;				// frames learned from without a model, the lane must be empty, 0 = 15
+	uint16_t adapt_frames;				// window of the statistics, 0 = 900 (a minute at 15 Hz)
+	uint8_t sigma_tenths;				// 0 = 30, three standard deviations
+	uint8_t reserved[9];
+} VL53L5CX_BackgroundConfig;
+
+// People counter for setCounter(), fixed layout like VL53L5CX_Frame. The foreground of the background model
+// (setBackground(), or one made of roi, margin_mm and learn_frames if there is none) within the zones of roi
+// is segmented, neighbouring foreground zones are one blob. Blobs are tracked by their centroid and count a
+// crossing when they move from one side of the counting line to the other.
+#define VL53L5CX_COUNTER_MAX_BLOBS		8
+#define VL53L5CX_COUNTER_ACROSS_ROWS	0	// people walk from row to row, the line runs along a row
+#define VL53L5CX_COUNTER_ACROSS_COLUMNS	1	// people walk from column to column
+
+typedef struct
+{
+	VL53L5CX_Roi roi;					// zones (0 = all of them) and rules of the targets, reduction unused
+	int16_t margin_mm;					// background without setBackground(), see VL53L5CX_BackgroundConfig
+	uint16_t learn_frames;
+	uint8_t axis;						// VL53L5CX_COUNTER_ACROSS_...
+	uint8_t line_percent;				// position of the line across the field of view, 0 = 50
+	uint8_t min_zones;					// zones a blob needs, 0 = 1
+	uint8_t gate_zones;					// farthest a blob moves from its predicted position per frame, 0 = 2
+	uint8_t max_misses;					// frames a blob may be missing before its track ends, 0 = 3
+	uint8_t reserved[7];
+} VL53L5CX_CounterConfig;
+
+#define VL53L5CX_CROSSING_FORWARD	0	// towards higher rows (columns)
+#define VL53L5CX_CROSSING_BACKWARD	1
+
+typedef struct
+{
+	uint64_t zone_mask;					// zones of the blob in the last frame it was seen
+	uint32_t id;						// 1, 2, ... never reused while the counter lives
+	uint32_t age_frames;				// since the track started
+	float column;						// centroid in zones, column 0 and row 0 hold zone 0
+	float row;
+	float distance_mm;					// closest zone of the blob, e.g. the head under a ceiling sensor
+	float speed_zones_s;				// along the counting axis, positive towards the forward side
+	uint8_t zones;						// zones in zone_mask
+	uint8_t misses;						// frames in a row not seen, the position is predicted meanwhile
+	int8_t side;						// of the line: 1 forward, -1 backward, 0 on it
+	uint8_t reserved[5];
+} VL53L5CX_Blob;
+
+typedef struct
+{
+	uint64_t timestamp_ns;				// of the frame the blob crossed in
+	uint32_t id;						// of the blob, see VL53L5CX_Blob
+	uint8_t direction;					// VL53L5CX_CROSSING_...
+	uint8_t zones;						// of the blob in that frame
+	uint16_t reserved;
+	float distance_mm;					// closest zone of the blob in that frame
+	uint32_t age_frames;				// of the blob
+} VL53L5CX_CrossingEvent;
+
+// Wake-on-approach idle mode for setIdleMode(), fixed layout like VL53L5CX_Frame. The sensor gets one detection
+// threshold per zone of roi (a distance window of min_distance_mm to max_distance_mm) and only raises INT for frames
+// with a target in it. Meanwhile the host reads no frames at all, it only polls the INT latch of the bridge. INT
+// wakes it up to full streaming; once the lane is empty for rearm_frames frames it goes back to sleep.
+typedef struct
+{
+	VL53L5CX_Roi roi;					// zones (0 = the center zones) and distance window, the rules tell an empty lane
+	uint16_t rearm_frames;				// empty frames before sleeping again, 0 = 30
+	uint16_t poll_ms;					// INT latch poll period while sleeping, 0 = 50
+	uint8_t reserved[12];
+} VL53L5CX_IdleConfig;
+
+typedef struct
+{
+	uint64_t wakeups;					// INT woke the host up
+	uint64_t idle_ms;					// time asleep, no frames read
+	uint64_t active_ms;					// time awake, every frame read
+	uint64_t latch_polls;				// INT latch polls, no I2C transaction
+	uint8_t idle;						// 1 while asleep
+	uint8_t reserved[7];
+} VL53L5CX_IdleStats;
+
+// Motion indicator for setMotionIndicator(), fixed layout like VL53L5CX_Frame. The sensor firmware compares the
+// histograms of every zone between frames within the distance window and reports a motion score per aggregate
+// of zones (16 of them, a 2x2 block of zones at 8x8, one zone at 4x4) with every frame; the host does no frame
+// differencing. An aggregate is in motion when its score reaches threshold, a frame when min_aggregates of them
+// are. start_frames such frames in a row start a motion event, stop_frames frames without motion end it.
+typedef struct
+{
+	uint16_t min_distance_mm;			// 400 to 4000, 0 = 400
+	uint16_t max_distance_mm;			// at most 1500 beyond min_distance_mm and 4000, 0 = 1500
+	uint32_t threshold;					// score of an aggregate in motion, 0 = 44 (the firmware default)
+	uint8_t min_aggregates;				// aggregates in motion for a frame with motion, 0 = 1
+	uint8_t start_frames;				// frames with motion in a row before VL53L5CX_MOTION_EVENT_STARTED, 0 = 2
+	uint8_t stop_frames;				// frames without motion in a row before VL53L5CX_MOTION_EVENT_STOPPED, 0 = 15
+	uint8_t reserved[5];
+} VL53L5CX_MotionConfig;
+
+#define VL53L5CX_MOTION_AGGREGATES	32
+
+typedef struct
+{
+	uint64_t timestamp_ns;				// of the frame, see VL53L5CX_Frame
+	uint32_t global_indicator_1;		// firmware global indicators, as reported
+	uint32_t global_indicator_2;
+	uint8_t status;						// firmware status of the motion results
+	uint8_t detected_aggregates;		// aggregates over the firmware detection threshold
+	uint8_t aggregates;					// entries of motion[] that are used
+	uint8_t moving;						// 1 while a motion event is open
+	uint32_t motion_mask;				// bit i: motion[i] reached threshold
+	uint32_t motion[VL53L5CX_MOTION_AGGREGATES];	// score per aggregate
+} VL53L5CX_MotionFrame;
+
+#define VL53L5CX_MOTION_EVENT_STOPPED	0
+#define VL53L5CX_MOTION_EVENT_STARTED	1
+
+typedef struct
+{
+	uint64_t timestamp_ns;				// of the frame the event was decided in
+	uint32_t peak;						// highest score since the motion started
+	uint32_t duration_ms;				// since the motion started, 0 for VL53L5CX_MOTION_EVENT_STARTED
+	uint8_t type;						// VL53L5CX_MOTION_EVENT_...
+	uint8_t aggregates;					// in motion in that frame
+	uint8_t reserved[6];
+} VL53L5CX_MotionEvent;
+
+// Power and frame rate governor for setGovernor(), fixed layout like VL53L5CX_Frame. The sensor moves between up to
+// four tiers, lowest power first, with the occupancy of the lane: occupied it goes to occupied_tier (to the top
+// tier after detail_ms), empty for hold_ms of its tier it steps down one. Tier 0 may be a sleep tier: no ranging,
+// the sensor in its low power mode, woken every hold_ms into tier 1 for probe_ms to look at the lane. Windows of
+// the day bound the tiers, e.g. sleep only at night.
+#define VL53L5CX_GOVERNOR_TIERS		4
+#define VL53L5CX_GOVERNOR_WINDOWS	4
+
+typedef struct
+{
+	uint8_t resolution;					// 16 or 64, 0 = sleep (tier 0 only)
+	uint8_t frequency_hz;				// 1 to 60 at 4x4, 1 to 15 at 8x8
+	uint8_t autonomous;					// 1 = autonomous ranging, the sensor integrates integration_ms per frame
+	uint8_t reserved;
+	uint16_t integration_ms;			// autonomous only, 2 to 1000 and below the frame period, 0 = 5
+	uint16_t hold_ms;					// empty lane before stepping down, 0 = 5000; sleep: until the next probe, 0 = 2000
+} VL53L5CX_GovernorTier;
+
+typedef struct
+{
+	uint16_t start_minute;				// local time, minutes after midnight
+	uint16_t end_minute;				// exclusive, below start_minute the window spans midnight
+	uint8_t lowest_tier;				// tiers the governor may use within the window
+	uint8_t highest_tier;
+	uint8_t reserved[2];
+} VL53L5CX_GovernorWindow;
+
+typedef struct
+{
+	VL53L5CX_GovernorTier tiers[VL53L5CX_GOVERNOR_TIERS];		// lowest power first
+	VL53L5CX_GovernorWindow windows[VL53L5CX_GOVERNOR_WINDOWS];	// the first one holding the time applies, none: all tiers
+	VL53L5CX_Roi roi;					// without presence zones a zone of it with a valid target is an occupied lane
+	uint8_t tier_count;					// 1 to VL53L5CX_GOVERNOR_TIERS
+	uint8_t window_count;				// 0 to VL53L5CX_GOVERNOR_WINDOWS
+	uint8_t occupied_tier;				// tier of an occupied lane, not the sleep tier
+	uint8_t reserved0;
+	uint16_t detail_ms;					// occupied this long moves to the top tier, 0 = never
+	uint16_t probe_ms;					// tier 1 time after a sleep, 0 = 1000
+	uint8_t reserved[8];
+} VL53L5CX_GovernorConfig;
+
+typedef struct
+{
+	uint64_t tier_ms[VL53L5CX_GOVERNOR_TIERS];	// time spent in each tier
+	uint64_t switch_ms;					// time the tier changes took, stopping and starting ranging included
+	uint32_t switches;					// tier changes
+	uint32_t failures;					// tier changes the sensor refused, the tier was kept
+	uint8_t tier;						// current tier
+	uint8_t sleeping;					// 1 while the sensor sleeps
+	uint8_t reserved[6];
+} VL53L5CX_GovernorStats;
+
+// getFrame() results
+#define VL53L5CX_FRAME_READY		1	// frame filled
+#define VL53L5CX_FRAME_NOT_READY	0	// no new frame since the last call, frame untouched
+#define VL53L5CX_FRAME_BAD_VERSION	(-1)	// version or size not supported
+#define VL53L5CX_FRAME_ERROR		(-2)	// the frame could not be read
+
+// Called by the acquisition thread with a frame that is only valid during the call, see setFrameCallback()
+typedef void (*VL53L5CX_FrameCallback)(const VL53L5CX_Frame* frame, void* user_data);
+
+// Called by the thread that read the frame (the acquisition thread while streaming) with an event that is only
+// valid during the call, see setPresenceCallback()
+typedef void (*VL53L5CX_PresenceCallback)(const VL53L5CX_PresenceEvent* event, void* user_data);
+
+// Called by the thread whose call failed with the SF_VL53L5CX_ERROR_TYPE (HID_VL53L5CX_Constants.h) and the
+// ULD or FT260 status, see setErrorCallback(). Must not throw or call back into the sensor.
+typedef void (*VL53L5CX_ErrorCallback)(uint8_t error_code, uint32_t error_value, void* user_data);
+
 class VL53L5CXSensor {
 private:
 	void* _vl53_sensor;
+	void* _replay = nullptr;			// HID_VL53L5CX_ReplaySensor when replaying a recording
+	void* _replay_clock = nullptr;
+	void* _stream = nullptr;			// HID_VL53L5CX_Stream while streaming
+	VL53L5CX_FrameCallback _frame_callback = nullptr;
+	void* _frame_callback_data = nullptr;
+	uint32_t _frame_callback_every = 1;
+	VL53L5CX_ErrorCallback _error_callback = nullptr;
+	void* _error_callback_data = nullptr;
+	VL53L5CX_Roi _range_roi;			// zones and rules of getRange()
+	void* _filter = nullptr;			// HID_VL53L5CX_Filter of the frames, nullptr = raw distances
+	void* _presence = nullptr;			// HID_VL53L5CX_Presence fed with every frame
+	VL53L5CX_PresenceCallback _presence_callback = nullptr;
+	void* _presence_callback_data = nullptr;
+	void* _tracker = nullptr;			// HID_VL53L5CX_Tracker fed with every frame
+	void* _counter = nullptr;			// HID_VL53L5CX_PeopleCounter fed with every frame
+	void* _background = nullptr;		// HID_VL53L5CX_Background fed with every frame, the counter's foreground
+	bool _counter_background = false;	// _background made by setCounter()
+	void* _idle = nullptr;				// HID_VL53L5CX_Idle of getFrame() and the stream
+	void* _motion = nullptr;			// HID_VL53L5CX_Motion fed with every frame
+	void* _governor = nullptr;			// HID_VL53L5CX_Governor of getFrame(), getRange() and the stream
+
+	bool resolutionChanges();			// the governor has tiers of different resolutions
 
 public:
 
 	VL53L5CXSensor(uint8_t i2c_address);
+	VL53L5CXSensor(const char* recording_path, uint8_t replay_mode);
 	~VL53L5CXSensor();
 
 	bool startRanging();
 	bool stopRanging();
 	bool isDataReady();
 	double getRange();
+	int32_t getFrame(VL53L5CX_Frame* frame);
+	bool setRangeRoi(const VL53L5CX_Roi* roi);
+	bool setZoneFilter(const VL53L5CX_Filter* filter);
+	bool setPresenceZones(const VL53L5CX_PresenceZone* zones, int32_t count);
+	bool setPresenceCallback(VL53L5CX_PresenceCallback callback, void* user_data);
+	int32_t readPresenceEvents(VL53L5CX_PresenceEvent* events, int32_t capacity);
+	uint32_t getPresenceState();
+	bool getZoneMotion(int32_t zone, VL53L5CX_ZoneMotion* motion);
+	bool setTracker(const VL53L5CX_TrackerConfig* config);
+	int32_t getTracks(VL53L5CX_Track* tracks, int32_t capacity);
+	bool setBackground(const VL53L5CX_BackgroundConfig* config);
+	bool getForeground(uint64_t* foreground);
+	bool saveBackground(const char* path);
+	bool loadBackground(const char* path);
+	bool setCounter(const VL53L5CX_CounterConfig* config);
+	bool getCrossingCounts(uint64_t* forward, uint64_t* backward);
+	int32_t readCrossingEvents(VL53L5CX_CrossingEvent* events, int32_t capacity);
+	int32_t getBlobs(VL53L5CX_Blob* blobs, int32_t capacity);
+	bool setIdleMode(const VL53L5CX_IdleConfig* config);
+	bool getIdleStats(VL53L5CX_IdleStats* stats);
+	bool setMotionIndicator(const VL53L5CX_MotionConfig* config);
+	bool getMotion(VL53L5CX_MotionFrame* motion);
+	int32_t readMotionFrames(VL53L5CX_MotionFrame* frames, int32_t capacity);
+	int32_t readMotionEvents(VL53L5CX_MotionEvent* events, int32_t capacity);
+	bool setGovernor(const VL53L5CX_GovernorConfig* config);
+	bool getGovernorStats(VL53L5CX_GovernorStats* stats);
+	bool startStreaming(uint32_t queue_frames);
+	void stopStreaming();
+	int32_t readFrames(VL53L5CX_Frame* frames, int32_t capacity, int32_t* count, uint32_t timeout_ms);
+	bool setFrameCallback(VL53L5CX_FrameCallback callback, void* user_data, uint32_t every_n_frames);
+	bool startRecording(const char* path, bool raw);
+	void stopRecording();
+	bool replayStep(uint32_t frames);
+	bool getMetricsName(char* buffer, uint32_t size);
+	bool setTimeouts(uint32_t operation_ms, uint32_t frame_percent);
+	bool setErrorCallback(VL53L5CX_ErrorCallback callback, void* user_data);
+	bool getLastError(uint8_t* error_code, uint32_t* error_value);
+	uint64_t getErrorCount(uint8_t error_code);
+
+	// called by the driver when a call fails
+	void onSensorError(uint8_t error_code, uint32_t error_value);
 };
 
-// Helper methods for constructor and exported methods
+// Helper methods for constructor and exported methods. No export throws: errors come back as return
+// values, lastError (getLastError), counters (getErrorCount) and the optional error callback.
+// Returns nullptr if the sensor cannot be opened, the reason is logged.
 extern "C" SENSOR_API void* Instantiate(uint8_t i2c_address);
 
+// replay_mode: 0 = real time, 1 = as fast as possible, 2 = stepped (see replayStep)
+// Returns nullptr if the recording cannot be opened.
+extern "C" SENSOR_API void* InstantiateReplay(const char* recording_path, uint8_t replay_mode);
+
 extern "C" SENSOR_API void Conclude(VL53L5CXSensor* t);
 
+// Returns false while streaming, the stream ranges already.
 extern "C" SENSOR_API bool startRanging(VL53L5CXSensor* t);
 
 extern "C" SENSOR_API bool stopRanging(VL53L5CXSensor* t);
 
+// Returns false while streaming, the acquisition thread takes the frames.
 extern "C" SENSOR_API bool isDataReady(VL53L5CXSensor* t);
 
+// Waits for the next frame and reduces its ROI (setRangeRoi()). While streaming it does not wait,
+// it reduces the newest frame the stream read (0 before the first one) and leaves the queue alone.
 extern "C" SENSOR_API double getRange(VL53L5CXSensor* t);
+
+// Non-blocking: returns VL53L5CX_FRAME_NOT_READY until the sensor has a new frame
+extern "C" SENSOR_API int32_t getFrame(VL53L5CXSensor* t, VL53L5CX_Frame* frame);
+
+// Zones, rules and reduction getRange() uses, copied. nullptr restores the default: mean of the
+// center zones with status 5 between 10 and 1200 mm. Returns false for a zone_mask while the governor
+// has tiers of different resolutions.
+extern "C" SENSOR_API bool setRangeRoi(VL53L5CXSensor* t, const VL53L5CX_Roi* roi);
+
+// Reduces count ROIs of one frame (from getFrame(), readFrames() or a frame callback) to
+// distances_mm[i], 0 if no zone of ROI i is valid, and their valid zones to valid_zones[i]
+// (may be nullptr). ROIs with the same rules share the validity pass. Needs no sensor.
+// Returns count, VL53L5CX_FRAME_BAD_VERSION or VL53L5CX_FRAME_ERROR.
+extern "C" SENSOR_API int32_t evaluateRois(const VL53L5CX_Frame* frame, const VL53L5CX_Roi* rois, int32_t count, double* distances_mm, uint8_t* valid_zones);
+
+// Filters the distances of every frame getFrame(), readFrames(), the frame callback and getRange()
+// see, per zone over time, so a target that jumps for one frame is not taken for real. Copied,
+// nullptr or VL53L5CX_FILTER_NONE removes the filter, any call starts it over. Returns false while
+// streaming or if a parameter is out of range. Recordings keep the raw frames.
+extern "C" SENSOR_API bool setZoneFilter(VL53L5CXSensor* t, const VL53L5CX_Filter* filter);
+
+// Watches count (up to VL53L5CX_PRESENCE_MAX_ZONES) presence zones in every frame the sensor delivers, through
+// getFrame(), readFrames(), the frame callback or getRange(), after the zone filter. Each zone costs one ROI
+// evaluation and a few compares per frame, an event is ready within the frame that decides it. The zones are
+// copied, count 0 removes them. Returns false while streaming, if a zone is invalid or has a zone_mask while the
+// governor has tiers of different resolutions.
+extern "C" SENSOR_API bool setPresenceZones(VL53L5CXSensor* t, const VL53L5CX_PresenceZone* zones, int32_t count);
+
+// Calls callback(event, user_data) for every presence event, on the thread that read the frame. nullptr
+// removes it. Returns false while streaming, set it before. Events are queued for readPresenceEvents() as well.
+extern "C" SENSOR_API bool setPresenceCallback(VL53L5CXSensor* t, VL53L5CX_PresenceCallback callback, void* user_data);
+
+// Moves up to capacity queued presence events, oldest first, to events[] without waiting. The queue keeps the
+// newest 64 events. Returns the number of events moved, also while streaming.
+extern "C" SENSOR_API int32_t readPresenceEvents(VL53L5CXSensor* t, VL53L5CX_PresenceEvent* events, int32_t capacity);
+
+// Bit i set: presence zone i is occupied.
+extern "C" SENSOR_API uint32_t getPresenceState(VL53L5CXSensor* t);
+
+// Range rate, motion and predicted arrival of presence zone zone as of the last frame, also while streaming.
+// Returns false if there is no such zone.
+extern "C" SENSOR_API bool getZoneMotion(VL53L5CXSensor* t, int32_t zone, VL53L5CX_ZoneMotion* motion);
+
+// Tracks every target of every zone across the frames read by getFrame(), readFrames(), the frame callback or
+// getRange(). Fixed capacity, the work per frame is bounded. nullptr removes it. Returns false while streaming
+// or if config is invalid.
+extern "C" SENSOR_API bool setTracker(VL53L5CXSensor* t, const VL53L5CX_TrackerConfig* config);
+
+// Copies up to capacity of the confirmed tracks as of the last frame, also while streaming. Returns how many.
+extern "C" SENSOR_API int32_t getTracks(VL53L5CXSensor* t, VL53L5CX_Track* tracks, int32_t capacity);
+
+// Targets per zone the sensor reports in this build (VL53L5CX_NB_TARGET_PER_ZONE, 1 to 4).
+extern "C" SENSOR_API int32_t getTargetsPerZone(VL53L5CXSensor* t);
+
+// Learns the depth of the empty lane per zone from the frames read by getFrame(), readFrames(), the frame
+// callback or getRange(), after the zone filter, and marks the zones closer than it in every frame. O(zones)
+// per frame, vectorised, nothing is allocated. nullptr removes it (a people counter then makes its own). Any
+// call starts learning over. Returns false while streaming, if config is invalid or while the governor has tiers
+// of different resolutions (the model would start over with every change).
+extern "C" SENSOR_API bool setBackground(VL53L5CXSensor* t, const VL53L5CX_BackgroundConfig* config);
+
+// Foreground zones of the last frame, also while streaming. Returns false while the model is learning or if
+// there is none.
+extern "C" SENSOR_API bool getForeground(VL53L5CXSensor* t, uint64_t* foreground);
+
+// Writes the background model to path with the fingerprint of the calibration data of the sensor, also while
+// streaming. Returns false if there is no learned model or the file cannot be written.
+extern "C" SENSOR_API bool saveBackground(VL53L5CXSensor* t, const char* path);
+
+// Replaces the background model by the one saved to path, so no learning is needed after a restart. The model
+// must have been saved with the same calibration data. Returns false while streaming, if there is no background
+// model or counter, or if the file cannot be read or does not match.
+extern "C" SENSOR_API bool loadBackground(VL53L5CXSensor* t, const char* path);
+
+// Counts people crossing a line in every frame read by getFrame(), readFrames(), the frame callback or getRange(),
+// after the zone filter, on the foreground of the background model (setBackground(), made from config if there is
+// none). A few hundred nanoseconds per frame, nothing is allocated. nullptr removes it, any call starts it over
+// with zero counts. Returns false while streaming, if config is invalid or while the governor has tiers of
+// different resolutions.
+extern "C" SENSOR_API bool setCounter(VL53L5CXSensor* t, const VL53L5CX_CounterConfig* config);
+
+// Crossings in each direction since setCounter(), also while streaming. Returns false if there is no counter.
+extern "C" SENSOR_API bool getCrossingCounts(VL53L5CXSensor* t, uint64_t* forward, uint64_t* backward);
+
+// Moves up to capacity queued crossings, oldest first, to events[] without waiting. The queue keeps the newest
+// 64 crossings. Returns the number of events moved, also while streaming.
+extern "C" SENSOR_API int32_t readCrossingEvents(VL53L5CXSensor* t, VL53L5CX_CrossingEvent* events, int32_t capacity);
+
+// Copies up to capacity of the blobs tracked as of the last frame, also while streaming. Returns how many.
+extern "C" SENSOR_API int32_t getBlobs(VL53L5CXSensor* t, VL53L5CX_Blob* blobs, int32_t capacity);
+
+// Sleeps between people: programs the detection thresholds of config into the sensor and stops reading frames
+// until its INT line fires, then getFrame(), readFrames() and the frame callback get every frame again until the
+// lane is empty (no presence zone occupied, or no zone of config->roi in its window without presence zones) for
+// rearm_frames frames. getRange() keeps reading every frame. The sensor INT must be wired to the interrupt input
+// of the FT260. nullptr disables it. Returns false while streaming, when replaying (a recording has no INT line),
+// with a governor (setGovernor()) or if the thresholds cannot be programmed.
+extern "C" SENSOR_API bool setIdleMode(VL53L5CXSensor* t, const VL53L5CX_IdleConfig* config);
+
+// Wake ups and time asleep and awake since setIdleMode(), also while streaming. Returns false without idle mode.
+extern "C" SENSOR_API bool getIdleStats(VL53L5CXSensor* t, VL53L5CX_IdleStats* stats);
+
+// Programs the motion indicator of the sensor firmware with the distance window of config and streams its results:
+// every frame read by getFrame(), readFrames(), the frame callback or getRange() carries the motion score of each
+// aggregate of zones and the global indicators, scored by the sensor (no frame differencing on the host). The zone
+// to aggregate map follows resolution changes. nullptr stops taking the results. Returns false while streaming, if
+// config is invalid or if the sensor does not take it.
+extern "C" SENSOR_API bool setMotionIndicator(VL53L5CXSensor* t, const VL53L5CX_MotionConfig* config);
+
+// Motion results of the last frame, also while streaming. Returns false without motion indicator or before the
+// first frame.
+extern "C" SENSOR_API bool getMotion(VL53L5CXSensor* t, VL53L5CX_MotionFrame* motion);
+
+// Moves up to capacity queued motion results, oldest first, to frames[] without waiting. The queue keeps those of
+// the newest 64 frames. Returns the number of results moved, also while streaming.
+extern "C" SENSOR_API int32_t readMotionFrames(VL53L5CXSensor* t, VL53L5CX_MotionFrame* frames, int32_t capacity);
+
+// Moves up to capacity queued motion events (started, stopped), oldest first, to events[] without waiting. The
+// queue keeps the newest 64 events. Returns the number of events moved, also while streaming.
+extern "C" SENSOR_API int32_t readMotionEvents(VL53L5CXSensor* t, VL53L5CX_MotionEvent* events, int32_t capacity);
+
+// Moves the sensor between the tiers of config (resolution, frequency, ranging mode, or sleep) with the occupancy
+// of the lane seen in every frame read by getFrame(), readFrames(), the frame callback or getRange(): the presence
+// zones, or config->roi without them. The schedule windows use the local time of day. Starts in occupied_tier.
+// While the sensor sleeps nothing is read and getRange() returns 0 at once, getFrame() VL53L5CX_FRAME_NOT_READY;
+// every hold_ms of the sleep tier the next call wakes it for a probe. Tiers of different resolutions (like the
+// defaults) start a background model, the people counter and zone masks over with every change, all tiers need the
+// same resolution with those. nullptr wakes the sensor and leaves it in its current tier. Returns false while
+// streaming, when replaying, with idle mode, if config is invalid, if its resolutions do not fit the background
+// model, the counter or the zone masks of the presence zones and setRangeRoi(), or if the sensor refuses the tier.
+extern "C" SENSOR_API bool setGovernor(VL53L5CXSensor* t, const VL53L5CX_GovernorConfig* config);
+
+// Time per tier and tier changes since setGovernor(), also while streaming. Returns false without a governor.
+extern "C" SENSOR_API bool getGovernorStats(VL53L5CXSensor* t, VL53L5CX_GovernorStats* stats);
+
+// Polls the sensor on a background thread and queues up to queue_frames frames for readFrames(),
+// the oldest are overwritten when the queue is full (0: nothing is queued, frames only go to the
+// frame callback, see setFrameCallback()). Ranging must be started. Returns false from the frame
+// callback. While streaming, getFrame() takes frames from the queue, getRange() reduces the newest
+// frame, startRanging(), isDataReady() and startRecording() return false.
+extern "C" SENSOR_API bool startStreaming(VL53L5CXSensor* t, uint32_t queue_frames);
+
+// Also done by stopRanging() and Conclude(). No readFrames() call may be in progress. From the frame
+// callback no frame is read after the callback returns, but the stream (and its queue) is only released
+// by the next stopStreaming() or startStreaming() on another thread, the setters refuse until then.
+extern "C" SENSOR_API void stopStreaming(VL53L5CXSensor* t);
+
+// Moves up to capacity queued frames, oldest first, to frames[] and their number to *count, waiting
+// at most timeout_ms for the first one. The caller sets version and size of frames[0].
+// Returns VL53L5CX_FRAME_READY, ..._NOT_READY (timeout), ..._BAD_VERSION or ..._ERROR (not streaming).
+extern "C" SENSOR_API int32_t readFrames(VL53L5CXSensor* t, VL53L5CX_Frame* frames, int32_t capacity, int32_t* count, uint32_t timeout_ms);
+
+// Calls callback(frame, user_data) from the acquisition thread for every every_n_frames-th frame.
+// Kept for every stream, startStreaming() starts the calls: startStreaming(t, 0) for the callback
+// alone, where getFrame() and readFrames() never have a frame, or with a queue for both. Installed
+// while streaming it is called from the next frame on. nullptr removes the callback, streaming goes
+// on; once this returns the previous callback is not running anymore. The time spent in the callback
+// is published in the metrics (frameCallbackUs), keep it short: the next frame is not read before it
+// returns. The callback may call stopStreaming() or stopRanging(), startStreaming() returns false
+// there and Conclude() must not be called.
+extern "C" SENSOR_API bool setFrameCallback(VL53L5CXSensor* t, VL53L5CX_FrameCallback callback, void* user_data, uint32_t every_n_frames);
+
+// Records every frame read from now on, start it before streaming. Returns false while streaming.
+extern "C" SENSOR_API bool startRecording(VL53L5CXSensor* t, const char* path, bool raw);
+
+// Also stops streaming, the acquisition thread writes into the recording.
+extern "C" SENSOR_API void stopRecording(VL53L5CXSensor* t);
+
+extern "C" SENSOR_API bool replayStep(VL53L5CXSensor* t, uint32_t frames);
+
+// Time budget of every call (operation_ms, 0 = the ULD budgets, 5.2 s to stop ranging on a wedged bus) and of frame reads
+// while ranging (frame_percent of the frame period, 200 by default, 0 = operation_ms). A call that
+// runs out of time fails with DEADLINE_EXCEEDED instead of waiting for a wedged bus.
+// Returns false while streaming, set the budgets before startStreaming().
+extern "C" SENSOR_API bool setTimeouts(VL53L5CXSensor* t, uint32_t operation_ms, uint32_t frame_percent);
+
+// Calls callback(error_code, error_value, user_data) whenever a call fails, also on the acquisition
+// thread while streaming. nullptr removes it. Returns false while streaming, set it before.
+extern "C" SENSOR_API bool setErrorCallback(VL53L5CXSensor* t, VL53L5CX_ErrorCallback callback, void* user_data);
+
+// Error of the last call (error_code 0 if it succeeded). Returns false while streaming, the
+// acquisition thread makes the calls then: use the error callback or getErrorCount().
+extern "C" SENSOR_API bool getLastError(VL53L5CXSensor* t, uint8_t* error_code, uint32_t* error_value);
+
+// Calls that failed with error_code since the sensor was opened, also in the metrics (driverErrors).
+extern "C" SENSOR_API uint64_t getErrorCount(VL53L5CXSensor* t, uint8_t error_code);
+
+// Name of the shared memory segment holding the driver metrics, see HID_VL53L5CX_Metrics.h
+extern "C" SENSOR_API bool getMetricsName(VL53L5CXSensor* t, char* buffer, uint32_t size);
+
+// Diagnostics of all sensors, see HID_VL53L5CX_Log.h
+// level: 0 = verbose (every frame), 1 = info (default), 2 = warnings, 3 = failures only, 4 = off
+extern "C" SENSOR_API void setLogLevel(uint8_t level);
+
+// Messages are passed to sink from a background thread, nullptr prints them to stdout again.
+typedef void (*VL53L5CX_LogCallback)(uint8_t level, const char* message);
+extern "C" SENSOR_API void setLogSink(VL53L5CX_LogCallback sink);
+
+// I2C and driver tracing for all sensors, see HID_VL53L5CX_Trace.h
+extern "C" SENSOR_API void startTrace();
+
+extern "C" SENSOR_API void stopTrace();
+
+extern "C" SENSOR_API bool saveTrace(const char* path);
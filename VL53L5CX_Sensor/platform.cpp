@@ -11,23 +11,83 @@
   */
 
 #include "pch.h" // use stdafx.h in Visual Studio 2017 and earlier
+#include <stdio.h>
 #include "HID_VL53L5CX.h"
-#include "HID_VL53L5CX_IO.h"
 #include "platform.h"
+#include "HID_VL53L5CX_Log.h"
 
-//#define DEBUG	1
-#ifdef DEBUG
-#define D(x)   x
-#else
-#define D(x)
-#endif
+static HID_VL53L5CX_Clock *platformClock(
+		VL53L5CX_Platform *p_platform)
+{
+	return (p_platform->clock != NULL) ? p_platform->clock : HID_VL53L5CX_Clock::systemClock();
+}
+
+/* Fails fast once the deadline passed, otherwise hands the time left to the transport */
+static uint8_t startTransaction(
+		VL53L5CX_Platform *p_platform)
+{
+	uint32_t timeoutMs = 0;
+	if (p_platform->deadline_ns != 0)
+	{
+		uint64_t now = platformClock(p_platform)->nowNs();
+		if (now >= p_platform->deadline_ns)
+		{
+			p_platform->deadline_expired = 1;
+			return VL53L5CX_STATUS_TIMEOUT_ERROR;
+		}
+		timeoutMs = (uint32_t)((p_platform->deadline_ns - now + 999999) / 1000000);
+	}
+	p_platform->VL53L5CX_i2c->setTimeoutMs(timeoutMs);
+	return VL53L5CX_STATUS_OK;
+}
+
+uint8_t CheckDeadline(
+		VL53L5CX_Platform *p_platform)
+{
+	if ((p_platform->deadline_ns == 0) || (platformClock(p_platform)->nowNs() < p_platform->deadline_ns))
+		return VL53L5CX_STATUS_OK;
+	p_platform->deadline_expired = 1;
+	return VL53L5CX_STATUS_TIMEOUT_ERROR;
+}
+
+uint64_t StartBudget(
+		VL53L5CX_Platform *p_platform)
+{
+	return platformClock(p_platform)->nowNs();
+}
+
+uint8_t CheckBudget(
+		VL53L5CX_Platform *p_platform,
+		uint64_t start_ns,
+		uint32_t budget_ms)
+{
+	if (platformClock(p_platform)->nowNs() - start_ns < (uint64_t)budget_ms * 1000000)
+		return VL53L5CX_STATUS_OK;
+	return VL53L5CX_STATUS_TIMEOUT_ERROR;
+}
 
 uint8_t RdByte(
 		VL53L5CX_Platform *p_platform,
 		uint16_t RegisterAdress,
 		uint8_t *p_value)
 {
-	return p_platform->VL53L5CX_i2c->readSingleByte(RegisterAdress, *p_value);
+	uint8_t status;
+	if ((status = startTransaction(p_platform)) != VL53L5CX_STATUS_OK)
+		return status;
+#ifndef VL53L5CX_DISABLE_TRACE
+	if (HID_VL53L5CX_Trace::enabled())
+	{
+		uint64_t start = HID_VL53L5CX_Trace::now();
+		status = p_platform->VL53L5CX_i2c->readSingleByte(RegisterAdress, *p_value);
+		HID_VL53L5CX_Trace::transaction(HID_VL53L5CX_TRACE_TYPE::READ, "RdByte", RegisterAdress, 1, status, start);
+	}
+	else
+#endif
+	status = p_platform->VL53L5CX_i2c->readSingleByte(RegisterAdress, *p_value);
+
+	if (p_platform->metrics != NULL)
+		HID_VL53L5CX_Metrics::transaction(p_platform->metrics, HID_VL53L5CX_BUS_OP::READ_BYTE, 1, status);
+	return status;
 }
 
 uint8_t WrByte(
@@ -35,7 +95,23 @@ uint8_t WrByte(
 		uint16_t RegisterAdress,
 		uint8_t value)
 {
-	return p_platform->VL53L5CX_i2c->writeSingleByte(RegisterAdress, value);
+	uint8_t status;
+	if ((status = startTransaction(p_platform)) != VL53L5CX_STATUS_OK)
+		return status;
+#ifndef VL53L5CX_DISABLE_TRACE
+	if (HID_VL53L5CX_Trace::enabled())
+	{
+		uint64_t start = HID_VL53L5CX_Trace::now();
+		status = p_platform->VL53L5CX_i2c->writeSingleByte(RegisterAdress, value);
+		HID_VL53L5CX_Trace::transaction(HID_VL53L5CX_TRACE_TYPE::WRITE, "WrByte", RegisterAdress, 1, status, start);
+	}
+	else
+#endif
+	status = p_platform->VL53L5CX_i2c->writeSingleByte(RegisterAdress, value);
+
+	if (p_platform->metrics != NULL)
+		HID_VL53L5CX_Metrics::transaction(p_platform->metrics, HID_VL53L5CX_BUS_OP::WRITE_BYTE, 1, status);
+	return status;
 }
 
 /*
@@ -48,7 +124,23 @@ uint8_t WrMulti(
 		uint8_t *p_values,
 		uint32_t size)
 {
-	return p_platform->VL53L5CX_i2c->writeMultipleBytes(RegisterAdress, p_values, size);
+	uint8_t status;
+	if ((status = startTransaction(p_platform)) != VL53L5CX_STATUS_OK)
+		return status;
+#ifndef VL53L5CX_DISABLE_TRACE
+	if (HID_VL53L5CX_Trace::enabled())
+	{
+		uint64_t start = HID_VL53L5CX_Trace::now();
+		status = p_platform->VL53L5CX_i2c->writeMultipleBytes(RegisterAdress, p_values, size);
+		HID_VL53L5CX_Trace::transaction(HID_VL53L5CX_TRACE_TYPE::WRITE, "WrMulti", RegisterAdress, size, status, start);
+	}
+	else
+#endif
+	status = p_platform->VL53L5CX_i2c->writeMultipleBytes(RegisterAdress, p_values, size);
+
+	if (p_platform->metrics != NULL)
+		HID_VL53L5CX_Metrics::transaction(p_platform->metrics, HID_VL53L5CX_BUS_OP::WRITE_MULTI, size, status);
+	return status;
 }
 
 uint8_t RdMulti(
@@ -57,7 +149,23 @@ uint8_t RdMulti(
 		uint8_t *p_values,
 		uint32_t size)
 {
-	return p_platform->VL53L5CX_i2c->readMultipleBytes(RegisterAdress, p_values, size);
+	uint8_t status;
+	if ((status = startTransaction(p_platform)) != VL53L5CX_STATUS_OK)
+		return status;
+#ifndef VL53L5CX_DISABLE_TRACE
+	if (HID_VL53L5CX_Trace::enabled())
+	{
+		uint64_t start = HID_VL53L5CX_Trace::now();
+		status = p_platform->VL53L5CX_i2c->readMultipleBytes(RegisterAdress, p_values, size);
+		HID_VL53L5CX_Trace::transaction(HID_VL53L5CX_TRACE_TYPE::READ, "RdMulti", RegisterAdress, size, status, start);
+	}
+	else
+#endif
+	status = p_platform->VL53L5CX_i2c->readMultipleBytes(RegisterAdress, p_values, size);
+
+	if (p_platform->metrics != NULL)
+		HID_VL53L5CX_Metrics::transaction(p_platform->metrics, HID_VL53L5CX_BUS_OP::READ_MULTI, size, status);
+	return status;
 }
 
 uint8_t Reset_Sensor(
@@ -65,7 +173,7 @@ uint8_t Reset_Sensor(
 {
 	uint8_t status = 0;
 	
-	printf("Reset Sensor here\n");
+	HID_VL53L5CX_LOG(INFO, "Reset Sensor here");
 
 	/* (Optional) Need to be implemented by customer. This function returns 0 if OK */
 	
@@ -105,9 +213,23 @@ uint8_t WaitMs(
 		VL53L5CX_Platform *p_platform,
 		uint32_t TimeMs)
 {
-	D( printf("WaitMs(%u)\n", TimeMs); )
+	HID_VL53L5CX_LOG(VERBOSE, "WaitMs(%u)", TimeMs);
 	/* Need to be implemented by customer. This function returns 0 if OK */
-	Sleep(TimeMs);
+	/* Sleep() would round up to the scheduler tick, use the high resolution clock */
+	HID_VL53L5CX_Clock *clock = platformClock(p_platform);
+
+	/* Never sleep past the deadline of the operation */
+	if (p_platform->deadline_ns != 0)
+	{
+		uint64_t wakeNs = clock->nowNs() + (uint64_t)TimeMs * 1000000;
+		if (wakeNs >= p_platform->deadline_ns)
+		{
+			clock->sleepUntilNs(p_platform->deadline_ns);
+			p_platform->deadline_expired = 1;
+			return VL53L5CX_STATUS_TIMEOUT_ERROR;
+		}
+	}
+	clock->sleepMs(TimeMs);
 	
 	return 0;
 }
@@ -17,9 +17,14 @@
 
 #include <stdint.h>
 #include <string.h>
+#ifdef _WIN32
 #include <windows.h>
+#endif
 
-#include "HID_VL53L5CX_IO.h"
+#include "HID_VL53L5CX_Transport.h"
+#include "HID_VL53L5CX_Clock.h"
+#include "HID_VL53L5CX_Trace.h"
+#include "HID_VL53L5CX_Metrics.h"
 
 /**
  * @brief Structure VL53L5CX_Platform needs to be filled by the customer,
@@ -35,7 +40,16 @@ typedef struct
 	 * needs to be added */
 	/* Example for most standard platform : I2C address of sensor */
 	uint8_t  			address;
-	HID_VL53L5CX_IO		*VL53L5CX_i2c;
+	HID_VL53L5CX_Transport	*VL53L5CX_i2c;
+	/* Time source used by WaitMs(), defaults to the system clock when NULL */
+	HID_VL53L5CX_Clock	*clock;
+	/* Bus and DCI counters, nothing is counted when NULL */
+	HID_VL53L5CX_MetricsBlock	*metrics;
+	/* Clock time (ns) after which no bus access starts and no wait goes on,
+	 * 0 = no deadline. Set by HID_VL53L5CX for every public method. */
+	uint64_t			deadline_ns;
+	/* Set when the deadline cut a bus access or a wait short */
+	uint8_t				deadline_expired;
 } VL53L5CX_Platform;
 
 /*
@@ -45,7 +59,9 @@ typedef struct
  * zone means a lower RAM). The value must be between 1 and 4.
  */
 
+#ifndef VL53L5CX_NB_TARGET_PER_ZONE
 #define 	VL53L5CX_NB_TARGET_PER_ZONE		1U
+#endif
 
 /*
  * @brief The macro below can be used to avoid data conversion into the driver.
@@ -72,6 +88,39 @@ typedef struct
 // #define VL53L5CX_DISABLE_TARGET_STATUS
 // #define VL53L5CX_DISABLE_MOTION_INDICATOR
 
+/*
+ * @brief The macros below record the I2C accesses and mark the driver phases
+ * for HID_VL53L5CX_Trace. A span lasts until the end of the enclosing scope or
+ * the next VL53L5CX_TRACE_NEXT(). User can define VL53L5CX_DISABLE_TRACE to
+ * remove them completely.
+ */
+
+// #define VL53L5CX_DISABLE_TRACE
+
+#ifndef VL53L5CX_DISABLE_TRACE
+#define VL53L5CX_TRACE_SPAN(span, name)		HID_VL53L5CX_TraceSpan span(name)
+#define VL53L5CX_TRACE_NEXT(span, name)		span.next(name)
+#define VL53L5CX_TRACE_ARG(span, arg, value)	span.setArg(arg, value)
+#else
+#define VL53L5CX_TRACE_SPAN(span, name)
+#define VL53L5CX_TRACE_NEXT(span, name)
+#define VL53L5CX_TRACE_ARG(span, arg, value)
+#endif
+
+/*
+ * @brief The macro below times a DCI command into the HID_VL53L5CX_Metrics
+ * latency histogram, until the end of the enclosing scope. User can define
+ * VL53L5CX_DISABLE_METRICS to remove it.
+ */
+
+// #define VL53L5CX_DISABLE_METRICS
+
+#ifndef VL53L5CX_DISABLE_METRICS
+#define VL53L5CX_METRICS_DCI(p_platform)	HID_VL53L5CX_MetricsTimer dci_timer((p_platform)->metrics, (p_platform)->clock)
+#else
+#define VL53L5CX_METRICS_DCI(p_platform)
+#endif
+
 /**
  * @param (VL53L5CX_Platform*) p_platform : Pointer of VL53L5CX platform
  * structure.
@@ -167,4 +216,38 @@ uint8_t WaitMs(
 		VL53L5CX_Platform *p_platform,
 		uint32_t TimeMs);
 
+/**
+ * @brief Checks the deadline of the current operation (deadline_ns) and sets
+ * deadline_expired once it passed. The ULD polling loops call it so that they
+ * give up at the deadline instead of after their own 2 s or 5 s budget
+ * (CheckBudget()).
+ * @param (VL53L5CX_Platform*) p_platform : Pointer of VL53L5CX platform
+ * structure.
+ * @return (uint8_t) status : 0 if time is left, 1 (VL53L5CX_STATUS_TIMEOUT_ERROR)
+ * otherwise.
+ */
+
+uint8_t CheckDeadline(
+		VL53L5CX_Platform *p_platform);
+
+/**
+ * @brief Budget of one ULD polling loop on the platform clock. StartBudget()
+ * returns the start of the loop, CheckBudget() fails once budget_ms elapsed
+ * since then, however long the bus accesses of the loop took.
+ * @param (VL53L5CX_Platform*) p_platform : Pointer of VL53L5CX platform
+ * structure.
+ * @param (uint64_t) start_ns : Returned by StartBudget().
+ * @param (uint32_t) budget_ms : Budget of the loop in ms.
+ * @return (uint8_t) status : 0 if time is left, 1 (VL53L5CX_STATUS_TIMEOUT_ERROR)
+ * otherwise.
+ */
+
+uint64_t StartBudget(
+		VL53L5CX_Platform *p_platform);
+
+uint8_t CheckBudget(
+		VL53L5CX_Platform *p_platform,
+		uint64_t start_ns,
+		uint32_t budget_ms);
+
 #endif	// _PLATFORM_H_
\ No newline at end of file
@@ -31,13 +31,18 @@ static uint8_t _vl53l5cx_poll_for_answer(
 {
 	uint8_t status = VL53L5CX_STATUS_OK;
 	uint8_t timeout = 0;
+	uint64_t start_ns = StartBudget(&(p_dev->platform));
+	VL53L5CX_TRACE_SPAN(span, "poll_for_answer");
 
 	do {
 		status |= RdMulti(&(p_dev->platform), address,
 				p_dev->temp_buffer, size);
 		status |= WaitMs(&(p_dev->platform), 10);
 
-		if(timeout >= (uint8_t)200)	/* 2s timeout */
+		/* 2s timeout, also on a slow bus, or the deadline of the calling operation */
+		if((timeout >= (uint8_t)200)
+			|| (CheckBudget(&(p_dev->platform), start_ns, 2000) != (uint8_t)0)
+			|| (CheckDeadline(&(p_dev->platform)) != (uint8_t)0))
 		{
 			status |= (uint8_t)VL53L5CX_STATUS_TIMEOUT_ERROR;
 			break;
@@ -53,6 +58,7 @@ static uint8_t _vl53l5cx_poll_for_answer(
 		}
 	}while ((p_dev->temp_buffer[pos] & mask) != expected_value);
 
+	VL53L5CX_TRACE_ARG(span, "polls", (uint32_t)timeout + (uint32_t)1);
 	return status;
 }
 
@@ -65,6 +71,8 @@ static uint8_t _vl53l5cx_poll_for_mcu_boot(
 {
    uint8_t go2_status0, go2_status1, status = VL53L5CX_STATUS_OK;
    uint16_t timeout = 0;
+   uint64_t start_ns = StartBudget(&(p_dev->platform));
+   VL53L5CX_TRACE_SPAN(span, "poll_for_mcu_boot");
 
    do {
 		status |= RdByte(&(p_dev->platform), 0x06, &go2_status0);
@@ -80,8 +88,16 @@ static uint8_t _vl53l5cx_poll_for_mcu_boot(
 			break;
 		}
 
-	}while (timeout < (uint16_t)500);
+		/* Deadline of the calling operation */
+		if(CheckDeadline(&(p_dev->platform)) != (uint8_t)0){
+			status |= (uint8_t)VL53L5CX_STATUS_TIMEOUT_ERROR;
+			break;
+		}
+
+	}while ((timeout < (uint16_t)500)
+		&& (CheckBudget(&(p_dev->platform), start_ns, 500) == (uint8_t)0));
 
+   VL53L5CX_TRACE_ARG(span, "polls", timeout);
    return status;
 }
 
@@ -245,6 +261,8 @@ uint8_t vl53l5cx_init(
 	uint8_t tmp, status = VL53L5CX_STATUS_OK;
 	uint8_t pipe_ctrl[] = {VL53L5CX_NB_TARGET_PER_ZONE, 0x00, 0x01, 0x00};
 	uint32_t single_range = 0x01;
+	VL53L5CX_TRACE_SPAN(init, "vl53l5cx_init");
+	VL53L5CX_TRACE_SPAN(stage, "sw reboot");
 
 	p_dev->default_xtalk = (uint8_t*)VL53L5CX_DEFAULT_XTALK;
 	p_dev->default_configuration = (uint8_t*)VL53L5CX_DEFAULT_CONFIGURATION;
@@ -274,6 +292,7 @@ uint8_t vl53l5cx_init(
 	status |= WaitMs(&(p_dev->platform), 100);
 
 	/* Wait for sensor booted (several ms required to get sensor ready ) */
+	VL53L5CX_TRACE_NEXT(stage, "wait boot");
 	status |= WrByte(&(p_dev->platform), 0x7fff, 0x00);
 	status |= _vl53l5cx_poll_for_answer(p_dev, 1, 0, 0x06, 0xff, 1);
 	if(status != (uint8_t)0){
@@ -284,6 +303,7 @@ uint8_t vl53l5cx_init(
 	status |= WrByte(&(p_dev->platform), 0x7fff, 0x02);
 
 	/* Enable FW access */
+	VL53L5CX_TRACE_NEXT(stage, "fw access");
 	status |= WrByte(&(p_dev->platform), 0x03, 0x0D);
 	status |= WrByte(&(p_dev->platform), 0x7fff, 0x01);
 	status |= _vl53l5cx_poll_for_answer(p_dev, 1, 0, 0x21, 0x10, 0x10);
@@ -294,6 +314,7 @@ uint8_t vl53l5cx_init(
 	status |= WrByte(&(p_dev->platform), 0x0C, 0x01);
 
 	/* Power ON status */
+	VL53L5CX_TRACE_NEXT(stage, "power on");
 	status |= WrByte(&(p_dev->platform), 0x7fff, 0x00);
 	status |= WrByte(&(p_dev->platform), 0x101, 0x00);
 	status |= WrByte(&(p_dev->platform), 0x102, 0x00);
@@ -319,6 +340,7 @@ uint8_t vl53l5cx_init(
 	status |= WrByte(&(p_dev->platform), 0x20, 0x06);
 
 	/* Download FW into VL53L5 */
+	VL53L5CX_TRACE_NEXT(stage, "fw download");
 	status |= WrByte(&(p_dev->platform), 0x7fff, 0x09);
 	status |= WrMulti(&(p_dev->platform),0,
 		(uint8_t*)&VL53L5CX_FIRMWARE[0],0x8000);
@@ -331,6 +353,7 @@ uint8_t vl53l5cx_init(
 	status |= WrByte(&(p_dev->platform), 0x7fff, 0x01);
 
 	/* Check if FW correctly downloaded */
+	VL53L5CX_TRACE_NEXT(stage, "fw check");
 	status |= WrByte(&(p_dev->platform), 0x7fff, 0x02);
 	status |= WrByte(&(p_dev->platform), 0x03, 0x0D);
 	status |= WrByte(&(p_dev->platform), 0x7fff, 0x01);
@@ -344,6 +367,7 @@ uint8_t vl53l5cx_init(
 	status |= WrByte(&(p_dev->platform), 0x0C, 0x01);
 
 	/* Reset MCU and wait boot */
+	VL53L5CX_TRACE_NEXT(stage, "mcu boot");
 	status |= WrByte(&(p_dev->platform), 0x7FFF, 0x00);
 	status |= WrByte(&(p_dev->platform), 0x114, 0x00);
 	status |= WrByte(&(p_dev->platform), 0x115, 0x00);
@@ -361,6 +385,7 @@ uint8_t vl53l5cx_init(
 	status |= WrByte(&(p_dev->platform), 0x7fff, 0x02);
 
 	/* Get offset NVM data and store them into the offset buffer */
+	VL53L5CX_TRACE_NEXT(stage, "offset data");
 	status |= WrMulti(&(p_dev->platform), 0x2fd8,
 		(uint8_t*)VL53L5CX_GET_NVM_CMD, sizeof(VL53L5CX_GET_NVM_CMD));
 	status |= _vl53l5cx_poll_for_answer(p_dev, 4, 0,
@@ -372,11 +397,13 @@ uint8_t vl53l5cx_init(
 	status |= _vl53l5cx_send_offset_data(p_dev, VL53L5CX_RESOLUTION_4X4);
 
 	/* Set default Xtalk shape. Send Xtalk to sensor */
+	VL53L5CX_TRACE_NEXT(stage, "xtalk data");
 	(void)memcpy(p_dev->xtalk_data, (uint8_t*)VL53L5CX_DEFAULT_XTALK,
 		VL53L5CX_XTALK_BUFFER_SIZE);
 	status |= _vl53l5cx_send_xtalk_data(p_dev, VL53L5CX_RESOLUTION_4X4);
 
 	/* Send default configuration to VL53L5CX firmware */
+	VL53L5CX_TRACE_NEXT(stage, "default configuration");
 	status |= WrMulti(&(p_dev->platform), 0x2c34,
 		p_dev->default_configuration,
 		sizeof(VL53L5CX_DEFAULT_CONFIGURATION));
@@ -494,6 +521,7 @@ uint8_t vl53l5cx_start_ranging(
 
 	union Block_header *bh_ptr;
 	uint8_t cmd[] = {0x00, 0x03, 0x00, 0x00};
+	VL53L5CX_TRACE_SPAN(span, "vl53l5cx_start_ranging");
 
 	status |= vl53l5cx_get_resolution(p_dev, &resolution);
 	p_dev->data_read_size = 0;
@@ -626,7 +654,9 @@ uint8_t vl53l5cx_stop_ranging(
 {
 	uint8_t tmp = 0, status = VL53L5CX_STATUS_OK;
 	uint16_t timeout = 0;
+	uint64_t start_ns = StartBudget(&(p_dev->platform));
 	uint32_t auto_stop_flag = 0;
+	VL53L5CX_TRACE_SPAN(span, "vl53l5cx_stop_ranging");
 
 	status |= RdMulti(&(p_dev->platform),
                           0x2FFC, (uint8_t*)&auto_stop_flag, 4);
@@ -644,13 +674,21 @@ uint8_t vl53l5cx_stop_ranging(
 		{
 			status |= RdByte(&(p_dev->platform), 0x6, &tmp);
 			status |= WaitMs(&(p_dev->platform), 10);
-			timeout++;	/* Timeout reached after 5 seconds */
+			timeout++;	/* Timeout reached after 5 seconds, also on a slow bus */
 
-			if(timeout > (uint16_t)500)
+			if((timeout > (uint16_t)500)
+				|| (CheckBudget(&(p_dev->platform), start_ns, 5000) != (uint8_t)0))
 			{
 				status |= tmp;
 				break;
 			}
+
+			/* Deadline of the calling operation */
+			if(CheckDeadline(&(p_dev->platform)) != (uint8_t)0)
+			{
+				status |= (uint8_t)VL53L5CX_STATUS_TIMEOUT_ERROR;
+				break;
+			}
 		}
 	}
 
@@ -714,6 +752,7 @@ uint8_t vl53l5cx_get_ranging_data(
 	union Block_header *bh_ptr;
 	uint16_t header_id, footer_id;
 	uint32_t i, j, msize;
+	VL53L5CX_TRACE_SPAN(span, "vl53l5cx_get_ranging_data");
 
 	status |= RdMulti(&(p_dev->platform), 0x0,
 			p_dev->temp_buffer, p_dev->data_read_size);
@@ -1226,6 +1265,9 @@ uint8_t vl53l5cx_dci_read_data(
 	uint8_t cmd[] = {0x00, 0x00, 0x00, 0x00,
 			0x00, 0x00, 0x00, 0x0f,
 			0x00, 0x02, 0x00, 0x08};
+	VL53L5CX_TRACE_SPAN(span, "dci_read");
+	VL53L5CX_TRACE_ARG(span, "index", index);
+	VL53L5CX_METRICS_DCI(&(p_dev->platform));
 
 	/* Check if tmp buffer is large enough */
 	if((data_size + (uint16_t)12)>(uint16_t)VL53L5CX_TEMPORARY_BUFFER_SIZE)
@@ -1276,6 +1318,9 @@ uint8_t vl53l5cx_dci_write_data(
 
 	uint16_t address = (uint16_t)VL53L5CX_UI_CMD_END - 
 		(data_size + (uint16_t)12) + (uint16_t)1;
+	VL53L5CX_TRACE_SPAN(span, "dci_write");
+	VL53L5CX_TRACE_ARG(span, "index", index);
+	VL53L5CX_METRICS_DCI(&(p_dev->platform));
 
 	/* Check if cmd buffer is large enough */
 	if((data_size + (uint16_t)12) 
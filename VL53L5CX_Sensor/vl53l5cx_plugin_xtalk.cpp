@@ -25,14 +25,17 @@ static uint8_t _vl53l5cx_poll_for_answer(
 {
 	uint8_t status = VL53L5CX_STATUS_OK;
 	uint8_t timeout = 0;
+	uint64_t start_ns = StartBudget(&(p_dev->platform));
 
 	do {
 		status |= RdMulti(&(p_dev->platform), 
                                   address, p_dev->temp_buffer, 4);
 		status |= WaitMs(&(p_dev->platform), 10);
 		
-                /* 2s timeout or FW error*/
+                /* 2s timeout, deadline of the calling operation or FW error*/
 		if((timeout >= (uint8_t)200) 
+                   || (CheckBudget(&(p_dev->platform), start_ns, 2000) != (uint8_t)0)
+                   || (CheckDeadline(&(p_dev->platform)) != (uint8_t)0)
                    || (p_dev->temp_buffer[2] >= (uint8_t) 0x7f))
 		{
 			status |= VL53L5CX_MCU_ERROR;		
@@ -151,6 +154,7 @@ uint8_t vl53l5cx_calibrate_xtalk(
 		uint16_t			distance_mm)
 {
 	uint16_t timeout = 0;
+	uint64_t start_ns = 0;
 	uint8_t cmd[] = {0x00, 0x03, 0x00, 0x00};
 	uint8_t footer[] = {0x00, 0x00, 0x00, 0x0F, 0x00, 0x01, 0x03, 0x04};
 	uint8_t continue_loop = 1, status = VL53L5CX_STATUS_OK;
@@ -219,7 +223,8 @@ uint8_t vl53l5cx_calibrate_xtalk(
 		status |= _vl53l5cx_poll_for_answer(p_dev, 
 				VL53L5CX_UI_CMD_STATUS, 0x3);
 
-		/* Wait for end of calibration */
+		/* Wait for end of calibration, 20s */
+		start_ns = StartBudget(&(p_dev->platform));
 		do {
 			status |= RdMulti(&(p_dev->platform), 
                                           0x0, p_dev->temp_buffer, 4);
@@ -238,7 +243,9 @@ uint8_t vl53l5cx_calibrate_xtalk(
 				}
 				continue_loop = (uint8_t)0;
 			}
-			else if(timeout >= (uint16_t)400)
+			else if((timeout >= (uint16_t)400)
+				|| (CheckBudget(&(p_dev->platform), start_ns, 20000) != (uint8_t)0)
+				|| (CheckDeadline(&(p_dev->platform)) != (uint8_t)0))
 			{
 				status |= VL53L5CX_STATUS_ERROR;
 				continue_loop = (uint8_t)0;
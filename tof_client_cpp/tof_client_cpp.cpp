@@ -47,6 +47,10 @@ static int runDistanceService()
     try {
         //VL53L5CXSensor *vl53_sensor = new VL53L5CXSensor(I2C_SLAVE_ADDR);
         VL53L5CXSensor* vl53_sensor = (VL53L5CXSensor *) Instantiate(I2C_SLAVE_ADDR);
+        if (vl53_sensor == nullptr) {
+            std::cout << "Cannot open the sensor" << std::endl;
+            return 0;
+        }
 
         //vl53_sensor.setErrorCallback(&sensorErrorCallback);
 
@@ -0,0 +1,2607 @@
+// tof_sim.cpp : Runs the driver stack against the simulated VL53L5CX sensor on a virtual clock
+// and prints timing figures. Needs no FT260 or sensor, so it also builds and runs on Linux:
+//
+//   g++ -std=c++14 -O2 -DHID_VL53L5CX_NO_FT260 -I../VL53L5CX_Sensor tof_sim.cpp
+//       ../VL53L5CX_Sensor/{vl53l5cx_api,platform,HID_VL53L5CX,HID_VL53L5CX_Clock,HID_VL53L5CX_Sim,HID_VL53L5CX_Recorder,
+//        HID_VL53L5CX_Replay,HID_VL53L5CX_Trace,HID_VL53L5CX_Metrics,HID_VL53L5CX_Log,HID_VL53L5CX_Stream,
+//        HID_VL53L5CX_Async,HID_VL53L5CX_Roi,HID_VL53L5CX_Outliers,HID_VL53L5CX_Filter,
+//        HID_VL53L5CX_Presence}.cpp -pthread -o tof_sim
+//
+// With -std=c++20 the asynchronous benchmark also runs the coroutine version.
+//
+// Usage: tof_sim [frames] [recording seconds]
+//
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <exception>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "HID_VL53L5CX.h"
+#include "HID_VL53L5CX_Async.h"
+#include "HID_VL53L5CX_Background.h"
+#include "HID_VL53L5CX_Filter.h"
+#include "HID_VL53L5CX_Governor.h"
+#include "HID_VL53L5CX_Idle.h"
+#include "HID_VL53L5CX_Log.h"
+#include "HID_VL53L5CX_Metrics.h"
+#include "HID_VL53L5CX_Motion.h"
+#include "HID_VL53L5CX_Outliers.h"
+#include "HID_VL53L5CX_Presence.h"
+#include "HID_VL53L5CX_Recorder.h"
+#include "HID_VL53L5CX_Replay.h"
+#include "HID_VL53L5CX_Roi.h"
+#include "HID_VL53L5CX_Sim.h"
+#include "HID_VL53L5CX_Stream.h"
+#include "HID_VL53L5CX_PeopleCounter.h"
+#include "HID_VL53L5CX_Trace.h"
+#include "HID_VL53L5CX_Tracker.h"
+
+// Heap allocations of the whole process, the frame path must not make any. Not
+// inlined, GCC would take malloc()/free() for a mismatch with new and delete.
+static std::atomic<uint64_t> allocations(0);
+
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+void *operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = malloc((size > 0) ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+static double toMs(uint64_t ns)
+{
+    return (double)ns / 1000000.0;
+}
+
+static void printReport(const char *name, const HID_VL53L5CX_SimReport &r)
+{
+    printf("%s\n", name);
+    printf("  cold start        : %10.2f ms\n", toMs(r.coldStartNs));
+    printf("  reconfigure       : %10.2f ms\n", toMs(r.reconfigureNs));
+    printf("  start / stop      : %10.2f / %.2f ms\n", toMs(r.startRangingNs), toMs(r.stopRangingNs));
+    printf("  frames            : %10llu delivered, %llu missed, %llu polls\n",
+        (unsigned long long)r.framesDelivered, (unsigned long long)r.framesMissed, (unsigned long long)r.polls);
+    printf("  latency min/avg/max: %9.2f / %.2f / %.2f ms\n",
+        toMs(r.latencyMinNs), toMs(r.latencyAvgNs), toMs(r.latencyMaxNs));
+    printf("  bus utilisation   : %9.1f %% I2C, %.1f %% incl. USB (%llu transactions)\n",
+        r.busUtilisation * 100.0, r.transportUtilisation * 100.0, (unsigned long long)r.bus.transactions);
+    printf("  simulated / wall  : %10.2f s / %.2f ms\n\n", toMs(r.virtualNs) / 1000.0, toMs(r.wallNs));
+}
+
+// Waits of the system clock against the time they took, the precision the platform
+// delays and the polling loops get on this machine. Fails the run if a wait returns early.
+static void benchmarkClock()
+{
+    printf("Clock: system clock waits, requested vs actual\n");
+
+    HID_VL53L5CX_Clock *clock = HID_VL53L5CX_Clock::systemClock();
+    static const uint64_t requestedNs[] = { 100000ULL, 500000ULL, 1000000ULL, 2000000ULL, 5000000ULL, 10000000ULL };
+    const uint32_t waits = 20;
+
+    for (uint64_t requested : requestedNs)
+    {
+        uint64_t totalNs = 0;
+        uint64_t maxNs = 0;
+        uint64_t early = 0;
+        for (uint32_t i = 0; i < waits; i++)
+        {
+            uint64_t start = clock->nowNs();
+            clock->sleepNs(requested);
+            uint64_t took = clock->nowNs() - start;
+            if (took < requested)
+                early++;
+            else
+            {
+                totalNs += took - requested;
+                if (took - requested > maxNs)
+                    maxNs = took - requested;
+            }
+        }
+
+        printf("  %6.2f ms wait     : %10.3f ms late on average, %.3f ms at most\n",
+            toMs(requested), toMs(totalNs / waits), toMs(maxNs));
+        if (early)
+            throw std::runtime_error("the system clock returned from a wait early");
+    }
+    printf("\n");
+}
+
+// Records frames from the simulated sensor in real time at the sensor rate and reports the cost
+// on the acquisition thread, then measures how fast the writer can go and how fast the reader maps
+// and indexes the file.
+static void benchmarkRecorder(const char *name, uint8_t resolution, uint8_t frequencyHz, uint32_t seconds)
+{
+    const char *path = "tof_sim_recording.vl5r";
+    HID_VL53L5CX_Clock *wall = HID_VL53L5CX_Clock::systemClock();
+
+    printf("%s\n", name);
+
+    // Real frames from the driver, the virtual clock makes them available immediately
+    HID_VL53L5CX_VirtualClock clock;
+    HID_VL53L5CX_SimConfig config;
+    config.i2cClockKHz = 400;
+    HID_VL53L5CX_SimSensor sim(&clock, config);
+    HID_VL53L5CX sensor(&sim, &clock);
+    if (!sensor.setResolution(resolution) || !sensor.setRangingFrequency(frequencyHz) || !sensor.startRanging())
+        throw std::runtime_error("cannot configure the simulated sensor");
+
+    HID_VL53L5CX_SessionHeader header;
+    HID_VL53L5CX_Recorder::initHeader(header, sensor.Dev, resolution, frequencyHz,
+        VL53L5CX_RANGING_MODE_CONTINUOUS, clock.nowNs());
+
+    // 1. Paced: one frame per sensor period, as the acquisition thread would
+    uint32_t frames = seconds * frequencyHz;
+    uint64_t periodNs = 1000000000ULL / frequencyHz;
+    uint64_t enqueueSum = 0, enqueueMax = 0;
+    VL53L5CX_ResultsData results;
+    uint64_t recorded, dropped, bytes;
+    {
+        HID_VL53L5CX_Recorder recorder(path, header);
+        uint64_t start = wall->nowNs();
+        for (uint32_t i = 0; i < frames; i++)
+        {
+            while (!sensor.isDataReady())
+                clock.sleepMs(1);
+            if (!sensor.getRangingData(&results))
+                throw std::runtime_error("getRangingData fails");
+
+            uint64_t t = wall->nowNs();
+            recorder.record(clock.nowNs(), sensor.Dev, &results);
+            uint64_t cost = wall->nowNs() - t;
+            enqueueSum += cost;
+            if (cost > enqueueMax)
+                enqueueMax = cost;
+
+            wall->sleepUntilNs(start + (i + 1) * periodNs);
+        }
+        recorder.close();
+        recorded = recorder.recordedCount();
+        dropped = recorder.droppedCount();
+        bytes = recorder.bytesWritten();
+    }
+    printf("  frame size        : %10u bytes raw, %u bytes compact\n", (unsigned)sensor.Dev->data_read_size,
+        (unsigned)HID_VL53L5CX_Recorder::compactSize(resolution, VL53L5CX_NB_TARGET_PER_ZONE));
+    printf("  paced %2u s        : %10llu recorded, %llu dropped, %.1f KB/s\n", seconds,
+        (unsigned long long)recorded, (unsigned long long)dropped, (double)bytes / 1024.0 / seconds);
+    printf("  enqueue avg/max   : %10.2f / %.2f us\n",
+        (double)enqueueSum / 1000.0 / (frames ? frames : 1), (double)enqueueMax / 1000.0);
+
+    // 2. Burst: the same frame as fast as the ring accepts it, gives the writer capacity
+    std::vector<uint8_t> wire(sensor.Dev->temp_buffer, sensor.Dev->temp_buffer + sensor.Dev->data_read_size);
+    SwapBuffer(wire.data(), (uint16_t)wire.size());
+    const uint32_t burst = 20000;
+    uint64_t retries = 0;
+    uint64_t start = wall->nowNs();
+    {
+        HID_VL53L5CX_Recorder recorder(path, header);
+        for (uint32_t i = 0; i < burst; i++)
+        {
+            while (!recorder.recordRaw(i * periodNs, (uint8_t)i, wire.data(), (uint32_t)wire.size()))
+                retries++;
+        }
+        recorder.close();
+        bytes = recorder.bytesWritten();
+    }
+    uint64_t burstNs = wall->nowNs() - start;
+    double framesPerS = (double)burst * 1e9 / (double)burstNs;
+    printf("  writer capacity   : %10.0f frames/s, %.1f MB/s (%.0fx the sensor rate)\n",
+        framesPerS, (double)bytes * 1e9 / (double)burstNs / (1024.0 * 1024.0), framesPerS / frequencyHz);
+
+    // 3. Reader: map, index and seek
+    start = wall->nowNs();
+    HID_VL53L5CX_RecordingReader reader;
+    if (!reader.open(path))
+        throw std::runtime_error("cannot open the recording");
+    uint64_t openNs = wall->nowNs() - start;
+    start = wall->nowNs();
+    uint64_t found = reader.findByTime((burst / 2) * periodNs);
+    uint64_t seekNs = wall->nowNs() - start;
+    start = wall->nowNs();
+    uint64_t checksum = 0;
+    for (uint64_t i = 0; i < reader.frameCount(); i++)
+        checksum += reader.frame(i).streamCount;
+    uint64_t scanNs = wall->nowNs() - start;
+    printf("  reader            : %10llu frames, open %.2f ms, seek to #%llu %.2f us, scan %.2f ms (checksum %llu)\n\n",
+        (unsigned long long)reader.frameCount(), toMs(openNs), (unsigned long long)found,
+        (double)seekNs / 1000.0, toMs(scanNs), (unsigned long long)checksum);
+
+    remove(path);
+}
+
+// Zone averaging of VL53L5CXSensor::getRange() without the console output
+static double averageCenterZones(const VL53L5CX_ResultsData &results)
+{
+    double sum = 0;
+    uint8_t valid_count = 0;
+    int zones[] = { 5, 6, 9, 10 };
+    for (int i : zones)
+    {
+        if ((results.target_status[VL53L5CX_NB_TARGET_PER_ZONE * i] == 5) &&
+            ((results.distance_mm[VL53L5CX_NB_TARGET_PER_ZONE * i] > 10) &&
+            (results.distance_mm[VL53L5CX_NB_TARGET_PER_ZONE * i] < 1200)))
+        {
+            sum += results.distance_mm[VL53L5CX_NB_TARGET_PER_ZONE * i];
+            ++valid_count;
+        }
+    }
+    return valid_count ? sum / valid_count : 0;
+}
+
+// Replays 'frames' recorded frames through the driver as fast as possible and times
+// the driver (isDataReady + getRangingData) and the processing chain per frame.
+// Returns the sum of all averages so runs can be compared.
+static double replayAccelerated(const char *name, const char *path)
+{
+    HID_VL53L5CX_Clock *wall = HID_VL53L5CX_Clock::systemClock();
+    HID_VL53L5CX_VirtualClock clock;
+    HID_VL53L5CX_ReplaySensor replay(&clock, path, HID_VL53L5CX_REPLAY_MODE::ACCELERATED);
+    HID_VL53L5CX sensor(&replay, &clock);
+    if (!sensor.startRanging())
+        throw std::runtime_error("cannot start the replay");
+
+    VL53L5CX_ResultsData results;
+    uint64_t frames = 0, driverNs = 0, processNs = 0;
+    double total = 0;
+    uint64_t start = wall->nowNs();
+    while (!replay.exhausted())
+    {
+        uint64_t t = wall->nowNs();
+        if (sensor.isDataReady() && sensor.getRangingData(&results))
+        {
+            uint64_t t2 = wall->nowNs();
+            total += averageCenterZones(results);
+            processNs += wall->nowNs() - t2;
+            driverNs += t2 - t;
+            frames++;
+        }
+    }
+    uint64_t elapsed = wall->nowNs() - start;
+    sensor.stopRanging();
+
+    printf("  %-19s: %10llu frames, %.0f frames/s, driver %.2f us/frame, zone average %.0f ns/frame\n", name,
+        (unsigned long long)frames, (double)frames * 1e9 / (double)(elapsed ? elapsed : 1),
+        (double)driverNs / 1000.0 / (frames ? frames : 1), (double)processNs / (frames ? frames : 1));
+    if (replay.mismatchCount())
+        printf("  %-19s  %llu frames did not match the driver configuration\n", "",
+            (unsigned long long)replay.mismatchCount());
+    return total;
+}
+
+// Records a session from the simulated sensor, then replays it through the full driver stack
+// in accelerated, stepped and real time mode.
+static void benchmarkReplay(uint32_t frames, uint32_t seconds)
+{
+    const char *rawPath = "tof_sim_replay_raw.vl5r";
+    const char *compactPath = "tof_sim_replay_compact.vl5r";
+    HID_VL53L5CX_Clock *wall = HID_VL53L5CX_Clock::systemClock();
+
+    printf("Replay 4x4 @ 15 Hz, %u frames\n", frames);
+
+    // Live session: slowly approaching target, recorded raw and compact
+    double liveTotal = 0;
+    for (int pass = 0; pass < 2; pass++)
+    {
+        HID_VL53L5CX_VirtualClock clock;
+        HID_VL53L5CX_SimConfig config;
+        config.i2cClockKHz = 400;
+        config.firmwareLoaded = true;
+        config.targetDistanceMm = 1100;
+        config.targetVelocityMmPerS = -2;
+        HID_VL53L5CX_SimSensor sim(&clock, config);
+        HID_VL53L5CX sensor(&sim, &clock);
+        if (!sensor.setRangingFrequency(15) || !sensor.startRanging()
+            || !sensor.startRecording(pass ? compactPath : rawPath, pass == 0))
+            throw std::runtime_error("cannot start the recording");
+
+        VL53L5CX_ResultsData results;
+        double total = 0;
+        for (uint32_t i = 0; i < frames; )
+        {
+            if (sensor.isDataReady() && sensor.getRangingData(&results))
+            {
+                total += averageCenterZones(results);
+                i++;
+                // Give the writer time to keep up, the virtual clock never sleeps
+                if ((i % 32) == 0)
+                    wall->sleepUs(500);
+            }
+            clock.sleepMs(10);
+        }
+        if (sensor.getDroppedFrames())
+            printf("  recording dropped %llu frames\n", (unsigned long long)sensor.getDroppedFrames());
+        sensor.stopRecording();
+        sensor.stopRanging();
+        liveTotal = total;
+    }
+
+    // Accelerated: every host side algorithm sees the recorded frames, only CPU bound
+    double rawTotal = replayAccelerated("accelerated raw", rawPath);
+    double compactTotal = replayAccelerated("accelerated compact", compactPath);
+    printf("  %-19s: %s (live %.1f, raw %.1f, compact %.1f)\n", "results",
+        ((rawTotal == liveTotal) && (compactTotal == liveTotal)) ? "identical to the live session" : "DIFFERENT",
+        liveTotal, rawTotal, compactTotal);
+
+    // Stepped: one frame per step, nothing in between
+    {
+        HID_VL53L5CX_VirtualClock clock;
+        HID_VL53L5CX_ReplaySensor replay(&clock, rawPath, HID_VL53L5CX_REPLAY_MODE::STEPPED);
+        HID_VL53L5CX sensor(&replay, &clock);
+        VL53L5CX_ResultsData results;
+        sensor.startRanging();
+        bool before = sensor.isDataReady();
+        replay.step();
+        bool after = sensor.isDataReady() && sensor.getRangingData(&results);
+        bool again = sensor.isDataReady();
+        sensor.stopRanging();
+        printf("  %-19s: ready before step %s, after step %s, after read %s\n", "stepped",
+            before ? "yes" : "no", after ? "yes" : "no", again ? "yes" : "no");
+    }
+
+    // Real time: frames arrive at their recorded pace on the wall clock
+    if (seconds)
+    {
+        HID_VL53L5CX_VirtualClock clock;
+        HID_VL53L5CX_ReplaySensor replay(&clock, rawPath, HID_VL53L5CX_REPLAY_MODE::REALTIME);
+        HID_VL53L5CX sensor(&replay);
+        VL53L5CX_ResultsData results;
+        sensor.startRanging();
+
+        uint64_t wanted = (uint64_t)seconds * 15, got = 0;
+        uint64_t start = wall->nowNs();
+        while (got < wanted)
+        {
+            if (sensor.isDataReady() && sensor.getRangingData(&results))
+                got++;
+            else
+                sensor.clock->sleepMs(1);
+        }
+        uint64_t elapsed = wall->nowNs() - start;
+        sensor.stopRanging();
+        printf("  %-19s: %10llu frames in %.1f ms (recorded pace %.1f ms)\n\n", "real time",
+            (unsigned long long)got, toMs(elapsed), (double)(wanted - 1) * 1000.0 / 15.0);
+    }
+
+    remove(rawPath);
+    remove(compactPath);
+}
+
+// Reads 'frames' frames at 'resolution' (ranging restarts after the change), returns the sum of
+// distance and status of the first target of every zone.
+static int64_t rangeAtResolution(HID_VL53L5CX &sensor, HID_VL53L5CX_VirtualClock &clock, uint8_t resolution, uint32_t frames)
+{
+    sensor.stopRanging();
+    if (!sensor.setResolution(resolution) || !sensor.startRanging())
+        throw std::runtime_error("cannot change the resolution");
+
+    VL53L5CX_ResultsData results;
+    int64_t sum = 0;
+    uint32_t polls = 0;
+    for (uint32_t i = 0; i < frames; )
+    {
+        if (sensor.isDataReady() && sensor.getRangingData(&results))
+        {
+            for (uint32_t zone = 0; zone < resolution; zone++)
+                sum += results.distance_mm[VL53L5CX_NB_TARGET_PER_ZONE * zone]
+                    + results.target_status[VL53L5CX_NB_TARGET_PER_ZONE * zone];
+            i++;
+            polls = 0;
+            // Give a recording writer time to keep up, the virtual clock never sleeps
+            if ((i % 16) == 0)
+                HID_VL53L5CX_Clock::systemClock()->sleepUs(500);
+        }
+        else if (++polls > 1000)
+            throw std::runtime_error("no frame for 10 s");
+        clock.sleepMs(10);
+    }
+    return sum;
+}
+
+// A recording that goes from 4x4 to 8x8 halfway, raw and compact, replayed with the same change.
+// Fails the run if a replayed frame does not match the live one.
+static void benchmarkReplayResolution(uint32_t frames)
+{
+    const char *path = "tof_sim_replay_resolution.vl5r";
+    printf("Replay 4x4 then 8x8 @ 15 Hz, %u + %u frames\n", frames, frames);
+
+    for (int raw = 1; raw >= 0; raw--)
+    {
+        int64_t live = 0;
+        {
+            HID_VL53L5CX_VirtualClock clock;
+            HID_VL53L5CX_SimConfig config;
+            config.firmwareLoaded = true;
+            config.targetDistanceMm = 900;
+            config.targetVelocityMmPerS = -5;
+            HID_VL53L5CX_SimSensor sim(&clock, config);
+            HID_VL53L5CX sensor(&sim, &clock);
+            if (!sensor.setRangingFrequency(15) || !sensor.startRecording(path, raw != 0))
+                throw std::runtime_error("cannot start the recording");
+            live = rangeAtResolution(sensor, clock, VL53L5CX_RESOLUTION_4X4, frames);
+            live += rangeAtResolution(sensor, clock, VL53L5CX_RESOLUTION_8X8, frames);
+            sensor.stopRanging();
+            if (sensor.getDroppedFrames())
+                throw std::runtime_error("the recording dropped frames");
+            sensor.stopRecording();
+        }
+
+        HID_VL53L5CX_VirtualClock clock;
+        HID_VL53L5CX_ReplaySensor replay(&clock, path, HID_VL53L5CX_REPLAY_MODE::ACCELERATED);
+        HID_VL53L5CX sensor(&replay, &clock);
+        int64_t replayed = rangeAtResolution(sensor, clock, VL53L5CX_RESOLUTION_4X4, frames);
+        replayed += rangeAtResolution(sensor, clock, VL53L5CX_RESOLUTION_8X8, frames);
+        sensor.stopRanging();
+        remove(path);
+
+        printf("  %-19s: %10llu frames, %llu mismatched, zone sum live %lld, replayed %lld\n",
+            raw ? "raw" : "compact", (unsigned long long)replay.servedCount(),
+            (unsigned long long)replay.mismatchCount(), (long long)live, (long long)replayed);
+        if (replay.mismatchCount() || (replayed != live))
+            throw std::runtime_error("a recording that changed resolution does not replay");
+    }
+    printf("\n");
+}
+
+// Wall time per frame of the polling loop against a warm simulated sensor, onFrame runs for every frame read
+static double frameCostNs(uint32_t frames, void (*onFrame)(const VL53L5CX_ResultsData &results) = nullptr)
+{
+    HID_VL53L5CX_Clock *wall = HID_VL53L5CX_Clock::systemClock();
+    HID_VL53L5CX_VirtualClock clock;
+    HID_VL53L5CX_SimConfig config;
+    config.firmwareLoaded = true;
+    HID_VL53L5CX_SimSensor sim(&clock, config);
+    HID_VL53L5CX sensor(&sim, &clock);
+    sensor.setRangingFrequency(15);
+    sensor.startRanging();
+
+    VL53L5CX_ResultsData results;
+    uint64_t start = wall->nowNs();
+    for (uint32_t i = 0; i < frames; )
+    {
+        if (sensor.isDataReady() && sensor.getRangingData(&results))
+        {
+            if (onFrame != nullptr)
+                onFrame(results);
+            i++;
+        }
+        clock.sleepMs(10);
+    }
+    uint64_t elapsed = wall->nowNs() - start;
+    sensor.stopRanging();
+    return (double)elapsed / frames;
+}
+
+// Traces a cold start and a few frames on the virtual time line, then measures the cost of
+// the tracing hooks when disabled and enabled.
+static void benchmarkTrace(uint32_t frames)
+{
+    const char *path = "tof_sim_trace.json";
+
+    printf("Trace: cold start and %u frames, 4x4 @ 15 Hz, 400 kHz I2C\n", frames);
+    {
+        HID_VL53L5CX_VirtualClock clock;
+        HID_VL53L5CX_SimConfig config;
+        config.i2cClockKHz = 400;
+        HID_VL53L5CX_SimSensor sim(&clock, config);
+
+        HID_VL53L5CX_Trace::start(&clock);
+        HID_VL53L5CX sensor(&sim, &clock);
+        sensor.setRangingFrequency(15);
+        sensor.startRanging();
+        VL53L5CX_ResultsData results;
+        for (uint32_t i = 0; i < frames; )
+        {
+            if (sensor.isDataReady() && sensor.getRangingData(&results))
+                i++;
+            clock.sleepMs(10);
+        }
+        sensor.stopRanging();
+        HID_VL53L5CX_Trace::stop();
+    }
+    bool saved = HID_VL53L5CX_Trace::writeChromeTrace(path);
+    printf("  events            : %10llu recorded, %llu dropped, %s %s\n",
+        (unsigned long long)HID_VL53L5CX_Trace::eventCount(), (unsigned long long)HID_VL53L5CX_Trace::droppedCount(),
+        saved ? "saved to" : "cannot write", path);
+
+    const uint32_t costFrames = 20000;
+    frameCostNs(costFrames / 10);   // warm up
+    double off = frameCostNs(costFrames);
+    HID_VL53L5CX_Trace::start(nullptr, 1 << 20);
+    double on = frameCostNs(costFrames);
+    HID_VL53L5CX_Trace::stop();
+    printf("  cost per frame    : %10.0f ns tracing off, %.0f ns tracing on\n\n", off, on);
+}
+
+// What getRange() reports for every frame
+static void logZones(const VL53L5CX_ResultsData &results)
+{
+    const int zones[] = { 5, 6, 9, 10 };
+    for (int i : zones)
+        HID_VL53L5CX_LOG(VERBOSE, "Zone : %3d, Status : %3u, Distance : %4d mm", i,
+            results.target_status[VL53L5CX_NB_TARGET_PER_ZONE * i], results.distance_mm[VL53L5CX_NB_TARGET_PER_ZONE * i]);
+    HID_VL53L5CX_LOG(VERBOSE, "Avg Distance for %u valid values: %g mm", 4u, averageCenterZones(results));
+}
+
+// The same lines written synchronously, as getRange() used to
+static FILE *printFile = nullptr;
+static void printZones(const VL53L5CX_ResultsData &results)
+{
+    const int zones[] = { 5, 6, 9, 10 };
+    for (int i : zones)
+        fprintf(printFile, "Zone : %3d, Status : %3u, Distance : %4d mm\n", i,
+            results.target_status[VL53L5CX_NB_TARGET_PER_ZONE * i], results.distance_mm[VL53L5CX_NB_TARGET_PER_ZONE * i]);
+    fprintf(printFile, "\nAvg Distance for %u valid values: %g mm\n", 4u, averageCenterZones(results));
+    fflush(printFile);
+}
+
+static uint64_t sinkMessages = 0;
+static void countingSink(uint8_t level, const char *message)
+{
+    (void)level;
+    (void)message;
+    sinkMessages++;
+}
+
+// Per frame cost of the getRange() diagnostics: filtered by level, through the logger, and
+// printed synchronously to a file the way they were before. The virtual clock delivers frames
+// far faster than any sensor, so the logger drops most messages here by design.
+static void benchmarkLogging(uint32_t frames)
+{
+    printf("Logging: 5 lines per frame, %u frames\n", frames);
+    HID_VL53L5CX_LOG_LEVEL level = HID_VL53L5CX_Log::getLevel();
+
+    frameCostNs(frames / 10);   // warm up
+    double none = frameCostNs(frames);
+
+    HID_VL53L5CX_Log::setLevel(HID_VL53L5CX_LOG_LEVEL::WARNING);
+    double off = frameCostNs(frames, logZones);
+
+    HID_VL53L5CX_Log::setSink(countingSink);
+    HID_VL53L5CX_Log::setLevel(HID_VL53L5CX_LOG_LEVEL::VERBOSE);
+    uint64_t dropped = HID_VL53L5CX_Log::droppedCount();
+    double on = frameCostNs(frames, logZones);
+    HID_VL53L5CX_Log::flush();
+    dropped = HID_VL53L5CX_Log::droppedCount() - dropped;
+    HID_VL53L5CX_Log::setLevel(level);
+    HID_VL53L5CX_Log::setSink(nullptr);
+
+    printFile = tmpfile();
+    double printed = (printFile != nullptr) ? frameCostNs(frames, printZones) : 0.0;
+    if (printFile != nullptr)
+        fclose(printFile);
+
+    printf("  cost per frame    : %10.0f ns without diagnostics\n", none);
+    printf("  verbose filtered  : %10.0f ns\n", off);
+    printf("  verbose logged    : %10.0f ns (%llu messages to the sink, %llu dropped)\n", on,
+        (unsigned long long)sinkMessages, (unsigned long long)dropped);
+    printf("  printed to a file : %10.0f ns\n", printed);
+
+    // Quiet for a while, the logging thread sleeps: the next message wakes it, it does
+    // not start a thread (which allocates) on the writer's path
+    std::this_thread::sleep_for(std::chrono::milliseconds(600));
+    HID_VL53L5CX_Log::setSink(countingSink);
+    uint64_t messages = sinkMessages;
+    uint64_t before = allocations.load();
+    HID_VL53L5CX_LOG(FAILURE, "after %u ms without messages", 600u);
+    bool flushed = HID_VL53L5CX_Log::flush();
+    uint64_t allocated = allocations.load() - before;
+    HID_VL53L5CX_Log::setSink(nullptr);
+    printf("  after 600 ms idle : %10llu message(s) to the sink, %llu allocation(s)\n\n",
+        (unsigned long long)(sinkMessages - messages), (unsigned long long)allocated);
+    if (!flushed || allocated)
+        throw std::runtime_error("the logger allocates or stalls after an idle period");
+}
+
+static double histogramAverage(const HID_VL53L5CX_Histogram &h)
+{
+    uint64_t count = h.count.load(std::memory_order_relaxed);
+    return count ? (double)h.sum.load(std::memory_order_relaxed) / count : 0.0;
+}
+
+// Runs a cold start and some frames, stalls the polling loop once so frames are lost, and
+// reads the metrics back through the shared memory segment like a monitoring agent would.
+static void benchmarkMetrics(uint32_t frames)
+{
+    printf("Metrics: cold start and %u frames, 4x4 @ 15 Hz, 400 kHz I2C, one 500 ms stall\n", frames);
+
+    HID_VL53L5CX_VirtualClock clock;
+    HID_VL53L5CX_SimConfig config;
+    config.i2cClockKHz = 400;
+    HID_VL53L5CX_SimSensor sim(&clock, config);
+    HID_VL53L5CX sensor(&sim, &clock);
+    sensor.setRangingFrequency(15);
+    sensor.startRanging();
+
+    VL53L5CX_ResultsData results;
+    for (uint32_t i = 0; i < frames; )
+    {
+        if (sensor.isDataReady() && sensor.getRangingData(&results))
+        {
+            i++;
+            if (i == frames / 2)
+                clock.sleepMs(500);
+        }
+        clock.sleepMs(10);
+    }
+    sensor.stopRanging();
+
+    HID_VL53L5CX_MetricsView view;
+    const HID_VL53L5CX_MetricsBlock *m = sensor.getMetrics();
+    if (view.open(sensor.getMetricsName()))
+        m = view.data();
+    printf("  segment           : %s%s\n", sensor.getMetricsName(), view.data() ? "" : " (not shared, read in process)");
+
+    const char *ops[] = { "RdByte", "WrByte", "RdMulti", "WrMulti" };
+    for (int op = 0; op < 4; op++)
+        printf("  %-18s: %10llu transactions, %llu bytes\n", ops[op],
+            (unsigned long long)m->busTransactions[op].load(), (unsigned long long)m->busBytes[op].load());
+
+    uint64_t errors = 0;
+    for (uint32_t status = 0; status < m->statusCodes; status++)
+        errors += m->transportErrors[status].load();
+    printf("  transport errors  : %10llu\n", (unsigned long long)errors);
+    printf("  DCI commands      : %10llu, avg %.0f us, max %llu us\n", (unsigned long long)m->dciLatencyUs.count.load(),
+        histogramAverage(m->dciLatencyUs), (unsigned long long)m->dciLatencyUs.max.load());
+    printf("  frames            : %10llu delivered, %llu dropped, %llu corrupted\n",
+        (unsigned long long)m->framesDelivered.load(), (unsigned long long)m->framesDropped.load(),
+        (unsigned long long)m->framesCorrupted.load());
+    printf("  polls per frame   : %10.2f avg, %llu max\n", histogramAverage(m->pollsPerFrame),
+        (unsigned long long)m->pollsPerFrame.max.load());
+    printf("  frame age         : %10.0f us avg, %llu us max\n", histogramAverage(m->frameAgeUs),
+        (unsigned long long)m->frameAgeUs.max.load());
+    printf("  silicon temp      : %10lld degC (%lld..%lld)\n\n", (long long)m->siliconTempDegC.load(),
+        (long long)m->siliconTempMinDegC.load(), (long long)m->siliconTempMaxDegC.load());
+}
+
+// One simulated sensor behind the asynchronous facade, its operations complete on the
+// dispatcher of the main thread.
+struct AsyncRun
+{
+    HID_VL53L5CX_VirtualClock clock;
+    std::unique_ptr<HID_VL53L5CX_SimSensor> sim;
+    std::unique_ptr<HID_VL53L5CX_AsyncSensor> sensor;
+    uint32_t wanted = 0;
+    uint32_t frames = 0;
+    uint64_t distanceSum = 0;
+    bool failed = false;
+
+    AsyncRun(HID_VL53L5CX_Dispatcher *dispatcher, uint32_t frameCount) : wanted(frameCount)
+    {
+        HID_VL53L5CX_SimConfig config;
+        config.i2cClockKHz = 400;
+        config.firmwareLoaded = true;
+        sim.reset(new HID_VL53L5CX_SimSensor(&clock, config));
+        HID_VL53L5CX_SimSensor *transport = sim.get();
+        HID_VL53L5CX_Clock *sensorClock = &clock;
+        sensor.reset(new HID_VL53L5CX_AsyncSensor(
+            [transport, sensorClock]() { return new HID_VL53L5CX(transport, sensorClock); }, dispatcher));
+    }
+
+    void count(const VL53L5CX_Frame &frame)
+    {
+        frames++;
+        for (uint8_t i = 0; i < frame.resolution; i++)
+            distanceSum += frame.distance_mm[i];
+    }
+};
+
+static HID_VL53L5CX_Profile asyncProfile()
+{
+    HID_VL53L5CX_Profile profile;
+    profile.resolution = 64;
+    profile.frequencyHz = 15;
+    profile.sharpenerPercent = 10;
+    return profile;
+}
+
+// C++14: every step is a continuation of the previous one
+static void nextAsyncFrame(AsyncRun &run)
+{
+    run.sensor->nextFrame(1000).then([&run](const HID_VL53L5CX_Future<VL53L5CX_Frame> &frame) {
+        if (frame.ok())
+            run.count(frame.value());
+        else
+            run.failed = true;
+
+        if (frame.ok() && (run.frames < run.wanted))
+            nextAsyncFrame(run);
+        else
+            run.sensor->stop(1000);
+    });
+}
+
+static void startAsyncChain(AsyncRun &run)
+{
+    run.sensor->init(5000).then([&run](const HID_VL53L5CX_Future<bool> &init) {
+        if (!init.ok())
+        {
+            run.failed = true;
+            return;
+        }
+        run.sensor->applyProfile(asyncProfile(), 1000);
+        run.sensor->start(1000).then([&run](const HID_VL53L5CX_Future<bool> &start) {
+            if (start.ok())
+                nextAsyncFrame(run);
+            else
+                run.failed = true;
+        });
+    });
+}
+
+#ifdef HID_VL53L5CX_HAS_COROUTINES
+// C++20: the same sequence written straight down
+static HID_VL53L5CX_Coroutine startAsyncCoroutine(AsyncRun &run)
+{
+    if (!(co_await run.sensor->init(5000)).ok() || !(co_await run.sensor->applyProfile(asyncProfile(), 1000)).ok()
+        || !(co_await run.sensor->start(1000)).ok())
+    {
+        run.failed = true;
+        co_return;
+    }
+
+    while (run.frames < run.wanted)
+    {
+        HID_VL53L5CX_Future<VL53L5CX_Frame> frame = co_await run.sensor->nextFrame(1000);
+        if (!frame.ok())
+        {
+            run.failed = true;
+            break;
+        }
+        run.count(frame.value());
+    }
+    co_await run.sensor->stop(1000);
+}
+#endif
+
+static const char *asyncStatusName(HID_VL53L5CX_ASYNC_STATUS status)
+{
+    switch (status)
+    {
+    case HID_VL53L5CX_ASYNC_STATUS::PENDING: return "pending";
+    case HID_VL53L5CX_ASYNC_STATUS::DONE: return "done";
+    case HID_VL53L5CX_ASYNC_STATUS::FAILED: return "failed";
+    case HID_VL53L5CX_ASYNC_STATUS::TIMED_OUT: return "timed out";
+    case HID_VL53L5CX_ASYNC_STATUS::CANCELLED: return "cancelled";
+    }
+    return "?";
+}
+
+// Drives two sensors from the main thread through one dispatcher, then shows a deadline and a
+// cancellation on a sensor that never delivers a frame.
+static void benchmarkAsync(uint32_t frames)
+{
+    HID_VL53L5CX_Clock *wall = HID_VL53L5CX_Clock::systemClock();
+    HID_VL53L5CX_Dispatcher dispatcher;
+
+    printf("Async: 2 sensors, 8x8 @ 15 Hz, %u frames each, one controller thread\n", frames);
+    for (int coroutine = 0; coroutine < 2; coroutine++)
+    {
+        AsyncRun first(&dispatcher, frames);
+        AsyncRun second(&dispatcher, frames);
+
+        uint64_t start = wall->nowNs();
+#ifdef HID_VL53L5CX_HAS_COROUTINES
+        if (coroutine)
+        {
+            startAsyncCoroutine(first);
+            startAsyncCoroutine(second);
+        }
+#else
+        if (coroutine)
+        {
+            printf("  coroutines        : need C++20\n");
+            break;
+        }
+#endif
+        if (!coroutine)
+        {
+            startAsyncChain(first);
+            startAsyncChain(second);
+        }
+        size_t jobs = dispatcher.runUntilIdle();
+        uint64_t elapsed = wall->nowNs() - start;
+
+        printf("  %-18s: %u + %u frames%s, %zu continuations, %.2f ms, distance sum %llu\n",
+            coroutine ? "co_await" : "then()", first.frames, second.frames,
+            (first.failed || second.failed) ? " (failed)" : "", jobs, toMs(elapsed),
+            (unsigned long long)(first.distanceSum + second.distanceSum));
+    }
+
+    // Initialised but never started: no frame ever comes
+    AsyncRun idle(&dispatcher, 0);
+    idle.sensor->init(5000);
+    HID_VL53L5CX_Future<VL53L5CX_Frame> late = idle.sensor->nextFrame(50);
+    uint64_t start = wall->nowNs();
+    dispatcher.runUntilIdle();
+    printf("  deadline 50 ms    : %s after %.2f ms\n", asyncStatusName(late.status()), toMs(wall->nowNs() - start));
+
+    HID_VL53L5CX_CancelToken token = HID_VL53L5CX_CancelToken::create();
+    HID_VL53L5CX_Future<VL53L5CX_Frame> abandoned = idle.sensor->nextFrame(0, token);
+    HID_VL53L5CX_Future<VL53L5CX_Frame> queued = idle.sensor->nextFrame(0, token);
+    start = wall->nowNs();
+    dispatcher.runFor(20);
+    token.cancel();
+    dispatcher.runUntilIdle();
+    printf("  cancel at 20 ms   : %s / %s after %.2f ms\n\n", asyncStatusName(abandoned.status()),
+        asyncStatusName(queued.status()), toMs(wall->nowNs() - start));
+}
+
+// One sensor shared by three application threads without a lock: one reads frames, two keep
+// querying the configuration. Frame reads go ahead of the queries on the I/O thread.
+static void benchmarkSharedSensor(uint32_t frames)
+{
+    HID_VL53L5CX_Clock *wall = HID_VL53L5CX_Clock::systemClock();
+    printf("Shared sensor: 1 thread reading %u frames, 2 threads querying the configuration\n", frames);
+
+    AsyncRun run(nullptr, frames);
+    const HID_VL53L5CX_ASYNC_STATUS DONE = HID_VL53L5CX_ASYNC_STATUS::DONE;
+    if ((run.sensor->init(5000).wait() != DONE) || (run.sensor->applyProfile(asyncProfile(), 1000).wait() != DONE)
+        || (run.sensor->start(1000).wait() != DONE))
+    {
+        printf("  start failed\n\n");
+        return;
+    }
+
+    // The sensor stores the sharpener with less precision than a percentage, what it reports is the reference
+    HID_VL53L5CX_Future<uint8_t> sharpener =
+        run.sensor->call<uint8_t>([](HID_VL53L5CX *s) { return s->getSharpenerPercent(); }, 1000);
+    sharpener.wait();
+
+    std::atomic<bool> reading(true);
+    std::atomic<uint64_t> queries(0);
+    std::atomic<uint64_t> wrongAnswers(0);
+    auto query = [&run, &reading, &queries, &wrongAnswers, &sharpener](bool frequency) {
+        while (reading.load())
+        {
+            HID_VL53L5CX_Future<uint8_t> answer = frequency
+                ? run.sensor->call<uint8_t>([](HID_VL53L5CX *s) { return s->getRangingFrequency(); }, 1000)
+                : run.sensor->call<uint8_t>([](HID_VL53L5CX *s) { return s->getSharpenerPercent(); }, 1000);
+            answer.wait();
+            if (!answer.ok() || (answer.value() != (frequency ? 15 : sharpener.value())))
+                wrongAnswers++;
+            queries++;
+        }
+    };
+    std::thread frequencyThread(query, true);
+    std::thread sharpenerThread(query, false);
+
+    uint64_t start = wall->nowNs();
+    uint64_t lost = 0;
+    for (uint32_t i = 0; i < frames; i++)
+    {
+        HID_VL53L5CX_Future<VL53L5CX_Frame> frame = run.sensor->nextFrame(1000);
+        if (frame.wait() == DONE)
+            run.count(frame.value());
+        else
+            lost++;
+    }
+    uint64_t elapsed = wall->nowNs() - start;
+    reading.store(false);
+    frequencyThread.join();
+    sharpenerThread.join();
+    run.sensor->stop(1000).wait();
+
+    printf("  frames            : %10u read, %llu failed, %.2f ms\n", run.frames, (unsigned long long)lost, toMs(elapsed));
+    printf("  queries           : %10llu answered meanwhile, %llu wrong or failed\n\n",
+        (unsigned long long)queries.load(), (unsigned long long)wrongAnswers.load());
+}
+
+// One call against a wedged bus: virtual time it took and how it failed.
+static double timeWedgedCall(const char *name, HID_VL53L5CX_VirtualClock &clock, HID_VL53L5CX &sensor, bool (*call)(HID_VL53L5CX &))
+{
+    uint64_t start = clock.nowNs();
+    bool ok = call(sensor);
+    double ms = toMs(clock.nowNs() - start);
+    printf("  %-34s: %8.1f ms, %s (error %u)\n", name, ms, ok ? "ok" : "failed", (unsigned)sensor.lastError.lastErrorCode);
+    return ms;
+}
+
+// How long the driver hangs on to a bus that stopped answering in the middle of ranging, with
+// the ULD budgets, an operation timeout and a 50 ms scope like a gate controller would use.
+static void benchmarkDeadlines()
+{
+    printf("Deadlines: 4x4 @ 15 Hz, 400 kHz I2C, bus wedged while ranging\n");
+
+    HID_VL53L5CX_VirtualClock clock;
+    HID_VL53L5CX_SimConfig config;
+    config.i2cClockKHz = 400;
+    config.firmwareLoaded = true;
+    HID_VL53L5CX_SimSensor sim(&clock, config);
+    HID_VL53L5CX sensor(&sim, &clock);
+    sensor.setRangingFrequency(15);
+    sensor.startRanging();
+    sim.setWedged(true);
+
+    timeWedgedCall("isDataReady (frame budget)", clock, sensor, [](HID_VL53L5CX &s) { return s.isDataReady(); });
+    double uldMs = timeWedgedCall("stopRanging (ULD budgets)", clock, sensor, [](HID_VL53L5CX &s) { return s.stopRanging(); });
+    sensor.setOperationTimeout(100);
+    timeWedgedCall("stopRanging (100 ms timeout)", clock, sensor, [](HID_VL53L5CX &s) { return s.stopRanging(); });
+    sensor.setOperationTimeout(0);
+    timeWedgedCall("stopRanging (50 ms scope)", clock, sensor, [](HID_VL53L5CX &s) {
+        HID_VL53L5CX_DeadlineScope scope(&s, 50);
+        return s.stopRanging();
+    });
+
+    sim.setWedged(false);
+    timeWedgedCall("stopRanging (bus recovered)", clock, sensor, [](HID_VL53L5CX &s) { return s.stopRanging(); });
+    printf("\n");
+
+    // The 5 s of the ULD count in time, not in polls that each wait for the read budget
+    if (uldMs > 6000)
+        throw std::runtime_error("the ULD budget of stopRanging counts polls");
+}
+
+static void countFrame(const VL53L5CX_Frame *frame, void *count)
+{
+    (void)frame;
+    ((std::atomic<uint32_t> *)count)->fetch_add(1, std::memory_order_relaxed);
+}
+
+// A frame callback that stops its own stream, as stopStreaming() from the callback does
+struct StoppingCallback
+{
+    HID_VL53L5CX_Stream *stream = nullptr;
+    std::atomic<uint32_t> calls{0};
+    std::atomic<bool> onThread{false};
+};
+
+static void stopFromCallback(const VL53L5CX_Frame *frame, void *data)
+{
+    (void)frame;
+    StoppingCallback *stopping = (StoppingCallback *)data;
+    stopping->onThread.store(stopping->stream->onAcquisitionThread());
+    stopping->stream->requestStop();
+    stopping->calls.fetch_add(1);
+}
+
+// The frame path (data ready, read, decode, publish) in steady state: polled directly with
+// the bus wedged for a while, then pushed by a stream. Fails the run if it allocates.
+static void benchmarkHotPath(uint32_t frames)
+{
+    printf("Hot path: %u frames polled (bus wedged for 20 polls) and %u streamed, 8x8 @ 15 Hz\n", frames, frames);
+
+    HID_VL53L5CX_VirtualClock clock;
+    HID_VL53L5CX_SimConfig config;
+    config.i2cClockKHz = 400;
+    config.firmwareLoaded = true;
+    HID_VL53L5CX_SimSensor sim(&clock, config);
+    HID_VL53L5CX sensor(&sim, &clock);
+    uint64_t reported = 0;
+    sensor.setErrorCallback([](SF_VL53L5CX_ERROR_TYPE, uint32_t, void *count) { (*(uint64_t *)count)++; }, &reported);
+    sensor.setResolution(64);
+    sensor.setRangingFrequency(15);
+    sensor.startRanging();
+
+    VL53L5CX_Frame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.version = VL53L5CX_FRAME_VERSION;
+    frame.size = sizeof(VL53L5CX_Frame);
+    while (HID_VL53L5CX_Stream::readFrame(&sensor, &frame) != VL53L5CX_FRAME_READY)
+        clock.sleepMs(10);
+
+    uint64_t before = allocations.load();
+    uint32_t read = 0;
+    uint32_t failed = 0;
+    for (uint32_t poll = 0; read < frames; poll++)
+    {
+        if (poll == frames / 2)
+            sim.setWedged(true);
+        else if (poll == frames / 2 + 20)
+            sim.setWedged(false);
+
+        int32_t result = HID_VL53L5CX_Stream::readFrame(&sensor, &frame);
+        if (result == VL53L5CX_FRAME_READY)
+            read++;
+        else if (result == VL53L5CX_FRAME_ERROR)
+            failed++;
+        clock.sleepMs(10);
+    }
+    uint64_t polled = allocations.load() - before;
+
+    uint64_t counted = 0;
+    const HID_VL53L5CX_MetricsBlock *m = sensor.getMetrics();
+    for (uint32_t code = 0; code < m->errorCodes; code++)
+        counted += m->driverErrors[code].load();
+
+    // Only the acquisition thread uses the sensor and its clock from here on
+    std::atomic<uint32_t> pushed(0);
+    uint64_t streamed;
+    {
+        HID_VL53L5CX_Stream stream(&sensor, 0, 10);
+        stream.setCallback(&countFrame, &pushed);
+        while (pushed.load() < 2)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        before = allocations.load();
+        uint32_t start = pushed.load();
+        while (pushed.load() < start + frames)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        streamed = allocations.load() - before;
+
+        // What getRange() reduces while streaming, also without a queue
+        VL53L5CX_Frame newest;
+        if (!stream.latest(newest) || (newest.resolution == 0))
+            throw std::runtime_error("the stream keeps no newest frame");
+    }
+
+    // Stopped from its own callback: no frame after it, and the destructor joins from here
+    StoppingCallback stopping;
+    {
+        HID_VL53L5CX_Stream stream(&sensor, 0, 10);
+        stopping.stream = &stream;
+        stream.setCallback(&stopFromCallback, &stopping);
+        while (stopping.calls.load() == 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    if ((stopping.calls.load() != 1) || !stopping.onThread.load())
+        throw std::runtime_error("a stream stopped from its callback goes on");
+    sensor.stopRanging();
+
+    printf("  polled            : %10u frames, %u failed polls, %llu errors counted, %llu reported\n", read, failed,
+        (unsigned long long)counted, (unsigned long long)reported);
+    printf("  allocations       : %10llu polled, %llu streamed\n\n", (unsigned long long)polled, (unsigned long long)streamed);
+    if ((polled != 0) || (streamed != 0))
+        throw std::runtime_error("the frame path allocates");
+}
+
+// Frames with every status code and distances around the default window, so the
+// kernels see valid and invalid zones of every kind.
+static void randomFrame(VL53L5CX_Frame &frame, uint8_t resolution, uint32_t &seed)
+{
+    memset(&frame, 0, sizeof(frame));
+    frame.version = VL53L5CX_FRAME_VERSION;
+    frame.size = sizeof(VL53L5CX_Frame);
+    frame.resolution = resolution;
+    for (uint32_t i = 0; i < VL53L5CX_FRAME_MAX_ZONES; i++)
+    {
+        seed = seed * 1664525 + 1013904223;
+        frame.distance_mm[i] = (int16_t)((seed >> 8) % 1400) - 50;
+        frame.range_sigma_mm[i] = (uint16_t)((seed >> 4) % 40);
+        frame.target_status[i] = (uint8_t)(((seed >> 24) & 1) ? 5 : ((seed >> 26) % 14));
+        seed = seed * 1664525 + 1013904223;
+        frame.signal_per_spad[i] = (seed >> 12) % 3000;
+    }
+}
+
+// Keeps the timed evaluations from being optimised away
+static volatile double roiSink;
+
+// Several ROIs per frame like a lane controller: four lanes side by side with
+// different reductions and a stricter center ROI with the outlier check,
+// vectorised against scalar.
+static void benchmarkRoi(uint32_t frames)
+{
+    HID_VL53L5CX_Clock *wall = HID_VL53L5CX_Clock::systemClock();
+    printf("ROI: 4 lanes and a center median per frame, %u frames, %s\n", frames,
+        HID_VL53L5CX_Roi::simd() ? "SSE2 against scalar" : "scalar only (no SSE2)");
+
+    uint32_t mismatches = 0;
+    const uint8_t resolutions[] = { 16, 64 };
+    for (uint8_t resolution : resolutions)
+    {
+        uint32_t width = (resolution == 64) ? 8 : 4;
+        const uint8_t reductions[] = { VL53L5CX_ROI_MEAN, VL53L5CX_ROI_MIN, VL53L5CX_ROI_SIGNAL_WEIGHTED, VL53L5CX_ROI_MEAN };
+        VL53L5CX_Roi rois[5];
+        for (uint32_t lane = 0; lane < 4; lane++)
+        {
+            rois[lane] = HID_VL53L5CX_Roi::defaults();
+            rois[lane].status_mask = (1u << 5) | (1u << 9);
+            rois[lane].reduction = reductions[lane];
+            rois[lane].zone_mask = 0;
+            for (uint32_t row = 0; row < width; row++)
+                for (uint32_t column = lane * width / 4; column < (lane + 1) * width / 4; column++)
+                    rois[lane].zone_mask |= 1ULL << (row * width + column);
+        }
+        rois[4] = HID_VL53L5CX_Roi::defaults();
+        rois[4].max_sigma_mm = 20;
+        rois[4].min_signal = 100;
+        rois[4].reduction = VL53L5CX_ROI_MEDIAN;
+        rois[4].outlier_cm = 30;
+
+        std::vector<VL53L5CX_Frame> set(256);
+        uint32_t seed = resolution;
+        for (VL53L5CX_Frame &frame : set)
+            randomFrame(frame, resolution, seed);
+
+        uint32_t passes = 0;
+        for (const VL53L5CX_Frame &frame : set)
+        {
+            double vectorised[5], scalar[5];
+            uint8_t vectorisedCount[5], scalarCount[5];
+            passes = HID_VL53L5CX_Roi::evaluate(frame, rois, 5, vectorised, vectorisedCount, true);
+            HID_VL53L5CX_Roi::evaluate(frame, rois, 5, scalar, scalarCount, false);
+            for (uint32_t i = 0; i < 5; i++)
+                if ((vectorised[i] != scalar[i]) || (vectorisedCount[i] != scalarCount[i]))
+                    mismatches++;
+        }
+
+        double timeNs[2];
+        for (int kernel = 0; kernel < 2; kernel++)
+        {
+            double distances[5];
+            uint64_t start = wall->nowNs();
+            for (uint32_t i = 0; i < frames; i++)
+            {
+                HID_VL53L5CX_Roi::evaluate(set[i % set.size()], rois, 5, distances, nullptr, kernel == 0);
+                roiSink = distances[i % 5];
+            }
+            timeNs[kernel] = (double)(wall->nowNs() - start) / frames;
+        }
+        printf("  %ux%u               : %6.0f ns per frame vectorised, %.0f ns scalar, %u validity passes\n", width,
+            width, timeNs[0], timeNs[1], passes);
+    }
+    printf("  mismatches        : %10u\n\n", mismatches);
+    if (mismatches != 0)
+        throw std::runtime_error("the ROI kernels disagree");
+}
+
+// The outlier check alone on random frames, vectorised against scalar, and
+// what it does to the center mean of a 4x4 frame with one multipath zone.
+static void benchmarkOutliers(uint32_t frames)
+{
+    HID_VL53L5CX_Clock *wall = HID_VL53L5CX_Clock::systemClock();
+    printf("Outliers: 3x3 neighbour median, %u frames, %s\n", frames,
+        HID_VL53L5CX_Roi::simd() ? "SSE2 against scalar" : "scalar only (no SSE2)");
+
+    VL53L5CX_Roi rules = HID_VL53L5CX_Roi::defaults();
+    rules.zone_mask = UINT64_MAX;
+    rules.status_mask = (1u << 5) | (1u << 9);
+
+    uint32_t mismatches = 0;
+    const uint8_t resolutions[] = { 16, 64 };
+    for (uint8_t resolution : resolutions)
+    {
+        // Smooth surfaces with a few zones off, so there are outliers and inliers to find
+        std::vector<VL53L5CX_Frame> set(256);
+        std::vector<uint64_t> confident(set.size());
+        uint32_t seed = resolution;
+        uint32_t flagged = 0;
+        for (uint32_t f = 0; f < set.size(); f++)
+        {
+            randomFrame(set[f], resolution, seed);
+            for (uint32_t i = 0; i < resolution; i++)
+            {
+                if (set[f].distance_mm[i] % 5 != 0)
+                    set[f].distance_mm[i] = (int16_t)(600 + 20 * (i % 8) + set[f].distance_mm[i] % 40);
+            }
+            confident[f] = HID_VL53L5CX_Roi::validZones(set[f], rules);
+            uint64_t vectorised = HID_VL53L5CX_Outliers::find(set[f], confident[f], 300, true);
+            if (vectorised != HID_VL53L5CX_Outliers::find(set[f], confident[f], 300, false))
+                mismatches++;
+            flagged += HID_VL53L5CX_Roi::zoneCount(vectorised);
+        }
+
+        double timeNs[2];
+        for (int kernel = 0; kernel < 2; kernel++)
+        {
+            uint64_t start = wall->nowNs();
+            for (uint32_t i = 0; i < frames; i++)
+                roiSink = (double)HID_VL53L5CX_Outliers::find(set[i % set.size()], confident[i % set.size()], 300, kernel == 0);
+            timeNs[kernel] = (double)(wall->nowNs() - start) / frames;
+        }
+        uint32_t width = (resolution == 64) ? 8 : 4;
+        printf("  %ux%u               : %6.0f ns per frame vectorised, %.0f ns scalar, %.1f outliers per frame\n", width,
+            width, timeNs[0], timeNs[1], (double)flagged / set.size());
+    }
+
+    // Everything at about 800 mm but zone 6 (the README sample)
+    VL53L5CX_Frame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.resolution = 16;
+    for (uint32_t i = 0; i < 16; i++)
+    {
+        frame.distance_mm[i] = (int16_t)(795 + (i * 7) % 11);
+        frame.target_status[i] = 5;
+    }
+    frame.distance_mm[6] = 1625;
+    VL53L5CX_Roi center = HID_VL53L5CX_Roi::defaults();
+    center.max_distance_mm = 2000;
+    double plain = HID_VL53L5CX_Roi::reduce(frame, HID_VL53L5CX_Roi::validZones(frame, center), center.reduction);
+    center.outlier_cm = 30;
+    double checked = HID_VL53L5CX_Roi::reduce(frame, HID_VL53L5CX_Roi::validZones(frame, center), center.reduction);
+    printf("  center mean       : %6.0f mm with zone 6 at 1625 mm, %.0f mm with a 30 cm outlier gate\n", plain, checked);
+
+    printf("  mismatches        : %10u\n\n", mismatches);
+    if (mismatches != 0)
+        throw std::runtime_error("the outlier kernels disagree");
+}
+
+static void countPresenceEvent(const VL53L5CX_PresenceEvent *event, void *count)
+{
+    (void)event;
+    (*(uint32_t *)count)++;
+}
+
+// A person walking up to the gate and away again, with a one frame blip before,
+// a one frame dropout and a stop in the hysteresis band meanwhile: only the real
+// entry and exit may become events. Then the cost of eight zones per frame.
+static void benchmarkPresence(uint32_t frames)
+{
+    printf("Presence: 4x4 @ 15 Hz, enter < 1000 mm for 2 frames, exit > 1150 mm for 3 frames, dwell 10 frames\n");
+
+    VL53L5CX_PresenceZone zone;
+    memset(&zone, 0, sizeof(zone));
+    zone.roi = HID_VL53L5CX_Roi::defaults();
+    zone.enter_mm = 1000;
+    zone.exit_mm = 1150;
+    zone.enter_frames = 2;
+    zone.exit_frames = 3;
+    zone.min_dwell_frames = 10;
+
+    HID_VL53L5CX_Presence presence(&zone, 1);
+    uint32_t called = 0;
+    presence.setCallback(countPresenceEvent, &called);
+
+    VL53L5CX_Frame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.resolution = 16;
+    for (uint32_t i = 0; i < 120; i++)
+    {
+        // Nothing in range (status 0) unless someone is there
+        int16_t distance = 0;
+        if ((i == 10) || ((i >= 30) && (i < 90) && (i != 50)))
+            distance = 700;
+        if ((i >= 60) && (i < 66))
+            distance = 1100;
+        frame.timestamp_ns = 1000000000ULL + i * 66666667ULL;
+        for (uint32_t z = 0; z < 16; z++)
+        {
+            frame.distance_mm[z] = distance;
+            frame.target_status[z] = (distance != 0) ? 5 : 0;
+        }
+        presence.update(frame);
+    }
+
+    VL53L5CX_PresenceEvent events[8];
+    uint32_t count = presence.read(events, 8);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        printf("  %-7s           : zone %u, frame %llu, %.0f mm\n", (events[i].type == VL53L5CX_PRESENCE_ENTERED) ? "entered" : "left",
+            events[i].zone, (unsigned long long)((events[i].timestamp_ns - 1000000000ULL + 1000) / 66666667ULL), events[i].distance_mm);
+    }
+    if ((count != 2) || (called != 2) || (events[0].type != VL53L5CX_PRESENCE_ENTERED) || (events[1].type != VL53L5CX_PRESENCE_LEFT)
+        || (events[0].timestamp_ns != 1000000000ULL + 31 * 66666667ULL) || (events[1].timestamp_ns != 1000000000ULL + 92 * 66666667ULL))
+        throw std::runtime_error("unexpected presence events");
+
+    // Eight lanes of an 8x8 frame on random frames
+    VL53L5CX_PresenceZone lanes[8];
+    for (uint32_t lane = 0; lane < 8; lane++)
+    {
+        lanes[lane] = zone;
+        lanes[lane].roi.status_mask = (1u << 5) | (1u << 9);
+        lanes[lane].roi.zone_mask = 0x0101010101010101ULL << lane;
+        lanes[lane].enter_frames = 1;
+        lanes[lane].exit_frames = 1;
+        lanes[lane].min_dwell_frames = 0;
+    }
+    HID_VL53L5CX_Presence busy(lanes, 8);
+    std::vector<VL53L5CX_Frame> set(256);
+    uint32_t seed = 8;
+    for (VL53L5CX_Frame &f : set)
+        randomFrame(f, 64, seed);
+
+    HID_VL53L5CX_Clock *wall = HID_VL53L5CX_Clock::systemClock();
+    VL53L5CX_PresenceEvent drained[HID_VL53L5CX_PRESENCE_QUEUE];
+    uint64_t drainedCount = 0;
+    uint64_t before = allocations.load();
+    uint64_t start = wall->nowNs();
+    for (uint32_t i = 0; i < frames; i++)
+    {
+        VL53L5CX_Frame &next = set[i % set.size()];
+        next.timestamp_ns = 1000000000ULL + i * 66666667ULL;
+        busy.update(next);
+        if (i % 16 == 15)
+            drainedCount += busy.read(drained, HID_VL53L5CX_PRESENCE_QUEUE);
+    }
+    double updateNs = (double)(wall->nowNs() - start) / frames;
+    uint64_t allocated = allocations.load() - before;
+    printf("  8 zones, 8x8      : %6.0f ns per frame, %.2f events per frame, %llu allocations\n\n", updateNs,
+        (double)drainedCount / frames, (unsigned long long)allocated);
+    if (allocated != 0)
+        throw std::runtime_error("the presence detector allocates");
+}
+
+static const char *motionName(uint8_t motion)
+{
+    switch (motion)
+    {
+    case VL53L5CX_MOTION_STATIONARY:
+        return "stationary";
+    case VL53L5CX_MOTION_APPROACHING:
+        return "approaching";
+    case VL53L5CX_MOTION_LEAVING:
+        return "leaving";
+    default:
+        return "unknown";
+    }
+}
+
+// A person walking up to the gate at 1.2 m/s with 10 mm of noise, standing at
+// 600 mm for a second and walking away: the range rate and the predicted
+// arrival at 1000 mm against the truth, and how much earlier ARRIVING (500 ms
+// ahead) comes than ENTERED.
+static void benchmarkArrival()
+{
+    printf("Arrival: 4x4 @ 15 Hz, 1200 mm/s from 3500 mm, 8 frame range rate, trigger 1000 mm, ARRIVING 500 ms ahead\n");
+
+    VL53L5CX_PresenceZone zone;
+    memset(&zone, 0, sizeof(zone));
+    zone.roi = HID_VL53L5CX_Roi::defaults();
+    zone.roi.max_distance_mm = 4000;
+    zone.enter_mm = 1000;
+    zone.exit_mm = 1150;
+    zone.enter_frames = 2;
+    zone.exit_frames = 3;
+    zone.rate_frames = 8;
+    zone.arrival_ms = 500;
+    HID_VL53L5CX_Presence presence(&zone, 1);
+
+    const double period = 1.0 / 15;
+    const double speed = 1200;
+    const double arrivalSeconds = (3500.0 - 1000.0) / speed;
+    const uint32_t standFrames = (uint32_t)((3500.0 - 600.0) / speed / period);
+
+    VL53L5CX_Frame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.resolution = 16;
+    double worstRate = 0, worstArrival = 0, stillRate = 0;
+    bool sawApproach = false, sawStationary = false, sawLeaving = false;
+    for (uint32_t i = 0; i < 90; i++)
+    {
+        double t = i * period;
+        double truth;
+        if (i <= standFrames)
+            truth = 3500 - speed * t;
+        else if (i <= standFrames + 15)
+            truth = 600;
+        else
+            truth = 600 + speed * (t - (standFrames + 15) * period);
+
+        int16_t distance = (int16_t)(truth + ((i * 7) % 21) - 10);
+        frame.timestamp_ns = 1000000000ULL + i * 66666667ULL;
+        frame.stream_count = (uint8_t)(i % 255);
+        for (uint32_t z = 0; z < 16; z++)
+        {
+            frame.distance_mm[z] = distance;
+            frame.target_status[z] = 5;
+        }
+        presence.update(frame);
+
+        VL53L5CX_ZoneMotion motion;
+        if (!presence.motion(0, motion))
+            throw std::runtime_error("no motion for presence zone 0");
+        sawApproach |= (motion.motion == VL53L5CX_MOTION_APPROACHING);
+        sawLeaving |= (motion.motion == VL53L5CX_MOTION_LEAVING);
+
+        // Once the window is all walk resp. all standing
+        if ((i >= 8) && (i <= standFrames))
+        {
+            worstRate = std::max(worstRate, fabs(motion.velocity_mm_s + speed));
+            if (truth > 1000)
+                worstArrival = std::max(worstArrival, fabs(motion.arrival_s - (arrivalSeconds - t)));
+        }
+        if ((i >= standFrames + 8) && (i <= standFrames + 15))
+        {
+            stillRate = std::max(stillRate, fabs((double)motion.velocity_mm_s));
+            sawStationary |= (motion.motion == VL53L5CX_MOTION_STATIONARY);
+        }
+        if ((i % 10 == 0) || (i == standFrames + 15))
+            printf("  frame %2u %5.0f mm : %5.0f mm, %6.0f mm/s, %-11s, arrival %5.2f s\n", i, truth, motion.distance_mm,
+                motion.velocity_mm_s, motionName(motion.motion), motion.arrival_s);
+    }
+
+    VL53L5CX_PresenceEvent events[8];
+    uint32_t count = presence.read(events, 8);
+    uint64_t arrivingNs = 0, enteredNs = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if ((events[i].type == VL53L5CX_PRESENCE_ARRIVING) && (arrivingNs == 0))
+            arrivingNs = events[i].timestamp_ns;
+        if ((events[i].type == VL53L5CX_PRESENCE_ENTERED) && (enteredNs == 0))
+            enteredNs = events[i].timestamp_ns;
+    }
+    double lead = (double)(enteredNs - arrivingNs) * 1e-9;
+    printf("  range rate error  : %.0f mm/s walking, %.0f mm/s standing, arrival error %.0f ms\n", worstRate, stillRate,
+        worstArrival * 1000);
+    printf("  ARRIVING          : %.0f ms before ENTERED, %.0f ms before the person reached 1000 mm\n\n", lead * 1000,
+        (arrivalSeconds - (double)(arrivingNs - 1000000000ULL) * 1e-9) * 1000);
+    if ((arrivingNs == 0) || (enteredNs == 0) || (lead < 0.4) || (worstRate > 60) || (worstArrival > 0.1)
+        || !sawApproach || !sawStationary || !sawLeaving)
+        throw std::runtime_error("unexpected range rate or arrival");
+}
+
+// A frame of the queue scenario at 60 Hz: person A walks in from 2000 mm
+// at 1 m/s in the four center zones and is gone after frame 80, person
+// B waits at 2600 mm behind A (second target) and is the first target once A
+// is gone. Frame 40 has a one frame blip in zone 15.
+static void queueTargets(HID_VL53L5CX_Targets &targets, uint32_t index)
+{
+    memset(&targets, 0, sizeof(targets));
+    targets.resolution = 16;
+    targets.timestampNs = 1000000000ULL + index * 16666667ULL;
+    const uint32_t center[] = { 5, 6, 9, 10 };
+    for (uint32_t zone : center)
+    {
+        int16_t noise = (int16_t)(((index * 7 + zone * 3) % 21) - 10);
+        uint32_t count = 0;
+        if (index < 80)
+        {
+            targets.distance_mm[zone][count] = (int16_t)(2000 - index * 1000 / 60 + noise);
+            targets.target_status[zone][count++] = 5;
+        }
+        targets.distance_mm[zone][count] = (int16_t)(2600 - noise);
+        targets.target_status[zone][count++] = 5;
+        targets.count[zone] = (uint8_t)count;
+    }
+    if (index == 40)
+    {
+        targets.distance_mm[15][0] = 1000;
+        targets.target_status[15][0] = 5;
+        targets.count[15] = 1;
+    }
+}
+
+// The tracker on the queue scenario: both people keep their track ids, the
+// blip never becomes a track. Then its cost on the worst frame there is, 8x8
+// with four targets in every zone, and the simulated sensor end to end.
+static void benchmarkTracker(uint32_t frames)
+{
+    printf("Tracker: 4x4 @ 60 Hz, A walks in from 2000 mm at 1 m/s in front of B at 2600 mm, then leaves\n");
+
+    VL53L5CX_TrackerConfig config = HID_VL53L5CX_Tracker::defaults();
+    std::unique_ptr<HID_VL53L5CX_Tracker> tracker(new HID_VL53L5CX_Tracker(config));
+    HID_VL53L5CX_Targets targets;
+    VL53L5CX_Track tracks[VL53L5CX_TRACKER_MAX_TRACKS];
+    uint32_t idA = 0, idB = 0;
+    double worstRate = 0;
+    bool stable = true;
+    for (uint32_t i = 0; i < 120; i++)
+    {
+        queueTargets(targets, i);
+        tracker->update(targets);
+        uint32_t count = tracker->tracks(tracks, VL53L5CX_TRACKER_MAX_TRACKS);
+
+        // Until A is given up there are exactly A and B, afterwards only B
+        uint32_t seenA = 0, seenB = 0;
+        for (uint32_t t = 0; t < count; t++)
+        {
+            if (tracks[t].zone_mask & (1ULL << 15))
+                stable = false;
+            if (tracks[t].distance_mm > 2300)
+                seenB = tracks[t].id;
+            else
+            {
+                seenA = tracks[t].id;
+                if (i >= 30 && i < 80)
+                    worstRate = std::max(worstRate, fabs(tracks[t].velocity_mm_s + 1000.0));
+            }
+        }
+        if (i == 1)
+        {
+            idA = seenA;
+            idB = seenB;
+        }
+        if ((i >= 1) && ((seenB != idB) || (seenA != ((i < 80U + config.max_misses) ? idA : 0))))
+            stable = false;
+        if ((i % 20 == 0) || (i == 80) || (i == 86))
+        {
+            printf("  frame %3u         :", i);
+            for (uint32_t t = 0; t < count; t++)
+                printf(" #%u %4.0f mm %5.0f mm/s %u zones%s", tracks[t].id, tracks[t].distance_mm, tracks[t].velocity_mm_s,
+                    tracks[t].zones, (tracks[t].misses != 0) ? " (predicted)" : "");
+            printf("\n");
+        }
+    }
+    printf("  range rate error  : %.0f mm/s, track ids %s\n", worstRate, stable ? "stable" : "CHANGED");
+    if ((idA == 0) || (idB == 0) || (idA == idB) || !stable || (worstRate > 100))
+        throw std::runtime_error("unexpected tracks");
+
+    // The longest coast the config allows still ends: 255 misses, the counter must not wrap
+    config.max_misses = 255;
+    tracker.reset(new HID_VL53L5CX_Tracker(config));
+    HID_VL53L5CX_Targets lone;
+    memset(&lone, 0, sizeof(lone));
+    lone.resolution = 16;
+    uint32_t coasting = 0;
+    for (uint32_t i = 0; i < 3 + 300; i++)
+    {
+        lone.count[5] = (i < 3) ? 1 : 0;
+        lone.distance_mm[5][0] = 1500;
+        lone.target_status[5][0] = 5;
+        lone.timestampNs = 1000000000ULL + i * 16666667ULL;
+        tracker->update(lone);
+        if (i == 3 + 254)
+            coasting = tracker->tracks(tracks, VL53L5CX_TRACKER_MAX_TRACKS);
+    }
+    uint32_t left = tracker->tracks(tracks, VL53L5CX_TRACKER_MAX_TRACKS);
+    printf("  max_misses 255    : %u track(s) after 255 misses, %u after 300\n", coasting, left);
+    if ((coasting != 1) || (left != 0))
+        throw std::runtime_error("a track with max_misses 255 does not end");
+    config = HID_VL53L5CX_Tracker::defaults();
+
+    // Every zone with four targets that pass the rules, spread over the whole range
+    std::vector<HID_VL53L5CX_Targets> set(64);
+    uint32_t seed = 45;
+    for (uint32_t f = 0; f < set.size(); f++)
+    {
+        HID_VL53L5CX_Targets &busy = set[f];
+        memset(&busy, 0, sizeof(busy));
+        busy.resolution = 64;
+        for (uint32_t zone = 0; zone < 64; zone++)
+        {
+            busy.count[zone] = HID_VL53L5CX_TRACKER_TARGETS;
+            for (uint32_t t = 0; t < HID_VL53L5CX_TRACKER_TARGETS; t++)
+            {
+                seed = seed * 1664525 + 1013904223;
+                busy.distance_mm[zone][t] = (int16_t)(100 + t * 900 + (seed >> 8) % 800);
+                busy.target_status[zone][t] = 5;
+            }
+        }
+    }
+    HID_VL53L5CX_Clock *wall = HID_VL53L5CX_Clock::systemClock();
+    tracker.reset(new HID_VL53L5CX_Tracker(config));
+    uint64_t before = allocations.load();
+    uint64_t start = wall->nowNs();
+    for (uint32_t i = 0; i < frames; i++)
+    {
+        HID_VL53L5CX_Targets &busy = set[i % set.size()];
+        busy.timestampNs = 1000000000ULL + i * 16666667ULL;
+        tracker->update(busy);
+    }
+    double updateNs = (double)(wall->nowNs() - start) / frames;
+    uint64_t allocated = allocations.load() - before;
+    printf("  8x8, 4 targets    : %6.0f ns per frame (16.7 ms at 60 Hz), %u tracks, %llu dropped, %llu allocations\n",
+        updateNs, tracker->tracks(tracks, VL53L5CX_TRACKER_MAX_TRACKS), (unsigned long long)tracker->droppedCount(),
+        (unsigned long long)allocated);
+    if (allocated != 0)
+        throw std::runtime_error("the tracker allocates");
+
+    // The simulated sensor through readFrame(), the second target needs a build with more than one per zone
+    HID_VL53L5CX_VirtualClock clock;
+    HID_VL53L5CX_SimConfig simConfig;
+    simConfig.i2cClockKHz = 400;
+    simConfig.firmwareLoaded = true;
+    simConfig.targetDistanceMm = 900;
+    simConfig.secondTargetDistanceMm = 2400;
+    HID_VL53L5CX_SimSensor sim(&clock, simConfig);
+    HID_VL53L5CX sensor(&sim, &clock);
+    sensor.setResolution(16);
+    sensor.setRangingFrequency(15);
+    sensor.startRanging();
+    tracker.reset(new HID_VL53L5CX_Tracker(config));
+    HID_VL53L5CX_Stages stages;
+    stages.tracker = tracker.get();
+    VL53L5CX_Frame frame;
+    memset(&frame, 0, sizeof(frame));
+    for (uint32_t read = 0; read < 10;)
+    {
+        if (HID_VL53L5CX_Stream::readFrame(&sensor, &frame, &stages) == VL53L5CX_FRAME_READY)
+            read++;
+        clock.sleepMs(10);
+    }
+    sensor.stopRanging();
+    uint32_t count = tracker->tracks(tracks, VL53L5CX_TRACKER_MAX_TRACKS);
+    uint32_t expected = (VL53L5CX_NB_TARGET_PER_ZONE > 1U) ? 2 : 1;
+    printf("  simulated sensor  : %u targets per zone, %u tracks:", (unsigned)VL53L5CX_NB_TARGET_PER_ZONE, count);
+    for (uint32_t t = 0; t < count; t++)
+        printf(" #%u %4.0f mm %u zones", tracks[t].id, tracks[t].distance_mm, tracks[t].zones);
+    printf("\n\n");
+    if (count != expected)
+        throw std::runtime_error("the tracker missed a simulated target");
+}
+
+// A person seen from the ceiling: two rows from round(row) on of columns
+// column and column + 1, their head closest to the sensor
+static void addPerson(VL53L5CX_Frame &frame, double row, uint32_t column, int16_t distanceMm)
+{
+    int32_t first = (int32_t)floor(row + 0.5);
+    for (int32_t r = first; r <= first + 1; r++)
+    {
+        if ((r < 0) || (r >= 8))
+            continue;
+        for (uint32_t c = column; c <= column + 1; c++)
+            frame.distance_mm[r * 8 + c] = (int16_t)(distanceMm + ((r == first) ? 0 : 80));
+    }
+}
+
+// Frame index of the turnstile scenario: 8x8 at 15 Hz from 2500 mm above the
+// floor, a fixture at 900 mm along column 7. A walks through forward (from row
+// 0 to row 7) in columns 1-2, B backward in columns 5-6 at the same time, C
+// walks up to the line in columns 3-4 and turns back. Frame 60 has a blip.
+static void turnstileFrame(VL53L5CX_Frame &frame, uint32_t index)
+{
+    memset(&frame, 0, sizeof(frame));
+    frame.version = VL53L5CX_FRAME_VERSION;
+    frame.size = sizeof(VL53L5CX_Frame);
+    frame.resolution = 64;
+    frame.timestamp_ns = 1000000000ULL + index * 66666667ULL;
+    for (uint32_t zone = 0; zone < 64; zone++)
+    {
+        frame.distance_mm[zone] = (int16_t)((((zone % 8) == 7) ? 900 : 2500) + ((index * 7 + zone * 13) % 41) - 20);
+        frame.range_sigma_mm[zone] = 6;
+        frame.target_status[zone] = 5;
+    }
+    if ((index >= 20) && (index <= 50))
+        addPerson(frame, -1 + (index - 20) * 0.3, 1, 1300);
+    if ((index >= 30) && (index <= 60))
+        addPerson(frame, 7 - (index - 30) * 0.3, 5, 1500);
+    if ((index >= 70) && (index <= 90))
+        addPerson(frame, (index <= 80) ? (-1 + (index - 70) * 0.3) : (2 - (index - 80) * 0.3), 3, 1400);
+    if (index == 60)
+        frame.distance_mm[6 * 8] = 1000;
+}
+
+// The people counter on the turnstile scenario: exactly A forward and B
+// backward. Then the cost per frame of the whole stage with its background
+// model and the labelling of random foreground masks on its own.
+static void benchmarkPeopleCounter(uint32_t frames)
+{
+    printf("People counter: 8x8 @ 15 Hz, A forward and B backward at once, C turns at the line, a blip\n");
+
+    VL53L5CX_CounterConfig config = HID_VL53L5CX_PeopleCounter::defaults();
+    std::unique_ptr<HID_VL53L5CX_PeopleCounter> counter(new HID_VL53L5CX_PeopleCounter(config));
+    std::unique_ptr<HID_VL53L5CX_Background> background(new HID_VL53L5CX_Background(HID_VL53L5CX_PeopleCounter::backgroundConfig(config)));
+    VL53L5CX_Frame frame;
+    VL53L5CX_Blob blobs[VL53L5CX_COUNTER_MAX_BLOBS];
+    uint32_t mostBlobs = 0;
+    for (uint32_t i = 0; i < 110; i++)
+    {
+        turnstileFrame(frame, i);
+        counter->update(frame, background->update(frame));
+        uint32_t count = counter->blobs(blobs, VL53L5CX_COUNTER_MAX_BLOBS);
+        mostBlobs = std::max(mostBlobs, count);
+        if ((i == 15) || (i == 40) || (i == 80))
+        {
+            printf("  frame %3u         :", i);
+            for (uint32_t b = 0; b < count; b++)
+                printf(" #%u row %.1f col %.1f %4.0f mm %+5.1f zones/s side %+d", blobs[b].id, blobs[b].row, blobs[b].column,
+                    blobs[b].distance_mm, blobs[b].speed_zones_s, blobs[b].side);
+            printf("\n");
+        }
+    }
+    VL53L5CX_CrossingEvent events[8];
+    uint32_t count = counter->read(events, 8);
+    for (uint32_t e = 0; e < count; e++)
+        printf("  crossing          : #%u %s after %u frames, %u zones, %4.0f mm\n", events[e].id,
+            (events[e].direction == VL53L5CX_CROSSING_FORWARD) ? "forward " : "backward", events[e].age_frames,
+            events[e].zones, events[e].distance_mm);
+    uint64_t forward = counter->count(VL53L5CX_CROSSING_FORWARD);
+    uint64_t backward = counter->count(VL53L5CX_CROSSING_BACKWARD);
+    printf("  counts            : %llu forward, %llu backward, at most %u blobs at once\n", (unsigned long long)forward,
+        (unsigned long long)backward, mostBlobs);
+    if ((forward != 1) || (backward != 1) || (count != 2))
+        throw std::runtime_error("unexpected crossings");
+
+    // The longest coast the config allows still ends: 255 misses, the counter must not wrap
+    config.max_misses = 255;
+    counter.reset(new HID_VL53L5CX_PeopleCounter(config));
+    background.reset(new HID_VL53L5CX_Background(HID_VL53L5CX_PeopleCounter::backgroundConfig(config)));
+    uint32_t coasting = 0;
+    for (uint32_t i = 0; i < 110 + 300; i++)
+    {
+        turnstileFrame(frame, (i < 110) ? i : 0);
+        frame.timestamp_ns = 1000000000ULL + i * 66666667ULL;
+        counter->update(frame, background->update(frame));
+        if (i == 110 + 200)
+            coasting = counter->blobs(blobs, VL53L5CX_COUNTER_MAX_BLOBS);
+    }
+    uint32_t left = counter->blobs(blobs, VL53L5CX_COUNTER_MAX_BLOBS);
+    printf("  max_misses 255    : %u blob(s) 200 frames after the scene, %u after 300\n", coasting, left);
+    if ((coasting == 0) || (left != 0))
+        throw std::runtime_error("a blob with max_misses 255 does not end");
+    config = HID_VL53L5CX_PeopleCounter::defaults();
+
+    // The whole stage, frames of the scenario over and over
+    std::vector<VL53L5CX_Frame> set(110);
+    for (uint32_t i = 0; i < set.size(); i++)
+        turnstileFrame(set[i], i);
+    HID_VL53L5CX_Clock *wall = HID_VL53L5CX_Clock::systemClock();
+    counter.reset(new HID_VL53L5CX_PeopleCounter(config));
+    background.reset(new HID_VL53L5CX_Background(HID_VL53L5CX_PeopleCounter::backgroundConfig(config)));
+    uint64_t before = allocations.load();
+    uint64_t start = wall->nowNs();
+    for (uint32_t i = 0; i < frames; i++)
+    {
+        VL53L5CX_Frame &next = set[i % set.size()];
+        next.timestamp_ns = 1000000000ULL + i * 66666667ULL;
+        counter->update(next, background->update(next));
+    }
+    double updateNs = (double)(wall->nowNs() - start) / frames;
+    uint64_t allocated = allocations.load() - before;
+
+    // Labelling alone on random masks, a third of the zones foreground
+    std::vector<uint64_t> masks(256);
+    uint32_t seed = 46;
+    for (uint64_t &mask : masks)
+    {
+        for (uint32_t zone = 0; zone < 64; zone++)
+        {
+            seed = seed * 1664525 + 1013904223;
+            mask |= (uint64_t)(((seed >> 8) % 3) == 0) << zone;
+        }
+    }
+    uint64_t labelled = 0;
+    start = wall->nowNs();
+    for (uint32_t i = 0; i < frames; i++)
+    {
+        uint64_t foreground = masks[i % masks.size()];
+        for (uint64_t remaining = foreground; remaining != 0; labelled++)
+            remaining &= ~HID_VL53L5CX_Roi::connectedZones(foreground, remaining & (0 - remaining), 64);
+    }
+    double labelNs = (double)(wall->nowNs() - start) / frames;
+
+    printf("  whole stage       : %6.0f ns per frame, %llu allocations\n", updateNs, (unsigned long long)allocated);
+    printf("  labelling         : %6.0f ns per random 8x8 mask, %.1f blobs each\n\n", labelNs, (double)labelled / frames);
+    if (allocated != 0)
+        throw std::runtime_error("the people counter allocates");
+}
+
+// Frame of an empty 8x8 lane: the floor at floorMm with +-20 mm of noise, a
+// fixture at 900 mm along column 7, a glossy zone 20 with +-250 mm and zone
+// 63 without a target
+static void laneFrame(VL53L5CX_Frame &frame, uint32_t index, int16_t floorMm)
+{
+    memset(&frame, 0, sizeof(frame));
+    frame.version = VL53L5CX_FRAME_VERSION;
+    frame.size = sizeof(VL53L5CX_Frame);
+    frame.resolution = 64;
+    frame.timestamp_ns = 1000000000ULL + index * 66666667ULL;
+    for (uint32_t zone = 0; zone < 64; zone++)
+    {
+        frame.distance_mm[zone] = (int16_t)((((zone % 8) == 7) ? 900 : floorMm) + ((index * 7 + zone * 13) % 41) - 20);
+        frame.range_sigma_mm[zone] = 6;
+        frame.target_status[zone] = 5;
+    }
+    frame.distance_mm[20] = (int16_t)(floorMm + ((index * 37) % 501) - 250);
+    frame.target_status[63] = 255;
+}
+
+// The background model: no foreground in the empty lane although one zone is
+// noisier than the margin, none while the floor drifts by more than the margin,
+// exactly the zones of a person even after they stood longer than the window.
+// A saved model loads only with its calibration fingerprint and has the right
+// foreground on its first frame. Then the cost per frame and the kernels,
+// vectorised against scalar.
+static void benchmarkBackground(uint32_t frames)
+{
+    printf("Background model: 8x8 @ 15 Hz, a fixture, a glossy zone, a zone without target\n");
+
+    VL53L5CX_BackgroundConfig config = HID_VL53L5CX_Background::defaults();
+    std::unique_ptr<HID_VL53L5CX_Background> model(new HID_VL53L5CX_Background(config));
+    VL53L5CX_Frame frame;
+    uint32_t index = 0;
+    uint64_t falseZones = 0;
+    for (; index < 300; index++)
+    {
+        laneFrame(frame, index, 2500);
+        falseZones += HID_VL53L5CX_Roi::zoneCount(model->update(frame));
+    }
+    float mean = 0, sigma = 0;
+    model->zone(20, mean, sigma);
+    printf("  empty lane        : %llu foreground zones in 300 frames, glossy zone %4.0f +- %3.0f mm\n",
+        (unsigned long long)falseZones, mean, sigma);
+
+    // 400 mm in 3000 frames (3.3 minutes), a frozen model would see the floor as foreground
+    uint64_t driftZones = 0;
+    for (uint32_t i = 0; i <= 3000; i++, index++)
+    {
+        laneFrame(frame, index, (int16_t)(2500 - i * 400 / 3000));
+        driftZones += HID_VL53L5CX_Roi::zoneCount(model->update(frame));
+    }
+    model->zone(0, mean, sigma);
+    printf("  floor drift       : %llu foreground zones while the floor rose 400 mm, zone 0 at %4.0f mm\n",
+        (unsigned long long)driftZones, mean);
+
+    // A person standing in rows 3-4 of columns 3-4 for longer than the window
+    const uint64_t person = (3ULL << 27) | (3ULL << 35);
+    uint32_t wrong = 0;
+    for (uint32_t i = 0; i < 1200; i++, index++)
+    {
+        laneFrame(frame, index, 2100);
+        addPerson(frame, 3, 3, 1300);
+        if (model->update(frame) != person)
+            wrong++;
+    }
+    printf("  person            : %u of 1200 frames with other foreground zones, %llu empty frames learned\n",
+        wrong, (unsigned long long)model->emptyCount());
+    if ((falseZones != 0) || (driftZones != 0) || (wrong != 0))
+        throw std::runtime_error("wrong foreground");
+
+    // Warm start from a saved model
+    const char *path = "tof_sim_background.vl5b";
+    const uint64_t fingerprint = 0x5EED0047ULL;
+    bool saved = model->save(path, fingerprint);
+    model.reset(new HID_VL53L5CX_Background(config));
+    bool mismatch = model->load(path, fingerprint + 1);
+    bool loaded = model->load(path, fingerprint);
+    uint64_t first = model->update(frame);
+    printf("  saved model       : %s, other calibration %s, first frame %s\n", saved ? "written" : "not written",
+        mismatch ? "loaded" : "refused", (first == person) ? "has the person" : "wrong");
+    remove(path);
+    if (!saved || mismatch || !loaded || (first != person))
+        throw std::runtime_error("the saved model does not load back");
+
+    // Empty frames are the expensive ones, they update the statistics
+    std::vector<VL53L5CX_Frame> set(64);
+    for (uint32_t i = 0; i < set.size(); i++)
+        laneFrame(set[i], i, 2500);
+    HID_VL53L5CX_Clock *wall = HID_VL53L5CX_Clock::systemClock();
+    double frameNs[2];
+    uint64_t before = allocations.load();
+    for (uint32_t pass = 0; pass < 2; pass++)
+    {
+        HID_VL53L5CX_Background timed(config, pass == 0);
+        uint64_t start = wall->nowNs();
+        for (uint32_t i = 0; i < frames; i++)
+            timed.update(set[i % set.size()]);
+        frameNs[pass] = (double)(wall->nowNs() - start) / frames;
+    }
+    uint64_t allocated = allocations.load() - before;
+
+    // Both kernels on the same random frames, a third of them with a person
+    HID_VL53L5CX_Background vectorised(config, true), scalar(config, false);
+    uint32_t mismatches = 0;
+    uint32_t seed = 47;
+    int16_t thresholds[VL53L5CX_FRAME_MAX_ZONES];
+    for (uint32_t i = 0; i < 3000; i++)
+    {
+        laneFrame(frame, i, 2500);
+        seed = seed * 1664525 + 1013904223;
+        if (((seed >> 8) % 3) == 0)
+            addPerson(frame, (seed >> 12) % 7, (seed >> 16) % 6, 1300);
+        if (vectorised.update(frame) != scalar.update(frame))
+            mismatches++;
+
+        randomFrame(frame, (i & 1) ? 64 : 16, seed);
+        for (uint32_t zone = 0; zone < VL53L5CX_FRAME_MAX_ZONES; zone++)
+        {
+            seed = seed * 1664525 + 1013904223;
+            thresholds[zone] = (int16_t)((seed >> 8) % 1400) - 50;
+        }
+        if (HID_VL53L5CX_Background::closerZones(frame.distance_mm, thresholds, frame.resolution, true)
+            != HID_VL53L5CX_Background::closerZones(frame.distance_mm, thresholds, frame.resolution, false))
+            mismatches++;
+    }
+
+    printf("  update            : %6.0f ns per empty frame (%.0f ns scalar), %llu allocations\n", frameNs[0], frameNs[1],
+        (unsigned long long)allocated);
+    printf("  kernels           : %u mismatches vectorised against scalar\n\n", mismatches);
+    if ((allocated != 0) || (mismatches != 0))
+        throw std::runtime_error("the background model allocates or its kernels disagree");
+}
+
+// Lane of the idle benchmark: the floor at 3000 mm, a person at 1200 mm from
+// 10 s to 14 s after ranging started
+class IdleLaneSensor : public HID_VL53L5CX_SimSensor
+{
+public:
+    IdleLaneSensor(HID_VL53L5CX_VirtualClock *clock, const HID_VL53L5CX_SimConfig &config)
+        : HID_VL53L5CX_SimSensor(clock, config) {}
+
+protected:
+    void sceneResults(uint64_t frame, uint64_t readyNs, VL53L5CX_ResultsData &results) override
+    {
+        HID_VL53L5CX_SimSensor::sceneResults(frame, readyNs, results);
+        uint64_t sinceNs = readyNs - rangingStartTimeNs();
+        bool person = (sinceNs >= 10000000000ULL) && (sinceNs < 14000000000ULL);
+        for (uint32_t zone = 0; zone < VL53L5CX_RESOLUTION_8X8; zone++)
+            results.distance_mm[zone * VL53L5CX_NB_TARGET_PER_ZONE] = person ? 1200 : 3000;
+    }
+};
+
+struct IdleLaneRun
+{
+    uint32_t frames[3] = {};            // read while empty, with the person, empty again
+    uint64_t wakeMs = 0;                // person there -> first frame read
+    uint64_t sleepMs = 0;               // person gone -> asleep again
+    HID_VL53L5CX_SimBusStats emptyBus;  // first 10 s
+    VL53L5CX_IdleStats stats = {};
+};
+
+// 24 s of the lane through readFrame() polled every 10 ms like a stream, the
+// presence detector decides when the lane is empty
+static IdleLaneRun runIdleLane(bool idleMode)
+{
+    HID_VL53L5CX_VirtualClock clock;
+    HID_VL53L5CX_SimConfig simConfig;
+    simConfig.i2cClockKHz = 400;
+    simConfig.firmwareLoaded = true;
+    IdleLaneSensor sim(&clock, simConfig);
+    HID_VL53L5CX sensor(&sim, &clock);
+    sensor.setResolution(16);
+    sensor.setRangingFrequency(15);
+    sensor.startRanging();
+
+    VL53L5CX_PresenceZone zone;
+    memset(&zone, 0, sizeof(zone));
+    zone.roi = HID_VL53L5CX_Roi::defaults();
+    zone.roi.status_mask = (1u << 5) | (1u << 9);
+    zone.roi.max_distance_mm = 4000;
+    zone.enter_mm = 2000;
+    zone.exit_mm = 2200;
+    zone.enter_frames = 2;
+    zone.exit_frames = 3;
+    HID_VL53L5CX_Presence presence(&zone, 1);
+    HID_VL53L5CX_Idle idle(HID_VL53L5CX_Idle::defaults());
+    HID_VL53L5CX_Stages stages;
+    stages.presence = &presence;
+    if (idleMode)
+    {
+        if (!idle.start(&sensor))
+            throw std::runtime_error("idle mode does not start on the simulated sensor");
+        stages.idle = &idle;
+    }
+
+    IdleLaneRun run;
+    VL53L5CX_Frame frame;
+    memset(&frame, 0, sizeof(frame));
+    HID_VL53L5CX_SimBusStats busStart = sim.busStats();
+    bool emptyMeasured = false;
+    uint64_t startNs = clock.nowNs();
+    for (uint64_t elapsed = 0; elapsed < 24000000000ULL; elapsed = clock.nowNs() - startNs)
+    {
+        uint32_t phase = (elapsed < 10000000000ULL) ? 0 : ((elapsed < 14000000000ULL) ? 1 : 2);
+        if ((phase > 0) && !emptyMeasured)
+        {
+            HID_VL53L5CX_SimBusStats bus = sim.busStats();
+            run.emptyBus.transactions = bus.transactions - busStart.transactions;
+            run.emptyBus.bytesRead = bus.bytesRead - busStart.bytesRead;
+            run.emptyBus.transportBusyNs = bus.transportBusyNs - busStart.transportBusyNs;
+            run.emptyBus.interruptPolls = bus.interruptPolls - busStart.interruptPolls;
+            emptyMeasured = true;
+        }
+        if (HID_VL53L5CX_Stream::readFrame(&sensor, &frame, &stages) == VL53L5CX_FRAME_READY)
+        {
+            if ((phase == 1) && (run.frames[1] == 0))
+                run.wakeMs = (frame.timestamp_ns - startNs) / 1000000 - 10000;
+            run.frames[phase]++;
+        }
+        idle.stats(run.stats);
+        if ((phase == 2) && (run.sleepMs == 0) && run.stats.idle)
+            run.sleepMs = (clock.nowNs() - startNs) / 1000000 - 14000;
+        clock.sleepMs(10);
+    }
+    sensor.stopRanging();
+    return run;
+}
+
+// Wake-on-approach: nothing is read from the empty lane, the person is seen
+// within a latch poll and a frame of arriving and the host sleeps again once
+// the presence detector lets go. Against streaming every frame.
+static void benchmarkIdle()
+{
+    printf("Idle mode: 4x4 @ 15 Hz, 400 kHz I2C, 24 s of an empty lane with a person from 10 s to 14 s\n");
+    IdleLaneRun streaming = runIdleLane(false);
+    IdleLaneRun idle = runIdleLane(true);
+
+    const char *names[2] = { "streaming", "idle mode" };
+    const IdleLaneRun *runs[2] = { &streaming, &idle };
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        const IdleLaneRun &run = *runs[i];
+        printf("  %-9s         : %3u + %3u + %3u frames read, empty lane: %5llu I2C transactions, %6.1f KB read,"
+            " %5.0f ms bridge busy, %3llu INT polls\n", names[i], run.frames[0], run.frames[1], run.frames[2],
+            (unsigned long long)run.emptyBus.transactions, run.emptyBus.bytesRead / 1024.0,
+            run.emptyBus.transportBusyNs / 1e6, (unsigned long long)run.emptyBus.interruptPolls);
+    }
+    printf("  idle mode         : %llu wake ups, first frame %llu ms after the person came, asleep %llu ms after"
+        " they left, %llu ms asleep, %llu ms awake\n\n", (unsigned long long)idle.stats.wakeups,
+        (unsigned long long)idle.wakeMs, (unsigned long long)idle.sleepMs, (unsigned long long)idle.stats.idle_ms,
+        (unsigned long long)idle.stats.active_ms);
+
+    if ((idle.frames[0] != 0) || (idle.emptyBus.transactions != 0) || (idle.stats.wakeups != 1) || !idle.stats.idle
+        || (idle.wakeMs > 150) || (idle.frames[1] + 3 < streaming.frames[1]) || (idle.sleepMs == 0))
+        throw std::runtime_error("idle mode read the empty lane or missed the person");
+}
+
+// Lane of the motion benchmark: the floor at 3000 mm, a person at 1000 mm in the
+// lower half of the zones, standing, swaying from 3 s to 6 s, then standing again.
+// A door in the top row swings between 2600 mm and 3000 mm from 8 s to 9 s.
+class MotionLaneSensor : public HID_VL53L5CX_SimSensor
+{
+public:
+    uint8_t resolution = 16;
+
+    MotionLaneSensor(HID_VL53L5CX_VirtualClock *clock, const HID_VL53L5CX_SimConfig &config)
+        : HID_VL53L5CX_SimSensor(clock, config) {}
+
+protected:
+    void sceneResults(uint64_t frame, uint64_t readyNs, VL53L5CX_ResultsData &results) override
+    {
+        HID_VL53L5CX_SimSensor::sceneResults(frame, readyNs, results);
+        double t = (readyNs - rangingStartTimeNs()) / 1e9;
+        uint32_t width = (resolution == 64) ? 8 : 4;
+        double person = 1000;
+        if ((t >= 3) && (t < 6))
+            person += 250 * sin(2 * 3.14159265358979 * (t - 3) / 1.2);
+        for (uint32_t zone = 0; zone < VL53L5CX_RESOLUTION_8X8; zone++)
+        {
+            int16_t distance = 3000;
+            if ((zone >= resolution / 2u) && (zone < resolution))
+                distance = (int16_t)person;
+            else if ((zone < width) && (t >= 8) && (t < 9) && (frame & 1))
+                distance = 2600;
+            results.distance_mm[zone * VL53L5CX_NB_TARGET_PER_ZONE] = distance;
+        }
+    }
+};
+
+struct MotionLaneRun
+{
+    uint32_t frames = 0;
+    uint32_t motionFrames = 0;          // read from the stage, one per frame
+    uint32_t strayFrames = 0;           // with motion while the person stood
+    uint32_t aggregates = 0;            // of the last motion frame
+    VL53L5CX_MotionEvent events[4] = {};
+    uint32_t eventCount = 0;
+};
+
+// 12 s of the lane through readFrame() polled every 10 ms like a stream. The
+// motion indicator is programmed at 4x4, an 8x8 run then changes the resolution.
+static MotionLaneRun runMotionLane(uint8_t resolution)
+{
+    HID_VL53L5CX_VirtualClock clock;
+    HID_VL53L5CX_SimConfig simConfig;
+    simConfig.i2cClockKHz = 400;
+    simConfig.firmwareLoaded = true;
+    MotionLaneSensor sim(&clock, simConfig);
+    sim.resolution = resolution;
+    HID_VL53L5CX sensor(&sim, &clock);
+    VL53L5CX_MotionConfig config = HID_VL53L5CX_Motion::defaults();
+    if (!sensor.setResolution(16) || !sensor.setMotionIndicator(config.min_distance_mm, config.max_distance_mm)
+        || !sensor.setResolution(resolution) || !sensor.setRangingFrequency(15) || !sensor.startRanging())
+        throw std::runtime_error("the motion indicator cannot be programmed on the simulated sensor");
+
+    HID_VL53L5CX_Motion motion(config);
+    HID_VL53L5CX_Stages stages;
+    stages.motion = &motion;
+
+    MotionLaneRun run;
+    VL53L5CX_Frame frame;
+    memset(&frame, 0, sizeof(frame));
+    VL53L5CX_MotionFrame scores[HID_VL53L5CX_MOTION_QUEUE];
+    uint64_t startNs = clock.nowNs();
+    while (clock.nowNs() - startNs < 12000000000ULL)
+    {
+        if (HID_VL53L5CX_Stream::readFrame(&sensor, &frame, &stages) == VL53L5CX_FRAME_READY)
+            run.frames++;
+        uint32_t count = motion.read(scores, HID_VL53L5CX_MOTION_QUEUE);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            double t = (scores[i].timestamp_ns - startNs) / 1e9;
+            if ((scores[i].motion_mask != 0) && ((t < 3) || (t > 6.1)))
+                run.strayFrames++;
+            run.aggregates = scores[i].aggregates;
+        }
+        run.motionFrames += count;
+        count = motion.readEvents(run.events + run.eventCount, 4 - run.eventCount);
+        for (uint32_t i = run.eventCount; i < run.eventCount + count; i++)
+            run.events[i].timestamp_ns -= startNs;
+        run.eventCount += count;
+        clock.sleepMs(10);
+    }
+    sensor.stopRanging();
+    return run;
+}
+
+// The motion indicator of the firmware streamed through the frame stages: a
+// person swaying is one motion event, standing still or a door beyond the
+// distance window are none. The host only thresholds 16 scores per frame.
+static void benchmarkMotion(uint32_t frames)
+{
+    printf("Motion indicator: 15 Hz, 400 kHz I2C, window 400-1500 mm, a person standing, swaying 3-6 s, standing,"
+        " a door at 2600-3000 mm at 8-9 s\n");
+    const uint8_t resolutions[2] = { 16, 64 };
+    for (uint8_t resolution : resolutions)
+    {
+        MotionLaneRun run = runMotionLane(resolution);
+        const VL53L5CX_MotionEvent &started = run.events[0], &stopped = run.events[1];
+        printf("  %ux%u               : %u frames, %u motion frames of %u aggregates, %u with motion while standing,"
+            " started at %llu ms, stopped at %llu ms after %u ms, peak %u\n", resolution == 64 ? 8 : 4,
+            resolution == 64 ? 8 : 4, run.frames, run.motionFrames, run.aggregates, run.strayFrames,
+            (unsigned long long)(started.timestamp_ns / 1000000), (unsigned long long)(stopped.timestamp_ns / 1000000),
+            stopped.duration_ms, stopped.peak);
+        if ((run.eventCount != 2) || (started.type != VL53L5CX_MOTION_EVENT_STARTED)
+            || (stopped.type != VL53L5CX_MOTION_EVENT_STOPPED) || (run.motionFrames != run.frames)
+            || (run.strayFrames != 0) || (run.aggregates != 16) || (started.timestamp_ns < 3000000000ULL)
+            || (started.timestamp_ns > 3400000000ULL) || (stopped.timestamp_ns < 6000000000ULL)
+            || (stopped.timestamp_ns > 7500000000ULL))
+            throw std::runtime_error("the motion stream missed the person or saw the door");
+    }
+
+    // Host cost: thresholding the scores and the event hysteresis, nothing else
+    VL53L5CX_ResultsData results;
+    memset(&results, 0, sizeof(results));
+    results.motion_indicator.nb_of_aggregates = 16;
+    uint32_t seed = 49;
+    HID_VL53L5CX_Clock *wall = HID_VL53L5CX_Clock::systemClock();
+    double updateNs[2];
+    uint64_t before = allocations.load();
+    for (uint32_t pass = 0; pass < 2; pass++)
+    {
+        HID_VL53L5CX_Motion timed(HID_VL53L5CX_Motion::defaults(), pass == 0);
+        uint64_t start = wall->nowNs();
+        for (uint32_t i = 0; i < frames; i++)
+        {
+            results.motion_indicator.motion[i & 15] = (i * 7) % 100;
+            timed.update(results, i * 66666667ULL);
+        }
+        updateNs[pass] = (double)(wall->nowNs() - start) / frames;
+    }
+    uint64_t allocated = allocations.load() - before;
+
+    uint32_t mismatches = 0;
+    uint32_t scores[VL53L5CX_MOTION_AGGREGATES];
+    for (uint32_t i = 0; i < 10000; i++)
+    {
+        for (uint32_t a = 0; a < VL53L5CX_MOTION_AGGREGATES; a++)
+        {
+            seed = seed * 1664525 + 1013904223;
+            scores[a] = (seed >> 8) % 120;
+        }
+        uint32_t count = i % 33, threshold = i % 90;
+        if (HID_VL53L5CX_Motion::reached(scores, count, threshold, true) != HID_VL53L5CX_Motion::reached(scores, count, threshold, false))
+            mismatches++;
+    }
+    printf("  update            : %6.0f ns per frame (%.0f ns scalar), %llu allocations, %u mismatches vectorised"
+        " against scalar\n\n", updateNs[0], updateNs[1], (unsigned long long)allocated, mismatches);
+    if ((allocated != 0) || (mismatches != 0))
+        throw std::runtime_error("the motion stream allocates or its kernels disagree");
+}
+
+// Lane of the governor benchmark: the floor at 3000 mm, a person at 1200 mm in
+// every zone from 40 s to 50 s and from 100 s to 105 s after originNs. On the
+// virtual clock, ranging restarts with every tier change.
+class GovernorLaneSensor : public HID_VL53L5CX_SimSensor
+{
+public:
+    uint64_t originNs = 0;
+
+    GovernorLaneSensor(HID_VL53L5CX_VirtualClock *clock, const HID_VL53L5CX_SimConfig &config)
+        : HID_VL53L5CX_SimSensor(clock, config) {}
+
+protected:
+    void sceneResults(uint64_t frame, uint64_t readyNs, VL53L5CX_ResultsData &results) override
+    {
+        HID_VL53L5CX_SimSensor::sceneResults(frame, readyNs, results);
+        uint64_t sinceMs = (readyNs - originNs) / 1000000ULL;
+        bool person = ((sinceMs >= 40000) && (sinceMs < 50000)) || ((sinceMs >= 100000) && (sinceMs < 105000));
+        for (uint32_t zone = 0; zone < VL53L5CX_RESOLUTION_8X8; zone++)
+            results.distance_mm[zone * VL53L5CX_NB_TARGET_PER_ZONE] = person ? 1200 : 3000;
+    }
+};
+
+struct GovernorLaneRun
+{
+    uint32_t frames[5] = {};            // 0-40 s, person, 50-60 s, sleep window, 120-130 s
+    uint64_t seenMs = 0;                // person there -> presence zone occupied
+    uint64_t detailMs = 0;              // person there -> first 8x8 frame
+    uint32_t awakePolls = 0;            // polls in the sleep window not told the sensor sleeps
+    HID_VL53L5CX_SimBusStats bus;
+    VL53L5CX_GovernorStats stats = {};
+};
+
+// 130 s of the lane through readFrame() polled every 10 ms like a stream. The
+// schedule starts at midnight and only allows sleep from 00:01 to 00:02.
+static GovernorLaneRun runGovernorLane(bool governed)
+{
+    HID_VL53L5CX_VirtualClock clock;
+    HID_VL53L5CX_SimConfig simConfig;
+    simConfig.i2cClockKHz = 400;
+    simConfig.firmwareLoaded = true;
+    GovernorLaneSensor sim(&clock, simConfig);
+    HID_VL53L5CX sensor(&sim, &clock);
+    sensor.setResolution(64);
+    sensor.setRangingFrequency(15);
+    sensor.startRanging();
+
+    VL53L5CX_PresenceZone zone;
+    memset(&zone, 0, sizeof(zone));
+    zone.roi = HID_VL53L5CX_Roi::defaults();
+    zone.roi.status_mask = (1u << 5) | (1u << 9);
+    zone.roi.max_distance_mm = 4000;
+    zone.enter_mm = 2000;
+    zone.exit_mm = 2200;
+    zone.enter_frames = 2;
+    zone.exit_frames = 3;
+    HID_VL53L5CX_Presence presence(&zone, 1);
+
+    VL53L5CX_GovernorConfig config = HID_VL53L5CX_Governor::defaults();
+    config.tiers[1].hold_ms = 10000;
+    config.windows[0].start_minute = 1;
+    config.windows[0].end_minute = 2;
+    config.window_count = 1;
+    HID_VL53L5CX_Governor governor(config, 0);
+    HID_VL53L5CX_Stages stages;
+    stages.presence = &presence;
+
+    GovernorLaneRun run;
+    HID_VL53L5CX_SimBusStats busStart = sim.busStats();
+    uint64_t startNs = clock.nowNs();
+    sim.originNs = startNs;
+    if (governed)
+    {
+        if (!HID_VL53L5CX_Governor::check(config) || !governor.start(&sensor))
+            throw std::runtime_error("the governor does not start on the simulated sensor");
+        stages.governor = &governor;
+    }
+
+    VL53L5CX_Frame frame;
+    memset(&frame, 0, sizeof(frame));
+    for (uint64_t elapsedMs = 0; elapsedMs < 130000; elapsedMs = (clock.nowNs() - startNs) / 1000000ULL)
+    {
+        int32_t result = HID_VL53L5CX_Stream::readFrame(&sensor, &frame, &stages);
+
+        // What getRange() returns on at once instead of waiting for the next probe
+        if (governed && (elapsedMs > 60100) && (elapsedMs < 120000) && ((result == VL53L5CX_FRAME_READY) || !governor.asleep()))
+            run.awakePolls++;
+        if (result == VL53L5CX_FRAME_READY)
+        {
+            uint64_t frameMs = (frame.timestamp_ns - startNs) / 1000000ULL;
+            uint32_t phase = (frameMs < 40000) ? 0 : (frameMs < 50000) ? 1 : (frameMs < 60000) ? 2 : (frameMs < 120000) ? 3 : 4;
+            run.frames[phase]++;
+            if ((phase == 1) && (run.seenMs == 0) && (presence.occupied() != 0))
+                run.seenMs = frameMs - 40000;
+            if ((phase == 1) && (run.detailMs == 0) && (frame.resolution == 64))
+                run.detailMs = frameMs - 40000;
+        }
+        clock.sleepMs(10);
+    }
+    governor.stats(run.stats);
+    HID_VL53L5CX_SimBusStats bus = sim.busStats();
+    run.bus.transactions = bus.transactions - busStart.transactions;
+    run.bus.bytesRead = bus.bytesRead - busStart.bytesRead;
+    run.bus.transportBusyNs = bus.transportBusyNs - busStart.transportBusyNs;
+    if (governed)
+        governor.stop(&sensor);
+    sensor.stopRanging();
+    return run;
+}
+
+// The governor against ranging 8x8 at 15 Hz all the time: time per tier, what
+// the bridge carries, how soon the person is seen from sleep and that nothing
+// is read while the schedule keeps the sensor asleep.
+static void benchmarkGovernor()
+{
+    printf("Governor: 130 s of a lane, a person from 40 s to 50 s and 100 s to 105 s, sleep only from 60 s to 120 s\n");
+    GovernorLaneRun fixed = runGovernorLane(false);
+    GovernorLaneRun governed = runGovernorLane(true);
+
+    const char *names[2] = { "8x8 @ 15 Hz", "governor" };
+    const GovernorLaneRun *runs[2] = { &fixed, &governed };
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        const GovernorLaneRun &run = *runs[i];
+        printf("  %-11s       : %4u + %3u + %3u + %3u + %3u frames read, %6llu I2C transactions, %8.1f KB read,"
+            " %6.0f ms bridge busy\n", names[i], run.frames[0], run.frames[1], run.frames[2], run.frames[3], run.frames[4],
+            (unsigned long long)run.bus.transactions, run.bus.bytesRead / 1024.0, run.bus.transportBusyNs / 1e6);
+    }
+    const VL53L5CX_GovernorStats &stats = governed.stats;
+    uint64_t totalMs = stats.tier_ms[0] + stats.tier_ms[1] + stats.tier_ms[2] + stats.tier_ms[3];
+    printf("  time per tier     : asleep %.1f s, 4x4 @ 5 Hz autonomous %.1f s, 4x4 @ 15 Hz %.1f s, 8x8 @ 15 Hz %.1f s\n",
+        stats.tier_ms[0] / 1e3, stats.tier_ms[1] / 1e3, stats.tier_ms[2] / 1e3, stats.tier_ms[3] / 1e3);
+    printf("  tier changes      : %u taking %llu ms, %u refused\n", stats.switches, (unsigned long long)stats.switch_ms,
+        stats.failures);
+    printf("  wake latency      : person seen %llu ms after arriving, 8x8 after %llu ms\n\n",
+        (unsigned long long)governed.seenMs, (unsigned long long)governed.detailMs);
+
+    if ((stats.failures != 0) || (governed.frames[3] != 0) || (governed.frames[4] == 0) || (governed.awakePolls != 0) || (governed.seenMs == 0)
+        || (governed.seenMs > 3000) || (governed.detailMs == 0) || (governed.detailMs > governed.seenMs + 1500)
+        || (totalMs + 1000 < 130000) || (totalMs > 131000) || (governed.bus.bytesRead * 4 > fixed.bus.bytesRead))
+        throw std::runtime_error("the governor missed the person, ranged in the sleep window or saved nothing");
+}
+
+// The background model and the people counter behind the governor on the lane
+// of the governor benchmark, the first 60 s: frames of the person the model
+// sees, frames it learns from instead (it starts over with a new resolution)
+// and the blobs the counter makes of the one person.
+struct GovernorModelRun
+{
+    uint32_t personFrames = 0;
+    uint32_t seen = 0;
+    uint32_t learning = 0;
+    uint32_t blobs = 0;
+};
+
+static GovernorModelRun runGovernorModel(const VL53L5CX_GovernorConfig &config)
+{
+    HID_VL53L5CX_VirtualClock clock;
+    HID_VL53L5CX_SimConfig simConfig;
+    simConfig.i2cClockKHz = 400;
+    simConfig.firmwareLoaded = true;
+    GovernorLaneSensor sim(&clock, simConfig);
+    HID_VL53L5CX sensor(&sim, &clock);
+    sensor.setRangingFrequency(15);
+    sensor.startRanging();
+
+    VL53L5CX_CounterConfig counterConfig = HID_VL53L5CX_PeopleCounter::defaults();
+    HID_VL53L5CX_PeopleCounter counter(counterConfig);
+    HID_VL53L5CX_Background background(HID_VL53L5CX_Background::defaults());
+    HID_VL53L5CX_Governor governor(config, 0);
+    HID_VL53L5CX_Stages stages;
+    stages.background = &background;
+    stages.counter = &counter;
+    stages.governor = &governor;
+
+    uint64_t startNs = clock.nowNs();
+    sim.originNs = startNs;
+    if (!HID_VL53L5CX_Governor::check(config) || !governor.start(&sensor))
+        throw std::runtime_error("the governor does not start on the simulated sensor");
+
+    GovernorModelRun run;
+    uint32_t lastBlob = 0;
+    VL53L5CX_Frame frame;
+    memset(&frame, 0, sizeof(frame));
+    for (uint64_t elapsedMs = 0; elapsedMs < 60000; elapsedMs = (clock.nowNs() - startNs) / 1000000ULL)
+    {
+        uint64_t frameMs = UINT64_MAX;
+        if (HID_VL53L5CX_Stream::readFrame(&sensor, &frame, &stages) == VL53L5CX_FRAME_READY)
+            frameMs = (frame.timestamp_ns - startNs) / 1000000ULL;
+        if ((frameMs >= 40000) && (frameMs < 50000))
+        {
+            run.personFrames++;
+            if (background.learning())
+                run.learning++;
+            else if (background.foreground() != 0)
+                run.seen++;
+            VL53L5CX_Blob blob;
+            if ((counter.blobs(&blob, 1) == 1) && (blob.id != lastBlob))
+            {
+                run.blobs++;
+                lastBlob = blob.id;
+            }
+        }
+        clock.sleepMs(10);
+    }
+    governor.stop(&sensor);
+    sensor.stopRanging();
+    return run;
+}
+
+// Why setGovernor() wants tiers of one resolution with a background model or
+// the people counter: the defaults switch to 8x8 while the person is there.
+static void benchmarkGovernorModel()
+{
+    printf("Governor with a background model and the people counter: a person from 40 s to 50 s\n");
+    VL53L5CX_GovernorConfig mixed = HID_VL53L5CX_Governor::defaults();
+    VL53L5CX_GovernorConfig fixed = mixed;
+    fixed.tier_count = 3;
+    fixed.occupied_tier = 2;
+
+    GovernorModelRun runs[2] = { runGovernorModel(mixed), runGovernorModel(fixed) };
+    const char *names[2] = { "4x4 and 8x8", "4x4 only" };
+    for (uint32_t i = 0; i < 2; i++)
+        printf("  %-11s       : %3u frames of the person, %3u seen, %3u learned as background, %u blob(s)\n", names[i],
+            runs[i].personFrames, runs[i].seen, runs[i].learning, runs[i].blobs);
+    printf("\n");
+
+    if (HID_VL53L5CX_Governor::fixedResolution(mixed) || !HID_VL53L5CX_Governor::fixedResolution(fixed)
+        || (runs[0].learning == 0) || (runs[1].learning != 0) || (runs[1].blobs != 1)
+        || (runs[1].seen * 10 < runs[1].personFrames * 9))
+        throw std::runtime_error("the governor and the background model do not get along");
+}
+
+static const char *filterName(uint8_t type)
+{
+    switch (type)
+    {
+    case VL53L5CX_FILTER_EMA:
+        return "EMA";
+    case VL53L5CX_FILTER_MEDIAN:
+        return "median";
+    case VL53L5CX_FILTER_KALMAN:
+        return "Kalman";
+    default:
+        return "none";
+    }
+}
+
+// Zone 6 of a 4x4 frame at 15 Hz on a target at startMm moving at speedMmS
+static void steadyFrame(VL53L5CX_Frame &frame, uint32_t index, double startMm, double speedMmS)
+{
+    memset(&frame, 0, sizeof(frame));
+    frame.version = VL53L5CX_FRAME_VERSION;
+    frame.size = sizeof(VL53L5CX_Frame);
+    frame.resolution = 16;
+    frame.timestamp_ns = 1000000000ULL + index * 66666667ULL;
+    frame.distance_mm[6] = (int16_t)(startMm + speedMmS * index / 15.0 + ((index * 7) % 5) - 2);
+    frame.range_sigma_mm[6] = 4;
+    frame.target_status[6] = 5;
+}
+
+// The three zone filters on random frames, vectorised against scalar, and what
+// they make of the one frame spike of the README sample and of a moving target.
+static void benchmarkFilters(uint32_t frames)
+{
+    HID_VL53L5CX_Clock *wall = HID_VL53L5CX_Clock::systemClock();
+    printf("Zone filters: %u frames, %s\n", frames, HID_VL53L5CX_Roi::simd() ? "SSE2 against scalar" : "scalar only (no SSE2)");
+
+    uint32_t mismatches = 0;
+    uint64_t allocated = 0;
+    const uint8_t types[] = { VL53L5CX_FILTER_EMA, VL53L5CX_FILTER_MEDIAN, VL53L5CX_FILTER_KALMAN };
+    for (uint8_t type : types)
+    {
+        VL53L5CX_Filter config = HID_VL53L5CX_Filter::defaults(type);
+        double timeNs[2][2];
+        const uint8_t resolutions[] = { 16, 64 };
+        for (uint32_t r = 0; r < 2; r++)
+        {
+            // Zones that stay valid or invalid for a while, so the filters build up state
+            std::vector<VL53L5CX_Frame> set(256);
+            uint32_t seed = resolutions[r] + type;
+            for (uint32_t i = 0; i < set.size(); i++)
+            {
+                randomFrame(set[i], resolutions[r], seed);
+                set[i].timestamp_ns = 1000000000ULL + i * 66666667ULL;
+                if ((i > 0) && (i % 8 != 0))
+                    memcpy(set[i].target_status, set[i - 1].target_status, sizeof(set[i].target_status));
+            }
+
+            std::unique_ptr<HID_VL53L5CX_Filter> vectorised(new HID_VL53L5CX_Filter(config, true));
+            std::unique_ptr<HID_VL53L5CX_Filter> scalar(new HID_VL53L5CX_Filter(config, false));
+            for (const VL53L5CX_Frame &frame : set)
+            {
+                VL53L5CX_Frame a = frame, b = frame;
+                vectorised->apply(a);
+                scalar->apply(b);
+                if (memcmp(a.distance_mm, b.distance_mm, sizeof(a.distance_mm)) != 0)
+                    mismatches++;
+            }
+
+            // Timestamps keep rising across the rounds, the Kalman filter sees one long stream
+            for (int kernel = 0; kernel < 2; kernel++)
+            {
+                HID_VL53L5CX_Filter &filter = (kernel == 0) ? *vectorised : *scalar;
+                VL53L5CX_Frame frame;
+                uint64_t before = allocations.load();
+                uint64_t start = wall->nowNs();
+                for (uint32_t i = 0; i < frames; i++)
+                {
+                    frame = set[i % set.size()];
+                    frame.timestamp_ns += (uint64_t)(i / set.size()) * set.size() * 66666667ULL;
+                    filter.apply(frame);
+                    roiSink = frame.distance_mm[i % resolutions[r]];
+                }
+                timeNs[r][kernel] = (double)(wall->nowNs() - start) / frames;
+                allocated += allocations.load() - before;
+            }
+        }
+        printf("  %-6s            : 4x4 %4.0f ns per frame vectorised, %.0f ns scalar; 8x8 %4.0f ns, %.0f ns\n",
+            filterName(type), timeNs[0][0], timeNs[0][1], timeNs[1][0], timeNs[1][1]);
+    }
+
+    // Zone 6 at 800 mm jumps to 1625 mm for one frame, then a target approaching at 1 m/s
+    for (uint8_t type : types)
+    {
+        HID_VL53L5CX_Filter filter(HID_VL53L5CX_Filter::defaults(type));
+        VL53L5CX_Frame frame;
+        int16_t spike = 0;
+        for (uint32_t i = 0; i < 30; i++)
+        {
+            steadyFrame(frame, i, 800, 0);
+            if (i == 20)
+                frame.distance_mm[6] = 1625;
+            filter.apply(frame);
+            if (i == 20)
+                spike = frame.distance_mm[6];
+        }
+
+        filter.reset();
+        double lag = 0;
+        for (uint32_t i = 0; i < 45; i++)
+        {
+            steadyFrame(frame, i, 3500, -1000);
+            int16_t raw = frame.distance_mm[6];
+            filter.apply(frame);
+            if (i >= 30)
+                lag += (double)(frame.distance_mm[6] - raw) / 15;
+        }
+        printf("  %-6s            : 1625 mm spike at 800 mm reads %4d mm, %4.0f mm behind a target at 1 m/s\n",
+            filterName(type), spike, lag);
+    }
+
+    printf("  allocations       : %10llu\n", (unsigned long long)allocated);
+    printf("  mismatches        : %10u\n\n", mismatches);
+    if (mismatches != 0)
+        throw std::runtime_error("the zone filter kernels disagree");
+    if (allocated != 0)
+        throw std::runtime_error("the zone filters allocate");
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t frames = (argc > 1) ? (uint32_t)atoi(argv[1]) : 100;
+    uint32_t recordSeconds = (argc > 2) ? (uint32_t)atoi(argv[2]) : 2;
+
+    // Sensor life cycle messages would interleave with the reports
+    HID_VL53L5CX_Log::setLevel(HID_VL53L5CX_LOG_LEVEL::WARNING);
+
+    try {
+        HID_VL53L5CX_SimScenario scenario;
+        scenario.frames = frames;
+
+        // Current DLL behaviour: 4x4, 100 kHz, 10 ms poll interval
+        printReport("4x4 @ 15 Hz, 100 kHz I2C, 10 ms poll", HID_VL53L5CX_SimHarness::run(scenario));
+
+        scenario.pollIntervalMs = 1;
+        printReport("4x4 @ 15 Hz, 100 kHz I2C, 1 ms poll", HID_VL53L5CX_SimHarness::run(scenario));
+
+        scenario.sensor.i2cClockKHz = 400;
+        scenario.pollIntervalMs = 10;
+        printReport("4x4 @ 15 Hz, 400 kHz I2C, 10 ms poll", HID_VL53L5CX_SimHarness::run(scenario));
+
+        scenario.resolution = 64;
+        scenario.frequencyHz = 15;
+        printReport("8x8 @ 15 Hz, 400 kHz I2C, 10 ms poll", HID_VL53L5CX_SimHarness::run(scenario));
+
+        scenario.sensor.firmwareLoaded = true;
+        printReport("8x8 @ 15 Hz, 400 kHz I2C, warm start", HID_VL53L5CX_SimHarness::run(scenario));
+
+        benchmarkClock();
+
+        if (recordSeconds)
+        {
+            benchmarkRecorder("Recording 4x4 @ 60 Hz", 16, 60, recordSeconds);
+            benchmarkRecorder("Recording 8x8 @ 15 Hz", 64, 15, recordSeconds);
+        }
+
+        benchmarkReplay(frames * 20, recordSeconds);
+        benchmarkReplayResolution(frames);
+        benchmarkTrace(frames / 10 + 1);
+        benchmarkMetrics(frames);
+        benchmarkLogging(20000);
+        benchmarkAsync(frames);
+        benchmarkSharedSensor(frames);
+        benchmarkDeadlines();
+        benchmarkHotPath(frames);
+        benchmarkRoi(frames * 1000);
+        benchmarkOutliers(frames * 1000);
+        benchmarkFilters(frames * 1000);
+        benchmarkPresence(frames * 1000);
+        benchmarkArrival();
+        benchmarkTracker(frames * 1000);
+        benchmarkPeopleCounter(frames * 1000);
+        benchmarkBackground(frames * 1000);
+        benchmarkIdle();
+        benchmarkMotion(frames * 1000);
+        benchmarkGovernor();
+        benchmarkGovernorModel();
+    }
+    catch (const std::exception& e) {
+        HID_VL53L5CX_Log::flush();
+        std::cout << "Exception: " << e.what() << std::endl;
+        return 1;
+    }
+
+    HID_VL53L5CX_Log::flush();
+    return 0;
+}